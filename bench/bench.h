@@ -0,0 +1,185 @@
+#ifndef MINOCORE_BENCH_H__
+#define MINOCORE_BENCH_H__
+#include "minocore/util/macros.h"
+#include "minocore/util/timer.h"
+#include "blaze/Math.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace minocore {
+
+namespace bench {
+
+/*
+ * Minimal timing harness for bench/minobench.cpp.
+ * Each benchmark is run once per requested thread count, repeated until both min_reps and min_ms are met,
+ * and summarized by the median repetition. Results are emitted as JSON so that runs can be diffed across builds.
+ */
+
+struct Result {
+    std::string name;
+    unsigned nthreads;
+    size_t ops;     // Work items per repetition (distance evaluations, points, queries...)
+    size_t reps;
+    double median_ms, min_ms, max_ms;
+    double ns_per_op() const {return median_ms * 1e6 / std::max(ops, size_t(1));}
+    double ops_per_sec() const {return ops / (median_ms * 1e-3);}
+};
+
+inline std::vector<unsigned> default_thread_counts() {
+    std::vector<unsigned> ret{1};
+    unsigned maxt = 1;
+    OMP_ONLY(maxt = omp_get_max_threads();)
+    while(ret.back() * 2 < maxt) ret.push_back(ret.back() * 2);
+    if(ret.back() != maxt) ret.push_back(maxt);
+    return ret;
+}
+
+inline void set_threads(unsigned nt) {
+    OMP_ONLY(omp_set_num_threads(nt);)
+    (void)nt;
+}
+
+class Suite {
+    std::vector<Result> results_;
+    std::vector<std::pair<std::string, std::string>> config_;
+public:
+    std::vector<unsigned> threads_ = default_thread_counts();
+    std::vector<std::string> filters_;
+    double min_ms_ = 250.;
+    size_t min_reps_ = 3, max_reps_ = 1000;
+    bool verbose_ = true;
+
+    bool enabled(const std::string &name) const {
+        return filters_.empty() || std::any_of(filters_.begin(), filters_.end(),
+            [&](const auto &f) {return name.find(f) != std::string::npos;});
+    }
+    bool any_enabled(std::initializer_list<std::string> names) const {
+        return std::any_of(names.begin(), names.end(), [&](const auto &name) {return enabled(name);});
+    }
+    template<typename T>
+    void add_config(std::string key, const T &val) {
+        if constexpr(std::is_convertible_v<T, std::string>) config_.emplace_back(std::move(key), '"' + std::string(val) + '"');
+        else config_.emplace_back(std::move(key), std::to_string(val));
+    }
+
+    /*
+     * Times body() at each thread count. reset() is called, untimed, before every repetition
+     * for benchmarks which consume or modify their inputs.
+     * Benchmarks which are serial by construction should pass scaling=false to be run once, single-threaded.
+     */
+    template<typename Body, typename Reset>
+    void run(const std::string &name, size_t ops, const Body &body, const Reset &reset, bool scaling=true) {
+        if(!enabled(name)) return;
+        for(const unsigned nt: threads_) {
+            if(!scaling && nt != threads_.front()) break;
+            set_threads(scaling ? nt: 1);
+            std::vector<double> times;
+            double total = 0.;
+            // Warm up unless a single repetition already exceeds the time budget
+            reset();
+            auto start = util::hrc::now();
+            body();
+            const double first = util::timediff2ms(start, util::hrc::now());
+            if(first >= min_ms_) times.push_back(first), total = first;
+            while(times.size() < max_reps_ && (times.size() < min_reps_ || total < min_ms_)) {
+                reset();
+                start = util::hrc::now();
+                body();
+                times.push_back(util::timediff2ms(start, util::hrc::now()));
+                total += times.back();
+            }
+            std::sort(times.begin(), times.end());
+            Result r{name, scaling ? nt: 1u, ops, times.size(), times[times.size() / 2], times.front(), times.back()};
+            if(verbose_)
+                std::fprintf(stderr, "[bench] %-40s threads=%-3u reps=%-5zu %12.3f ms %12.2f ns/op\n",
+                             name.data(), r.nthreads, r.reps, r.median_ms, r.ns_per_op());
+            results_.push_back(std::move(r));
+        }
+        set_threads(threads_.back());
+    }
+    template<typename Body>
+    void run(const std::string &name, size_t ops, const Body &body, bool scaling=true) {
+        run(name, ops, body, []() {}, scaling);
+    }
+
+    const std::vector<Result> &results() const {return results_;}
+
+    void emit_json(std::FILE *fp) const {
+        std::map<std::string, double> base;
+        for(const auto &r: results_)
+            if(r.nthreads == 1) base.emplace(r.name, r.median_ms);
+        std::fprintf(fp, "{\n  \"build\": {\"compiler\": \"%s\", \"sleef\": %s, \"blas\": %s, \"openmp\": %s, \"ndebug\": %s},\n",
+                     __VERSION__,
+#ifdef BLAZE_USE_SLEEF
+                     BLAZE_USE_SLEEF ? "true": "false",
+#else
+                     "false",
+#endif
+                     BLAZE_BLAS_MODE ? "true": "false",
+#ifdef _OPENMP
+                     "true",
+#else
+                     "false",
+#endif
+#ifdef NDEBUG
+                     "true"
+#else
+                     "false"
+#endif
+        );
+        std::fprintf(fp, "  \"config\": {");
+        for(size_t i = 0; i < config_.size(); ++i)
+            std::fprintf(fp, "%s\"%s\": %s", i ? ", ": "", config_[i].first.data(), config_[i].second.data());
+        std::fprintf(fp, "},\n  \"results\": [\n");
+        for(size_t i = 0; i < results_.size(); ++i) {
+            const auto &r = results_[i];
+            auto bit = base.find(r.name);
+            const double speedup = bit == base.end() ? 1.: bit->second / r.median_ms;
+            std::fprintf(fp, "    {\"name\": \"%s\", \"threads\": %u, \"ops\": %zu, \"reps\": %zu, "
+                             "\"median_ms\": %.6g, \"min_ms\": %.6g, \"max_ms\": %.6g, "
+                             "\"ns_per_op\": %.6g, \"ops_per_sec\": %.6g, \"speedup\": %.4g}%s\n",
+                         r.name.data(), r.nthreads, r.ops, r.reps, r.median_ms, r.min_ms, r.max_ms,
+                         r.ns_per_op(), r.ops_per_sec(), speedup, i + 1 == results_.size() ? "": ",");
+        }
+        std::fprintf(fp, "  ]\n}\n");
+    }
+};
+
+// Keeps the optimizer from discarding results which are otherwise unused
+template<typename T>
+INLINE void do_not_optimize(const T &x) {
+    asm volatile("" : : "g"(&x) : "memory");
+}
+
+/*
+ * Benchmark input built on first get(), so that inputs of benchmarks the filters skip are never computed.
+ * Benchmarks call get() only after checking that one of their names is enabled.
+ */
+template<typename Make>
+class Lazy {
+public:
+    using value_type = std::invoke_result_t<Make &>;
+private:
+    Make make_;
+    std::unique_ptr<value_type> val_;
+public:
+    Lazy(Make make): make_(std::move(make)) {}
+    value_type &get() {
+        if(!val_) val_.reset(new value_type(make_()));
+        return *val_;
+    }
+};
+
+} // namespace bench
+
+} // namespace minocore
+
+#endif /* MINOCORE_BENCH_H__ */
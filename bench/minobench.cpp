@@ -0,0 +1,323 @@
+#include "minocore/dist.h"
+#include "minocore/clustering.h"
+#include "minocore/coreset.h"
+#include "minocore/optim.h"
+#include "minocore/hash.h"
+#include "minocore/wip/streaming.h"
+#include "bench/bench.h"
+#include "bench/synth.h"
+#include <getopt.h>
+
+using namespace minocore;
+using bench::Suite;
+using bench::do_not_optimize;
+
+void usage(const char *s) {
+    std::fprintf(stderr, "Usage: %s <flags>\n"
+                         "-n\tNumber of points [5000]\n"
+                         "-d\tDimension [50]\n"
+                         "-k\tNumber of clusters [10]\n"
+                         "-D\tDimension of sparse count data [2000]\n"
+                         "-c\tExpected counts per row of sparse data [100]\n"
+                         "-s\tSeed [0]\n"
+                         "-i\tLoad dense data from a file written by exp/generate_*.py rather than generating it\n"
+                         "-t\tComma-separated thread counts [1,2,4,...,max]\n"
+                         "-b\tOnly run benchmarks whose name contains this string. May be given multiple times.\n"
+                         "-m\tMinimum milliseconds per measurement [250]\n"
+                         "-o\tWrite JSON here [stdout]\n"
+                         "-T\tWrite a chrome://tracing trace of library phases here (requires building with TRACE=1)\n"
+                         "-q\tDo not print results to stderr as they are collected\n", s);
+    std::exit(1);
+}
+
+using DM = blaze::DynamicMatrix<float>;
+using SM = blaze::CompressedMatrix<float>;
+
+static constexpr dist::DissimilarityMeasure dense_measures[] {
+    dist::L1, dist::L2, dist::SQRL2, dist::JSM, dist::JSD, dist::MKL, dist::POISSON, dist::HELLINGER,
+    dist::BHATTACHARYYA_METRIC, dist::BHATTACHARYYA_DISTANCE, dist::TVD, dist::LLR, dist::UWLLR,
+    dist::REVERSE_MKL, dist::REVERSE_POISSON, dist::ITAKURA_SAITO, dist::REVERSE_ITAKURA_SAITO,
+    dist::COSINE_DISTANCE, dist::PROBABILITY_COSINE_DISTANCE, dist::EMD
+};
+
+static jsd::Prior prior_for(dist::DissimilarityMeasure m) {
+    return dist::detail::needs_logs(m) || m == dist::ITAKURA_SAITO || m == dist::REVERSE_ITAKURA_SAITO
+        ? jsd::DIRICHLET: jsd::NONE;
+}
+
+// n * 16 evaluations of app(i, j), with j spread over the dataset
+template<typename App>
+void bench_pairs(Suite &suite, const std::string &name, const App &app) {
+    static constexpr size_t PAIRS_PER_ROW = 16;
+    const size_t n = app.size();
+    suite.run(name, n * PAIRS_PER_ROW, [&]() {
+        double s = 0.;
+        OMP_PRAGMA("omp parallel for reduction(+:s)")
+        for(size_t i = 0; i < n; ++i)
+            for(size_t r = 0; r < PAIRS_PER_ROW; ++r)
+                s += app(i, (i * 7919 + r * 104729 + 1) % n);
+        do_not_optimize(s);
+    });
+}
+
+template<typename Data>
+void bench_distances(Suite &suite, Data &data, const char *label, bool sparse) {
+    using MT = typename Data::value_type;
+    for(const auto m: dense_measures) {
+        if(sparse && (m == dist::EMD)) continue;
+        const std::string name = std::string("dist/") + label + '/' + dist::detail::prob2str(m);
+        if(!suite.enabled(name)) continue;
+        MT copy(data.get());
+        try {
+            auto app = make_probdiv_applicator(copy, m, prior_for(m));
+            bench_pairs(suite, name, app);
+        } catch(const std::exception &ex) {
+            std::fprintf(stderr, "Skipping %s: %s\n", name.data(), ex.what());
+        }
+    }
+}
+
+// Pairwise distances and kNN graphs from reduced-precision rows, for the measures quant:: supports
+template<quant::Precision P, typename Data>
+void bench_quantized(Suite &suite, Data &data) {
+    for(const auto m: {dist::L2, dist::HELLINGER, dist::JSD}) {
+        if(P == quant::INT8 && m == dist::JSD) continue;
+        const std::string suffix = std::string(quant::precision2str(P)) + '/' + dist::detail::prob2str(m);
+        if(!suite.enabled("dist/quant/" + suffix) && !suite.enabled("knn/quant/" + suffix)) continue;
+        DM copy(data.get());
+        auto app = make_probdiv_applicator(copy, m, prior_for(m));
+        auto qapp = make_quantized_applicator<P>(app);
+        bench_pairs(suite, "dist/quant/" + suffix, qapp);
+        suite.run("knn/quant/" + suffix, app.size(), [&]() {
+            auto knns = make_knns(qapp, 10);
+            do_not_optimize(knns);
+        });
+    }
+}
+
+template<typename LazyApp>
+void bench_seeding(Suite &suite, LazyApp &lazy_app, dist::DissimilarityMeasure measure, unsigned k, uint64_t seed) {
+    const std::string ms = dist::detail::prob2str(measure);
+    if(!suite.any_enabled({"seed/kmeanspp/" + ms, "seed/kmc2/" + ms})) return;
+    const auto &app = lazy_app.get();
+    suite.run("seed/kmeanspp/" + ms, app.size(), [&]() {
+        auto res = make_kmeanspp(app, k, seed);
+        do_not_optimize(res);
+    });
+    suite.run("seed/kmc2/" + ms, app.size(), [&]() {
+        auto res = make_kmc2(app, k, 200, seed);
+        do_not_optimize(res);
+    });
+}
+
+// One round of hard, extrinsic Lloyd's, starting each repetition from the same k-means++ centers
+template<typename LazyApp>
+void bench_lloyd(Suite &suite, LazyApp &lazy_app, dist::DissimilarityMeasure measure, unsigned k, uint64_t seed) {
+    const std::string name = std::string("lloyd/") + dist::detail::prob2str(measure);
+    if(!suite.enabled(name)) return;
+    const auto &app = lazy_app.get();
+    using CentersVec = std::vector<blaze::DynamicVector<float, blaze::rowVector>>;
+    auto [ids, asn0, costs0] = make_kmeanspp(app, k, seed);
+    CentersVec ctrs0(ids.size()), ctrs;
+    for(size_t i = 0; i < ids.size(); ++i) ctrs0[i] = app.row(ids[i]);
+    blaze::DynamicVector<uint32_t> asn;
+    blaze::DynamicVector<float> costs;
+    suite.run(name, app.size(), [&]() {
+        clustering::perform_lloyd_loop<clustering::HARD>(ctrs, asn, app, ctrs.size(), costs, seed,
+                                                         static_cast<const float *>(nullptr), 1);
+    }, [&]() {
+        ctrs = ctrs0;
+        asn.resize(app.size());
+        for(size_t i = 0; i < asn.size(); ++i) asn[i] = asn0[i];
+    });
+}
+
+template<typename LazyApp>
+void bench_coreset(Suite &suite, LazyApp &lazy_app, unsigned k, uint64_t seed) {
+    static constexpr coresets::SensitivityMethod methods[] {coresets::BFL, coresets::VX, coresets::LBK};
+    auto sampler_name = [](auto sens) {return std::string("coreset/make_sampler/") + coresets::sm2str(sens);};
+    const bool sample = suite.any_enabled({"coreset/sample/100", "coreset/sample/1000"});
+    if(!sample && std::none_of(std::begin(methods), std::end(methods), [&](auto sens) {return suite.enabled(sampler_name(sens));}))
+        return;
+    const auto &app = lazy_app.get();
+    auto [ids, asn, costs] = make_kmeanspp(app, k, seed);
+    coresets::CoresetSampler<float, uint32_t> cs;
+    for(const auto sens: methods) {
+        const std::string name = sampler_name(sens);
+        suite.run(name, app.size(), [&]() {
+            cs.make_sampler(app.size(), ids.size(), costs.data(), asn.data(), static_cast<const float *>(nullptr), seed, sens);
+        });
+    }
+    if(!sample) return;
+    cs.make_sampler(app.size(), ids.size(), costs.data(), asn.data(), static_cast<const float *>(nullptr), seed, coresets::BFL);
+    for(const size_t m: {100u, 1000u}) {
+        suite.run("coreset/sample/" + std::to_string(m), m, [&]() {
+            auto ics = cs.sample(m, seed);
+            do_not_optimize(ics);
+        });
+    }
+}
+
+// Local search, Jain-Vazirani and Thorup's sampling over a precomputed Euclidean distance matrix
+template<typename Points>
+void bench_metric_solvers(Suite &suite, Points &points, unsigned k, uint64_t seed) {
+    if(!suite.any_enabled({"lsearch/kmedian", "jv/ufl", "thorup/oracle"})) return;
+    const DM &data = points.get().data;
+    const size_t np = std::min(data.rows(), size_t(1000)), nf = std::min(np, size_t(200));
+    DM dm(np, np);
+    OMP_PFOR
+    for(size_t i = 0; i < np; ++i)
+        for(size_t j = 0; j < np; ++j)
+            dm(i, j) = blz::l2Dist(row(data, i), row(data, j));
+    suite.run("lsearch/kmedian", np, [&]() {
+        auto lsearcher = make_kmed_lsearcher(dm, k, 1e-2, seed);
+        lsearcher.run();
+        do_not_optimize(lsearcher.sol_);
+    });
+    if(suite.enabled("jv/ufl")) {
+        DM fdm = submatrix(dm, 0, 0, nf, np);
+        const float fcost = blaze::sum(fdm) / (nf * k);
+        suite.run("jv/ufl", nf * np, [&]() {
+            jv::JVSolver<DM, float, uint32_t> jvs(fdm, fcost);
+            jvs.run();
+            do_not_optimize(jvs);
+        });
+    }
+    suite.run("thorup/oracle", np, [&]() {
+        auto res = thorup::oracle_thorup_d(dm, np, k, static_cast<const float *>(nullptr), 21, 3, 0.5, seed);
+        do_not_optimize(res);
+    });
+}
+
+void bench_graph(Suite &suite, unsigned k, uint64_t seed) {
+    if(!suite.enabled("thorup/graph")) return;
+    auto g = bench::grid_graph<float>(100, seed);
+    suite.run("thorup/graph", boost::num_vertices(g), [&]() {
+        auto res = thorup_sample_mincost(g, k, seed, 3);
+        do_not_optimize(res);
+    });
+}
+
+// LSH insertion and query, and exact versus LSH-assisted kNN graphs, all under the JSD
+template<typename LazyApp>
+void bench_neighbors(Suite &suite, LazyApp &lazy_app, uint64_t seed) {
+    if(!suite.any_enabled({"lsh/add", "lsh/query", "knn/exact", "knn/lsh"})) return;
+    const auto &app = lazy_app.get();
+    const auto &data = app.data();
+    hash::LSHasherSettings settings{unsigned(data.columns()), 4, 8};
+    using Table = LSHTable<JSDLSHasher<float>>;
+    Table table(settings, .1, seed);
+    suite.run("lsh/add", data.rows(), [&]() {table.add(data);}, [&]() {table.clear();});
+    table.clear();
+    table.add(data);
+    suite.run("lsh/query", data.rows(), [&]() {
+        auto res = table.query(data);
+        do_not_optimize(res);
+    });
+    suite.run("knn/exact", app.size(), [&]() {
+        auto knns = make_knns(app, 10);
+        do_not_optimize(knns);
+    });
+    suite.run("knn/lsh", app.size(), [&]() {
+        auto knns = make_knns_by_lsh(app, table, 10);
+        do_not_optimize(knns);
+    });
+}
+
+// Online k-median (BMORST/OFL) over the mixture as one stream in mini-batches. Serial, so ns/op is the per-core
+// ingest cost: the target of 1M points/s per core is 1000 ns/op.
+template<typename Points>
+void bench_streaming(Suite &suite, Points &points, unsigned k, uint64_t seed) {
+    if(!suite.enabled("stream/kmedian")) return;
+    const DM &data = points.get().data;
+    using Clusterer = streaming::DenseKServiceClusterer<float, blz::L1Norm>;
+    static constexpr size_t BATCH = 1024;
+    std::unique_ptr<Clusterer> clusterer;
+    suite.run("stream/kmedian", data.rows(), [&]() {
+        for(size_t i = 0; i < data.rows(); i += BATCH)
+            clusterer->add_batch(submatrix(data, i, 0, std::min(BATCH, data.rows() - i), data.columns()));
+        do_not_optimize(clusterer->cost());
+    }, [&]() {
+        clusterer.reset(new Clusterer(k, data.rows(), data.columns(), 1., seed));
+    }, false);
+}
+
+int main(int argc, char *argv[]) {
+    size_t n = 5000, d = 50, sparse_d = 2000;
+    unsigned k = 10;
+    double coverage = 100.;
+    uint64_t seed = 0;
+    std::string input, outpath, tracepath;
+    Suite suite;
+    for(int c;(c = getopt(argc, argv, "n:d:k:D:c:s:i:t:b:m:o:T:qh")) >= 0;) {
+        switch(c) {
+            case 'n': n = std::strtoull(optarg, nullptr, 10); break;
+            case 'd': d = std::strtoull(optarg, nullptr, 10); break;
+            case 'k': k = std::atoi(optarg); break;
+            case 'D': sparse_d = std::strtoull(optarg, nullptr, 10); break;
+            case 'c': coverage = std::atof(optarg); break;
+            case 's': seed = std::strtoull(optarg, nullptr, 10); break;
+            case 'i': input = optarg; break;
+            case 't': {
+                suite.threads_.clear();
+                for(char *s = optarg; *s; s += *s == ',') suite.threads_.push_back(std::strtoul(s, &s, 10));
+                break;
+            }
+            case 'b': suite.filters_.emplace_back(optarg); break;
+            case 'm': suite.min_ms_ = std::atof(optarg); break;
+            case 'o': outpath = optarg; break;
+            case 'T': tracepath = optarg; trace::set_enabled(true); break;
+            case 'q': suite.verbose_ = false; break;
+            case 'h': default: usage(argv[0]);
+        }
+    }
+    if(suite.threads_.empty() || std::find(suite.threads_.begin(), suite.threads_.end(), 0u) != suite.threads_.end())
+        usage(argv[0]);
+    // Inputs are built by the first selected benchmark which reads them, so filtered runs skip the rest
+    bench::Lazy points([&]() {
+        return input.empty() ? bench::gaussian_mixture<float>(n, d, k, seed): bench::load_exp_data<float>(input);
+    });
+    if(!input.empty()) n = points.get().data.rows(), d = points.get().data.columns(), k = std::max(k, points.get().k);
+    bench::Lazy counts([&]() {return DM(bench::bregman_counts<float>(n, d, k, 1000., 5., seed).data);});
+    bench::Lazy sparse_counts([&]() {
+        SM ret = bench::bregman_counts<float>(n, sparse_d, k, coverage, 5., seed).data;
+        suite.add_config("sparse_nnz", blaze::nonZeros(ret));
+        return ret;
+    });
+    // Applicators normalize their rows in place, so each gets its own copy
+    bench::Lazy qdata([&]() {return DM(submatrix(counts.get(), 0, 0, std::min(n, size_t(2000)), d));});
+    bench::Lazy knndata([&]() {return DM(submatrix(counts.get(), 0, 0, std::min(n, size_t(2000)), d));});
+    bench::Lazy l2data([&]() {return DM(points.get().data);});
+    bench::Lazy mkldata([&]() {return DM(counts.get());});
+    bench::Lazy l2app([&]() {return make_probdiv_applicator(l2data.get(), dist::SQRL2);});
+    bench::Lazy mklapp([&]() {return make_probdiv_applicator(mkldata.get(), dist::MKL, jsd::DIRICHLET);});
+    bench::Lazy jsdapp([&]() {return make_probdiv_applicator(knndata.get(), dist::JSD, jsd::DIRICHLET);});
+    suite.add_config("n", n);
+    suite.add_config("d", d);
+    suite.add_config("k", k);
+    suite.add_config("sparse_d", sparse_d);
+    suite.add_config("seed", seed);
+    if(!input.empty()) suite.add_config("input", input);
+
+    bench_distances(suite, counts, "dense", false);
+    bench_distances(suite, sparse_counts, "sparse", true);
+    bench_quantized<quant::FP16>(suite, qdata);
+    bench_quantized<quant::BF16>(suite, qdata);
+    bench_quantized<quant::INT8>(suite, qdata);
+    bench_seeding(suite, l2app, dist::SQRL2, k, seed);
+    bench_seeding(suite, mklapp, dist::MKL, k, seed);
+    bench_lloyd(suite, l2app, dist::SQRL2, k, seed);
+    bench_lloyd(suite, mklapp, dist::MKL, k, seed);
+    bench_coreset(suite, l2app, k, seed);
+    bench_metric_solvers(suite, points, k, seed);
+    bench_graph(suite, k, seed);
+    bench_streaming(suite, points, k, seed);
+    bench_neighbors(suite, jsdapp, seed);
+
+    std::FILE *ofp = outpath.empty() ? stdout: std::fopen(outpath.data(), "w");
+    if(!ofp) throw std::runtime_error(std::string("Failed to open ") + outpath);
+    suite.emit_json(ofp);
+    if(ofp != stdout) std::fclose(ofp);
+    if(!tracepath.empty()) trace::dump_chrome_trace(tracepath);
+    return 0;
+}
@@ -0,0 +1,135 @@
+#ifndef MINOCORE_BENCH_SYNTH_H__
+#define MINOCORE_BENCH_SYNTH_H__
+#include "minocore/util/textparse.h"
+#include "minocore/graph/graph.h"
+#include "blaze/Math.h"
+#include <numeric>
+#include <random>
+
+namespace minocore {
+
+namespace bench {
+
+/*
+ * Synthetic inputs for the benchmark suite.
+ * These follow exp/generate_kmeans_data.py and exp/generate_bregman_data.py,
+ * but are generated in-process from a fixed seed so that every run sees the same data.
+ * Files written by those scripts can be loaded with load_exp_data instead.
+ */
+
+template<typename FT=float>
+struct Dataset {
+    blaze::DynamicMatrix<FT> data;
+    std::vector<uint32_t> labels;
+    unsigned k = 0;
+};
+
+// Shuffles rows (and labels) so that clusters are interleaved, as the scripts do.
+template<typename FT>
+void shuffle_rows(Dataset<FT> &ds, std::mt19937_64 &mt) {
+    std::vector<uint32_t> order(ds.data.rows());
+    std::iota(order.begin(), order.end(), 0u);
+    std::shuffle(order.begin(), order.end(), mt);
+    blaze::DynamicMatrix<FT> shuffled = rows(ds.data, order);
+    std::vector<uint32_t> labels(order.size());
+    for(size_t i = 0; i < order.size(); ++i) labels[i] = ds.labels[order[i]];
+    ds.data = std::move(shuffled);
+    ds.labels = std::move(labels);
+}
+
+// Gaussian mixture: k centers drawn from |N(0, 5^2)|, with unit-variance points around each.
+template<typename FT=float>
+Dataset<FT> gaussian_mixture(size_t n, size_t d, unsigned k, uint64_t seed=0) {
+    std::mt19937_64 mt(seed);
+    std::normal_distribution<FT> gen;
+    blaze::DynamicMatrix<FT> centers = blaze::generate(k, d, [&](size_t, size_t) {return std::abs(gen(mt) * FT(5));});
+    Dataset<FT> ret{blaze::DynamicMatrix<FT>(n, d), std::vector<uint32_t>(n), k};
+    for(size_t i = 0; i < n; ++i) {
+        const unsigned c = i * k / n;
+        ret.labels[i] = c;
+        for(size_t j = 0; j < d; ++j) ret.data(i, j) = centers(c, j) + gen(mt);
+    }
+    shuffle_rows(ret, mt);
+    return ret;
+}
+
+/*
+ * Multinomial count data: k centers on the simplex from |Cauchy| draws,
+ * and each row a multinomial sample of Poisson(coverage) draws from a perturbed center.
+ * With coverage << d, most entries are zero, which makes this the input for the sparse benchmarks.
+ */
+template<typename FT=float>
+Dataset<FT> bregman_counts(size_t n, size_t d, unsigned k, double coverage=1000., double variance=5., uint64_t seed=0) {
+    std::mt19937_64 mt(seed);
+    std::cauchy_distribution<double> cgen;
+    std::normal_distribution<double> ngen;
+    std::poisson_distribution<unsigned> pgen(coverage);
+    blaze::DynamicMatrix<double> centers = blaze::generate(k, d, [&](size_t, size_t) {return std::abs(cgen(mt) * variance);});
+    for(size_t i = 0; i < k; ++i) {
+        auto r = row(centers, i);
+        r /= blaze::sum(r);
+    }
+    Dataset<FT> ret{blaze::DynamicMatrix<FT>(n, d, FT(0)), std::vector<uint32_t>(n), k};
+    std::vector<double> probs(d);
+    for(size_t i = 0; i < n; ++i) {
+        const unsigned c = i * k / n;
+        ret.labels[i] = c;
+        for(size_t j = 0; j < d; ++j) probs[j] = std::abs(centers(c, j) + ngen(mt));
+        std::discrete_distribution<unsigned> dd(probs.begin(), probs.end());
+        for(unsigned nsamp = pgen(mt); nsamp--; ++ret.data(i, dd(mt)));
+    }
+    shuffle_rows(ret, mt);
+    return ret;
+}
+
+// Loads the text format written by exp/generate_*.py: a "n/d/k" header, then one whitespace-separated row per line.
+template<typename FT=float>
+Dataset<FT> load_exp_data(const std::string &path) {
+    return textparse::with_file_contents(path, [](const char *s, size_t len) {
+        const char *p = s, *e = s + len;
+        const char *eol = textparse::next_line(p, e);
+        Dataset<FT> ret;
+        const size_t n = textparse::parse_uint(p, eol); ++p;
+        const size_t d = textparse::parse_uint(p, eol); ++p;
+        ret.k = textparse::parse_uint(p, eol);
+        if(!n || !d) throw std::runtime_error("Expected a n/d/k header line");
+        ret.data.resize(n, d);
+        p = eol;
+        for(size_t i = 0; i < n; ++i) {
+            if(p >= e) throw std::runtime_error("Unexpected end of file after " + std::to_string(i) + " rows");
+            eol = textparse::next_line(p, e);
+            for(size_t j = 0; j < d; ++j)
+                ret.data(i, j) = textparse::parse_float<FT>(p, eol);
+            p = eol;
+        }
+        return ret;
+    });
+}
+
+/*
+ * side x side grid with integral weights in [1, 10] and a few random long-range chords,
+ * standing in for a road network in the graph benchmarks. Always connected.
+ */
+template<typename FT=float>
+Graph<boost::undirectedS, FT> grid_graph(unsigned side, uint64_t seed=0) {
+    std::mt19937_64 mt(seed);
+    std::uniform_int_distribution<unsigned> wgen(1, 10);
+    Graph<boost::undirectedS, FT> ret(size_t(side) * side);
+    for(unsigned i = 0; i < side; ++i) {
+        for(unsigned j = 0; j < side; ++j) {
+            const unsigned v = i * side + j;
+            if(j + 1 < side) boost::add_edge(v, v + 1, FT(wgen(mt)), ret);
+            if(i + 1 < side) boost::add_edge(v, v + side, FT(wgen(mt)), ret);
+        }
+    }
+    const size_t nv = size_t(side) * side;
+    for(size_t i = 0; i < nv / 64; ++i)
+        boost::add_edge(mt() % nv, mt() % nv, FT(wgen(mt) * 4), ret);
+    return ret;
+}
+
+} // namespace bench
+
+} // namespace minocore
+
+#endif /* MINOCORE_BENCH_SYNTH_H__ */
@@ -4,5 +4,6 @@
 #include "minocore/clustering/dispatch.h"
 #include "minocore/clustering/traits.h"
 #include "minocore/clustering/sampling.h"
+#include "minocore/clustering/model.h"
 
 #endif /* MINOCORE_CLUSTERING_HEADERS_H__ */
@@ -111,21 +111,25 @@ struct CentroidPolicy {
         using FT = blz::ElementType_t<VT>;
         PREC_REQ(measure != static_cast<dist::DissimilarityMeasure>(-1), "Must define dissimilarity measure");
         if(measure == dist::L1 || measure == dist::TOTAL_VARIATION_DISTANCE) {
-            OMP_PFOR
-            for(unsigned j = 0; j < newcon.size(); ++j) {
-                blz::DynamicVector<FT, blz::rowVector> newweights;
-                {
-                    auto col = trans(column(assignments, j));
-                    if(wc) newweights = col * *wc;
-                    else   newweights = col;
-                }
-                if(measure == dist::L1) {
-                    std::conditional_t<blz::IsDenseMatrix_v<VT>,
-                                       blz::DynamicMatrix<FT>, blz::CompressedMatrix<FT>>
-                        scaled_data = data % blz::expand(rs, data.columns());
-                    coresets::l1_median(scaled_data, newcon[j], newweights.data());
-                } else { // TVD
-                    coresets::l1_median(data, newcon[j], newweights.data());
+            if constexpr(!blz::IsMatrix_v<MatType>) {
+                throw std::invalid_argument("Soft L1/TVD centers require the data as a blaze matrix");
+            } else {
+                OMP_PFOR
+                for(unsigned j = 0; j < newcon.size(); ++j) {
+                    blz::DynamicVector<FT, blz::rowVector> newweights;
+                    {
+                        auto col = trans(column(assignments, j));
+                        if(wc) newweights = col * *wc;
+                        else   newweights = col;
+                    }
+                    if(measure == dist::L1) {
+                        std::conditional_t<blz::IsDenseMatrix_v<VT>,
+                                           blz::DynamicMatrix<FT>, blz::CompressedMatrix<FT>>
+                            scaled_data = data % blz::expand(rs, data.columns());
+                        coresets::l1_median(scaled_data, newcon[j], newweights.data());
+                    } else { // TVD
+                        coresets::l1_median(data, newcon[j], newweights.data());
+                    }
                 }
             }
         } else {
@@ -155,6 +155,34 @@ enum LloydLoopResult {
     UNFINISHED
 };
 
+namespace detail {
+// Rows of the applicator's (normalized) data at ids, as a blaze matrix expression.
+// Compressed views are not blaze matrices, so their selected rows are gathered into a CompressedMatrix.
+template<typename MatrixType, typename IT>
+decltype(auto) select_rows(const jsd::DissimilarityApplicator<MatrixType> &app, const IT *ids, size_t n) {
+    if constexpr(is_compressed_view_v<MatrixType>) return app.gather_rows(ids, n);
+    else                                          return rows(app.data(), ids, n);
+}
+template<typename MatrixType>
+decltype(auto) all_rows(const jsd::DissimilarityApplicator<MatrixType> &app) {
+    if constexpr(is_compressed_view_v<MatrixType>) {
+        std::vector<uint32_t> ids(app.size());
+        std::iota(ids.begin(), ids.end(), 0u);
+        return app.gather_rows(ids.data(), ids.size());
+    } else return app.data();
+}
+// The rows of an applicator over a compressed view, read in place as the applicator presents them (normalized, with the prior),
+// for the soft centroid update, which only needs rows() and row(x, i).
+template<typename App>
+struct ApplicatorRows {
+    const App &app_;
+    size_t rows() const {return app_.size();}
+    size_t columns() const {return app_.data().columns();}
+};
+template<typename App>
+auto row(const ApplicatorRows<App> &x, size_t i, blaze::Unchecked={}) {return x.app_.row(i);}
+} // namespace detail
+
 template<Assignment asn_method=HARD, CenterOrigination co=EXTRINSIC, typename MatrixType, typename CentersType, typename Assignments, typename WFT=ElementType_t<MatrixType>,
          typename CostType>
 LloydLoopResult perform_lloyd_loop(CentersType &centers, Assignments &assignments,
@@ -170,8 +198,8 @@ LloydLoopResult perform_lloyd_loop(CentersType &centers, Assignments &assignment
     }
     assert(retcost.size() == app.size() || !std::fprintf(stderr, "retcost size: %zu. app size: %zu\n", retcost.size(), app.size()));
     if(co != EXTRINSIC) throw std::invalid_argument("Must be extrinsic for Lloyd's");
+    MINOCORE_PHASE("perform_lloyd_loop");
     using FT = ElementType_t<MatrixType>;
-    auto &mat = app.data();
     const size_t npoints = app.size();
     CentersType centers_cpy(centers), centers_cache;
     MINOCORE_REQUIRE(centers.size() == k, "Must have the correct number of centers");
@@ -218,7 +246,7 @@ LloydLoopResult perform_lloyd_loop(CentersType &centers, Assignments &assignment
 #endif
             if(weight_cv) {
                 auto ew = blaze::expand(*weight_cv, app.data().columns());
-                std::fprintf(stderr, "expanded weight shape: %zu/%zu. asn: %zu/%zu\n", ew.rows(), ew.columns(), assignments.rows(), assignments.columns());
+                MINOCORE_LOG("expanded weight shape: %zu/%zu. asn: %zu/%zu\n", ew.rows(), ew.columns(), assignments.rows(), assignments.columns());
                 return blaze::sum(assignments % retcost % ew);
             } else {
                 return blaze::sum(assignments % retcost);
@@ -281,24 +309,26 @@ LloydLoopResult perform_lloyd_loop(CentersType &centers, Assignments &assignment
                     dist::detail::set_cache(centers[i], centers_cache[i], measure);
             }
             for(auto &i: assigned) i.clear();
-            OMP_PFOR
-            for(size_t i = 0; i < npoints; ++i) {
-                auto dist = app(i, centers[0], getcache(0), measure);
-                unsigned asn = 0;
-                for(unsigned j = 1; j < k; ++j) {
-                    auto newdist = app(i, centers[j], getcache(j), measure);
-                    if(newdist < dist) {
-                        asn = j;
-                        dist = newdist;
+            app.with_kernel(measure, [&](const auto &kernel) {
+                OMP_PFOR
+                for(size_t i = 0; i < npoints; ++i) {
+                    auto dist = kernel(i, centers[0], getcache(0));
+                    unsigned asn = 0;
+                    for(unsigned j = 1; j < k; ++j) {
+                        auto newdist = kernel(i, centers[j], getcache(j));
+                        if(newdist < dist) {
+                            asn = j;
+                            dist = newdist;
+                        }
+                    }
+                    retcost[i] = dist;
+                    assignments[i] = asn;
+                    {
+                        OMP_ONLY(std::unique_lock<std::mutex> lock(mutexes[asn]);)
+                        assigned[asn].push_back(i);
                     }
                 }
-                retcost[i] = dist;
-                assignments[i] = asn;
-                {
-                    OMP_ONLY(std::unique_lock<std::mutex> lock(mutexes[asn]);)
-                    assigned[asn].push_back(i);
-                }
-            }
+            });
             // Check termination condition
             if(auto rc = check(); rc != UNFINISHED) {
                 ret = rc;
@@ -327,7 +357,7 @@ LloydLoopResult perform_lloyd_loop(CentersType &centers, Assignments &assignment
                     std::partial_sum(retcost.data(), retcost.data() + retcost.size(), csum.data());
                     auto newp = std::lower_bound(csum.data(), csum.data() + csum.size(), urd(rng) * csum[csum.size() - 1])
                                 - csum.data();
-                    centers[centers_to_restart[i]] = row(app.data(), newp, blaze::unchecked);
+                    centers[centers_to_restart[i]] = app.row(newp);
                     if(++i != restartn) {
                         OMP_PFOR
                         for(size_t i = 0; i < npoints; ++i)
@@ -343,7 +373,7 @@ LloydLoopResult perform_lloyd_loop(CentersType &centers, Assignments &assignment
                 shared::sort(assigned_ids.begin(), assigned_ids.end()); // Better access pattern
                 auto aidptr = assigned_ids.data();
                 const size_t nid = assigned_ids.size();
-                auto rowsel = rows(mat, aidptr, nid);
+                decltype(auto) rowsel = detail::select_rows(app, aidptr, nid);
                 auto sumsel = blaze::elements(app.row_sums(), aidptr, nid);
                 if(weight_cv) {
                     auto wsel = blaze::elements(*weight_cv, aidptr, nid);
@@ -365,6 +395,18 @@ LloydLoopResult perform_lloyd_loop(CentersType &centers, Assignments &assignment
         }
         std::unique_ptr<std::mutex[]> mutexes;
         OMP_ONLY(mutexes.reset(new std::mutex[centers.size()]);)
+        auto update_centers = [&](const auto &softdata) {
+            CentroidPolicy::perform_soft_assignment(
+                assignments, app.row_sums(),
+                OMP_ONLY(mutexes.get(),)
+                softdata, centers_cpy, weight_cv.get(), measure
+            );
+        };
+        // Compressed views are read in place, except under L1/TVD, whose weighted medians need a blaze matrix.
+        std::unique_ptr<blaze::CompressedMatrix<FT>> gathered;
+        if constexpr(is_compressed_view_v<MatrixType>)
+            if(measure == dist::L1 || measure == dist::TOTAL_VARIATION_DISTANCE)
+                gathered.reset(new blaze::CompressedMatrix<FT>(detail::all_rows(app)));
         for(;;) {
             if(centers_cache.size()) {
                 for(size_t i = 0; i < centers.size(); ++i)
@@ -382,11 +424,10 @@ LloydLoopResult perform_lloyd_loop(CentersType &centers, Assignments &assignment
                 goto end;
             }
             // Now points have been assigned, and we now perform center assignment
-            CentroidPolicy::perform_soft_assignment(
-                assignments, app.row_sums(),
-                OMP_ONLY(mutexes.get(),)
-                app.data(), centers_cpy, weight_cv.get(), measure
-            );
+            if constexpr(is_compressed_view_v<MatrixType>) {
+                if(gathered) update_centers(*gathered);
+                else         update_centers(detail::ApplicatorRows<jsd::DissimilarityApplicator<MatrixType>>{app});
+            } else update_centers(app.data());
         }
         std::swap(centers_cpy, centers);
     }
@@ -510,7 +551,7 @@ auto perform_clustering(const jsd::DissimilarityApplicator<MatrixType> &app, siz
             PRETTY_SAY << "Beginning lloyd loop\n";
             // Perform EM
             if(auto ret = perform_lloyd_loop<asn_method>(centers, assignments, app, k, costs, ct.seed, ct.weights, max_iter, eps))
-                std::fprintf(stderr, "lloyd loop ret: %s\n", ret == REACHED_MAX_ROUNDS ? "max rounds": "unfinished");
+                MINOCORE_LOG("lloyd loop ret: %s\n", ret == REACHED_MAX_ROUNDS ? "max rounds": "unfinished");
         }
     } else if(dist::detail::satisfies_metric(measure) || dist::detail::satisfies_rho_metric(measure)) {
         MINOCORE_REQUIRE(asn_method == HARD, "Can't do soft metric k-median");
@@ -0,0 +1,277 @@
+#ifndef MINOCORE_CLUSTERING_MODEL_H__
+#define MINOCORE_CLUSTERING_MODEL_H__
+#include "minocore/dist/applicator.h"
+#include "minocore/util/binary_format.h"
+
+namespace minocore {
+
+namespace clustering {
+
+/*
+ * A fitted hard clustering, for labeling points that were not part of training.
+ *
+ * The model keeps the centers, their per-measure caches (dist::detail::set_cache), and the prior used in training,
+ * so that a batch of new rows is preprocessed exactly as training rows were and compared against ready-made centers.
+ * Batches are scored with a GEMM where the measure decomposes into inner products (SQRL2, L2, MKL, POISSON);
+ * for metrics, center-center distances prune candidates via the triangle inequality; otherwise, every pair is evaluated.
+ *
+ * Models are written with the aligned, checksummed layout in util/binary_format.h
+ * (section 0: centers, k x d; section 1: prior data), and derived state is rebuilt on load.
+ */
+
+struct ModelHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t endian;
+    uint32_t ft_size;
+    uint32_t it_size;   // sizeof(uint32_t) labels
+    uint64_t k;
+    uint64_t d;
+    int32_t measure;
+    int32_t prior;
+    uint64_t nprior;
+    uint64_t offsets[2];
+    uint64_t file_size;
+    uint64_t checksum;
+};
+
+template<typename FT=float>
+class ClusteringModel {
+public:
+    using CenterType = blaze::DynamicVector<FT, blaze::rowVector>;
+    static constexpr const char *BINARY_MAGIC = "MNCMODEL";
+private:
+    dist::DissimilarityMeasure measure_;
+    jsd::Prior prior_;
+    CenterType prior_data_; // Empty unless the prior takes parameters
+    std::vector<CenterType> centers_;
+    std::vector<CenterType> caches_; // Empty if the measure uses no cache
+    size_t d_ = 0;
+    // GEMM operand: centers (SQRL2/L2) or their logs (MKL/POISSON), with squared norms for the former
+    blaze::DynamicMatrix<FT> gemm_centers_;
+    blaze::DynamicVector<FT> center_sqrnorms_;
+    // Center-center distances, for metric measures only
+    blaze::DynamicMatrix<FT> cc_;
+
+    static bool uses_weighted_rows(dist::DissimilarityMeasure measure) {
+        return measure == dist::L1 || measure == dist::L2 || measure == dist::SQRL2 || measure == dist::WEMD;
+    }
+    // HELLINGER is computed as a squared distance, so it is excluded despite satisfies_metric.
+    static bool can_prune(dist::DissimilarityMeasure measure) {
+        return dist::detail::satisfies_metric(measure) && measure != dist::HELLINGER && measure != dist::ORACLE_METRIC;
+    }
+    bool uses_gemm() const {return gemm_centers_.rows() != 0;}
+    const CenterType *cache(size_t j) const {return caches_.empty() ? static_cast<const CenterType *>(nullptr): &caches_[j];}
+
+    void finalize() {
+        const size_t k = centers_.size();
+        MINOCORE_REQUIRE(k > 0, "A model requires at least one center");
+        d_ = centers_.front().size();
+        for(const auto &c: centers_) MINOCORE_REQUIRE(c.size() == d_, "All centers must have the same dimension");
+        caches_.clear();
+        if(dist::detail::needs_logs(measure_) || dist::detail::needs_sqrt(measure_)) {
+            caches_.resize(k);
+            OMP_PFOR
+            for(size_t i = 0; i < k; ++i)
+                dist::detail::set_cache(centers_[i], caches_[i], measure_);
+        }
+        gemm_centers_.clear();
+        if(measure_ == dist::SQRL2 || measure_ == dist::L2 || measure_ == dist::MKL || measure_ == dist::POISSON) {
+            const bool kl = measure_ == dist::MKL || measure_ == dist::POISSON;
+            gemm_centers_.resize(k, d_);
+            center_sqrnorms_.resize(k);
+            for(size_t i = 0; i < k; ++i) {
+                blaze::row(gemm_centers_, i) = kl ? caches_[i]: centers_[i];
+                center_sqrnorms_[i] = blaze::sqrNorm(centers_[i]);
+            }
+        }
+        cc_.clear();
+        if(can_prune(measure_) && k > 1) {
+            cc_.resize(k, k);
+            if(measure_ == dist::L1 || measure_ == dist::L2) {
+                OMP_PFOR
+                for(size_t i = 0; i < k; ++i)
+                    for(size_t j = 0; j < k; ++j)
+                        cc_(i, j) = measure_ == dist::L1 ? blaze::l1Norm(centers_[i] - centers_[j]): blaze::l2Norm(centers_[i] - centers_[j]);
+            } else {
+                // Probability measures: centers are already normalized, so an applicator over them yields the same distances.
+                blaze::DynamicMatrix<FT> cm(k, d_);
+                for(size_t i = 0; i < k; ++i) blaze::row(cm, i) = centers_[i];
+                jsd::DissimilarityApplicator<blaze::DynamicMatrix<FT>> capp(cm, measure_);
+                OMP_PFOR
+                for(size_t i = 0; i < k; ++i)
+                    for(size_t j = 0; j < k; ++j)
+                        cc_(i, j) = i == j ? FT(0): FT(capp(i, j));
+            }
+        }
+    }
+
+    template<typename App>
+    void assign_gemm(const App &app, uint32_t *labels, FT *costs) const {
+        static constexpr size_t BLOCK_ROWS = 4096;
+        const size_t n = app.size(), k = centers_.size();
+        const bool kl = measure_ == dist::MKL || measure_ == dist::POISSON;
+        blaze::DynamicMatrix<FT> dots;
+        for(size_t start = 0; start < n; start += BLOCK_ROWS) {
+            const size_t nb = std::min(BLOCK_ROWS, n - start);
+            dots = blaze::submatrix(app.data(), start, 0, nb, d_) * blaze::trans(gemm_centers_);
+            OMP_PFOR
+            for(size_t i = 0; i < nb; ++i) {
+                const size_t gi = start + i;
+                auto drow = blaze::row(dots, i);
+                FT base, scale;
+                if(kl) {
+                    // KL(x || c) = sum(x log x) - x . log(c)
+                    base = app.negentropy(gi);
+                    scale = -1;
+                } else {
+                    // ||x - c||^2 = ||x||^2 - 2 x . c + ||c||^2, where x = row_sum * normalized row
+                    const FT rs = app.row_sums()[gi];
+                    base = rs * rs * blaze::sqrNorm(app.row(gi));
+                    scale = -2 * rs;
+                }
+                uint32_t best = 0;
+                FT bd = std::numeric_limits<FT>::max();
+                for(size_t j = 0; j < k; ++j) {
+                    FT dj = base + scale * drow[j];
+                    if(!kl) dj = std::max(dj + center_sqrnorms_[j], FT(0));
+                    if(dj < bd) bd = dj, best = j;
+                }
+                labels[gi] = best;
+                costs[gi] = measure_ == dist::L2 ? std::sqrt(bd): bd;
+            }
+        }
+    }
+
+    template<typename App>
+    size_t assign_pairwise(const App &app, uint32_t *labels, FT *costs) const {
+        const size_t n = app.size(), k = centers_.size();
+        const bool prune = cc_.rows() != 0;
+        size_t npruned = 0;
+        OMP_PRAGMA("omp parallel for schedule(dynamic, 64) reduction(+:npruned)")
+        for(size_t i = 0; i < n; ++i) {
+            uint32_t best = 0;
+            FT bd = app(i, centers_[0], cache(0), measure_);
+            for(size_t j = 1; j < k; ++j) {
+                // For a metric, d(x, c_j) >= d(c_best, c_j) - d(x, c_best) >= d(x, c_best)
+                if(prune && cc_(best, j) >= 2 * bd) {
+                    ++npruned;
+                    continue;
+                }
+                const FT dj = app(i, centers_[j], cache(j), measure_);
+                if(dj < bd) bd = dj, best = j;
+            }
+            labels[i] = best;
+            costs[i] = bd;
+        }
+        return npruned;
+    }
+
+    ClusteringModel() = default;
+public:
+    ClusteringModel(dist::DissimilarityMeasure measure, std::vector<CenterType> centers,
+                    jsd::Prior prior=jsd::NONE, const CenterType *prior_data=nullptr):
+        measure_(measure), prior_(prior), centers_(std::move(centers))
+    {
+        if(prior_data) prior_data_ = *prior_data;
+        if((prior == jsd::GAMMA_BETA || prior == jsd::FEATURE_SPECIFIC_PRIOR) && prior_data_.size() == 0)
+            throw std::invalid_argument("This prior requires prior data");
+        finalize();
+    }
+    // From an intrinsic solution: centers are rows of the training applicator.
+    template<typename MatrixType, typename IT>
+    static ClusteringModel from_indices(const jsd::DissimilarityApplicator<MatrixType> &app, const IT *ids, size_t k,
+                                        jsd::Prior prior=jsd::NONE, const CenterType *prior_data=nullptr)
+    {
+        std::vector<CenterType> centers(k);
+        const bool weighted = uses_weighted_rows(app.get_measure());
+        for(size_t i = 0; i < k; ++i) {
+            if(weighted) centers[i] = app.weighted_row(ids[i]);
+            else         centers[i] = app.row(ids[i]);
+        }
+        return ClusteringModel(app.get_measure(), std::move(centers), prior, prior_data);
+    }
+
+    size_t num_centers() const {return centers_.size();}
+    size_t dimension() const {return d_;}
+    dist::DissimilarityMeasure measure() const {return measure_;}
+    jsd::Prior prior() const {return prior_;}
+    const std::vector<CenterType> &centers() const {return centers_;}
+
+    /*
+     * Labels each row of batch, writing the nearest center to labels and the dissimilarity to it to costs.
+     * batch is preprocessed as in training: dense and blaze sparse batches are normalized in place; compressed views are not modified.
+     * Returns the number of center comparisons skipped by triangle-inequality pruning.
+     */
+    template<typename MatrixType>
+    size_t assign(MatrixType &batch, uint32_t *labels, FT *costs) const {
+        MINOCORE_REQUIRE(batch.columns() == d_, "Batch dimension must match the model's");
+        if(batch.rows() == 0) return 0;
+        jsd::DissimilarityApplicator<MatrixType> app(batch, measure_, prior_, prior_data_.size() ? &prior_data_: static_cast<const CenterType *>(nullptr));
+        if constexpr(blaze::IsMatrix_v<MatrixType>) {
+            // Sparse rows store only their nonzeros, so a nonzero prior would be missing from the inner products.
+            if(uses_gemm() && (blaze::IsDenseMatrix_v<MatrixType> || prior_ == jsd::NONE)) {
+                assign_gemm(app, labels, costs);
+                return 0;
+            }
+        }
+        return assign_pairwise(app, labels, costs);
+    }
+    template<typename MatrixType>
+    std::pair<blz::DV<uint32_t>, blz::DV<FT>> assign(MatrixType &batch) const {
+        std::pair<blz::DV<uint32_t>, blz::DV<FT>> ret;
+        ret.first.resize(batch.rows());
+        ret.second.resize(batch.rows());
+        assign(batch, ret.first.data(), ret.second.data());
+        return ret;
+    }
+
+    void write(const std::string &path) const {
+        io::SectionWriter<ModelHeader> sw(path);
+        ModelHeader hdr{};
+        io::set_magic(hdr, BINARY_MAGIC);
+        hdr.ft_size = sizeof(FT);
+        hdr.it_size = sizeof(uint32_t);
+        hdr.k = centers_.size();
+        hdr.d = d_;
+        hdr.measure = measure_;
+        hdr.prior = prior_;
+        hdr.nprior = prior_data_.size();
+        std::vector<FT> flat(centers_.size() * d_);
+        for(size_t i = 0; i < centers_.size(); ++i)
+            std::copy(centers_[i].begin(), centers_[i].end(), flat.data() + i * d_);
+        hdr.offsets[0] = sw.write(flat.data(), flat.size() * sizeof(FT));
+        hdr.offsets[1] = sw.write(prior_data_.data(), prior_data_.size() * sizeof(FT));
+        sw.finish(hdr);
+    }
+    static ClusteringModel read(const std::string &path, bool verify_checksum=true) {
+        mio::mmap_source ms(path);
+        const auto &hdr = io::validate<ModelHeader>(ms, BINARY_MAGIC, sizeof(FT), sizeof(uint32_t), verify_checksum);
+        if(!dist::detail::is_valid_measure(static_cast<dist::DissimilarityMeasure>(hdr.measure)))
+            throw std::runtime_error("Model file has an invalid measure");
+        ClusteringModel ret;
+        ret.measure_ = static_cast<dist::DissimilarityMeasure>(hdr.measure);
+        ret.prior_ = static_cast<jsd::Prior>(hdr.prior);
+        const FT *cp = io::section<FT>(ms, hdr, 0, hdr.k * hdr.d);
+        ret.centers_.resize(hdr.k);
+        for(size_t i = 0; i < hdr.k; ++i) {
+            ret.centers_[i].resize(hdr.d);
+            std::copy(cp + i * hdr.d, cp + (i + 1) * hdr.d, ret.centers_[i].begin());
+        }
+        if(hdr.nprior) {
+            const FT *pp = io::section<FT>(ms, hdr, 1, hdr.nprior);
+            ret.prior_data_.resize(hdr.nprior);
+            std::copy(pp, pp + hdr.nprior, ret.prior_data_.begin());
+        }
+        ret.finalize();
+        return ret;
+    }
+};
+
+} // namespace clustering
+
+using clustering::ClusteringModel;
+
+} // namespace minocore
+
+#endif /* MINOCORE_CLUSTERING_MODEL_H__ */
@@ -0,0 +1,176 @@
+#pragma once
+#ifndef FGC_ALIAS_TABLE_H__
+#define FGC_ALIAS_TABLE_H__
+#include "aesctr/wy.h"
+#include "minocore/util/macros.h"
+#ifdef _OPENMP
+#  include <omp.h>
+#endif
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <numeric>
+#include <stdexcept>
+#include <vector>
+
+namespace minocore {
+namespace coresets {
+
+/*
+ * Walker/Vose alias method: O(n) construction, in parallel, and O(1) sampling.
+ * A bucket i is drawn uniformly, and kept with probability prob_[i]; otherwise alias_[i] is returned.
+ *
+ * The table either owns its arrays or refers to external storage (e.g., a memory-mapped sampler file),
+ * in which case construction is free.
+ */
+template<typename FT=float, typename IT=std::uint32_t, typename RNG=wy::WyRand<uint64_t, 2>>
+class VoseAliasTable {
+    std::unique_ptr<FT[]> owned_prob_;
+    std::unique_ptr<IT[]> owned_alias_;
+    const FT *prob_;
+    const IT *alias_;
+    size_t n_;
+    RNG rng_;
+public:
+    template<typename Iter>
+    VoseAliasTable(Iter first, Iter last, uint64_t seed=137): n_(std::distance(first, last)), rng_(seed) {
+        if(n_ == 0) throw std::invalid_argument("Cannot build an alias table over an empty range");
+        if(n_ - 1 > static_cast<size_t>(std::numeric_limits<IT>::max()))
+            throw std::invalid_argument("IT is too small to index this alias table");
+        owned_prob_.reset(new FT[n_]);
+        owned_alias_.reset(new IT[n_]);
+        build(first);
+        prob_ = owned_prob_.get();
+        alias_ = owned_alias_.get();
+    }
+    // Non-owning: prob and alias must outlive the table.
+    VoseAliasTable(const FT *prob, const IT *alias, size_t n, uint64_t seed=137):
+        prob_(prob), alias_(alias), n_(n), rng_(seed) {}
+
+    void seed(uint64_t seed) {rng_.seed(seed);}
+    size_t size() const {return n_;}
+    bool owns_data() const {return owned_prob_ != nullptr;}
+    const FT *probabilities() const {return prob_;}
+    const IT *aliases() const {return alias_;}
+
+    INLINE IT sample() {
+        const IT bucket = (static_cast<__uint128_t>(rng_()) * n_) >> 64;
+        const double coin = (rng_() >> 11) * 0x1p-53;
+        return coin < prob_[bucket] ? bucket: alias_[bucket];
+    }
+    IT operator()() {return sample();}
+
+private:
+    static constexpr size_t CHUNK = size_t(1) << 14;
+
+    /*
+     * Partitioned sweep construction (Hübschle-Schneider and Sanders, Parallel Weighted Random Sampling).
+     * With weights scaled to mean 1, light items (< 1) and heavy items (>= 1) are each taken in index order.
+     * Sweeping fills light item a from the current heavy item b, or closes b (aliasing it to the next heavy item)
+     * once its remainder drops to 1 or below. Both the order of these steps and b's remainder follow from prefix sums
+     * of the light deficits (1 - w) and heavy surpluses (w - 1), so the sweep is a merge of two sorted sequences,
+     * which is split into parts built independently.
+     * Chunks are of fixed size, so the table does not depend on the number of threads.
+     */
+    template<typename Iter>
+    void build(Iter first) {
+        const size_t nchunks = (n_ + CHUNK - 1) / CHUNK;
+        std::vector<double> scaled(n_);
+        constexpr bool random_access = std::is_base_of_v<std::random_access_iterator_tag, typename std::iterator_traits<Iter>::iterator_category>;
+        if constexpr(!random_access) std::copy_n(first, n_, scaled.begin());
+        std::vector<double> chunk_sums(nchunks);
+        std::vector<size_t> chunk_nlight(nchunks + 1);
+        size_t nbad = 0;
+        OMP_PRAGMA("omp parallel for reduction(+:nbad)")
+        for(size_t c = 0; c < nchunks; ++c) {
+            double sum = 0.;
+            for(size_t i = c * CHUNK, e = std::min(i + CHUNK, n_); i < e; ++i) {
+                if constexpr(random_access) scaled[i] = first[i];
+                nbad += !(scaled[i] >= 0.) || std::isinf(scaled[i]);
+                sum += scaled[i];
+            }
+            chunk_sums[c] = sum;
+        }
+        if(nbad) throw std::invalid_argument("Alias table weights must be finite and nonnegative");
+        const double sum = std::accumulate(chunk_sums.begin(), chunk_sums.end(), 0.);
+        if(!(sum > 0.) || std::isinf(sum)) throw std::invalid_argument("Alias table requires a positive total weight");
+        const double mul = n_ / sum;
+        // Scale, and total light deficits and heavy surpluses per chunk
+        std::vector<double> chunk_deficit(nchunks + 1), chunk_surplus(nchunks + 1);
+        OMP_PFOR
+        for(size_t c = 0; c < nchunks; ++c) {
+            size_t nl = 0;
+            double deficit = 0., surplus = 0.;
+            for(size_t i = c * CHUNK, e = std::min(i + CHUNK, n_); i < e; ++i) {
+                const double w = scaled[i] *= mul;
+                if(w < 1.) ++nl, deficit += 1. - w;
+                else surplus += w - 1.;
+            }
+            chunk_nlight[c + 1] = nl;
+            chunk_deficit[c + 1] = deficit;
+            chunk_surplus[c + 1] = surplus;
+        }
+        std::partial_sum(chunk_nlight.begin(), chunk_nlight.end(), chunk_nlight.begin());
+        std::partial_sum(chunk_deficit.begin(), chunk_deficit.end(), chunk_deficit.begin());
+        std::partial_sum(chunk_surplus.begin(), chunk_surplus.end(), chunk_surplus.begin());
+        const size_t nlight = chunk_nlight[nchunks], nheavy = n_ - nlight;
+        // light[a], heavy[b]: the a-th light and b-th heavy items;
+        // ldef[a]: total deficit of the lights before a; hsur[b]: total surplus of the heavies before b
+        std::vector<IT> light(nlight), heavy(nheavy);
+        std::vector<double> ldef(nlight + 1), hsur(nheavy + 1);
+        OMP_PFOR
+        for(size_t c = 0; c < nchunks; ++c) {
+            // Offset local sums, accumulated as above, so that ldef and hsur are nondecreasing across chunks
+            size_t a = chunk_nlight[c], b = c * CHUNK - a;
+            const double doff = chunk_deficit[c], soff = chunk_surplus[c];
+            double deficit = 0., surplus = 0.;
+            for(size_t i = c * CHUNK, e = std::min(i + CHUNK, n_); i < e; ++i) {
+                const double w = scaled[i];
+                if(w < 1.) ldef[a] = doff + deficit, light[a++] = i, deficit += 1. - w;
+                else       hsur[b] = soff + surplus, heavy[b++] = i, surplus += w - 1.;
+            }
+        }
+        ldef[nlight] = chunk_deficit[nchunks];
+        hsur[nheavy] = chunk_surplus[nchunks];
+        // Light a precedes heavy b in the sweep iff ldef[a] < hsur[b + 1].
+        // split(m) is the number of lights among the first m steps.
+        auto split = [&](size_t m) {
+            size_t lo = m > nheavy ? m - nheavy: 0, hi = std::min(m, nlight);
+            while(lo < hi) {
+                const size_t mid = (lo + hi) / 2;
+                if(ldef[mid] < hsur[m - mid]) lo = mid + 1;
+                else hi = mid;
+            }
+            return lo;
+        };
+        OMP_PFOR
+        for(size_t part = 0; part < nchunks; ++part) {
+            const size_t mbeg = part * CHUNK, mend = std::min(mbeg + CHUNK, n_);
+            size_t a = split(mbeg), b = mbeg - a;
+            for(size_t m = mbeg; m < mend; ++m) {
+                if(b < nheavy && (a == nlight || hsur[b + 1] <= ldef[a])) {
+                    // Close heavy b, whose remainder is 1 + hsur[b + 1] - ldef[a]; the last one keeps everything left.
+                    const IT h = heavy[b];
+                    if(b + 1 < nheavy) {
+                        owned_prob_[h] = std::clamp(1. + hsur[b + 1] - ldef[a], 0., 1.);
+                        owned_alias_[h] = heavy[b + 1];
+                    } else owned_prob_[h] = 1, owned_alias_[h] = h;
+                    ++b;
+                } else {
+                    // Fill light a from heavy b. Lights left over after the last heavy are 1 up to rounding error.
+                    const IT l = light[a];
+                    if(b < nheavy) owned_prob_[l] = scaled[l], owned_alias_[l] = heavy[b];
+                    else           owned_prob_[l] = 1, owned_alias_[l] = l;
+                    ++a;
+                }
+            }
+        }
+    }
+};
+
+} // namespace coresets
+} // namespace minocore
+
+#endif /* FGC_ALIAS_TABLE_H__ */
@@ -4,7 +4,8 @@
 #include <vector>
 #include <map>
 #include <queue>
-#include "alias_sampler/alias_sampler.h"
+#include "minocore/coreset/alias_table.h"
+#include "minocore/util/binary_format.h"
 #include "minocore/util/shared.h"
 #include "blaze/math/CustomVector.h"
 #include "blaze/math/DynamicVector.h"
@@ -68,6 +69,8 @@ struct IndexCoreset {
     size_t size() const {return indices_.size();}
     IndexCoreset(IndexCoreset &&o) = default;
     IndexCoreset(const IndexCoreset &o) = default;
+    IndexCoreset &operator=(IndexCoreset &&o) = default;
+    IndexCoreset &operator=(const IndexCoreset &o) = default;
     void write(gzFile fp) const {
         uint64_t n = size();
         if(gzwrite(fp, &n, sizeof(n)) != sizeof(n)) goto fail;
@@ -91,11 +94,32 @@ struct IndexCoreset {
             throw std::runtime_error("Failed to write in "s + __PRETTY_FUNCTION__);
     }
     void write(std::string path) const {
-        gzFile fp = gzopen(path.data(), "rb");
+        gzFile fp = gzopen(path.data(), "wb");
         if(!fp) throw std::runtime_error("Failed to open file in "s + __PRETTY_FUNCTION__);
         write(fp);
         gzclose(fp);
     }
+    static constexpr const char *BINARY_MAGIC = "MNCIDXCS";
+    // Versioned, aligned binary layout (see binary_format.h): indices in section 0, weights in section 1.
+    void write_binary(const std::string &path) const {
+        io::SectionWriter<> sw(path);
+        io::FileHeader hdr{};
+        io::set_magic(hdr, BINARY_MAGIC);
+        hdr.ft_size = sizeof(FT); hdr.it_size = sizeof(IT);
+        hdr.n = size();
+        hdr.flags = 3;
+        hdr.offsets[0] = sw.write(indices_.data(), sizeof(IT) * size());
+        hdr.offsets[1] = sw.write(weights_.data(), sizeof(FT) * size());
+        sw.finish(hdr);
+    }
+    static IndexCoreset read_binary(const std::string &path, bool verify_checksum=true) {
+        mio::mmap_source ms(path);
+        const auto &hdr = io::validate(ms, BINARY_MAGIC, sizeof(FT), sizeof(IT), verify_checksum);
+        IndexCoreset ret(hdr.n);
+        std::memcpy(ret.indices_.data(), io::section<IT>(ms, hdr, 0, hdr.n), sizeof(IT) * hdr.n);
+        std::memcpy(ret.weights_.data(), io::section<FT>(ms, hdr, 1, hdr.n), sizeof(FT) * hdr.n);
+        return ret;
+    }
     void compact(bool shrink_to_fit=true) {
         // TODO: replace with hash map and compact
         std::map<std::pair<IT, FT>, uint32_t> m;
@@ -152,11 +176,27 @@ struct UniformSampler {
         }
         ret.weights_ = static_cast<FT>(np_) / n; // Ensure final weight = np_
 #ifndef NDEBUG
-        std::fprintf(stderr, "Weights for uniform: %g (%zu / %zu)\n", static_cast<FT>(np_) / n,
+        MINOCORE_LOG("Weights for uniform: %g (%zu / %zu)\n", static_cast<FT>(np_) / n,
                      np_, n);
 #endif
         return ret;
     }
+    // As CoresetSampler::sample_nested: coresets for each size are prefixes of one draw
+    std::vector<IndexCoreset<IT, FT>> sample_nested(const std::vector<size_t> &sizes, uint64_t seed=0) {
+        if(seed) rng_.seed(seed);
+        const size_t nmax = sizes.empty() ? size_t(0): *std::max_element(sizes.begin(), sizes.end());
+        std::vector<IT> draws(nmax);
+        for(auto &d: draws) d = rng_() % np_;
+        std::vector<IndexCoreset<IT, FT>> ret;
+        ret.reserve(sizes.size());
+        for(const size_t n: sizes) {
+            IndexCoreset<IT, FT> cs(n);
+            std::copy(draws.begin(), draws.begin() + n, cs.indices_.begin());
+            cs.weights_ = static_cast<FT>(np_) / n;
+            ret.emplace_back(std::move(cs));
+        }
+        return ret;
+    }
     size_t size() {return np_;}
 };
 
@@ -186,13 +226,17 @@ auto map2index(const MapCoreset<IT, FT, MapType, Extra...> &map) {
 
 template<typename FT=float, typename IT=std::uint32_t>
 struct CoresetSampler {
-    using Sampler = alias::AliasSampler<FT, wy::WyRand<IT, 2>, IT>;
+    using Sampler = VoseAliasTable<FT, IT>;
     using CoresetType = IndexCoreset<IT, FT>;
     std::unique_ptr<Sampler>     sampler_;
     std::unique_ptr<FT []>         probs_;
     std::unique_ptr<blaze::DynamicVector<FT>> weights_;
     std::unique_ptr<blaze::DynamicVector<IT>> fl_bicriteria_points_; // Used only by FL
     std::unique_ptr<IT []>        fl_asn_;
+    // Set instead of the owned arrays above when the sampler is memory-mapped
+    std::shared_ptr<mio::mmap_source> mapping_;
+    const FT *mapped_probs_ = nullptr, *mapped_weights_ = nullptr;
+    const IT *mapped_fl_points_ = nullptr, *mapped_fl_asn_ = nullptr;
     size_t                            np_;
     size_t                             k_;
     size_t                             b_;
@@ -202,11 +246,17 @@ struct CoresetSampler {
 
     bool ready() const {return sampler_.get();}
 
+    const FT *probs() const {return probs_ ? probs_.get(): mapped_probs_;}
+    const FT *weight_data() const {return weights_ ? weights_->data(): mapped_weights_;}
+    const IT *fl_asn() const {return fl_asn_ ? fl_asn_.get(): mapped_fl_asn_;}
+    const IT *fl_points() const {return fl_bicriteria_points_ ? fl_bicriteria_points_->data(): mapped_fl_points_;}
+
     bool operator==(const CoresetSampler &o) const {
+        const FT *w = weight_data(), *ow = o.weight_data();
         return np_ == o.np_ &&
-                       std::equal(probs_.get(), probs_.get() + np_, o.probs_.get()) &&
-                      ((weights_.get() == nullptr && o.weights_.get() == nullptr) || // Both are nullptr or
-                        std::equal(weights_.get(), weights_.get() + np_, o.weights_.get())); // They're both the same
+                       std::equal(probs(), probs() + np_, o.probs()) &&
+                      ((w == nullptr && ow == nullptr) || // Both are nullptr or
+                        (w && ow && std::equal(w, w + np_, ow))); // They're both the same
     }
 
     std::string to_string() const {
@@ -236,35 +286,36 @@ struct CoresetSampler {
         gzclose(fp);
     }
     void write(gzFile fp) const {
-        if(fl_asn_ || fl_bicriteria_points_) throw std::runtime_error("Not implemented: serialization for FL coreset samplers");
+        if(fl_asn() || fl_points()) throw std::runtime_error("FL coreset samplers can only be serialized with write_binary");
         uint64_t n = np_;
         gzwrite(fp, &n, sizeof(n));
 #if VERBOSE_AF
-        std::fprintf(stderr, "Writing %zu\n", size_t(n));
+        MINOCORE_LOG("Writing %zu\n", size_t(n));
 #endif
         gzwrite(fp, &seed_, sizeof(seed_));
-        gzwrite(fp, &probs_[0], sizeof(probs_[0]) * np_);
-        uint32_t weights_present = weights_ ? 137: 0;
+        gzwrite(fp, probs(), sizeof(FT) * np_);
+        uint32_t weights_present = weight_data() ? 137: 0;
         gzwrite(fp, &weights_present, sizeof(weights_present));
-        if(weights_)
-            gzwrite(fp, weights_->data(), sizeof(weights_->operator[](0)) * np_);
+        if(weight_data())
+            gzwrite(fp, weight_data(), sizeof(FT) * np_);
     }
     void write(std::FILE *fp) const {
         auto fd = ::fileno(fp);
         uint64_t n = np_;
         checked_posix_write(fd, &n, sizeof(n));
         checked_posix_write(fd, &seed_, sizeof(seed_));
-        checked_posix_write(fd, &probs_[0], sizeof(probs_[0]) * np_);
-        uint32_t weights_present = weights_ ? 137: 0;
+        checked_posix_write(fd, probs(), sizeof(FT) * np_);
+        uint32_t weights_present = weight_data() ? 137: 0;
         checked_posix_write(fd, &weights_present, sizeof(weights_present));
-        if(weights_)
-            checked_posix_write(fd, weights_->data(), sizeof(weights_->operator[](0)) * np_);
+        if(weight_data())
+            checked_posix_write(fd, weight_data(), sizeof(FT) * np_);
     }
     void read(gzFile fp) {
+        unmap();
         uint64_t n;
         gzread(fp, &n, sizeof(n));
 #if VERBOSE_AF
-        std::fprintf(stderr, "Reading %zu\n", size_t(n));
+        MINOCORE_LOG("Reading %zu\n", size_t(n));
 #endif
         np_ = n;
         gzread(fp, &seed_, sizeof(seed_));
@@ -280,6 +331,7 @@ struct CoresetSampler {
         sampler_.reset(new Sampler(probs_.get(), probs_.get() + n, seed_));
     }
     void read(std::FILE *fp) {
+        unmap();
         uint64_t n;
         auto fd = ::fileno(fp);
         ::read(fd, &n, sizeof(n));
@@ -296,6 +348,62 @@ struct CoresetSampler {
         sampler_.reset(new Sampler(probs_.get(), probs_.get() + n, seed_));
     }
 
+    static constexpr const char *BINARY_MAGIC = "MNCSMPLR";
+    /*
+     * Versioned, aligned binary layout (see binary_format.h).
+     * Sections: 0 probs, 1 alias probabilities, 2 aliases, 3 weights, 4 FL bicriteria points, 5 FL assignments.
+     * Storing the alias table lets map() sample directly from the file without rebuilding it.
+     */
+    void write_binary(const std::string &path) const {
+        if(!ready()) throw std::runtime_error("Sampler not constructed");
+        io::SectionWriter<> sw(path);
+        io::FileHeader hdr{};
+        io::set_magic(hdr, BINARY_MAGIC);
+        hdr.ft_size = sizeof(FT); hdr.it_size = sizeof(IT);
+        hdr.n = np_; hdr.k = k_; hdr.b = b_; hdr.seed = seed_;
+        hdr.sens = sens_;
+        hdr.offsets[0] = sw.write(probs(), sizeof(FT) * np_);
+        hdr.offsets[1] = sw.write(sampler_->probabilities(), sizeof(FT) * np_);
+        hdr.offsets[2] = sw.write(sampler_->aliases(), sizeof(IT) * np_);
+        if(auto w = weight_data()) {
+            hdr.flags |= 1;
+            hdr.offsets[3] = sw.write(w, sizeof(FT) * np_);
+        }
+        if(auto fp = fl_points()) {
+            hdr.flags |= 2;
+            hdr.offsets[4] = sw.write(fp, sizeof(IT) * b_);
+        }
+        if(auto fa = fl_asn()) {
+            hdr.flags |= 4;
+            hdr.offsets[5] = sw.write(fa, sizeof(IT) * np_);
+        }
+        sw.finish(hdr);
+    }
+    /*
+     * Maps a file written by write_binary read-only and samples from it in place.
+     * The mapping is shared, so many processes can load the same sampler at the cost of faulting in pages.
+     */
+    static CoresetSampler map(const std::string &path, bool verify_checksum=true) {
+        CoresetSampler ret;
+        ret.mapping_ = std::make_shared<mio::mmap_source>(path);
+        const auto &ms = *ret.mapping_;
+        const auto &hdr = io::validate(ms, BINARY_MAGIC, sizeof(FT), sizeof(IT), verify_checksum);
+        ret.np_ = hdr.n; ret.k_ = hdr.k; ret.b_ = hdr.b; ret.seed_ = hdr.seed;
+        ret.sens_ = static_cast<SensitivityMethod>(hdr.sens);
+        ret.mapped_probs_ = io::section<FT>(ms, hdr, 0, ret.np_);
+        ret.sampler_.reset(new Sampler(io::section<FT>(ms, hdr, 1, ret.np_), io::section<IT>(ms, hdr, 2, ret.np_), ret.np_, ret.seed_));
+        if(hdr.flags & 1) ret.mapped_weights_   = io::section<FT>(ms, hdr, 3, ret.np_);
+        if(hdr.flags & 2) ret.mapped_fl_points_ = io::section<IT>(ms, hdr, 4, ret.b_);
+        if(hdr.flags & 4) ret.mapped_fl_asn_    = io::section<IT>(ms, hdr, 5, ret.np_);
+        return ret;
+    }
+    void unmap() {
+        mapped_probs_ = mapped_weights_ = nullptr;
+        mapped_fl_points_ = mapped_fl_asn_ = nullptr;
+        sampler_.reset();
+        mapping_.reset();
+    }
+
     template<typename CFT>
     void make_gmm_sampler(size_t ncenters,
                       const CFT *costs, const IT *assignments,
@@ -360,7 +468,10 @@ struct CoresetSampler {
                       const IT *centerids = nullptr, // Necessary for FL sampling, otherwise useless
                       double alpha_est=0.)
     {
+        MINOCORE_PHASE("CoresetSampler::make_sampler");
+        unmap();
         sens_ = sens;
+        seed_ = seed;
         np_ = np;
         b_ = ncenters;
         if(!k) k = ncenters;
@@ -368,7 +479,7 @@ struct CoresetSampler {
         if(weights) {
             weights_.reset(new blaze::DynamicVector<FT>(np_));
             std::memcpy(weights_->data(), weights, sizeof(FT) * np_);
-        } else weights_.release();
+        } else weights_.reset();
         if(sens == LUCIC_FAULKNER_KRAUSE_FELDMAN) {
             make_gmm_sampler(ncenters, costs, assignments, seed, alpha_est);
         } else if(sens == VARADARAJAN_XIAO) {
@@ -391,35 +502,18 @@ struct CoresetSampler {
                          const CFT *costs, const IT *assignments,
                          uint64_t seed=137)
     {
-        auto cv = blaze::CustomVector<CFT, blaze::unaligned, blaze::unpadded>(const_cast<CFT *>(costs), np_);
-        double total_cost =
-            weights_ ? blaze::dot(*weights_, cv)
-                     : blaze::sum(cv);
+        const auto sums = cluster_sums(ncenters, costs, assignments);
         probs_.reset(new FT[np_]);
-        blaze::CustomVector<FT, blaze::unaligned, blaze::unpadded> sensitivies(probs_.get(), np_);
-        std::vector<IT> center_counts(ncenters);
-        OMP_PFOR
-        for(size_t i = 0; i < np_; ++i) {
-            OMP_ATOMIC
-            ++center_counts[assignments[i]];
-        }
-        if(weights_) {
-            sensitivies = (*weights_) * cv * (1. / total_cost);
-        } else {
-            sensitivies = cv * (1. / total_cost);
-        }
-        // sensitivities = weights * costs / total_cost
-        blaze::DynamicVector<FT> ccinv(ncenters);
+        const double tcinv = 1. / sums.total_cost;
+        std::vector<double> ccinv(ncenters);
         for(unsigned i = 0; i < ncenters; ++i)
-            ccinv[i] = 1. / center_counts[i];
-        OMP_PFOR
-        for(size_t i = 0; i < np_; ++i) {
-            sensitivies[i] += ccinv[assignments[i]];
-        }
+            ccinv[i] = 1. / sums.counts[i];
         // sensitivities = weights * costs / total_cost + 1. / (cluster_size)
-        const double total_sensitivity = blaze::sum(sensitivies);
+        OMP_PFOR
+        for(size_t i = 0; i < np_; ++i)
+            probs_[i] = getweight(i) * costs[i] * tcinv + ccinv[assignments[i]];
         // probabilities = sensitivity / sum(sensitivities) [use the same location in memory because we no longer need sensitivities]
-        sensitivies *= 1. / total_sensitivity;
+        normalize_probs();
         sampler_.reset(new Sampler(probs_.get(), probs_.get() + np_, seed));
     }
     template<typename CFT>
@@ -436,12 +530,11 @@ struct CoresetSampler {
             else fl_bicriteria_points_->resize(b_);
             *fl_bicriteria_points_ = blaze::CustomVector<const IT, blaze::unaligned, blaze::unpadded>(bicriteria_centers, b_);
         }
-        auto cv = blaze::CustomVector<CFT, blaze::unaligned, blaze::unpadded>(const_cast<CFT *>(costs), np_);
-        auto total_cost =
-            weights_ ? blaze::dot(*weights_, cv)
-                     : blaze::sum(cv);
+        double total_cost = 0.;
+        OMP_PRAGMA("omp parallel for reduction(+:total_cost)")
+        for(size_t i = 0; i < np_; ++i)
+            total_cost += getweight(i) * costs[i];
         probs_.reset(new FT[np_]);
-        sampler_.reset(new Sampler(probs_.get(), probs_.get() + np_, seed));
         double total_cost_inv = 1. / (total_cost);
         if(weights_) {
             OMP_PFOR
@@ -449,8 +542,11 @@ struct CoresetSampler {
                 probs_[i] = getweight(i) * (costs[i]) * total_cost_inv;
             }
         } else {
-            blaze::CustomVector<FT, blaze::unaligned, blaze::unpadded> probv(const_cast<FT *>(probs_.get()), np_);
-            probv = blaze::ceil(FT(np_) * total_cost_inv * cv) + 1.;
+            const double mul = np_ * total_cost_inv;
+            OMP_PFOR
+            for(size_t i = 0; i < np_; ++i)
+                probs_[i] = std::ceil(mul * costs[i]) + 1.;
+            normalize_probs();
         }
         sampler_.reset(new Sampler(probs_.get(), probs_.get() + np_, seed));
     }
@@ -460,40 +556,21 @@ struct CoresetSampler {
                           uint64_t seed=137)
     {
         const double alpha = 16 * std::log(k_) + 32., alpha2 = 2. * alpha;
-
-        //auto center_counts = std::make_unique<IT[]>(ncenters);
-        blaze::DynamicVector<FT> weight_sums(ncenters, FT(0));
-        blaze::DynamicVector<FT> cost_sums(ncenters, FT(0));
-
-        double total_costs(0.);
-        OMP_PRAGMA("omp parallel for reduction(+:total_costs)")
-        for(size_t i = 0; i < np_; ++i) {
-            const auto asn = assignments[i];
-            assert(asn < ncenters);
-            const auto w = getweight(i);
-
-            OMP_ATOMIC
-            weight_sums[asn] += w; // If unweighted, weights are 1.
-            //OMP_ATOMIC
-            //++center_counts[asn];
-
-            const double pointcost = w * costs[i];
-            OMP_ATOMIC
-            cost_sums[asn] += pointcost;
-            total_costs += w * costs[i];
-        }
-        double weight_sum = blaze::sum(weight_sums);
-        total_costs /= weight_sum;
+        const auto sums = cluster_sums(ncenters, costs, assignments);
+        const double weight_sum = sums.total_weight;
+        const double total_costs = sums.total_cost / weight_sum;
         const double tcinv = alpha / total_costs;
-        blaze::DynamicVector<FT> sens(np_);
+        std::vector<double> cluster_terms(ncenters);
         for(size_t i = 0; i < ncenters; ++i) {
-            cost_sums[i] = alpha2 * cost_sums[i] / (weight_sums[i] * total_costs) + 4 * weight_sum / weight_sums[i];
+            cluster_terms[i] = alpha2 * sums.costs[i] / (sums.weights[i] * total_costs) + 4 * weight_sum / sums.weights[i];
         }
+        probs_.reset(new FT[np_]);
         OMP_PFOR
         for(size_t i = 0; i < np_; ++i) {
-            sens[i] = tcinv * costs[i] + cost_sums[assignments[i]];
+            probs_[i] = tcinv * costs[i] + cluster_terms[assignments[i]];
         }
-        sampler_.reset(new Sampler(sens.data(), sens.data() + np_, seed));
+        normalize_probs();
+        sampler_.reset(new Sampler(probs_.get(), probs_.get() + np_, seed));
     }
     template<typename CFT>
     void make_sampler_bfl(size_t ncenters,
@@ -503,39 +580,88 @@ struct CoresetSampler {
         // This is for a bicriteria approximation
         // Use make_sampler_vx for a constant approximation for arbitrary metric spaces,
         // and make_sampler_lbk for bicriteria approximations for \mu-similar divergences.
-        auto cv = blaze::CustomVector<CFT, blaze::unaligned, blaze::unpadded>(const_cast<CFT *>(costs), np_);
-        double total_cost =
-            weights_ ? blaze::dot(*weights_, cv)
-                    : blaze::sum(cv);
+        const auto sums = cluster_sums(ncenters, costs, assignments);
+        const double total_cost = sums.total_cost;
+        std::vector<double> cluster_inv(ncenters);
+        for(size_t i = 0; i < ncenters; ++i)
+            cluster_inv[i] = 1. / (sums.weights[i] * sums.counts[i]);
         probs_.reset(new FT[np_]);
-        double total_probs = 0.;
-        std::vector<IT> center_counts(ncenters);
-        std::vector<FT> weight_sums(ncenters);
         OMP_PFOR
-        for(size_t i = 0; i < np_; ++i) {
-            const auto asn = assignments[i];
-            assert(asn < ncenters);
-            const auto w = getweight(i);
-            OMP_ATOMIC
-            weight_sums[asn] += w; // If unweighted, weights are 1.
-            OMP_ATOMIC
-            ++center_counts[asn];
-        }
-        OMP_PRAGMA("omp parallel for reduction(+:total_probs)")
         for(size_t i = 0; i < np_; ++i) {
             const auto w = getweight(i);
             double fraccost = w * costs[i] / total_cost;
-            const auto asn = assignments[i];
-            double fracw = w / (weight_sums[asn] * center_counts[asn]);
+            double fracw = w * cluster_inv[assignments[i]];
             probs_[i] = .5 * (fraccost + fracw);
-            total_probs += probs_[i];
         }
         // Because this doesn't necessarily sum to 1.
-        blaze::CustomVector<FT, blaze::unaligned, blaze::unpadded>(probs_.get(), np_) /= total_probs;
+        normalize_probs();
         sampler_.reset(new Sampler(probs_.get(), probs_.get() + np_, seed));
     }
     auto getweight(size_t ind) const {
-        return weights_ ? weights_->operator[](ind): static_cast<FT>(1.);
+        const FT *w = weight_data();
+        return w ? w[ind]: static_cast<FT>(1.);
+    }
+    /*
+     * Per-center point counts, weight sums and weighted cost sums.
+     * Each thread fills its own histogram over a static block of points, and these are summed pairwise in a tree,
+     * which avoids contention on the bins of a few large clusters.
+     * Fewer threads are used when k is large enough that zeroing and merging histograms would outweigh the points.
+     * nt sets the number of histograms instead (e.g., for testing); results do not otherwise depend on it beyond rounding.
+     */
+    struct ClusterSums {
+        std::vector<uint64_t> counts;
+        std::vector<double> weights, costs;
+        double total_weight = 0., total_cost = 0.;
+    };
+    template<typename CFT>
+    ClusterSums cluster_sums(size_t ncenters, const CFT *costs, const IT *assignments, size_t nt=0) const {
+        MINOCORE_PHASE("CoresetSampler::cluster_sums");
+        if(!nt) {
+            nt = 1;
+            OMP_ONLY(nt = std::max(size_t(1), std::min(size_t(omp_get_max_threads()), np_ / std::max(size_t(1), 4 * ncenters)));)
+        }
+        std::vector<uint64_t> counts(nt * ncenters);
+        std::vector<double> weights(nt * ncenters), csums(nt * ncenters);
+        OMP_PRAGMA("omp parallel num_threads(nt)")
+        {
+            size_t tid = 0;
+            OMP_ONLY(tid = omp_get_thread_num();)
+            uint64_t *const cp = &counts[tid * ncenters];
+            double *const wp = &weights[tid * ncenters], *const sp = &csums[tid * ncenters];
+            OMP_PRAGMA("omp for schedule(static)")
+            for(size_t i = 0; i < np_; ++i) {
+                const auto asn = assignments[i];
+                assert(asn < ncenters);
+                const double w = getweight(i);
+                ++cp[asn];
+                wp[asn] += w; // If unweighted, weights are 1.
+                sp[asn] += w * costs[i];
+            }
+        }
+        for(size_t stride = 1; stride < nt; stride <<= 1) {
+            const size_t npairs = (nt - stride + 2 * stride - 1) / (2 * stride);
+            OMP_PFOR
+            for(size_t idx = 0; idx < npairs * ncenters; ++idx) {
+                const size_t dst = (idx / ncenters) * 2 * stride, src = dst + stride, j = idx % ncenters;
+                counts[dst * ncenters + j] += counts[src * ncenters + j];
+                weights[dst * ncenters + j] += weights[src * ncenters + j];
+                csums[dst * ncenters + j] += csums[src * ncenters + j];
+            }
+        }
+        counts.resize(ncenters); weights.resize(ncenters); csums.resize(ncenters);
+        ClusterSums ret{std::move(counts), std::move(weights), std::move(csums)};
+        ret.total_weight = std::accumulate(ret.weights.begin(), ret.weights.end(), 0.);
+        ret.total_cost = std::accumulate(ret.costs.begin(), ret.costs.end(), 0.);
+        return ret;
+    }
+    // Scales probs_ to sum to 1
+    void normalize_probs() {
+        double total = 0.;
+        OMP_PRAGMA("omp parallel for reduction(+:total)")
+        for(size_t i = 0; i < np_; ++i) total += probs_[i];
+        const double inv = 1. / total;
+        OMP_PFOR
+        for(size_t i = 0; i < np_; ++i) probs_[i] *= inv;
     }
     struct importance_compare {
         bool operator()(const std::pair<IT, FT> lh, const std::pair<IT, FT> rh) const {
@@ -553,7 +679,7 @@ struct CoresetSampler {
         importance_queue topk;
         std::pair<IT, FT> cpoint;
         for(size_t i = 0; i < size(); ++i) {
-            FT pi = probs_[i];
+            FT pi = probs()[i];
             if(topk.size() < n) {
                 cpoint = {IT(i), pi};
                 topk.push(cpoint);
@@ -581,28 +707,60 @@ struct CoresetSampler {
         if(seed) sampler_->seed(seed);
         IndexCoreset<IT, FT> ret(n);
         const double dn = n;
+        const FT *const pp = probs();
         for(size_t i = 0; i < n; ++i) {
             const auto ind = sampler_->sample();
             assert(ind < np_);
             ret.indices_[i] = ind;
-            ret.weights_[i] = getweight(ind) / (dn * probs_[ind]);
+            ret.weights_[i] = getweight(ind) / (dn * pp[ind]);
         }
-        if(sens_ == FL && fl_bicriteria_points_) {
-            assert(fl_bicriteria_points_->size() == b_);
-            std::unique_ptr<FT[]> wsums(new FT[b_]());
-            auto &bicp = *fl_bicriteria_points_;
-            for(size_t i = 0; i < n; ++i)
-                wsums[fl_asn_[i]] += ret.weights_[i];
-            const double wmul = (1. + 10. * eps) * b_;
-            ret.resize(n + b_);
-            for(size_t i = n; i < ret.size(); ++i) {
-                ret.indices_[i] = bicp[i - n];
-                ret.weights_[i] = std::max(wmul - wsums[i - n], 0.);
+        add_fl_points(ret, eps);
+        return ret;
+    }
+    /*
+     * Coresets for each of sizes from a single draw of max(sizes) points:
+     * the coreset for size n is the first n points drawn, reweighted for n,
+     * and so is distributed exactly as sample(n).
+     * Smaller coresets are subsets of larger ones, so per-point work (e.g., shortest-path rows) can be shared across sizes.
+     */
+    std::vector<IndexCoreset<IT, FT>> sample_nested(const std::vector<size_t> &sizes, uint64_t seed=0, double eps=0.1) {
+        if(unlikely(!sampler_.get())) throw std::runtime_error("Sampler not constructed");
+        if(seed) sampler_->seed(seed);
+        const size_t nmax = sizes.empty() ? size_t(0): *std::max_element(sizes.begin(), sizes.end());
+        std::vector<IT> draws(nmax);
+        for(auto &d: draws) d = sampler_->sample();
+        const FT *const pp = probs();
+        std::vector<IndexCoreset<IT, FT>> ret;
+        ret.reserve(sizes.size());
+        for(const size_t n: sizes) {
+            IndexCoreset<IT, FT> cs(n);
+            const double dn = n;
+            for(size_t i = 0; i < n; ++i) {
+                cs.indices_[i] = draws[i];
+                cs.weights_[i] = getweight(draws[i]) / (dn * pp[draws[i]]);
             }
+            add_fl_points(cs, eps);
+            ret.emplace_back(std::move(cs));
         }
         return ret;
     }
     size_t size() const {return np_;}
+private:
+    // FL coresets also carry the bicriteria points, weighted to make up their clusters' shortfall
+    void add_fl_points(IndexCoreset<IT, FT> &ret, double eps) const {
+        if(sens_ != FL || !fl_points()) return;
+        const size_t n = ret.size();
+        std::unique_ptr<FT[]> wsums(new FT[b_]());
+        const IT *bicp = fl_points(), *asn = fl_asn();
+        for(size_t i = 0; i < n; ++i)
+            wsums[asn[ret.indices_[i]]] += ret.weights_[i];
+        const double wmul = (1. + 10. * eps) * b_;
+        ret.resize(n + b_);
+        for(size_t i = n; i < ret.size(); ++i) {
+            ret.indices_[i] = bicp[i - n];
+            ret.weights_[i] = std::max(wmul - wsums[i - n], 0.);
+        }
+    }
 };
 
 
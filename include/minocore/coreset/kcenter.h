@@ -1,6 +1,7 @@
 #ifndef FGC_KCENTER_CORESET_H__
 #define FGC_KCENTER_CORESET_H__
 #include "minocore/optim/kcenter.h"
+#include "minocore/util/trace.h"
 
 namespace minocore {
 namespace coresets {
@@ -83,7 +84,7 @@ kcenter_bicriteria(Iter first, Iter end, RNG &rng, size_t, double eps,
     assert(end > first);
     size_t np = end - first;
     const size_t z = std::ceil(gamma * np);
-    std::fprintf(stderr, "z: %zu\n", z);
+    MINOCORE_LOG("z: %zu\n", z);
     size_t farthestchunksize = std::ceil((1 + eps) * z),
            samplechunksize = std::ceil(std::log(1./eta) / (1 - gamma));
     IVec<IT> ret;
@@ -99,10 +100,10 @@ kcenter_bicriteria(Iter first, Iter end, RNG &rng, size_t, double eps,
     }
     assert(flat_hash_set<IT>(ret.begin(), ret.end()).size() == ret.size());
     if(samplechunksize > 100) {
-        std::fprintf(stderr, "Warning: with samplechunksize %zu, it may end up taking a decent amount of time. Consider swapping this in for a hash set.", samplechunksize);
+        MINOCORE_LOG("Warning: with samplechunksize %zu, it may end up taking a decent amount of time. Consider swapping this in for a hash set.\n", samplechunksize);
     }
     if(samplechunksize > farthestchunksize) {
-        std::fprintf(stderr, "samplecc is %zu (> fcs %zu). changing gcs to scc + z (%zu)\n", samplechunksize, farthestchunksize, samplechunksize + z);
+        MINOCORE_LOG("samplecc is %zu (> fcs %zu). changing gcs to scc + z (%zu)\n", samplechunksize, farthestchunksize, samplechunksize + z);
         farthestchunksize = samplechunksize + z;
     }
     fpq<IT, FT> pq(farthestchunksize);
@@ -189,7 +190,7 @@ kcenter_bicriteria(Iter first, Iter end, RNG &rng, size_t, double eps,
     bicret.centers() = std::move(ret);
     bicret.labels() = std::move(labels);
     bicret.outliers() = std::move(pq.getc());
-    std::fprintf(stderr, "outliers size: %zu\n", bicret.outliers().size());
+    MINOCORE_LOG("outliers size: %zu\n", bicret.outliers().size());
     std::get<3>(bicret) = minmaxdist;
     return bicret;
     // center ids, label assignments for all points besides outliers, outliers, and the distance of the closest excluded point
@@ -261,7 +262,7 @@ kcenter_coreset_outliers(Iter first, Iter end, RNG &rng, size_t k, double eps=0.
     auto bic = kcenter_bicriteria(first, end, rng, k, eps,
                                   gamma, nrounds, eta, norm);
     double rtilde = bic.outlier_threshold();
-    std::fprintf(stderr, "outlier threshold: %f\n", rtilde);
+    MINOCORE_LOG("outlier threshold: %f\n", rtilde);
     auto &centers = bic.centers();
     auto &labels = bic.labels();
     auto &outliers = bic.outliers();
@@ -278,7 +279,7 @@ kcenter_coreset_outliers(Iter first, Iter end, RNG &rng, size_t k, double eps=0.
     SK_UNROLL_8
     do ++counts[labels[i++]]; while(i < np);
     coresets::IndexCoreset<IT, FT> ret(centers.size() + outliers.size());
-    std::fprintf(stderr, "ret size: %zu. centers size: %zu. counts size %zu. outliers size: %zu\n", ret.size(), centers.size(), counts.size(), outliers.size());
+    MINOCORE_LOG("ret size: %zu. centers size: %zu. counts size %zu. outliers size: %zu\n", ret.size(), centers.size(), counts.size(), outliers.size());
     for(i = 0; i < outliers.size(); ++i) {
         assert(outliers[i].second < np);
         ret.indices_[i] = outliers[i].second;
@@ -296,8 +297,148 @@ kcenter_coreset_outliers(Iter first, Iter end, RNG &rng, size_t k, double eps=0.
     }
     return ret;
 }
+
+/*
+// Composable (MapReduce-style) construction:
+// 1. Split the data into partitions, each of which builds its own (k, z)-center coreset
+//    (with its own outlier queue) independently, whether in threads or separate processes.
+// 2. Take the union of the coresets (merge_kcenter_coresets), which is itself a coreset for the full data.
+// 3. Resolve the union with a final weighted greedy pass (kcenter_greedy_2approx_outliers_weighted).
+// Each partition keeps all z outliers' worth of budget, since the outliers may all lie in a single partition.
+*/
+
+template<typename IT, typename FT>
+coresets::IndexCoreset<IT, FT>
+merge_kcenter_coresets(const std::vector<coresets::IndexCoreset<IT, FT>> &coresets, const std::vector<size_t> &offsets={}) {
+    // offsets[i], if provided, is added to the indices of coreset i to convert partition-local indices to global ones.
+    MINOCORE_VALIDATE(offsets.empty() || offsets.size() == coresets.size());
+    size_t total = 0;
+    for(const auto &cs: coresets) total += cs.size();
+    coresets::IndexCoreset<IT, FT> ret(total);
+    size_t i = 0;
+    for(size_t ci = 0; ci < coresets.size(); ++ci) {
+        const auto &cs = coresets[ci];
+        const IT offset = offsets.empty() ? IT(0): IT(offsets[ci]);
+        for(size_t j = 0; j < cs.size(); ++j, ++i) {
+            ret.indices_[i] = cs.indices_[j] + offset;
+            ret.weights_[i] = cs.weights_[j];
+        }
+    }
+    return ret;
+}
+
+/*
+// Greedy k-center with outliers over a weighted point set (e.g., a union of coresets).
+// indices are indices into [first, end); weights give the number of points each represents.
+// Each round excludes the farthest points with total weight at most z,
+// then samples the next center among the farthest points with total weight at most (1 + eps) z.
+// Returns centers (indices into the full data), labels (indices of the nearest center for each coreset point),
+// outliers (distance, index) and the radius of the non-outlier points.
+*/
+template<typename Iter, typename FT=shared::ContainedTypeFromIterator<Iter>,
+         typename IT=std::uint32_t, typename RNG, typename WFT, typename Norm=L2Norm>
+bicriteria_result_t<IT>
+kcenter_greedy_2approx_outliers_weighted(Iter first, const IT *indices, const WFT *weights, size_t n,
+                                         RNG &rng, size_t k, double z, double eps=0.1, const Norm &norm=Norm())
+{
+    auto dm = make_index_dm(first, norm);
+    MINOCORE_REQUIRE(n > 0, "Nonempty point set required");
+    std::vector<FT> distances(n, std::numeric_limits<FT>::max());
+    IVec<IT> centers, labels(n);
+    std::vector<IT> order(n);
+    IT newc = rng() % n;
+    std::vector<std::pair<double, IT>> outliers;
+    double radius = 0.;
+    for(;;) {
+        push_back(centers, indices[newc]);
+        OMP_PFOR
+        for(size_t i = 0; i < n; ++i) {
+            if(distances[i] == 0.) continue;
+            const FT d = i == newc ? FT(0): FT(dm(indices[i], indices[newc]));
+            if(d < distances[i]) distances[i] = d, labels[i] = centers.size() - 1;
+        }
+        std::iota(order.begin(), order.end(), IT(0));
+        shared::sort(order.begin(), order.end(), [&](auto x, auto y) {return distances[x] > distances[y];});
+        // Outliers: the farthest points with total weight <= z
+        double cw = 0.;
+        size_t nout = 0;
+        while(nout < n && cw + weights[order[nout]] <= z) cw += weights[order[nout++]];
+        radius = nout < n ? double(distances[order[nout]]): 0.;
+        if(centers.size() >= k || radius == 0.) {
+            outliers.resize(nout);
+            for(size_t i = 0; i < nout; ++i)
+                outliers[i] = {distances[order[i]], indices[order[i]]};
+            break;
+        }
+        // Candidates: the farthest points with total weight <= (1 + eps) z (at least one)
+        size_t ncand = nout;
+        while(ncand < n && (ncand == 0 || cw + weights[order[ncand]] <= (1. + eps) * z)) cw += weights[order[ncand++]];
+        ncand = std::max(ncand, size_t(1));
+        newc = order[rng() % ncand];
+        if(distances[newc] == 0.) newc = order[0];
+    }
+    bicriteria_result_t<IT> ret;
+    ret.centers() = std::move(centers);
+    ret.labels() = std::move(labels);
+    ret.outliers() = std::move(outliers);
+    std::get<3>(ret) = radius;
+    return ret;
+}
+
+/*
+// Builds a (k, z)-center coreset for each of npartitions contiguous partitions in parallel,
+// and returns their union (with global indices).
+// Parameters are as in kcenter_coreset_outliers; gamma is the fraction of outliers in the full dataset.
+*/
+template<typename Iter, typename FT=shared::ContainedTypeFromIterator<Iter>,
+         typename IT=std::uint32_t, typename RNG, typename Norm=L2Norm>
+coresets::IndexCoreset<IT, FT>
+kcenter_coreset_outliers_partitioned(Iter first, Iter end, RNG &rng, size_t k, unsigned npartitions, double eps=0.1, double mu=.5,
+                                     double rho=1.5, double gamma=0.001, double eta=0.01, const Norm &norm=Norm())
+{
+    const size_t np = end - first;
+    MINOCORE_VALIDATE(npartitions > 0);
+    npartitions = std::min(size_t(npartitions), np);
+    const double z = std::ceil(gamma * np);
+    std::vector<size_t> offsets(npartitions + 1);
+    for(unsigned i = 0; i <= npartitions; ++i)
+        offsets[i] = np * i / npartitions;
+    std::vector<uint64_t> seeds(npartitions);
+    for(auto &s: seeds) s = rng();
+    std::vector<coresets::IndexCoreset<IT, FT>> partition_coresets;
+    partition_coresets.reserve(npartitions);
+    for(unsigned i = 0; i < npartitions; ++i) partition_coresets.emplace_back(size_t(0));
+    OMP_PFOR_DYN
+    for(unsigned i = 0; i < npartitions; ++i) {
+        const size_t psz = offsets[i + 1] - offsets[i];
+        // Each partition may need to hold all of the outliers.
+        const double pgamma = std::min(1., z / psz);
+        wy::WyRand<IT, 2> prng(seeds[i]);
+        partition_coresets[i] = kcenter_coreset_outliers<Iter, FT, IT>(first + offsets[i], first + offsets[i + 1], prng, k, eps, mu,
+                                                                       rho, pgamma, eta, norm);
+    }
+    offsets.pop_back();
+    return merge_kcenter_coresets(partition_coresets, offsets);
+}
+
+/*
+// Full composable pipeline: partitioned coreset construction followed by a final greedy pass over the union.
+*/
+template<typename Iter, typename FT=shared::ContainedTypeFromIterator<Iter>,
+         typename IT=std::uint32_t, typename RNG, typename Norm=L2Norm>
+bicriteria_result_t<IT>
+kcenter_outliers_partitioned(Iter first, Iter end, RNG &rng, size_t k, unsigned npartitions, double eps=0.1, double mu=.5,
+                             double rho=1.5, double gamma=0.001, double eta=0.01, const Norm &norm=Norm())
+{
+    auto cs = kcenter_coreset_outliers_partitioned<Iter, FT, IT>(first, end, rng, k, npartitions, eps, mu, rho, gamma, eta, norm);
+    const double z = std::ceil(gamma * (end - first));
+    return kcenter_greedy_2approx_outliers_weighted<Iter, FT, IT>(first, cs.indices_.data(), cs.weights_.data(), cs.size(), rng, k, z, eps, norm);
+}
 } // namespace outliers
 using outliers::kcenter_coreset_outliers;
+using outliers::kcenter_coreset_outliers_partitioned;
+using outliers::kcenter_outliers_partitioned;
+using outliers::merge_kcenter_coresets;
 using outliers::kcenter_greedy_2approx_outliers;
 } // namespace coresets
 using coresets::outliers::kcenter_greedy_2approx_outliers;
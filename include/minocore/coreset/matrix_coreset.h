@@ -1,5 +1,6 @@
 #pragma once
 #include "minocore/coreset/coreset.h"
+#include "minocore/util/trace.h"
 
 namespace minocore {
 namespace coresets {
@@ -57,7 +58,7 @@ index2matrix(const IndexCoreset<IT, FT> &ic, const MatrixType &mat,
         for(size_t i = 0; i < icsz; ++i) assert(icdat[i] < mat.rows());
 #endif
         auto rows = blaze::rows(mat, icdat, icsz);
-        std::fprintf(stderr, "blaze row selection: %zu/%zu of matrix %zu/%zu\n", rows.rows(), rows.columns(), mat.rows(), mat.columns());
+        MINOCORE_LOG("blaze row selection: %zu/%zu of matrix %zu/%zu\n", rows.rows(), rows.columns(), mat.rows(), mat.columns());
         resize_and_assign(ret, rows);
     } else {
 #if !NDEBUG
@@ -67,7 +68,7 @@ index2matrix(const IndexCoreset<IT, FT> &ic, const MatrixType &mat,
         resize_and_assign(ret, columns);
     }
 #if !NDEBUG
-    std::fprintf(stderr, "Gathered pieces for index2matrix\n");
+    MINOCORE_LOG("Gathered pieces for index2matrix\n");
 #endif
     return MatrixCoreset<MatrixType, FT>{std::move(ret), std::move(weights), rowwise};
 } // index2matrix
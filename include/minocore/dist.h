@@ -3,4 +3,6 @@
 #include <minocore/dist/applicator.h>
 #include <minocore/dist/distance.h>
 #include <minocore/dist/knngraph.h>
+#include <minocore/dist/metrictree.h>
+#include <minocore/dist/quantized.h>
 #endif
@@ -5,8 +5,12 @@
 #include "minocore/dist/distance.h"
 #include "distmat/distmat.h"
 #include "minocore/optim/kmeans.h"
+#include "minocore/util/csc.h"
+#include "minocore/util/trace.h"
 #include <boost/math/special_functions/digamma.hpp>
 #include <boost/math/special_functions/polygamma.hpp>
+#include <atomic>
+#include <mutex>
 #include <set>
 
 
@@ -17,23 +21,72 @@ namespace jsd {
 using namespace blz;
 using namespace blz::distance;
 
+/*
+ * Distance oracle for one measure, fixed at compile time.
+ * Obtained from DissimilarityApplicator::with_kernel, which checks the prior and builds the derived caches once,
+ * so that calls neither switch on the measure nor re-check priors or caches per pair.
+ * CACHED: whether the derived matrix the measure reads is present (sqrts for Hellinger/Bhattacharyya,
+ * logs for the KL/Poisson family).
+ * VIA_CALL: evaluate through Applicator::call (sparse data with a prior, which those paths apply per entry).
+ */
+template<typename Applicator, DissimilarityMeasure M, bool CACHED=false, bool VIA_CALL=false>
+struct PairKernel {
+    using FT = typename Applicator::FT;
+    static constexpr DissimilarityMeasure measure = M;
+    const Applicator &app_;
+    PairKernel(const Applicator &app): app_(app) {}
+    size_t size() const {return app_.size();}
+    INLINE FT operator()(size_t i, size_t j) const {
+        MINOCORE_COUNT(DISTANCE_EVALS, 1);
+        if constexpr(VIA_CALL) return app_.template call<M>(i, j);
+        else                   return app_.template kernel_call<M, CACHED>(i, j);
+    }
+    // Row i against an external vector (e.g., a center), passing cache to the same measures as the applicator does
+    template<typename OT, typename CacheT=OT, typename=std::enable_if_t<!std::is_integral_v<OT>>>
+    INLINE FT operator()(size_t i, const OT &o, const CacheT *cache=static_cast<CacheT *>(nullptr)) const {
+        MINOCORE_COUNT(DISTANCE_EVALS, 1);
+        if constexpr(M == REVERSE_MKL || M == MKL || M == REVERSE_POISSON || M == POISSON || M == HELLINGER
+                     || M == LLR || M == UWLLR || M == OLLR || M == ITAKURA_SAITO)
+            return app_.template call<M>(i, o, cache);
+        else
+            return app_.template call<M>(i, o);
+    }
+};
+
 
 template<typename MatrixType>
 class DissimilarityApplicator {
     //using opposite_type = typename base_type::OppositeType;
     MatrixType &data_;
-    using VecT = blaze::DynamicVector<typename MatrixType::ElementType, IsRowMajorMatrix_v<MatrixType> ? blaze::rowVector: blaze::columnVector>;
+    // Compressed views (CSC/CSR over mmap'd files) are never modified;
+    // normalization and priors are applied on access, and derived values live in nnz-length arrays.
+    static constexpr bool IS_VIEW        = is_compressed_view_v<MatrixType>;
+    static constexpr bool IS_SPARSE      = IsSparseMatrix_v<MatrixType> || IS_VIEW;
+    static constexpr bool IS_DENSE_BLAZE = IsDenseMatrix_v<MatrixType>;
+    using VecT = blaze::DynamicVector<typename MatrixType::ElementType, (IS_VIEW || IsRowMajorMatrix_v<MatrixType>) ? blaze::rowVector: blaze::columnVector>;
     using matrix_type = MatrixType;
+    // Derived (log/sqrt) matrices are owned, so matrices over external buffers (e.g., blaze::CustomMatrix over NumPy data)
+    // store them in a DynamicMatrix of the same storage order.
+    using CacheMatrixType = std::conditional_t<IS_DENSE_BLAZE,
+        blaze::DynamicMatrix<typename MatrixType::ElementType, IsRowMajorMatrix_v<MatrixType> ? blaze::rowMajor: blaze::columnMajor>,
+        MatrixType>;
     VecT row_sums_;
-    std::unique_ptr<MatrixType> logdata_;
-    std::unique_ptr<MatrixType> sqrdata_;
+    // Full log/sqrt matrices are built on demand: see use_log_cache/use_sqrt_cache.
+    mutable std::unique_ptr<CacheMatrixType> logdata_;
+    mutable std::unique_ptr<CacheMatrixType> sqrdata_;
+    struct LazyCaches {
+        std::mutex lock;
+        std::atomic<bool> logs{false}, sqrts{false};
+        std::atomic<size_t> log_misses{0}, sqrt_misses{0};
+        bool automatic = true;
+    };
+    std::unique_ptr<LazyCaches> lazy_{new LazyCaches};
     std::unique_ptr<VecT> jsd_cache_;
     std::unique_ptr<VecT> prior_data_;
     std::unique_ptr<VecT> l2norm_cache_;
     std::unique_ptr<VecT> pl2norm_cache_;
+    blaze::DynamicVector<typename MatrixType::ElementType> logvals_, sqrtvals_; // Views only
     typename MatrixType::ElementType lambda_ = 0.5;
-    static constexpr bool IS_SPARSE      = IsSparseMatrix_v<MatrixType>;
-    static constexpr bool IS_DENSE_BLAZE = IsDenseMatrix_v<MatrixType>;
 public:
     using FT = typename MatrixType::ElementType;
     using MT = MatrixType;
@@ -72,18 +125,36 @@ public:
                 : measure == COSINE_DISTANCE ? COSINE_SIMILARITY
                 : measure == PROBABILITY_COSINE_DISTANCE ? PROBABILITY_COSINE_SIMILARITY
                 : measure;
-        for(size_t i = 0; i < nr; ++i) {
-            if constexpr((blaze::IsDenseMatrix_v<MatrixType>)) {
-                for(size_t j = i + 1; j < nr; ++j) {
-                    m(i, j) = this->call<actual_measure>(i, j);
+        // One kernel (and so one cache build) serves both triangles
+        with_kernel<actual_measure>([&](const auto &kernel) {
+            for(size_t i = 0; i < nr; ++i) {
+                if constexpr((blaze::IsDenseMatrix_v<MatrixType>)) {
+                    for(size_t j = i + 1; j < nr; ++j) {
+                        m(i, j) = kernel(i, j);
+                    }
+                } else {
+                    OMP_PFOR
+                    for(size_t j = i + 1; j < nr; ++j) {
+                        m(i, j) = kernel(i, j);
+                    }
                 }
-            } else {
-                OMP_PFOR
-                for(size_t j = i + 1; j < nr; ++j) {
-                    m(i, j) = this->call<actual_measure>(i, j);
+            }
+            if constexpr(!detail::is_symmetric(measure) && !dm::is_distance_matrix_v<MatType>) {
+                for(size_t i = 1; i < nr; ++i) {
+                    if constexpr((blaze::IsDenseMatrix_v<MatrixType>)) {
+                        for(size_t j = 0; j < i; ++j) {
+                            m(i, j) = kernel(i, j);
+                        }
+                    } else {
+                        OMP_PFOR
+                        for(size_t j = 0; j < i; ++j) {
+                            m(i, j) = kernel(i, j);
+                        }
+                    }
+                    m(i, i) = 0.;
                 }
             }
-        }
+        });
         if constexpr(measure == JSM) {
             if constexpr(blaze::IsDenseMatrix_v<MatType> || blaze::IsSparseMatrix_v<MatType>) {
                 m = blaze::sqrt(m);
@@ -108,28 +179,8 @@ public:
             if(symmetrize) {
                 fill_symmetric_upper_triangular(m);
             }
-        } else {
-            if constexpr(dm::is_distance_matrix_v<MatType>) {
-                std::fprintf(stderr, "Warning: using asymmetric measure with an upper triangular matrix. You are computing only half the values");
-            } else {
-                //std::fprintf(stderr, "Asymmetric measure %s/%s\n", detail::prob2str(measure), detail::prob2desc(measure));
-                for(size_t i = 1; i < nr; ++i) {
-                    if constexpr((blaze::IsDenseMatrix_v<MatrixType>)) {
-                        //std::fprintf(stderr, "Filling bottom half\n");
-                        for(size_t j = 0; j < i; ++j) {
-                            auto v = this->call<measure>(i, j);
-                            m(i, j) = v;
-                        }
-                    } else {
-                        OMP_PFOR
-                        for(size_t j = 0; j < i; ++j) {
-                            auto v = this->call<measure>(i, j);
-                            m(i, j) = v;
-                        }
-                    }
-                    m(i, i) = 0.;
-                }
-            }
+        } else if constexpr(dm::is_distance_matrix_v<MatType>) {
+            std::fprintf(stderr, "Warning: using asymmetric measure with an upper triangular matrix. You are computing only half the values");
         }
     } // set_distance_matrix
     template<typename MatType>
@@ -218,11 +269,114 @@ public:
 
     // Accessors
     decltype(auto) weighted_row(size_t ind) const {
-        return blaze::row(data_, ind BLAZE_CHECK_DEBUG) * row_sums_[ind];
+        if constexpr(IS_VIEW) return data_.row(ind, FT(1), prior_scalar(), prior_vector());
+        else                  return blaze::row(data_, ind BLAZE_CHECK_DEBUG) * row_sums_[ind];
+    }
+    auto row(size_t ind) const {
+        if constexpr(IS_VIEW) return data_.row(ind, FT(1) / row_sums_[ind], prior_scalar(), prior_vector());
+        else                  return blaze::row(data_, ind BLAZE_CHECK_DEBUG);
+    }
+    /*
+     * logrow and sqrtrow return views into the full log/sqrt matrices, building them on first use.
+     * After release_derived_caches, they are not rebuilt, and these throw: use with_logrow/with_sqrtrow instead.
+     * with_logrow and with_sqrtrow never build them: f receives the view if the matrix exists
+     * and otherwise an unevaluated expression, so the row is only computed as f reads it.
+     */
+    auto logrow(size_t ind) const {
+        if constexpr(!IS_VIEW) {
+            if(!has_log_cache() && lazy_->automatic) materialize_derived_caches(JSD);
+            MINOCORE_REQUIRE(has_log_cache(), "Log matrix was released; use with_logrow");
+        }
+        return cached_logrow(ind);
+    }
+    auto sqrtrow(size_t ind) const {
+        if constexpr(!IS_VIEW) {
+            if(!has_sqrt_cache() && lazy_->automatic) materialize_derived_caches(HELLINGER);
+            MINOCORE_REQUIRE(has_sqrt_cache(), "Sqrt matrix was released; use with_sqrtrow");
+        }
+        return cached_sqrtrow(ind);
+    }
+    template<typename F>
+    decltype(auto) with_logrow(size_t ind, F &&f) const {
+        if constexpr(!IS_VIEW) if(!has_log_cache()) return f(neginf2zero(blaze::log(row(ind))));
+        return f(cached_logrow(ind));
+    }
+    template<typename F>
+    decltype(auto) with_sqrtrow(size_t ind, F &&f) const {
+        if constexpr(!IS_VIEW) if(!has_sqrt_cache()) return f(blaze::sqrt(row(ind)));
+        return f(cached_sqrtrow(ind));
+    }
+    // Views into the log/sqrt matrices, for callers which have already checked that they exist
+    auto cached_logrow(size_t ind) const {
+        if constexpr(IS_VIEW) return data_.row(ind, logvals_.data());
+        else                  return blaze::row(*logdata_, ind BLAZE_CHECK_DEBUG);
+    }
+    auto cached_sqrtrow(size_t ind) const {
+        if constexpr(IS_VIEW) return data_.row(ind, sqrtvals_.data());
+        else                  return blaze::row(*sqrdata_, ind BLAZE_CHECK_DEBUG);
+    }
+    bool has_log_cache() const {
+        if constexpr(IS_VIEW) return logvals_.size();
+        else                  return lazy_->logs.load(std::memory_order_acquire);
+    }
+    bool has_sqrt_cache() const {
+        if constexpr(IS_VIEW) return sqrtvals_.size();
+        else                  return lazy_->sqrts.load(std::memory_order_acquire);
+    }
+    // sum_k p_k log p_k for row i; cached under measures which use logs
+    FT negentropy(size_t i) const {return get_jsdcache(i);}
+    /*
+     * Builds the full log and/or sqrt matrices used by measure, for callers about to evaluate many distances.
+     * Otherwise they are built once distance calls have computed rows() log (or sqrt) rows on the fly.
+     */
+    void materialize_derived_caches(DissimilarityMeasure measure) const {
+        if constexpr(!IS_VIEW) {
+            std::lock_guard<std::mutex> guard(lazy_->lock);
+            if(dist::detail::needs_logs(measure)) materialize_locked<true>();
+            if(dist::detail::needs_sqrt(measure)) materialize_locked<false>();
+        }
+    }
+    void materialize_derived_caches() const {materialize_derived_caches(measure_);}
+    /*
+     * Frees the full log/sqrt matrices and stops them from being rebuilt automatically;
+     * distance calls then compute derived rows on the fly.
+     * Meant for use alongside a quant::QuantizedApplicator, which keeps its own reduced-precision copy.
+     * Returns the number of bytes freed.
+     */
+    size_t release_derived_caches() {
+        size_t ret = 0;
+        if constexpr(!IS_VIEW) {
+            std::lock_guard<std::mutex> guard(lazy_->lock);
+            lazy_->automatic = false;
+            lazy_->logs.store(false);
+            lazy_->sqrts.store(false);
+            for(auto p: {&logdata_, &sqrdata_}) {
+                if(!*p) continue;
+                if constexpr(IS_DENSE_BLAZE) ret += (*p)->rows() * (*p)->columns() * sizeof(FT);
+                else                         ret += nonZeros(**p) * (sizeof(FT) + sizeof(size_t));
+                p->reset();
+            }
+        }
+        return ret;
+    }
+    /*
+     * Copies the (normalized) rows at ids into a CompressedMatrix.
+     * Used where a blaze matrix expression is needed, e.g., center updates over a compressed view.
+     */
+    template<typename IT>
+    blaze::CompressedMatrix<FT> gather_rows(const IT *ids, size_t n) const {
+        blaze::CompressedMatrix<FT> ret(n, data_.columns());
+        size_t nnz = 0;
+        for(size_t i = 0; i < n; ++i) nnz += nonZeros(row(ids[i]));
+        ret.reserve(nnz);
+        for(size_t i = 0; i < n; ++i) {
+            auto r = row(ids[i]);
+            for(auto it = r.begin(), e = r.end(); it != e; ++it)
+                ret.append(i, it->index(), it->value());
+            ret.finalize(i);
+        }
+        return ret;
     }
-    auto row(size_t ind) const {return blaze::row(data_, ind BLAZE_CHECK_DEBUG);}
-    auto logrow(size_t ind) const {return blaze::row(*logdata_, ind BLAZE_CHECK_DEBUG);}
-    auto sqrtrow(size_t ind) const {return blaze::row(*sqrdata_, ind BLAZE_CHECK_DEBUG);}
 
     /*
      * Distances
@@ -273,8 +427,12 @@ public:
         } else if constexpr(constexpr_measure == POISSON) {
             ret = cp ? pkl(o, i, *cp): pkl(o, i);
         } else if constexpr(constexpr_measure == HELLINGER) {
-            ret = cp ? blaze::sqrNorm(sqrtrow(i) - *cp)
-                     : blaze::sqrNorm(sqrtrow(i) - blaze::sqrt(o));
+            if(use_sqrt_cache())
+                ret = cp ? blaze::sqrNorm(cached_sqrtrow(i) - *cp)
+                         : blaze::sqrNorm(cached_sqrtrow(i) - blaze::sqrt(o));
+            else
+                ret = cp ? blaze::sqrNorm(blaze::sqrt(row(i)) - *cp)
+                         : blaze::sqrNorm(blaze::sqrt(row(i)) - blaze::sqrt(o));
         } else if constexpr(constexpr_measure == BHATTACHARYYA_METRIC) {
             ret = bhattacharyya_metric(i, o);
         } else if constexpr(constexpr_measure == BHATTACHARYYA_DISTANCE) {
@@ -340,10 +498,13 @@ public:
         } else if constexpr(constexpr_measure == POISSON) {
             ret = cp ? pkl(i, o, *cp): pkl(i, o);
         } else if constexpr(constexpr_measure == HELLINGER) {
-            if(cp) {
-                ret = blaze::sqrNorm(sqrtrow(i) - *cp);
+            if(!use_sqrt_cache()) {
+                ret = cp ? blaze::sqrNorm(blaze::sqrt(row(i)) - *cp)
+                         : blaze::sqrNorm(blaze::sqrt(row(i)) - blaze::sqrt(o));
+            } else if(cp) {
+                ret = blaze::sqrNorm(cached_sqrtrow(i) - *cp);
             } else {
-                ret = blaze::sqrNorm(sqrtrow(i) - blaze::sqrt(o));
+                ret = blaze::sqrNorm(cached_sqrtrow(i) - blaze::sqrt(o));
             }
         } else if constexpr(constexpr_measure == BHATTACHARYYA_METRIC) {
             ret = cp ? bhattacharyya_metric(i, o, *cp)
@@ -437,6 +598,7 @@ public:
     }
     template<typename OT, typename CacheT=OT, typename=std::enable_if_t<!std::is_integral_v<OT> > >
     INLINE FT operator()(const OT &o, size_t i, const CacheT *cache, DissimilarityMeasure measure) const noexcept {
+        MINOCORE_COUNT(DISTANCE_EVALS, 1);
 #ifndef NDEBUG
         if(unlikely(i >= data_.rows())) {
             std::cerr << (std::string("Invalid rows selection: ") + std::to_string(i) + '\n');
@@ -483,6 +645,7 @@ public:
     }
     template<typename OT, typename CacheT=OT, typename=std::enable_if_t<!std::is_integral_v<OT> > >
     INLINE FT operator()(size_t i, const OT &o, const CacheT *cache, DissimilarityMeasure measure) const noexcept {
+        MINOCORE_COUNT(DISTANCE_EVALS, 1);
         if(unlikely(i >= data_.rows())) {
             std::cerr << (std::string("Invalid rows selection: ") + std::to_string(i) + '\n');
             std::exit(1);
@@ -529,6 +692,7 @@ public:
         return ret;
     }
     INLINE FT operator()(size_t i, size_t j, DissimilarityMeasure measure) const noexcept {
+        MINOCORE_COUNT(DISTANCE_EVALS, 1);
         if(unlikely(i >= data_.rows() || j >= data_.rows())) {
             std::cerr << (std::string("Invalid rows selection: ") + std::to_string(i) + ", " + std::to_string(j) + '\n');
             std::exit(1);
@@ -563,6 +727,87 @@ public:
         }
         return ret;
     }
+    /*
+     * Bulk evaluation: calls func(kernel) with the PairKernel for measure and returns its result.
+     * The measure is resolved here, once, rather than per pair, as are the checks for priors the measure cannot use
+     * (which throw before any work is done) and whether the derived caches are present.
+     * Unless release_derived_caches has been called, the log/sqrt matrices the measure reads are built first.
+     */
+    template<typename Func>
+    decltype(auto) with_kernel(DissimilarityMeasure measure, const Func &func) const {
+        switch(measure) {
+            case TOTAL_VARIATION_DISTANCE: return with_kernel<TOTAL_VARIATION_DISTANCE>(func);
+            case L1: return with_kernel<L1>(func);
+            case L2: return with_kernel<L2>(func);
+            case SQRL2: return with_kernel<SQRL2>(func);
+            case JSD: return with_kernel<JSD>(func);
+            case JSM: return with_kernel<JSM>(func);
+            case REVERSE_MKL: return with_kernel<REVERSE_MKL>(func);
+            case MKL: return with_kernel<MKL>(func);
+            case EMD: return with_kernel<EMD>(func);
+            case WEMD: return with_kernel<WEMD>(func);
+            case REVERSE_POISSON: return with_kernel<REVERSE_POISSON>(func);
+            case POISSON: return with_kernel<POISSON>(func);
+            case HELLINGER: return with_kernel<HELLINGER>(func);
+            case BHATTACHARYYA_METRIC: return with_kernel<BHATTACHARYYA_METRIC>(func);
+            case BHATTACHARYYA_DISTANCE: return with_kernel<BHATTACHARYYA_DISTANCE>(func);
+            case LLR: return with_kernel<LLR>(func);
+            case UWLLR: return with_kernel<UWLLR>(func);
+            case OLLR: return with_kernel<OLLR>(func);
+            case ITAKURA_SAITO: return with_kernel<ITAKURA_SAITO>(func);
+            case REVERSE_ITAKURA_SAITO: return with_kernel<REVERSE_ITAKURA_SAITO>(func);
+            case COSINE_DISTANCE: return with_kernel<COSINE_DISTANCE>(func);
+            case PROBABILITY_COSINE_DISTANCE: return with_kernel<PROBABILITY_COSINE_DISTANCE>(func);
+            case COSINE_SIMILARITY: return with_kernel<COSINE_SIMILARITY>(func);
+            case PROBABILITY_COSINE_SIMILARITY: return with_kernel<PROBABILITY_COSINE_SIMILARITY>(func);
+            default: throw std::invalid_argument(std::string("No distance kernel for measure ") + dist::detail::prob2str(measure));
+        }
+    }
+    template<typename Func>
+    decltype(auto) with_kernel(const Func &func) const {return with_kernel(measure_, func);}
+    template<DissimilarityMeasure M, typename Func>
+    decltype(auto) with_kernel(const Func &func) const {
+        if constexpr(IS_SPARSE) {
+            if constexpr(M == ITAKURA_SAITO || M == REVERSE_ITAKURA_SAITO)
+                throw TODOError("Itakura-Saito is not implemented for sparse matrices");
+            if constexpr(M == BHATTACHARYYA_METRIC || M == BHATTACHARYYA_DISTANCE || M == LLR || M == UWLLR || M == OLLR)
+                if(prior_data_) throw TODOError("TODO: complete special fast version of this supporting priors at no runtime cost.");
+        }
+        if constexpr(!IS_VIEW) {
+            if(lazy_->automatic) materialize_derived_caches(M);
+        }
+        if constexpr(dist::detail::needs_sqrt(M)) {
+            if(has_sqrt_cache()) return func(PairKernel<This, M, true>(*this));
+            return func(PairKernel<This, M, false>(*this));
+        } else if constexpr(is_kl_family(M)) {
+            if(IS_SPARSE && prior_data_) return func(PairKernel<This, M, false, true>(*this));
+            // Views keep their logs alongside the data (logvals_), so they always take the cached path
+            if constexpr(!IS_VIEW) if(!has_log_cache()) return func(PairKernel<This, M, false>(*this));
+            return func(PairKernel<This, M, true>(*this));
+        } else return func(PairKernel<This, M>(*this));
+    }
+    // Per-pair body of PairKernel; call only through with_kernel, which establishes the preconditions.
+    template<DissimilarityMeasure M, bool CACHED>
+    INLINE FT kernel_call(size_t i, size_t j) const {
+        if constexpr(M == HELLINGER) {
+            if constexpr(CACHED) return blaze::sqrNorm(cached_sqrtrow(i) - cached_sqrtrow(j));
+            else                 return blaze::sqrNorm(blaze::sqrt(row(i)) - blaze::sqrt(row(j)));
+        } else if constexpr(M == BHATTACHARYYA_METRIC || M == BHATTACHARYYA_DISTANCE) {
+            FT sim;
+            if constexpr(CACHED) sim = blaze::dot(cached_sqrtrow(i), cached_sqrtrow(j));
+            else                 sim = blaze::sum(blaze::sqrt(row(i) * row(j)));
+            if constexpr(M == BHATTACHARYYA_METRIC) return std::sqrt(1 - sim);
+            else                                    return -std::log(sim);
+        } else if constexpr(is_kl_family(M)) {
+            // As mkl(i, j), for data without a prior, minus the per-pair log cache check
+            const size_t a = M == MKL || M == POISSON ? i: j, b = M == MKL || M == POISSON ? j: i;
+            if constexpr(CACHED) return FT(get_jsdcache(a) - blaze::dot(row(a), cached_logrow(b)));
+            else                 return FT(get_jsdcache(a) - blaze::dot(row(a), neginf2zero(blaze::log(row(b)))));
+        } else return call<M>(i, j);
+    }
+    static constexpr bool is_kl_family(DissimilarityMeasure M) {
+        return M == MKL || M == REVERSE_MKL || M == POISSON || M == REVERSE_POISSON;
+    }
     template<typename MatType>
     void operator()(MatType &mat, DissimilarityMeasure measure, bool symmetrize=false) {
         set_distance_matrix(mat, measure, symmetrize);
@@ -628,11 +873,11 @@ public:
     }
 
     auto hellinger(size_t i, size_t j) const {
-        return sqrdata_ ? blaze::sqrNorm(sqrtrow(i) - sqrtrow(j))
+        return use_sqrt_cache() ? blaze::sqrNorm(cached_sqrtrow(i) - cached_sqrtrow(j))
                         : blaze::sqrNorm(blaze::sqrt(row(i)) - blaze::sqrt(row(j)));
     }
     FT jsd(size_t i, size_t j) const {
-        if(!IsSparseMatrix_v<MatrixType> || !prior_data_) {
+        if(!IS_SPARSE || !prior_data_) {
             assert(i < data_.rows());
             assert(j < data_.rows());
             FT ret;
@@ -675,7 +920,6 @@ public:
                 const FT sump = (lhrsimul + rhrsimul);
                 ret -= blz::number_shared_zeros(lhr, rhr) * (sump * std::log(.5 * (sump)));
             } else {
-                std::fprintf(stderr, "Fanciest\n");
                 // This could later be accelerated, but that kind of caching is more complicated.
                 auto &pd = *prior_data_;
                 auto dox = [&](auto x, auto y) {ret -= (x + y) * std::log(.5 * (x + y));};
@@ -724,7 +968,12 @@ public:
     auto jsd(size_t i, const OT &o, const OT2 &olog) const {
         if(IS_SPARSE && blaze::IsSparseVector_v<OT> && prior_data_) throw TODOError("TODO: complete special fast version of this supporting priors at no runtime cost.");
         auto mnlog = evaluate(log(0.5 * (row(i) + o)));
-        return (blaze::dot(row(i), logrow(i) - mnlog) + blaze::dot(o, olog - mnlog));
+        if constexpr(!IS_SPARSE) {
+            // row(i) . logrow(i) is cached, so this does not read the log matrix
+            return get_jsdcache(i) - blaze::dot(row(i), mnlog) + blaze::dot(o, olog - mnlog);
+        } else {
+            return dot_logrow(row(i), i) - blaze::dot(row(i), mnlog) + blaze::dot(o, olog - mnlog);
+        }
     }
     template<typename OT, typename=std::enable_if_t<!std::is_integral_v<OT>>>
     auto jsd(size_t i, const OT &o) const {
@@ -839,7 +1088,7 @@ public:
                 return ret + get_jsdcache(i);
             }
         }
-        return FT(get_jsdcache(i) - blz::dot(row(i), logrow(j)));
+        return FT(get_jsdcache(i) - dot_logrow(row(i), j));
     }
     template<typename OT, typename=std::enable_if_t<!std::is_integral_v<OT>>>
     auto mkl(size_t i, const OT &o) const {
@@ -849,17 +1098,17 @@ public:
     template<typename OT, typename=std::enable_if_t<!std::is_integral_v<OT>>, typename OT2>
     auto mkl(const OT &o, size_t i, const OT2 &olog) const {
         if(IS_SPARSE && blaze::IsSparseVector_v<OT> && prior_data_) throw TODOError("TODO: complete special fast version of this supporting priors at no runtime cost.");
-        return blaze::dot(o, olog - logrow(i));
+        return blaze::dot(o, olog) - dot_logrow(o, i);
     }
     template<typename OT, typename=std::enable_if_t<!std::is_integral_v<OT>>>
     auto mkl(const OT &o, size_t i) const {
         if(IS_SPARSE && prior_data_) throw TODOError("TODO: complete special fast version of this supporting priors at no runtime cost.");
-        return blaze::dot(o, blaze::neginf2zero(blaze::log(o)) - logrow(i));
+        return blaze::dot(o, blaze::neginf2zero(blaze::log(o))) - dot_logrow(o, i);
     }
     template<typename OT, typename=std::enable_if_t<!std::is_integral_v<OT>>, typename OT2>
     auto mkl(size_t i, const OT &, const OT2 &olog) const {
         if(IS_SPARSE && prior_data_) throw TODOError("TODO: complete special fast version of this supporting priors at no runtime cost.");
-        return blaze::dot(row(i), logrow(i) - olog);
+        return (IS_SPARSE ? dot_logrow(row(i), i): get_jsdcache(i)) - blaze::dot(row(i), olog);
     }
     template<typename...Args>
     auto pkl(Args &&...args) const { return mkl(std::forward<Args>(args)...);}
@@ -869,13 +1118,13 @@ public:
     auto psm(Args &&...args) const { return jsm(std::forward<Args>(args)...);}
     auto bhattacharyya_sim(size_t i, size_t j) const {
         if(IS_SPARSE && prior_data_) throw TODOError("TODO: complete special fast version of this supporting priors at no runtime cost.");
-        return sqrdata_ ? blaze::dot(sqrtrow(i), sqrtrow(j))
+        return use_sqrt_cache() ? blaze::dot(cached_sqrtrow(i), cached_sqrtrow(j))
                         : blaze::sum(blaze::sqrt(row(i) * row(j)));
     }
     template<typename OT, typename=std::enable_if_t<!std::is_integral_v<OT>>, typename OT2>
     auto bhattacharyya_sim(size_t i, const OT &o, const OT2 &osqrt) const {
         if(IS_SPARSE && prior_data_) throw std::runtime_error("Failed to calculate. TODO: complete special fast version of this supporting priors at no runtime cost.");
-        return sqrdata_ ? blaze::dot(sqrtrow(i), osqrt)
+        return use_sqrt_cache() ? blaze::dot(cached_sqrtrow(i), osqrt)
                         : blaze::sum(blaze::sqrt(row(i) * o));
     }
     template<typename OT, typename=std::enable_if_t<!std::is_integral_v<OT>>>
@@ -963,14 +1212,66 @@ public:
     }
     auto get_measure() const {return measure_;}
 private:
+    template<bool LOGS>
+    void materialize_locked() const {
+        auto &ready = LOGS ? lazy_->logs: lazy_->sqrts;
+        if(ready.load(std::memory_order_relaxed)) return;
+        if constexpr(LOGS) {
+            MINOCORE_PHASE("applicator::materialize_logs");
+            logdata_.reset(new CacheMatrixType(neginf2zero(log(data_))));
+        } else {
+            MINOCORE_PHASE("applicator::materialize_sqrts");
+            sqrdata_.reset(new CacheMatrixType(blaze::sqrt(data_)));
+        }
+        ready.store(true, std::memory_order_release);
+    }
+    /*
+     * Whether to read the full log (sqrt) matrix rather than computing a row on the fly.
+     * Each on-the-fly row counts as a miss; after about rows() misses, the matrix is built,
+     * bounding the wasted work at one extra pass (plus up to MISS_BATCH rows per thread).
+     * A thread finding the build under way keeps computing rows.
+     */
+    static constexpr size_t MISS_BATCH = 64;
+    template<bool LOGS>
+    bool use_cache() const {
+        if constexpr(IS_VIEW) {
+            return LOGS ? logvals_.size(): sqrtvals_.size();
+        } else {
+            auto &ready = LOGS ? lazy_->logs: lazy_->sqrts;
+            if(ready.load(std::memory_order_acquire)) return true;
+            if(!lazy_->automatic) return false;
+            // Misses are tallied per thread and flushed to the shared count every MISS_BATCH,
+            // so threads do not contend on one cache line per distance call.
+            // A thread switching applicators drops its unflushed misses, which only delays the build.
+            thread_local struct {const LazyCaches *owner = nullptr; size_t n = 0;} pending;
+            if(pending.owner != lazy_.get()) pending.owner = lazy_.get(), pending.n = 0;
+            if(++pending.n < MISS_BATCH) return false;
+            pending.n = 0;
+            auto &misses = LOGS ? lazy_->log_misses: lazy_->sqrt_misses;
+            if(misses.fetch_add(MISS_BATCH, std::memory_order_relaxed) + MISS_BATCH <= data_.rows()) return false;
+            std::unique_lock<std::mutex> guard(lazy_->lock, std::try_to_lock);
+            if(!guard.owns_lock()) return false;
+            materialize_locked<LOGS>();
+            return true;
+        }
+    }
+    bool use_log_cache() const {return use_cache<true>();}
+    bool use_sqrt_cache() const {return use_cache<false>();}
+    // v . logrow(j), computing row j's logs on the fly if the log matrix has not been built
+    template<typename VT>
+    FT dot_logrow(const VT &v, size_t j) const {
+        if constexpr(IS_VIEW) return blaze::dot(v, logrow(j));
+        else return use_log_cache() ? FT(blaze::dot(v, cached_logrow(j)))
+                                    : FT(blaze::dot(v, neginf2zero(blaze::log(row(j)))));
+    }
     template<typename Container=blaze::DynamicVector<FT, blaze::rowVector>>
     void prep(Prior prior, const Container *c=nullptr) {
-        std::fprintf(stderr, "beginning prep.\n");
+        MINOCORE_PHASE("applicator::prep");
         switch(prior) {
             case NONE:
             break;
             case DIRICHLET:
-                if constexpr(!IsSparseMatrix_v<MatrixType>) {
+                if constexpr(!IS_SPARSE) {
                     data_ += static_cast<FT>(1);
                 } else {
                     prior_data_.reset(new VecT({FT(1)}));
@@ -978,7 +1279,7 @@ private:
                 break;
             case GAMMA_BETA:
                 if(c == nullptr) throw std::invalid_argument("Can't do gamma_beta with null pointer");
-                if constexpr(IsSparseMatrix_v<MatrixType>) {
+                if constexpr(IS_SPARSE) {
                     prior_data_.reset(new VecT({(*c)[0]}));
                 } else if constexpr(IsDenseMatrix_v<MatrixType>) {
                     data_ += (*c)[0];
@@ -988,7 +1289,7 @@ private:
                 if(c == nullptr) throw std::invalid_argument("Can't do feature-specific with null pointer");
                 if constexpr(IsDenseMatrix_v<MatrixType>) {
                     data_ += blaze::expand(*c, data_.rows());
-                } else if constexpr(IsSparseMatrix_v<MatrixType>) {
+                } else if constexpr(IS_SPARSE) {
                     assert(c->size() == data_.columns());
                     prior_data_.reset(new VecT(data_.columns()));
                     *prior_data_ = *c;
@@ -996,7 +1297,22 @@ private:
             break;
         }
         row_sums_.resize(data_.rows());
-        {
+        if constexpr(IS_VIEW) {
+            // Row sums only: the mapped data is read-only, so row() applies the prior and 1 / row_sum on access.
+            const FT prior_total = !prior_data_ ? FT(0)
+                                 : prior_data_->size() == 1 ? FT(data_.columns() * (*prior_data_)[0])
+                                 : FT(blaze::sum(*prior_data_));
+            OMP_PFOR
+            for(size_t i = 0; i < data_.rows(); ++i) {
+                FT countsum = 0;
+                for(size_t k = data_.indptr_[i], e = data_.indptr_[i + 1]; k < e; ++k)
+                    countsum += data_.data_[k];
+                row_sums_[i] = countsum + prior_total;
+            }
+        } else {
+            // Exceptions cannot leave the parallel loop, so the nonnegativity check is reported after it.
+            bool negative = false;
+            OMP_PRAGMA("omp parallel for reduction(|:negative)")
             for(size_t i = 0; i < data_.rows(); ++i) {
                 auto r(row(i));
                 FT countsum = blaze::sum(r);
@@ -1004,8 +1320,7 @@ private:
                     if(prior == NONE) {
                         r += 1e-50;
 #ifndef NDEBUG
-                        if(dist::detail::expects_nonnegative(measure_) && blaze::min(r) < 0.)
-                            throw std::invalid_argument(std::string("Measure ") + dist::detail::prob2str(measure_) + " expects nonnegative data");
+                        negative |= dist::detail::expects_nonnegative(measure_) && blaze::min(r) < 0.;
 #endif
                     }
                 } else if constexpr(blaze::IsSparseMatrix_v<MatrixType>) {
@@ -1026,14 +1341,28 @@ private:
                 r /= countsum;
                 row_sums_[i] = countsum;
             }
+            if(negative)
+                throw std::invalid_argument(std::string("Measure ") + dist::detail::prob2str(measure_) + " expects nonnegative data");
         }
 
-        if(dist::detail::needs_logs(measure_)) {
-            logdata_.reset(new MatrixType(neginf2zero(log(data_))));
-        }
-        if(dist::detail::needs_sqrt(measure_)) {
-            sqrdata_.reset(new MatrixType(blaze::sqrt(data_)));
+        if constexpr(IS_VIEW) {
+            const bool logs = dist::detail::needs_logs(measure_), sqrts = dist::detail::needs_sqrt(measure_);
+            if(logs) logvals_.resize(data_.nonZeros());
+            if(sqrts) sqrtvals_.resize(data_.nonZeros());
+            if(logs || sqrts) {
+                OMP_PFOR
+                for(size_t i = 0; i < data_.rows(); ++i) {
+                    auto r = row(i);
+                    size_t k = data_.indptr_[i];
+                    for(auto it = r.begin(), e = r.end(); it != e; ++it, ++k) {
+                        const FT v = it->value();
+                        if(logs) logvals_[k] = v > FT(0) ? FT(std::log(v)): FT(0);
+                        if(sqrts) sqrtvals_[k] = std::sqrt(v);
+                    }
+                }
+            }
         }
+        // Full log/sqrt matrices for other inputs are deferred until distance calls need them (see use_cache)
         if(dist::detail::needs_l2_cache(measure_)) {
             l2norm_cache_.reset(new VecT(data_.rows()));
             OMP_PFOR
@@ -1048,7 +1377,7 @@ private:
                 pl2norm_cache_->operator[](i) = 1. / blaze::l2Norm(row(i));
             }
         }
-        if(logdata_) {
+        if(dist::detail::needs_logs(measure_)) {
             jsd_cache_.reset(new VecT(data_.rows()));
             auto &jc = *jsd_cache_;
             if constexpr(IS_SPARSE) {
@@ -1057,6 +1386,7 @@ private:
                     MINOCORE_VALIDATE(prior_data_->size() == 1 || prior_data_->size() == data_.columns());
                     auto &pd = *prior_data_;
                     const bool single_value = pd.size() == 1;
+                    OMP_PFOR
                     for(size_t i = 0; i < data_.rows(); ++i) {
                         const auto rs = row_sums_[i];
                         auto r = row(i);
@@ -1066,7 +1396,7 @@ private:
                             FT invp = pd[0] / rs;
                             size_t number_zero = r.size() - nonZeros(r);
                             contrib += number_zero * (invp * std::log(invp)); // Empty
-                            for(auto &pair: r) upcontrib(pair.value());       // Non-empty
+                            for(auto it = r.begin(); it != r.end(); ++it) upcontrib(it->value()); // Non-empty
                         } else {
                             size_t i = 0;
                             auto it = r.begin();
@@ -1084,11 +1414,21 @@ private:
                     }
                 }
             }
-            if(!(IS_SPARSE && prior_data_))
-                for(size_t i = 0; i < jc.size(); ++i)
-                    jc[i] = dot(row(i), logrow(i));
+            if(!(IS_SPARSE && prior_data_)) {
+                OMP_PFOR
+                for(size_t i = 0; i < jc.size(); ++i) {
+                    if constexpr(IS_VIEW) jc[i] = dot(row(i), logrow(i));
+                    else                  jc[i] = dot(row(i), neginf2zero(blaze::log(row(i))));
+                }
+            }
         }
     }
+    FT prior_scalar() const {
+        return prior_data_ && prior_data_->size() == 1 ? (*prior_data_)[0]: FT(0);
+    }
+    const FT *prior_vector() const {
+        return prior_data_ && prior_data_->size() > 1 ? prior_data_->data(): static_cast<const FT *>(nullptr);
+    }
     FT get_jsdcache(size_t index) const {
         assert(jsd_cache_ && jsd_cache_->size() > index);
         return (*jsd_cache_)[index];
@@ -1161,13 +1501,13 @@ auto make_jsm_applicator(MatrixType &data, Prior prior=NONE, const PriorContaine
 template<typename MatrixType>
 auto make_kmc2(const DissimilarityApplicator<MatrixType> &app, unsigned k, size_t m=2000, uint64_t seed=13) {
     wy::WyRand<uint64_t> gen(seed);
-    return coresets::kmc2(app, gen, app.size(), k, m);
+    return app.with_kernel([&](const auto &kernel) {return coresets::kmc2(kernel, gen, app.size(), k, m);});
 }
 
 template<typename MatrixType, typename WFT=blaze::ElementType_t<MatrixType>>
 auto make_kmeanspp(const DissimilarityApplicator<MatrixType> &app, unsigned k, uint64_t seed=13, const WFT *weights=nullptr) {
     wy::WyRand<uint64_t> gen(seed);
-    return coresets::kmeanspp(app, gen, app.size(), k, weights);
+    return app.with_kernel([&](const auto &kernel) {return coresets::kmeanspp(kernel, gen, app.size(), k, weights);});
 }
 
 template<typename MatrixType, typename WFT=typename MatrixType::ElementType, typename IT=uint32_t>
@@ -1,28 +1,33 @@
+#pragma once
 #include "minocore/graph.h"
 #include "minocore/util/packed.h"
 #include "minocore/dist/applicator.h"
+#include "minocore/dist/metrictree.h"
 #include "minocore/hash/hash.h"
 #include <boost/graph/kruskal_min_spanning_tree.hpp>
+#include <numeric>
 
 namespace minocore {
 
 template<typename IT=uint32_t, typename MatrixType>
 std::vector<packed::pair<blaze::ElementType_t<MatrixType>, IT>> make_knns(const jsd::DissimilarityApplicator<MatrixType> &app, unsigned k) {
+    MINOCORE_PHASE("make_knns");
     using FT = blaze::ElementType_t<MatrixType>;
     static_assert(std::is_integral_v<IT>, "Sanity");
     static_assert(std::is_floating_point_v<FT>, "Sanity");
 
     MINOCORE_REQUIRE(std::numeric_limits<IT>::max() > app.size(), "sanity check");
     if(k > app.size()) {
-        std::fprintf(stderr, "Note: make_knn_graph was provided k (%u) > # points (%zu).\n", k, app.size());
+        MINOCORE_LOG("Note: make_knn_graph was provided k (%u) > # points (%zu).\n", k, app.size());
         k = app.size();
     }
+    if(!k) return {};
     const size_t np = app.size();
     const jsd::DissimilarityMeasure measure = app.get_measure();
     std::vector<packed::pair<FT, IT>> ret(k * np);
     std::vector<unsigned> in_set(np);
     const bool measure_is_sym = blz::detail::is_symmetric(measure);
-    const bool measure_is_dist = measure_is_dist;
+    const bool measure_is_dist = blz::detail::is_dissimilarity(measure);
     std::unique_ptr<std::mutex[]> locks;
     OMP_ONLY(locks.reset(new std::mutex[np]);)
 
@@ -44,10 +49,11 @@ std::vector<packed::pair<blaze::ElementType_t<MatrixType>, IT>> make_knns(const
                 auto startp = &ret[i * k];
                 auto stopp = startp + k;
                 if(measure_is_dist) std::pop_heap(startp, stopp, std::less<void>());
-                                    std::pop_heap(startp, stopp, std::greater<void>());
+                else                std::pop_heap(startp, stopp, std::greater<void>());
                 ret[(i + 1) * k - 1] = packed::pair<FT, IT>{d, j};
                 if(measure_is_dist) std::push_heap(startp, stopp, std::less<void>());
-                                    std::push_heap(startp, stopp, std::greater<void>());
+                else                std::push_heap(startp, stopp, std::greater<void>());
+                MINOCORE_COUNT(HEAP_OPS, 2);
             };
             if(cmp(d)) {
                 OMP_ONLY(std::lock_guard<std::mutex> lock(locks[i]);)
@@ -66,31 +72,35 @@ std::vector<packed::pair<blaze::ElementType_t<MatrixType>, IT>> make_knns(const
             shared::sort(ptr, end, std::less<>());
         else
             shared::sort(ptr, end, std::greater<>());
-        ptr = end;
     };
-    auto ptr = ret.data();
-    if(measure_is_sym) {
-        OMP_PFOR
-        for(size_t i = 0; i < np; ++i) {
-            for(size_t j = i + 1; j < np; ++j) {
-                auto d = app(i, j);
-                update_fwd(d, i, j);
-                update_fwd(d, j, i);
+    app.with_kernel([&](const auto &dist) {
+        if(measure_is_sym) {
+            OMP_PFOR_DYN
+            for(size_t i = 0; i < np; ++i) {
+                for(size_t j = i + 1; j < np; ++j) {
+                    auto d = dist(i, j);
+                    update_fwd(d, i, j);
+                    update_fwd(d, j, i);
+                }
+                VERBOSE_ONLY(std::fprintf(stderr, "[Symmetric:%s] Completed %zu/%zu\n", blz::detail::prob2str(measure), i + 1, np);)
             }
-            perform_sort(ptr);
-            std::fprintf(stderr, "[Symmetric:%s] Completed %zu/%zu\n", blz::detail::prob2str(measure), i + 1, np);
-        }
-    } else {
-        OMP_PFOR
-        for(size_t i = 0; i < np; ++i) {
-            for(size_t j = 0; j < np; ++j) {
-                update_fwd(app(i, j), i, j);
+        } else {
+            OMP_PFOR
+            for(size_t i = 0; i < np; ++i) {
+                for(size_t j = 0; j < np; ++j) {
+                    if(unlikely(j == i)) continue;
+                    update_fwd(dist(i, j), i, j);
+                }
+                VERBOSE_ONLY(std::fprintf(stderr, "[Asymmetric:%s] Completed %zu/%zu\n", blz::detail::prob2str(measure), i + 1, np);)
             }
-            perform_sort(ptr);
-            std::fprintf(stderr, "[Asymmetric:%s] Completed %zu/%zu\n", blz::detail::prob2str(measure), i + 1, np);
         }
-    }
-    std::fprintf(stderr, "Created knn graph for k = %u and %zu points\n", k, np);
+    });
+    // Rows can be updated by other threads until the above loops complete,
+    // so sorting has to wait until all rows are final.
+    OMP_PFOR
+    for(size_t i = 0; i < np; ++i)
+        perform_sort(ret.data() + i * k);
+    MINOCORE_LOG("Created knn graph for k = %u and %zu points\n", k, np);
     return ret;
 }
 
@@ -98,6 +108,7 @@ template<typename IT=uint32_t, typename MatrixType, typename Hasher, typename IT
 std::vector<packed::pair<blaze::ElementType_t<MatrixType>, IT>>
 make_knns_by_lsh(const jsd::DissimilarityApplicator<MatrixType> &app, hash::LSHTable<Hasher, IT2, KT> &table, unsigned k, unsigned maxlshcmp=0)
 {
+    MINOCORE_PHASE("make_knns_by_lsh");
     if(!maxlshcmp) maxlshcmp = 10 * k;
     using FT = blaze::ElementType_t<MatrixType>;
     static_assert(std::is_integral_v<IT>, "Sanity");
@@ -105,7 +116,7 @@ make_knns_by_lsh(const jsd::DissimilarityApplicator<MatrixType> &app, hash::LSHT
 
     MINOCORE_REQUIRE(std::numeric_limits<IT>::max() > app.size(), "sanity check");
     if(k > app.size()) {
-        std::fprintf(stderr, "Note: make_knn_graph was provided k (%u) > # points (%zu).\n", k, app.size());
+        MINOCORE_LOG("Note: make_knn_graph was provided k (%u) > # points (%zu).\n", k, app.size());
         k = app.size();
     }
     const size_t np = app.size();
@@ -113,7 +124,7 @@ make_knns_by_lsh(const jsd::DissimilarityApplicator<MatrixType> &app, hash::LSHT
     std::vector<packed::pair<FT, IT>> ret(k * np);
     std::vector<unsigned> in_set(np);
     const bool measure_is_sym = blz::detail::is_symmetric(measure);
-    const bool measure_is_dist = measure_is_dist;
+    const bool measure_is_dist = blz::detail::is_dissimilarity(measure);
     std::unique_ptr<std::mutex[]> locks;
     OMP_ONLY(locks.reset(new std::mutex[np]);)
     table.add(app.data());
@@ -138,6 +149,7 @@ make_knns_by_lsh(const jsd::DissimilarityApplicator<MatrixType> &app, hash::LSHT
                 std::pop_heap(startp, stopp, std::less<void>());
                 ret[(i + 1) * k - 1] = packed::pair<FT, IT>{d, j};
                 std::push_heap(startp, stopp, std::less<void>());
+                MINOCORE_COUNT(HEAP_OPS, 2);
             };
             if(cmp(d)) {
                 OMP_ONLY(std::lock_guard<std::mutex> lock(locks[i]);)
@@ -167,7 +179,7 @@ make_knns_by_lsh(const jsd::DissimilarityApplicator<MatrixType> &app, hash::LSHT
     for(size_t i = 0; i < np; ++i) {
         if(in_set[i] >= k) continue;
         ++number_exhaustive;
-        std::fprintf(stderr, "Warning: LSH table returned < k (%d) neighbors (only %d compared). Performing exhaustive comparisons for item %zu\n",
+        MINOCORE_LOG("Warning: LSH table returned < k (%d) neighbors (only %d compared). Performing exhaustive comparisons for item %zu\n",
                      k, in_set[i], i);
         OMP_PFOR
         for(size_t j = (measure_is_sym ? i + 1: size_t(0)); j < np; ++j) {
@@ -178,9 +190,9 @@ make_knns_by_lsh(const jsd::DissimilarityApplicator<MatrixType> &app, hash::LSHT
         }
     }
     if(number_exhaustive)
-        std::fprintf(stderr, "Performed quadratic distance comparisons with %zu/%zu items\n",
+        MINOCORE_LOG("Performed quadratic distance comparisons with %zu/%zu items\n",
                      number_exhaustive, np);
-    std::fprintf(stderr, "Created knn graph for k = %u and %zu points\n", k, np);
+    MINOCORE_LOG("Created knn graph for k = %u and %zu points\n", k, np);
     return ret;
 }
 
@@ -196,7 +208,7 @@ auto knns2graph(const std::vector<packed::pair<FT, IT>> &knns, size_t np, bool m
         for(unsigned j = 0; j < k; ++j) {
             if(mutual) {
                 if(symmetric) {
-                    if(p[j].first > knns[k * (p[j].second + 1) * k - 1].first)
+                    if(p[j].first > knns[(p[j].second + 1) * k - 1].first)
                         continue;
                 } else {
                     // More expensive (O(k) vs O(1)), but does not require the assumption of symmetry.
@@ -224,63 +236,407 @@ auto knng2mst(const Graph &gr) {
     return ret;
 }
 
-#if 0
-template<typename IT=uint32_t, typename MatrixType>
-auto perform_rcc(const jsd::DissimilarityApplicator<MatrixType> &app, unsigned k, bool mutual=true, size_t niter=100) {
+namespace rcc {
+
+/*
+ * Robust continuous clustering (Shah & Koltun, PNAS 2017)
+ *
+ * The optimization is performed on a sparse edge set (mutual kNN edges plus the MST of the kNN graph),
+ * stored both as an edge list (lhs_/rhs_) and as a CSR adjacency (indptr_/adj_/eid_).
+ * Edge weights (lpq) are updated in parallel over edges; the representative matrix U is
+ * updated by preconditioned conjugate gradient on (I + lambda * L) U = X, where L is the
+ * weighted graph Laplacian, using row-parallel CSR products and buffers which are allocated once.
+ * Memory is O(n * d + |E|); no n x d temporaries are created per iteration.
+ */
+
+template<typename IT=uint32_t>
+struct DisjointSets {
+    std::unique_ptr<IT[]> parents_;
+    size_t n_;
+    DisjointSets(size_t n): parents_(new IT[n]), n_(n) {
+        std::iota(parents_.get(), parents_.get() + n, IT(0));
+    }
+    IT find(IT x) {
+        while(parents_[x] != x) {
+            parents_[x] = parents_[parents_[x]];
+            x = parents_[x];
+        }
+        return x;
+    }
+    bool unite(IT x, IT y) {
+        x = find(x), y = find(y);
+        if(x == y) return false;
+        if(x > y) std::swap(x, y);
+        parents_[y] = x;
+        return true;
+    }
+    size_t size() const {return n_;}
+};
+
+template<typename FT=float, typename IT=uint32_t>
+struct EdgeCSR {
+    // Undirected edges, lhs_[i] < rhs_[i]
+    std::vector<IT> lhs_, rhs_;
+    // Initial (data-space) edge lengths
+    std::vector<FT> lengths_;
+    // CSR adjacency: for vertex i, neighbors adj_[indptr_[i]:indptr_[i + 1]], connected by edge eid_[...].
+    std::vector<size_t> indptr_;
+    std::vector<IT> adj_, eid_;
+    size_t nv_ = 0;
+
+    size_t num_edges() const {return lhs_.size();}
+    size_t num_vertices() const {return nv_;}
+    size_t degree(size_t i) const {return indptr_[i + 1] - indptr_[i];}
+
+    void build_adjacency() {
+        const size_t ne = num_edges();
+        indptr_.assign(nv_ + 1, size_t(0));
+        for(size_t i = 0; i < ne; ++i)
+            ++indptr_[lhs_[i] + 1], ++indptr_[rhs_[i] + 1];
+        std::partial_sum(indptr_.begin(), indptr_.end(), indptr_.begin());
+        adj_.resize(2 * ne);
+        eid_.resize(2 * ne);
+        std::vector<size_t> offsets(indptr_.begin(), indptr_.end() - 1);
+        for(size_t i = 0; i < ne; ++i) {
+            const IT lh = lhs_[i], rh = rhs_[i];
+            auto &lo = offsets[lh], &ro = offsets[rh];
+            adj_[lo] = rh; eid_[lo++] = i;
+            adj_[ro] = lh; eid_[ro++] = i;
+        }
+    }
+};
+
+namespace detail {
+
+template<typename MatrixType, typename FT>
+FT row_distance(const MatrixType &mat, size_t i, size_t j) {
+    return blaze::l2Norm(row(mat, i, blaze::unchecked) - row(mat, j, blaze::unchecked));
+}
+
+// Estimates the spectral norm of the data matrix by power iteration on X^T X.
+template<typename MatrixType>
+double spectral_norm_estimate(const MatrixType &mat, unsigned niter=20) {
     using FT = blaze::ElementType_t<MatrixType>;
-    auto graph = make_knn_graph(app, k);
-    auto mst = knng2mst(graph);
-    using eh_t = std::conditional_t<sizeof(IT) <= 4, uint64_t, std::pair<IT, IT> >;
-    shared::flat_hash_set<eh_t> edges;
-    auto add_edge = [&](auto edge) {
-        if constexpr(sizeof(IT) <= 4) {
-            uint64_t encoded = (uint64_t(boost::source(edge, graph)) << 32) | boost::target(edge, graph);
-            edges.insert(encoded);
-        } else {
-            edges.insert(eh_t(boost::source(edge, graph), boost::target(edge, graph)));
+    blaze::DynamicVector<FT> v(mat.columns(), FT(1) / std::sqrt(FT(mat.columns()))), xv(mat.rows());
+    double ret = 0.;
+    for(unsigned i = 0; i < niter; ++i) {
+        xv = mat * v;
+        v = blaze::trans(mat) * xv;
+        const double vn = blaze::l2Norm(v);
+        if(vn == 0.) return 0.;
+        ret = std::sqrt(vn);
+        v /= vn;
+    }
+    return ret;
+}
+
+// Estimates the spectral norm of the weighted adjacency matrix defined by the edge set and
+// per-edge weights by power iteration.
+template<typename FT, typename IT, typename WeightFunc>
+double adjacency_norm_estimate(const EdgeCSR<FT, IT> &edges, const WeightFunc &wfunc, unsigned niter=20) {
+    const size_t nv = edges.num_vertices();
+    blaze::DynamicVector<FT> v(nv, FT(1) / std::sqrt(FT(nv))), av(nv);
+    double ret = 0.;
+    for(unsigned iter = 0; iter < niter; ++iter) {
+        OMP_PFOR
+        for(size_t i = 0; i < nv; ++i) {
+            FT sum = 0.;
+            for(size_t ind = edges.indptr_[i]; ind < edges.indptr_[i + 1]; ++ind)
+                sum += wfunc(edges.eid_[ind]) * v[edges.adj_[ind]];
+            av[i] = sum;
+        }
+        const double an = blaze::l2Norm(av);
+        if(an == 0.) return 0.;
+        ret = an;
+        v = av / an;
+    }
+    return ret;
+}
+
+} // namespace detail
+
+/*
+ * Builds the RCC edge set from a set of k-nearest neighbor lists (as returned by make_knns).
+ * If mutual, only mutual kNN edges are kept, and the MST of the full kNN graph is added to prevent
+ * spurious disconnection. Edge lengths are Euclidean distances between rows of data.
+ */
+template<typename IT=uint32_t, typename MatrixType, typename KFT>
+auto make_rcc_edges(const MatrixType &data, const std::vector<packed::pair<KFT, IT>> &knns, bool mutual=true) {
+    using FT = blaze::ElementType_t<MatrixType>;
+    static_assert(sizeof(IT) <= 4, "Edge encoding requires IT to fit in 32 bits");
+    const size_t np = data.rows();
+    MINOCORE_REQUIRE(np, "nonempty");
+    MINOCORE_REQUIRE(knns.size() % np == 0, "knns must have k items per row");
+    const size_t k = knns.size() / np;
+    std::vector<uint64_t> encoded;
+    encoded.reserve(knns.size());
+    for(size_t i = 0; i < np; ++i) {
+        for(size_t j = 0; j < k; ++j) {
+            const uint64_t o = knns[i * k + j].second;
+            if(o == i) continue;
+            encoded.push_back(i < o ? (uint64_t(i) << 32) | o: (o << 32) | i);
         }
-    };
-    for(const auto edge: mst) {
-        add_edge(edge);
     }
-    for(const auto edge: graph.edges()) {
-        add_edge(edge);
+    shared::sort(encoded.begin(), encoded.end());
+    // An edge listed from both endpoints is mutual.
+    std::vector<uint64_t> candidates;
+    std::vector<uint8_t> is_mutual;
+    candidates.reserve(encoded.size());
+    is_mutual.reserve(encoded.size());
+    for(auto it = encoded.begin(), e = encoded.end(); it != e;) {
+        auto nit = std::find_if(it, e, [v=*it](auto x) {return x != v;});
+        candidates.push_back(*it);
+        is_mutual.push_back(nit - it > 1);
+        it = nit;
     }
-    size_t nedges = edges.size();
-    std::unique_ptr<IT[]> lhp(new IT[nedges]), rhp(new IT[nedges]);
-    size_t i = 0;
-    for(const auto &e: edges) {
-        lhp[i] = e.first;
-        rhp[i] = e.second;
-        ++i;
+    { std::vector<uint64_t> tmp(std::move(encoded)); }
+    const size_t ncand = candidates.size();
+    std::vector<FT> clengths(ncand);
+    OMP_PFOR
+    for(size_t i = 0; i < ncand; ++i)
+        clengths[i] = detail::row_distance<MatrixType, FT>(data, candidates[i] >> 32, candidates[i] & 0xFFFFFFFFull);
+    std::vector<uint8_t> keep(ncand, 1);
+    if(mutual) {
+        std::vector<IT> order(ncand);
+        std::iota(order.begin(), order.end(), IT(0));
+        shared::sort(order.begin(), order.end(), [&](auto x, auto y) {return clengths[x] < clengths[y];});
+        DisjointSets<IT> ds(np);
+        for(size_t i = 0; i < ncand; ++i)
+            keep[i] = is_mutual[i];
+        for(const auto ind: order)
+            if(ds.unite(candidates[ind] >> 32, candidates[ind] & 0xFFFFFFFFull))
+                keep[ind] = 1;
     }
-    // Free unneeded memory
-    { shared::flat_hash_set<eh_t> tmp(std::move(edges)); }
-    const double xi = blaze::norm(app.data());
-    blaze::DynamicMatrix<FT> U = app.data();
-    blaze::DynamicVector<FT> lpq(nedges, 1.);
-    blaze::DynamicVector<FT> epsilons = blaze::generate(nedges, [&](auto x) {
-        return app(lhp[x], rhp[x]);
-    });
-    shared::sort(epsilons.data(), epsilons.data() + nedges);
-    const int top_samples = std::minimum(250, int(std::ceil(nedges*0.01)));
-    double delta = blaze::mean(blaze::subvector(epsilons, 0, top_samples));
-    double eps   = blaze::mean(blaze::subvector(epsilons, 0, int(std::ceil(nedge * 0.01)));
-    const double mu = 3.0 * std::pow(epsilons[nedges - 1], 2.);
-    auto calculate_objective = [&]() {
-        auto dat = .5 * blaze::sum(blaze::pow(app.data() - U), 2.);
-        return dat;
+    EdgeCSR<FT, IT> ret;
+    ret.nv_ = np;
+    const size_t ne = std::accumulate(keep.begin(), keep.end(), size_t(0));
+    ret.lhs_.reserve(ne); ret.rhs_.reserve(ne); ret.lengths_.reserve(ne);
+    for(size_t i = 0; i < ncand; ++i) {
+        if(!keep[i]) continue;
+        ret.lhs_.push_back(candidates[i] >> 32);
+        ret.rhs_.push_back(candidates[i] & 0xFFFFFFFFull);
+        ret.lengths_.push_back(clengths[i]);
+    }
+    ret.build_adjacency();
+    return ret;
+}
+
+template<typename FT=float, typename IT=uint32_t>
+struct RCCResult {
+    blaze::DynamicMatrix<FT> representatives_;
+    std::vector<IT> labels_;
+    size_t nclusters_;
+    std::vector<double> objective_;
+    double delta_;
+};
+
+/*
+ * Assigns clusters as the connected components of the graph consisting
+ * of edges whose representatives are within delta of each other.
+ */
+template<typename FT, typename IT>
+size_t rcc_components(const blaze::DynamicMatrix<FT> &U, const EdgeCSR<FT, IT> &edges, FT delta, std::vector<IT> &labels) {
+    const size_t np = U.rows(), ne = edges.num_edges();
+    DisjointSets<IT> ds(np);
+    std::vector<uint8_t> connected(ne);
+    OMP_PFOR
+    for(size_t i = 0; i < ne; ++i)
+        connected[i] = detail::row_distance<blaze::DynamicMatrix<FT>, FT>(U, edges.lhs_[i], edges.rhs_[i]) < delta;
+    for(size_t i = 0; i < ne; ++i)
+        if(connected[i]) ds.unite(edges.lhs_[i], edges.rhs_[i]);
+    labels.resize(np);
+    std::vector<IT> relabel(np, std::numeric_limits<IT>::max());
+    size_t ncomp = 0;
+    for(size_t i = 0; i < np; ++i) {
+        auto &rl = relabel[ds.find(i)];
+        if(rl == std::numeric_limits<IT>::max()) rl = ncomp++;
+        labels[i] = rl;
+    }
+    return ncomp;
+}
+
+/*
+ * perform_rcc
+ * Runs RCC on the rows of data, given a sparse edge set (see make_rcc_edges).
+ * niter:    maximum number of outer iterations
+ * cg_iter:  maximum number of CG iterations per U update
+ * cg_tol:   relative residual tolerance for the CG solve
+ * tol:      relative objective change at which to terminate once the graduated nonconvexity schedule has completed
+ */
+template<typename IT=uint32_t, typename MatrixType, typename FT=blaze::ElementType_t<MatrixType>>
+RCCResult<FT, IT> perform_rcc(const MatrixType &data, const EdgeCSR<FT, IT> &edges, size_t niter=100, unsigned cg_iter=50,
+                              double cg_tol=1e-4, double tol=1e-5)
+{
+    static_assert(std::is_floating_point_v<FT>, "Sanity");
+    const size_t np = data.rows(), nd = data.columns(), ne = edges.num_edges();
+    MINOCORE_REQUIRE(edges.num_vertices() == np, "Edge set must match the data");
+    MINOCORE_REQUIRE(ne > 0, "RCC requires a nonempty edge set");
+    RCCResult<FT, IT> ret;
+    auto &U = ret.representatives_;
+    U = data;
+
+    // Edge weights w_pq = mean(degree) / sqrt(degree_p * degree_q)
+    const FT mean_degree = FT(2. * ne / np);
+    std::vector<FT> w(ne), lpq(ne, FT(1)), ewl(ne);
+    OMP_PFOR
+    for(size_t i = 0; i < ne; ++i)
+        w[i] = mean_degree / std::sqrt(FT(edges.degree(edges.lhs_[i]) * edges.degree(edges.rhs_[i])));
+
+    // Graduated nonconvexity schedule
+    std::vector<FT> epsilons(edges.lengths_);
+    shared::sort(epsilons.begin(), epsilons.end());
+    const size_t top_samples = std::min(size_t(250), size_t(std::ceil(ne * 0.01)));
+    const FT delta = std::accumulate(epsilons.begin(), epsilons.begin() + top_samples, FT(0)) / top_samples;
+    ret.delta_ = delta;
+    const size_t onepct = std::max(size_t(1), size_t(std::ceil(ne * 0.01)));
+    const FT eps_floor = std::accumulate(epsilons.begin(), epsilons.begin() + onepct, FT(0)) / onepct;
+    FT mu = 3. * std::pow(epsilons.back(), 2);
+    { std::vector<FT> tmp(std::move(epsilons)); }
+    const double xi = detail::spectral_norm_estimate(data);
+    auto compute_lambda = [&]() {
+        const double anorm = detail::adjacency_norm_estimate(edges, [&](auto e) {return w[e] * lpq[e];});
+        return anorm > 0. ? FT(xi / anorm): FT(1);
     };
-    std::vector<FT> obj;
-    for(size_t iternum = 0; iternum < niter; ++iternum) {
+    FT lambda = compute_lambda();
+
+    // Buffers, allocated once
+    blaze::DynamicMatrix<FT> R(np, nd), P(np, nd), AP(np, nd);
+    blaze::DynamicVector<FT> diag(np);
+    blaze::DynamicVector<FT, blaze::rowVector> rz(nd), rznew(nd), pap(nd), alpha(nd), beta(nd), bnorm(nd);
+
+    auto update_lpq = [&]() {
+        OMP_PFOR
+        for(size_t i = 0; i < ne; ++i) {
+            const FT dist = blaze::sqrNorm(row(U, edges.lhs_[i], blaze::unchecked) - row(U, edges.rhs_[i], blaze::unchecked));
+            const FT v = mu / (mu + dist);
+            lpq[i] = v * v;
+            ewl[i] = w[i] * lpq[i];
+        }
+    };
+    // Computes out = (I + lambda L) in, row-parallel over the CSR adjacency.
+    auto apply_system = [&](const blaze::DynamicMatrix<FT> &in, blaze::DynamicMatrix<FT> &out) {
         OMP_PFOR
-        for(size_t i = 0; i < app.data().columns(); ++i) {
-            lpq[i] = mu / (mu + app(lhp[i], rhp[i]));
+        for(size_t i = 0; i < np; ++i) {
+            auto orow = row(out, i, blaze::unchecked);
+            orow = diag[i] * row(in, i, blaze::unchecked);
+            for(size_t ind = edges.indptr_[i]; ind < edges.indptr_[i + 1]; ++ind)
+                orow -= (lambda * ewl[edges.eid_[ind]]) * row(in, edges.adj_[ind], blaze::unchecked);
         }
+    };
+    // Column-wise dot products of two n x d matrices, scaled per row
+    auto coldot = [&](const blaze::DynamicMatrix<FT> &lhs, const blaze::DynamicMatrix<FT> &rhs, auto &out, bool precondition) {
+        out = FT(0);
+        OMP_PRAGMA("omp parallel")
+        {
+            blaze::DynamicVector<FT, blaze::rowVector> acc(nd, FT(0));
+            OMP_PRAGMA("omp for")
+            for(size_t i = 0; i < np; ++i) {
+                if(precondition)
+                    acc += (FT(1) / diag[i]) * (row(lhs, i, blaze::unchecked) * row(rhs, i, blaze::unchecked));
+                else
+                    acc += row(lhs, i, blaze::unchecked) * row(rhs, i, blaze::unchecked);
+            }
+            OMP_CRITICAL
+            {
+                out += acc;
+            }
+        }
+    };
+    auto update_u = [&]() {
+        OMP_PFOR
+        for(size_t i = 0; i < np; ++i) {
+            FT s = 0.;
+            for(size_t ind = edges.indptr_[i]; ind < edges.indptr_[i + 1]; ++ind)
+                s += ewl[edges.eid_[ind]];
+            diag[i] = FT(1) + lambda * s;
+        }
+        // Warm-started from the previous U: R = X - A U, P = D^-1 R
+        apply_system(U, AP);
+        OMP_PFOR
+        for(size_t i = 0; i < np; ++i) {
+            row(R, i, blaze::unchecked) = row(data, i, blaze::unchecked) - row(AP, i, blaze::unchecked);
+            row(P, i, blaze::unchecked) = row(R, i, blaze::unchecked) / diag[i];
+        }
+        coldot(R, R, rz, true);
+        bnorm = rz;
+        for(unsigned cgi = 0; cgi < cg_iter; ++cgi) {
+            if(blaze::max(rz) <= cg_tol * cg_tol * std::max(FT(1e-30), blaze::max(bnorm))) break;
+            apply_system(P, AP);
+            coldot(P, AP, pap, false);
+            for(size_t j = 0; j < nd; ++j)
+                alpha[j] = pap[j] > FT(0) ? rz[j] / pap[j]: FT(0);
+            OMP_PFOR
+            for(size_t i = 0; i < np; ++i) {
+                row(U, i, blaze::unchecked) += alpha * row(P, i, blaze::unchecked);
+                row(R, i, blaze::unchecked) -= alpha * row(AP, i, blaze::unchecked);
+            }
+            coldot(R, R, rznew, true);
+            for(size_t j = 0; j < nd; ++j)
+                beta[j] = rz[j] > FT(0) ? rznew[j] / rz[j]: FT(0);
+            rz = rznew;
+            OMP_PFOR
+            for(size_t i = 0; i < np; ++i)
+                row(P, i, blaze::unchecked) = row(R, i, blaze::unchecked) / diag[i] + beta * row(P, i, blaze::unchecked);
+        }
+    };
+    auto calculate_objective = [&]() {
+        double data_term = 0., edge_term = 0.;
+        OMP_PRAGMA("omp parallel for reduction(+:data_term)")
+        for(size_t i = 0; i < np; ++i)
+            data_term += blaze::sqrNorm(row(data, i, blaze::unchecked) - row(U, i, blaze::unchecked));
+        OMP_PRAGMA("omp parallel for reduction(+:edge_term)")
+        for(size_t i = 0; i < ne; ++i) {
+            const FT dist = blaze::sqrNorm(row(U, edges.lhs_[i], blaze::unchecked) - row(U, edges.rhs_[i], blaze::unchecked));
+            const FT sl = std::sqrt(lpq[i]) - FT(1);
+            edge_term += w[i] * (lpq[i] * dist + mu * sl * sl);
+        }
+        return .5 * data_term + .5 * lambda * edge_term;
+    };
+    auto &obj = ret.objective_;
+    size_t inner_iter = 0;
+    for(size_t iternum = 0; iternum < niter; ++iternum) {
+        update_lpq();
+        update_u();
         obj.push_back(calculate_objective());
+        VERBOSE_ONLY(std::fprintf(stderr, "[RCC] iter %zu: objective %g, mu %g, lambda %g\n", iternum, obj.back(), double(mu), double(lambda));)
+        const bool converged = obj.size() > 1 && std::abs(obj[obj.size() - 2] - obj.back()) <= tol * std::abs(obj[obj.size() - 2]);
+        if((++inner_iter == 4 || converged) && mu >= delta) {
+            // Halve mu until it reaches the scale of the shortest edges.
+            mu = std::max(mu / FT(2), std::min(delta / FT(2), eps_floor));
+            lambda = compute_lambda();
+            inner_iter = 0;
+        } else if(converged && mu < delta) {
+            break;
+        }
     }
+    ret.nclusters_ = rcc_components(U, edges, delta, ret.labels_);
+    return ret;
 }
-#endif
+
+/*
+ * RCC over the k-nearest-neighbor graph of app's rows.
+ * The graph is found with a VP-tree (make_knns_by_tree), which requires a measure supported by jsd::supports_metric_tree.
+ * For other measures, either pass precomputed kNNs (e.g., from make_knns_by_lsh) to the overload below,
+ * or set brute_force to use make_knns, which costs O(n^2) distance evaluations.
+ */
+template<typename IT=uint32_t, typename MatrixType, typename KFT>
+auto perform_rcc(const jsd::DissimilarityApplicator<MatrixType> &app, const std::vector<packed::pair<KFT, IT>> &knns, bool mutual=true, size_t niter=100) {
+    const auto edges = make_rcc_edges<IT>(app.data(), knns, mutual);
+    return perform_rcc<IT>(app.data(), edges, niter);
+}
+template<typename IT=uint32_t, typename MatrixType>
+auto perform_rcc(const jsd::DissimilarityApplicator<MatrixType> &app, unsigned k, bool mutual=true, size_t niter=100, bool brute_force=false) {
+    if(!brute_force && !jsd::supports_metric_tree(app.get_measure()))
+        throw std::invalid_argument(std::string("perform_rcc: ") + dist::detail::prob2str(app.get_measure())
+                                    + " is not supported by metric trees; pass precomputed kNNs, or brute_force=true for O(n^2) make_knns");
+    const auto knns = brute_force ? make_knns<IT>(app, k): make_knns_by_tree<IT>(app, k);
+    return perform_rcc<IT>(app, knns, mutual, niter);
+}
+
+} // namespace rcc
+
+using rcc::perform_rcc;
+using rcc::make_rcc_edges;
 
 
 } // minocore
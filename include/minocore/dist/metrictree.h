@@ -0,0 +1,126 @@
+#ifndef MINOCORE_DIST_METRICTREE_H__
+#define MINOCORE_DIST_METRICTREE_H__
+#include "minocore/dist/applicator.h"
+#include "minocore/util/vptree.h"
+
+namespace minocore {
+
+namespace jsd {
+
+/*
+ * Metric trees over applicator rows.
+ * Metrics (L1, L2, JSM, TVD, the Bhattacharyya metric) are indexed as they are, and
+ * squared metrics (SQRL2, JSD, and HELLINGER, which the applicator computes as a squared distance) by their square roots.
+ * Results are reported in the units of the measure itself.
+ */
+static constexpr INLINE bool tree_uses_sqrt(DissimilarityMeasure measure) {
+    return measure == SQRL2 || measure == JSD || measure == HELLINGER;
+}
+static constexpr INLINE bool supports_metric_tree(DissimilarityMeasure measure) {
+    switch(measure) {
+        case L1: case L2: case JSM: case TOTAL_VARIATION_DISTANCE: case BHATTACHARYYA_METRIC: return true;
+        default: return tree_uses_sqrt(measure);
+    }
+}
+
+namespace detail {
+// Wraps a distance oracle on row ids as the metric indexed by the tree
+template<typename Oracle, typename FT>
+struct RootedOracle {
+    const Oracle &oracle_;
+    bool sqrt_;
+    FT operator()(size_t i, size_t j) const {
+        const FT d = oracle_(i, j);
+        return sqrt_ ? std::sqrt(std::max(d, FT(0))): d;
+    }
+    FT from_tree(FT d) const {return sqrt_ ? d * d: d;}
+};
+} // namespace detail
+
+/*
+ * VP-tree over the rows ids[0..n) of app, e.g. a set of centers, for nearest-center, kNN and range queries from other rows:
+ * tree.nearest(tree_query(app, i)) finds the indexed row nearest row i, in tree units (the square root, for squared metrics).
+ * Rows can be added later with tree.insert(id).
+ */
+template<typename MatrixType, typename IT=uint32_t, typename FT=blaze::ElementType_t<MatrixType>>
+auto make_metric_tree(const DissimilarityApplicator<MatrixType> &app, const IT *ids, size_t n, size_t leaf_size=16, uint64_t seed=0) {
+    MINOCORE_REQUIRE(supports_metric_tree(app.get_measure()), "Metric trees require a metric, or the square of one");
+    detail::RootedOracle<DissimilarityApplicator<MatrixType>, FT> metric{app, tree_uses_sqrt(app.get_measure())};
+    return VPTree<decltype(metric), FT, IT>(metric, ids, ids + n, leaf_size, seed);
+}
+template<typename MatrixType, typename FT=blaze::ElementType_t<MatrixType>>
+auto tree_query(const DissimilarityApplicator<MatrixType> &app, size_t i) {
+    return [&app,i,root=tree_uses_sqrt(app.get_measure())](size_t id) {
+        const FT d = app(i, id);
+        return root ? std::sqrt(std::max(d, FT(0))): d;
+    };
+}
+
+/*
+ * Assigns each row of app to its nearest center (a row id), using a VP-tree over the centers.
+ * Returns (assignments, costs) as coresets::get_oracle_costs does, where assignments index into centers,
+ * but with O(log k) rather than k distance evaluations per row on low-dimensional data.
+ */
+template<typename MatrixType, typename Sol, typename IT=uint32_t, typename FT=blaze::ElementType_t<MatrixType>>
+std::pair<blaze::DynamicVector<IT>, blaze::DynamicVector<FT>>
+tree_assign(const DissimilarityApplicator<MatrixType> &app, const Sol &centers, size_t leaf_size=16) {
+    MINOCORE_PHASE("tree_assign");
+    const DissimilarityMeasure measure = app.get_measure();
+    MINOCORE_REQUIRE(supports_metric_tree(measure), "Metric trees require a metric, or the square of one");
+    const std::vector<IT> cids(centers.begin(), centers.end());
+    const size_t np = app.size(), k = cids.size();
+    blaze::DynamicVector<IT> asn(np);
+    blaze::DynamicVector<FT> costs(np);
+    app.with_kernel([&](const auto &kernel) {
+        detail::RootedOracle<std::decay_t<decltype(kernel)>, FT> metric{kernel, tree_uses_sqrt(measure)};
+        auto cdist = [&](IT a, IT b) {return metric(cids[a], cids[b]);};
+        VPTree<decltype(cdist), FT, IT> tree(cdist, leaf_size);
+        tree.rebuild(k);
+        tree.nearest_batch(np, [&](size_t i) {return [&metric,&cids,i](IT c) {return metric(i, cids[c]);};},
+                           asn.data(), costs.data());
+        costs = blaze::map(costs, [&metric](FT d) {return metric.from_tree(d);});
+    });
+    MINOCORE_LOG("Centers have total cost %g\n", blz::sum(costs));
+    return std::make_pair(std::move(asn), std::move(costs));
+}
+
+} // namespace jsd
+
+/*
+ * k-nearest neighbors of every row, as make_knns(app, k), found by querying a VP-tree over all rows.
+ * Requires a measure supported by jsd::supports_metric_tree.
+ */
+template<typename IT=uint32_t, typename MatrixType>
+std::vector<packed::pair<blaze::ElementType_t<MatrixType>, IT>> make_knns_by_tree(const jsd::DissimilarityApplicator<MatrixType> &app, unsigned k, size_t leaf_size=16, uint64_t seed=0) {
+    MINOCORE_PHASE("make_knns_by_tree");
+    using FT = blaze::ElementType_t<MatrixType>;
+    const jsd::DissimilarityMeasure measure = app.get_measure();
+    MINOCORE_REQUIRE(jsd::supports_metric_tree(measure), "Metric trees require a metric, or the square of one");
+    MINOCORE_REQUIRE(std::numeric_limits<IT>::max() > app.size(), "sanity check");
+    const size_t np = app.size();
+    if(k >= np) {
+        MINOCORE_LOG("Note: make_knns_by_tree was provided k (%u) >= # points (%zu).\n", k, np);
+        k = np ? np - 1: 0;
+    }
+    if(!k) return {};
+    std::vector<packed::pair<FT, IT>> ret(k * np);
+    app.with_kernel([&](const auto &kernel) {
+        jsd::detail::RootedOracle<std::decay_t<decltype(kernel)>, FT> metric{kernel, jsd::tree_uses_sqrt(measure)};
+        auto tree = make_vptree<FT, IT>(metric, np, leaf_size, seed);
+        OMP_PFOR_DYN
+        for(size_t i = 0; i < np; ++i) {
+            // One extra neighbor, to drop i itself (or, with duplicate rows, the farthest)
+            auto nn = tree.knn([&metric,i](IT j) {return metric(i, j);}, k + 1);
+            auto self = std::find_if(nn.begin(), nn.end(), [i](const auto &p) {return p.second == i;});
+            nn.erase(self == nn.end() ? nn.end() - 1: self);
+            auto out = &ret[i * k];
+            for(unsigned j = 0; j < k; ++j) out[j] = packed::pair<FT, IT>(metric.from_tree(nn[j].first), nn[j].second);
+        }
+    });
+    MINOCORE_LOG("Created knn graph by VP-tree for k = %u and %zu points\n", k, np);
+    return ret;
+}
+
+} // namespace minocore
+
+#endif /* MINOCORE_DIST_METRICTREE_H__ */
@@ -0,0 +1,449 @@
+#ifndef MINOCORE_DIST_QUANTIZED_H__
+#define MINOCORE_DIST_QUANTIZED_H__
+#include "minocore/dist/applicator.h"
+#include "minocore/util/packed.h"
+#include <cmath>
+#include <cstring>
+#include <limits>
+#if defined(__F16C__) && defined(__AVX__)
+#  include <immintrin.h>
+#endif
+
+/*
+ * Reduced-precision rows for bandwidth-bound pairwise stages.
+ *
+ * QuantizedMatrix<P> stores rows as IEEE half (FP16), bfloat16 (BF16) or int8 with a per-row scale (INT8),
+ * and QuantizedApplicator<P, MT> evaluates a subset of measures over the representation a DissimilarityApplicator
+ * reads for them (raw rows for L1/L2/SQRL2, probabilities for TVD/JSD/JSM, square roots of probabilities for
+ * Hellinger/Bhattacharyya). Kernels decode a block at a time and accumulate in fp32.
+ *
+ * Error bounds
+ * Quantization error is measured per row at construction: e1 = |x' - x|_1, e2 = |x' - x|_2, and
+ * r = max_k |x'_k - x_k| / |x_k| over nonzeros. For rows i, j, let E1 = e1_i + e1_j, E2 = e2_i + e2_j,
+ * r = max(r_i, r_j) and d' the approximate distance. Then |d - d'| <= bound(i, j, d'), where bound is
+ *     L1:       E1                         TVD:   E1 / 2
+ *     L2:       E2                         SQRL2, HELLINGER: E2 (2 sqrt(d') + E2)
+ *     BHATTACHARYYA_*: via the inner product of unit-norm rows, |BC - BC'| <= delta = E2 + e2_i e2_j,
+ *                      then delta / (BC' - delta) for the distance and min(sqrt(delta), delta / d') for the metric
+ *     JSD:      r (1 + log(D) + 2 r) for r < 1/2 (x log x has derivative log(x) + 1, and mixtures have entropy <= log(D))
+ *     JSM:      min(sqrt(eps), eps / d') with eps the JSD bound
+ * plus ACCUMULATION_EPS * d' for fp32 accumulation, to first order.
+ * Typical per-element relative errors are 2^-11 (FP16, normalized per row by a power of two), 2^-8 (BF16)
+ * and 1/254 of the row's largest magnitude (INT8). JSD/JSM need bounded relative error, so INT8 is rejected for them.
+ *
+ * make_knns(qapp, k) and QuantizedApplicator::assign use these bounds to select candidates, which are then
+ * reranked under the exact applicator, so their results match the full-precision ones.
+ */
+
+namespace minocore {
+
+namespace quant {
+
+using dist::DissimilarityMeasure;
+
+enum Precision: int {
+    FP16,
+    BF16,
+    INT8
+};
+
+static constexpr const char *precision2str(Precision p) {
+    switch(p) {
+        case FP16: return "FP16";
+        case BF16: return "BF16";
+        case INT8: return "INT8";
+    }
+    return "UNKNOWN";
+}
+
+namespace detail {
+
+INLINE uint32_t f2u(float f) {uint32_t ret; std::memcpy(&ret, &f, sizeof(ret)); return ret;}
+INLINE float u2f(uint32_t u) {float ret; std::memcpy(&ret, &u, sizeof(ret)); return ret;}
+
+// IEEE binary16, rounding to nearest even
+inline uint16_t float2half(float f) {
+    uint32_t x = f2u(f);
+    const uint32_t sign = (x >> 16) & 0x8000u;
+    x &= 0x7fffffffu;
+    if(x >= 0x7f800000u) return sign | (x > 0x7f800000u ? 0x7e00u: 0x7c00u); // NaN/Inf
+    if(x >= 0x477ff000u) return sign | 0x7c00u;                              // Rounds past 65504
+    if(x < 0x38800000u) {                                                    // Below 2^-14: subnormal or zero
+        if(x < 0x33000000u) return sign;
+        const unsigned shift = 126 - (x >> 23);
+        const uint32_t m = (x & 0x7fffffu) | 0x800000u, rem = m & ((1u << shift) - 1), half = 1u << (shift - 1);
+        uint32_t h = m >> shift;
+        h += rem > half || (rem == half && (h & 1));
+        return sign | h;
+    }
+    uint32_t h = (x - 0x38000000u) >> 13;
+    const uint32_t rem = x & 0x1fffu;
+    h += rem > 0x1000u || (rem == 0x1000u && (h & 1));
+    return sign | h;
+}
+
+INLINE float half2float(uint16_t h) {
+    const uint32_t sign = uint32_t(h & 0x8000u) << 16, exp = h & 0x7c00u, mant = h & 0x3ffu;
+    if(exp == 0x7c00u) return u2f(sign | 0x7f800000u | (mant << 13));
+    if(exp) return u2f(sign | (((exp >> 10) + 112) << 23) | (mant << 13));
+    return u2f(sign | f2u(mant * 0x1p-24f));
+}
+
+inline uint16_t float2bf16(float f) {
+    const uint32_t x = f2u(f);
+    if((x & 0x7fffffffu) > 0x7f800000u) return (x >> 16) | 0x40u;
+    return (x + 0x7fffu + ((x >> 16) & 1)) >> 16;
+}
+
+INLINE float bf162float(uint16_t h) {return u2f(uint32_t(h) << 16);}
+
+} // namespace detail
+
+template<Precision P>
+class QuantizedMatrix {
+public:
+    using storage_type = std::conditional_t<P == INT8, int8_t, uint16_t>;
+    static constexpr size_t BLOCK = 64;
+    static constexpr size_t LANES = 16;
+private:
+    size_t nr_ = 0, nc_ = 0, stride_ = 0;
+    std::vector<storage_type> data_;    // Row-major, rows zero-padded to a multiple of BLOCK
+    std::vector<float> scales_;         // x'_k = decode(stored_k) * scale
+    std::vector<float> l1err_, l2err_, relerr_;
+
+    static INLINE float decode_value(storage_type v) {
+        if constexpr(P == FP16)      return detail::half2float(v);
+        else if constexpr(P == BF16) return detail::bf162float(v);
+        else                         return v;
+    }
+    static storage_type encode_value(float v) {
+        if constexpr(P == FP16)      return detail::float2half(v);
+        else if constexpr(P == BF16) return detail::float2bf16(v);
+        else                         return static_cast<int8_t>(std::max(-127.f, std::min(127.f, std::nearbyint(v))));
+    }
+    void encode_row(size_t i, const double *x) {
+        double amax = 0.;
+        for(size_t k = 0; k < nc_; ++k) amax = std::max(amax, std::abs(x[k]));
+        float scale = 1.f;
+        if(amax > 0.) {
+            // FP16: a power of two placing the largest magnitude in [2^14, 2^15), far from both over- and underflow
+            if constexpr(P == FP16)      {int e; std::frexp(amax, &e); scale = std::ldexp(1.f, e - 15);}
+            else if constexpr(P == INT8) scale = amax / 127.;
+        }
+        storage_type *dst = &data_[i * stride_];
+        double l1 = 0., l2 = 0., rel = 0.;
+        for(size_t k = 0; k < nc_; ++k) {
+            dst[k] = encode_value(x[k] / scale);
+            const double err = std::abs(double(decode_value(dst[k]) * scale) - x[k]);
+            l1 += err;
+            l2 += err * err;
+            if(x[k]) rel = std::max(rel, err / std::abs(x[k]));
+        }
+        // Round up, so that bounds built from these stay bounds
+        static constexpr float INF = std::numeric_limits<float>::infinity();
+        scales_[i] = scale;
+        l1err_[i] = std::nextafter(float(l1), INF);
+        l2err_[i] = std::nextafter(float(std::sqrt(l2)), INF);
+        relerr_[i] = std::nextafter(float(rel), INF);
+    }
+public:
+    QuantizedMatrix() = default;
+    /*
+     * func(i, double *out) writes row i (nc values).
+     * Errors are measured against these values, so pass the highest-precision representation available.
+     */
+    template<typename RowFunc>
+    QuantizedMatrix(size_t nr, size_t nc, const RowFunc &func):
+        nr_(nr), nc_(nc), stride_((nc + BLOCK - 1) / BLOCK * BLOCK), data_(nr_ * stride_),
+        scales_(nr), l1err_(nr), l2err_(nr), relerr_(nr)
+    {
+        OMP_PRAGMA("omp parallel")
+        {
+            std::vector<double> buf(nc_);
+            OMP_PRAGMA("omp for")
+            for(size_t i = 0; i < nr_; ++i) {
+                func(i, buf.data());
+                encode_row(i, buf.data());
+            }
+        }
+    }
+    template<typename MT, bool SO>
+    explicit QuantizedMatrix(const blaze::DenseMatrix<MT, SO> &mat):
+        QuantizedMatrix((~mat).rows(), (~mat).columns(), [&](size_t i, double *out) {
+            for(size_t k = 0; k < (~mat).columns(); ++k) out[k] = (~mat)(i, k);
+        }) {}
+
+    size_t rows() const {return nr_;}
+    size_t columns() const {return nc_;}
+    size_t bytes() const {return data_.size() * sizeof(storage_type) + 4 * nr_ * sizeof(float);}
+    float l1_error(size_t i) const {return l1err_[i];}
+    float l2_error(size_t i) const {return l2err_[i];}
+    float relative_error(size_t i) const {return relerr_[i];}
+
+    // Decodes BLOCK values of row i, starting at start (a multiple of BLOCK)
+    INLINE void decode(size_t i, size_t start, float *out) const {
+        const storage_type *src = &data_[i * stride_ + start];
+        const float s = scales_[i];
+#if defined(__F16C__) && defined(__AVX__)
+        if constexpr(P == FP16) {
+            const __m256 vs = _mm256_set1_ps(s);
+            for(size_t k = 0; k < BLOCK; k += 8)
+                _mm256_storeu_ps(out + k, _mm256_mul_ps(_mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src + k))), vs));
+            return;
+        }
+#endif
+        for(size_t k = 0; k < BLOCK; ++k) out[k] = decode_value(src[k]) * s;
+    }
+    void decode_row(size_t i, float *out) const {
+        alignas(64) float buf[BLOCK];
+        for(size_t start = 0; start < stride_; start += BLOCK) {
+            decode(i, start, buf);
+            std::copy(buf, buf + std::min(BLOCK, nc_ - start), out + start);
+        }
+    }
+    /*
+     * Sums func(x'_ik, x'_jk) over columns, in LANES fp32 accumulators per block and a double across blocks.
+     * func(0, 0) must be 0, as padding is included.
+     */
+    template<typename Func>
+    INLINE double reduce(size_t i, size_t j, const Func &func) const {
+        alignas(64) float a[BLOCK], b[BLOCK];
+        double ret = 0.;
+        for(size_t start = 0; start < stride_; start += BLOCK) {
+            decode(i, start, a);
+            decode(j, start, b);
+            float acc[LANES]{};
+            for(size_t k = 0; k < BLOCK; k += LANES)
+                for(size_t l = 0; l < LANES; ++l)
+                    acc[l] += func(a[k + l], b[k + l]);
+            for(size_t l = 0; l < LANES; ++l) ret += acc[l];
+        }
+        return ret;
+    }
+};
+
+static constexpr INLINE bool is_supported(DissimilarityMeasure m) {
+    switch(m) {
+        case dist::L1: case dist::L2: case dist::SQRL2: case dist::TVD: case dist::HELLINGER:
+        case dist::BHATTACHARYYA_METRIC: case dist::BHATTACHARYYA_DISTANCE: case dist::JSD: case dist::JSM:
+            return true;
+        default: return false;
+    }
+}
+
+// Relative error of blocked fp32 accumulation (and the elementwise arithmetic feeding it), to first order
+static constexpr double ACCUMULATION_EPS = 16. * 0x1p-24;
+
+template<Precision P, typename MatrixType>
+class QuantizedApplicator {
+public:
+    using App = jsd::DissimilarityApplicator<MatrixType>;
+    using FT = blaze::ElementType_t<MatrixType>;
+private:
+    const App &app_;
+    const DissimilarityMeasure measure_;
+    QuantizedMatrix<P> qm_;
+    std::vector<float> entropies_; // JSD/JSM: sum_k p_k log p_k per row
+    double logdim_;
+
+    INLINE double bc(size_t i, size_t j) const {
+        return qm_.reduce(i, j, [](float a, float b) {return a * b;});
+    }
+    INLINE double jsd(size_t i, size_t j) const {
+        // 1/2 (sum p log p + sum q log q) - sum m log m, with m = (p + q) / 2 from the quantized rows
+        const double cross = qm_.reduce(i, j, [](float a, float b) {
+            const float m = (a + b) * .5f;
+            return m > 0.f ? m * std::log(m): 0.f;
+        });
+        return std::max(.5 * (entropies_[i] + entropies_[j]) - cross, 0.);
+    }
+
+    static QuantizedMatrix<P> quantize(const App &app) {
+        static_assert(blaze::IsDenseMatrix_v<MatrixType>, "QuantizedApplicator requires dense data");
+        const DissimilarityMeasure m = app.get_measure();
+        MINOCORE_REQUIRE(is_supported(m), std::string("Measure ") + dist::detail::prob2str(m) + " is not supported in reduced precision");
+        MINOCORE_REQUIRE(P != INT8 || (m != dist::JSD && m != dist::JSM), "INT8 has no relative error bound, which JSD/JSM require");
+        MINOCORE_PHASE("quant::quantize");
+        const size_t nc = app.data().columns();
+        return QuantizedMatrix<P>(app.size(), nc, [&](size_t i, double *out) {
+            auto r = app.row(i);
+            switch(m) {
+                case dist::L1: case dist::L2: case dist::SQRL2: {
+                    const double rs = app.row_sums()[i];
+                    for(size_t k = 0; k < nc; ++k) out[k] = r[k] * rs;
+                    break;
+                }
+                case dist::HELLINGER: case dist::BHATTACHARYYA_METRIC: case dist::BHATTACHARYYA_DISTANCE:
+                    for(size_t k = 0; k < nc; ++k) out[k] = std::sqrt(double(r[k]));
+                    break;
+                default:
+                    for(size_t k = 0; k < nc; ++k) out[k] = r[k];
+            }
+        });
+    }
+public:
+    explicit QuantizedApplicator(const App &app):
+        app_(app), measure_(app.get_measure()), qm_(quantize(app)), logdim_(std::log(double(app.data().columns())))
+    {
+        if(measure_ == dist::JSD || measure_ == dist::JSM) {
+            entropies_.resize(app.size());
+            OMP_PFOR
+            for(size_t i = 0; i < app.size(); ++i) {
+                auto r = app.row(i);
+                double s = 0.;
+                for(size_t k = 0; k < r.size(); ++k) if(r[k] > 0) s += r[k] * std::log(double(r[k]));
+                entropies_[i] = s;
+            }
+        }
+    }
+    const App &exact() const {return app_;}
+    const QuantizedMatrix<P> &matrix() const {return qm_;}
+    DissimilarityMeasure get_measure() const {return measure_;}
+    size_t size() const {return qm_.rows();}
+    size_t bytes() const {return qm_.bytes() + entropies_.size() * sizeof(float);}
+
+    // Approximate distance
+    INLINE float operator()(size_t i, size_t j) const {
+        MINOCORE_COUNT(DISTANCE_EVALS, 1);
+        switch(measure_) {
+            case dist::L1:    return qm_.reduce(i, j, [](float a, float b) {return std::abs(a - b);});
+            case dist::TVD:   return .5 * qm_.reduce(i, j, [](float a, float b) {return std::abs(a - b);});
+            case dist::L2:    return std::sqrt(qm_.reduce(i, j, [](float a, float b) {return (a - b) * (a - b);}));
+            case dist::SQRL2: case dist::HELLINGER:
+                return qm_.reduce(i, j, [](float a, float b) {return (a - b) * (a - b);});
+            case dist::BHATTACHARYYA_METRIC:
+                return std::sqrt(std::max(1. - bc(i, j), 0.));
+            case dist::BHATTACHARYYA_DISTANCE:
+                return -std::log(bc(i, j));
+            case dist::JSD: return jsd(i, j);
+            case dist::JSM: return std::sqrt(jsd(i, j));
+            default: __builtin_unreachable();
+        }
+    }
+    // Upper bound on |exact(i, j) - approx|, where approx == (*this)(i, j). See the top of this file.
+    float error_bound(size_t i, size_t j, float approx) const {
+        static constexpr float INF = std::numeric_limits<float>::infinity();
+        const double e1 = qm_.l1_error(i) + qm_.l1_error(j), e2 = qm_.l2_error(i) + qm_.l2_error(j);
+        const double acc = ACCUMULATION_EPS * std::abs(approx);
+        auto sqrt_bound = [approx](double eps) {return approx > 0 ? std::min(std::sqrt(eps), eps / approx): std::sqrt(eps);};
+        auto bc_bound = [&]() {return e2 + qm_.l2_error(i) * qm_.l2_error(j) + ACCUMULATION_EPS;};
+        auto jsd_bound = [&]() {
+            const double r = std::max(qm_.relative_error(i), qm_.relative_error(j));
+            return r < .5 ? r * (1. + logdim_ + 2. * r) + ACCUMULATION_EPS * 2. * (1. + logdim_): double(INF);
+        };
+        switch(measure_) {
+            case dist::L1:    return e1 + acc;
+            case dist::TVD:   return .5 * e1 + acc;
+            case dist::L2:    return e2 + acc;
+            case dist::SQRL2: case dist::HELLINGER:
+                return e2 * (2. * std::sqrt(std::max(approx, 0.f)) + e2) + acc;
+            case dist::BHATTACHARYYA_METRIC: return sqrt_bound(bc_bound());
+            case dist::BHATTACHARYYA_DISTANCE: {
+                const double bcv = std::exp(-double(approx)), delta = bc_bound();
+                return bcv > delta ? delta / (bcv - delta): INF;
+            }
+            case dist::JSD: return jsd_bound();
+            case dist::JSM: return sqrt_bound(jsd_bound());
+            default: __builtin_unreachable();
+        }
+    }
+
+    /*
+     * Assigns each point to its nearest center among ctrs[0..k), which index rows of the data.
+     * Centers whose approximate distance is within the error bound of the best are reranked exactly,
+     * so asn and costs match an exact assignment. Returns the number of exact evaluations performed.
+     */
+    template<typename IT, typename CFT>
+    size_t assign(const IT *ctrs, size_t k, IT *asn, CFT *costs) const {
+        MINOCORE_PHASE("quant::assign");
+        size_t nexact = 0;
+        const size_t np = size();
+        OMP_PRAGMA("omp parallel reduction(+:nexact)")
+        {
+            std::vector<float> approx(k), bounds(k);
+            OMP_PRAGMA("omp for schedule(dynamic, 64)")
+            for(size_t i = 0; i < np; ++i) {
+                float ub = std::numeric_limits<float>::max();
+                for(size_t c = 0; c < k; ++c) {
+                    approx[c] = (*this)(i, ctrs[c]);
+                    bounds[c] = error_bound(i, ctrs[c], approx[c]);
+                    ub = std::min(ub, approx[c] + bounds[c]);
+                }
+                FT best = std::numeric_limits<FT>::max();
+                IT bestc = 0;
+                for(size_t c = 0; c < k; ++c) {
+                    if(approx[c] - bounds[c] > ub) continue; // NaN bounds are reranked
+                    const FT d = app_(i, ctrs[c]);
+                    ++nexact;
+                    if(d < best) best = d, bestc = c;
+                }
+                asn[i] = bestc;
+                costs[i] = best;
+            }
+        }
+        return nexact;
+    }
+};
+
+template<Precision P, typename MatrixType>
+auto make_quantized_applicator(const jsd::DissimilarityApplicator<MatrixType> &app) {
+    return QuantizedApplicator<P, MatrixType>(app);
+}
+
+} // namespace quant
+
+using quant::QuantizedApplicator;
+using quant::make_quantized_applicator;
+
+/*
+ * Exact k-nearest neighbors, as make_knns(app, k), by filtering with a quantized applicator:
+ * for each point, every other point's approximate distance and error bound are computed,
+ * and only those which could be among the k nearest are evaluated exactly.
+ * Rows are independent, so unlike make_knns this needs no locks.
+ */
+template<typename IT=uint32_t, quant::Precision P, typename MatrixType>
+std::vector<packed::pair<blaze::ElementType_t<MatrixType>, IT>> make_knns(const QuantizedApplicator<P, MatrixType> &qapp, unsigned k) {
+    MINOCORE_PHASE("make_knns(quantized)");
+    using FT = blaze::ElementType_t<MatrixType>;
+    MINOCORE_REQUIRE(std::numeric_limits<IT>::max() > qapp.size(), "sanity check");
+    const size_t np = qapp.size();
+    if(k >= np) {
+        MINOCORE_LOG("Note: make_knns was provided k (%u) >= # points (%zu).\n", k, np);
+        k = np ? np - 1: 0;
+    }
+    if(!k) return {};
+    std::vector<packed::pair<FT, IT>> ret(k * np);
+    size_t nexact = 0;
+    OMP_PRAGMA("omp parallel reduction(+:nexact)")
+    {
+        std::vector<float> approx(np), bounds(np), upper;
+        upper.reserve(np);
+        std::vector<packed::pair<FT, IT>> cand;
+        OMP_PRAGMA("omp for schedule(dynamic, 16)")
+        for(size_t i = 0; i < np; ++i) {
+            upper.clear();
+            for(size_t j = 0; j < np; ++j) {
+                if(j == i) continue;
+                approx[j] = qapp(i, j);
+                bounds[j] = qapp.error_bound(i, j, approx[j]);
+                upper.push_back(approx[j] + bounds[j]);
+            }
+            std::nth_element(upper.begin(), upper.begin() + (k - 1), upper.end());
+            const float kth = upper[k - 1];
+            cand.clear();
+            for(size_t j = 0; j < np; ++j)
+                if(j != i && !(approx[j] - bounds[j] > kth))
+                    cand.emplace_back(qapp.exact()(i, j), IT(j));
+            nexact += cand.size();
+            std::partial_sort(cand.begin(), cand.begin() + k, cand.end());
+            std::copy(cand.begin(), cand.begin() + k, &ret[i * k]);
+        }
+    }
+    MINOCORE_LOG("Created knn graph for k = %u; %zu exact evaluations (%0.4g%% of all pairs)\n",
+                 k, nexact, 100. * nexact / (double(np) * (np - 1)));
+    return ret;
+}
+
+} // namespace minocore
+
+#endif /* MINOCORE_DIST_QUANTIZED_H__ */
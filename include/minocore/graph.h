@@ -1,4 +1,5 @@
 #pragma once
 #include "minocore/graph/graph.h"
+#include "minocore/graph/csr.h"
 #include "minocore/graph/parse.h"
 #include "minocore/graph/graphdist.h"
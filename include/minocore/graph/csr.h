@@ -0,0 +1,396 @@
+#pragma once
+#ifndef FGC_GRAPH_CSR_H__
+#define FGC_GRAPH_CSR_H__
+#include "minocore/graph/graph.h"
+#include "minocore/util/binary_format.h"
+#include "minocore/util/geo.h"
+#include "minocore/util/textparse.h"
+#include "minocore/util/trace.h"
+#include <atomic>
+#include <cassert>
+#include <cctype>
+#include <limits>
+#include <queue>
+#ifdef _OPENMP
+#  include <omp.h>
+#endif
+
+namespace minocore {
+
+namespace graph {
+
+/*
+ * Compact CSR graph.
+ *
+ * The out-arcs of u are targets[offsets[u]:offsets[u + 1]], sorted by target, with weights in parallel.
+ * Arcs are stored exactly as listed in the input, so an undirected DIMACS road network
+ * (which lists each edge in both directions) has both arcs present.
+ * Optional per-vertex coordinates (lat, lon), as emitted by osm2dimacs, are stored interleaved.
+ *
+ * On disk, this uses the aligned, checksummed layout in util/binary_format.h:
+ * section 0: offsets (uint64_t, nv + 1), 1: targets (IT, narcs), 2: weights (WT, narcs), 3: coordinates (double, 2 * nv).
+ * A mapped file is usable in place, without building a Boost graph.
+ */
+
+struct CSRGraphHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t endian;
+    uint32_t ft_size;   // sizeof(WT)
+    uint32_t it_size;   // sizeof(IT)
+    uint64_t nv;
+    uint64_t narcs;
+    uint32_t flags;     // CSR_HAS_COORDINATES
+    uint32_t reserved;
+    uint64_t offsets[4];
+    uint64_t file_size;
+    uint64_t checksum;
+};
+
+static constexpr const char *CSR_GRAPH_MAGIC = "MNCCSRGR";
+static constexpr uint32_t CSR_HAS_COORDINATES = 1;
+
+template<typename WT=float, typename IT=uint32_t>
+class CSRGraphView {
+protected:
+    const uint64_t *offsets_;
+    const IT *targets_;
+    const WT *weights_;
+    const double *coords_;
+    size_t nv_;
+public:
+    using weight_type = WT;
+    using index_type = IT;
+
+    CSRGraphView(const uint64_t *offsets, const IT *targets, const WT *weights, size_t nv, const double *coords=nullptr):
+        offsets_(offsets), targets_(targets), weights_(weights), coords_(coords), nv_(nv) {}
+
+    size_t num_vertices() const {return nv_;}
+    size_t num_arcs() const {return offsets_[nv_];}
+    size_t degree(size_t u) const {return offsets_[u + 1] - offsets_[u];}
+    const uint64_t *offsets() const {return offsets_;}
+    const IT *targets() const {return targets_;}
+    const WT *weights() const {return weights_;}
+    const double *coordinates() const {return coords_;}
+    const IT *targets(size_t u) const {return targets_ + offsets_[u];}
+    const WT *weights(size_t u) const {return weights_ + offsets_[u];}
+
+    bool has_coordinates() const {return coords_ != nullptr;}
+    latlon_t coordinate(size_t u) const {
+        assert(coords_);
+        return latlon_t(coords_[2 * u], coords_[2 * u + 1]);
+    }
+
+    // func(target, weight) for each out-arc of u
+    template<typename Func>
+    void for_each_arc(size_t u, const Func &func) const {
+        for(auto i = offsets_[u], e = offsets_[u + 1]; i < e; ++i)
+            func(targets_[i], weights_[i]);
+    }
+    // Index of the first arc u -> v, or -1 if absent.
+    int64_t find_arc(size_t u, size_t v) const {
+        const IT *b = targets(u), *e = targets_ + offsets_[u + 1];
+        const IT *it = std::lower_bound(b, e, IT(v));
+        return it != e && *it == v ? int64_t(it - targets_): int64_t(-1);
+    }
+};
+
+template<typename WT=float, typename IT=uint32_t>
+struct CSRGraph {
+    std::vector<uint64_t> offsets_;
+    std::vector<IT> targets_;
+    std::vector<WT> weights_;
+    std::vector<double> coords_; // Empty if the input carried no coordinates
+    size_t nv_ = 0;
+
+    size_t num_vertices() const {return nv_;}
+    size_t num_arcs() const {return targets_.size();}
+    CSRGraphView<WT, IT> view() const {
+        return CSRGraphView<WT, IT>(offsets_.data(), targets_.data(), weights_.data(), nv_, coords_.empty() ? nullptr: coords_.data());
+    }
+    void write(const std::string &path) const {
+        io::SectionWriter<CSRGraphHeader> sw(path);
+        CSRGraphHeader hdr{};
+        io::set_magic(hdr, CSR_GRAPH_MAGIC);
+        hdr.ft_size = sizeof(WT);
+        hdr.it_size = sizeof(IT);
+        hdr.nv = nv_;
+        hdr.narcs = targets_.size();
+        hdr.offsets[0] = sw.write(offsets_.data(), offsets_.size() * sizeof(uint64_t));
+        hdr.offsets[1] = sw.write(targets_.data(), targets_.size() * sizeof(IT));
+        hdr.offsets[2] = sw.write(weights_.data(), weights_.size() * sizeof(WT));
+        if(!coords_.empty()) {
+            hdr.offsets[3] = sw.write(coords_.data(), coords_.size() * sizeof(double));
+            hdr.flags |= CSR_HAS_COORDINATES;
+        }
+        sw.finish(hdr);
+    }
+};
+
+/*
+ * Read-only mapping of a file written by CSRGraph::write.
+ * Copies share the mapping.
+ */
+template<typename WT=float, typename IT=uint32_t>
+class MappedCSRGraph {
+    std::shared_ptr<mio::mmap_source> mapping_;
+    CSRGraphView<WT, IT> view_;
+    static CSRGraphView<WT, IT> make_view(const mio::mmap_source &ms, bool verify_checksum) {
+        const auto &hdr = io::validate<CSRGraphHeader>(ms, CSR_GRAPH_MAGIC, sizeof(WT), sizeof(IT), verify_checksum);
+        const uint64_t *offsets = io::section<uint64_t>(ms, hdr, 0, hdr.nv + 1);
+        if(offsets[hdr.nv] != hdr.narcs) throw std::runtime_error("Corrupted CSR graph: offsets do not match the arc count");
+        return CSRGraphView<WT, IT>(offsets, io::section<IT>(ms, hdr, 1, hdr.narcs), io::section<WT>(ms, hdr, 2, hdr.narcs), hdr.nv,
+                                    hdr.flags & CSR_HAS_COORDINATES ? io::section<double>(ms, hdr, 3, 2 * hdr.nv): nullptr);
+    }
+public:
+    MappedCSRGraph(const std::string &path, bool verify_checksum=false):
+        mapping_(std::make_shared<mio::mmap_source>(path)), view_(make_view(*mapping_, verify_checksum)) {}
+    const CSRGraphView<WT, IT> &view() const {return view_;}
+    void advise(int flag) const {
+        ::madvise((void *)mapping_->data(), mapping_->size(), flag);
+    }
+};
+
+namespace detail {
+
+INLINE const char *skip_digits(const char *p, const char *e) {
+    while(p < e && unsigned(*p - '0') < 10u) ++p;
+    return p;
+}
+
+// Matches the body of an osm2dimacs coordinate record, "<osmid>-><id>\t...", returning a cursor at <id>.
+// Other comments, including free text containing "->", yield nullptr.
+INLINE const char *match_coord_record(const char *p, const char *e) {
+    p = textparse::skip_ws(p, e);
+    if(p < e && *p == '-') ++p; // OSM ids may be negative
+    const char *d = skip_digits(p, e);
+    if(d == p || e - d < 2 || d[0] != '-' || d[1] != '>') return nullptr;
+    const char *id = d + 2, *t = skip_digits(id, e);
+    return t != id && t < e && *t == '\t' ? id: nullptr;
+}
+
+// Calls arc(u, v, w) for 'a' lines and coord(id, lat, lon) for osm2dimacs "c osmid->id\tlat\tlon" lines in [begin, end);
+// other comment lines are skipped.
+// Ids are 1-based, as in the file; any other non-comment line is counted in nbad.
+template<typename ArcFunc, typename CoordFunc>
+void for_each_dimacs_line(const char *s, size_t begin, size_t end, const ArcFunc &arc, const CoordFunc &coord, size_t &nbad) {
+    using namespace textparse;
+    const char *p = s + begin, *const e = s + end;
+    while(p < e) {
+        const char *nl = next_line(p, e);
+        const char *q = skip_ws(p, nl);
+        if(q < nl) {
+            switch(*q) {
+                case 'a': {
+                    ++q;
+                    const uint64_t u = parse_uint(q, nl);
+                    const uint64_t v = parse_uint(q, nl);
+                    arc(u, v, parse_float<double>(q, nl));
+                    break;
+                }
+                case 'c':
+                    if(const char *id = match_coord_record(q + 1, nl)) {
+                        const uint64_t vid = parse_uint(id, nl);
+                        const double lat = parse_float<double>(id, nl);
+                        coord(vid, lat, parse_float<double>(id, nl));
+                    }
+                    break;
+                case '\n': break;
+                default: ++nbad;
+            }
+        }
+        p = nl;
+    }
+}
+
+} // namespace detail
+
+/*
+ * Parallel DIMACS shortest-path (.gr) parser.
+ *
+ * The 'p sp n m' line is located serially; the remainder is split into newline-aligned chunks
+ * and parsed twice in parallel: once to count out-degrees (and collect coordinates),
+ * and once to scatter arcs into place via atomic cursors. Arcs are then sorted by target within each vertex.
+ */
+template<typename WT=float, typename IT=uint32_t>
+CSRGraph<WT, IT> parse_dimacs_csr(const char *s, size_t n, size_t nchunks=0) {
+    using namespace textparse;
+    const char *p = s, *const e = s + n;
+    for(const char *q; p < e && ((q = skip_ws(p, e)) == e || *q != 'p');) p = next_line(p, e);
+    if(p == e) throw std::runtime_error("Missing 'p' line in DIMACS file");
+    const char *nl = next_line(p, e);
+    const char *q = skip_ws(skip_ws(p, nl) + 1, nl);
+    while(q < nl && !std::isspace(*q)) ++q; // Problem type, e.g. "sp"
+    const size_t nv = parse_uint(q, nl), nexpected = parse_uint(q, nl);
+    if(!nv) throw std::runtime_error("DIMACS file lists no vertices");
+    if(nv - 1 > size_t(std::numeric_limits<IT>::max()))
+        throw std::runtime_error("IT is too small for the number of vertices");
+    CSRGraph<WT, IT> ret;
+    ret.nv_ = nv;
+    if(!nchunks) {
+        nchunks = 1;
+        OMP_ONLY(nchunks = omp_get_max_threads() * 8;)
+    }
+    const auto bounds = make_chunks(s, nl - s, n, nchunks);
+    const size_t nb = bounds.size() - 1;
+    std::unique_ptr<std::atomic<uint64_t>[]> cursors(new std::atomic<uint64_t>[nv]());
+    std::vector<double> coords(2 * nv, std::numeric_limits<double>::quiet_NaN());
+    std::atomic<uint64_t> nbad(0), ncoords(0);
+    // Pass 1: count out-degrees, and place coordinates
+    OMP_PFOR_DYN
+    for(size_t c = 0; c < nb; ++c) {
+        size_t lbad = 0, lcoords = 0;
+        detail::for_each_dimacs_line(s, bounds[c], bounds[c + 1],
+            [&](uint64_t u, uint64_t v, double) {
+                if(unlikely(u - 1 >= nv || v - 1 >= nv)) ++lbad; // Also rejects 0, which wraps around
+                else cursors[u - 1].fetch_add(1, std::memory_order_relaxed);
+            },
+            [&](uint64_t id, double lat, double lon) {
+                if(unlikely(id - 1 >= nv)) {++lbad; return;}
+                coords[2 * (id - 1)] = lat;
+                coords[2 * (id - 1) + 1] = lon;
+                ++lcoords;
+            }, lbad);
+        nbad.fetch_add(lbad, std::memory_order_relaxed);
+        ncoords.fetch_add(lcoords, std::memory_order_relaxed);
+    }
+    if(nbad.load()) throw std::runtime_error(std::to_string(nbad.load()) + " DIMACS lines were malformed or had out-of-range vertex ids");
+    ret.offsets_.resize(nv + 1);
+    ret.offsets_[0] = 0;
+    for(size_t i = 0; i < nv; ++i) {
+        const uint64_t cnt = cursors[i].load(std::memory_order_relaxed);
+        cursors[i].store(ret.offsets_[i], std::memory_order_relaxed);
+        ret.offsets_[i + 1] = ret.offsets_[i] + cnt;
+    }
+    const size_t narcs = ret.offsets_[nv];
+    if(narcs != nexpected)
+        std::fprintf(stderr, "Warning: header lists %zu arcs, but %zu were found\n", nexpected, narcs);
+    ret.targets_.resize(narcs);
+    ret.weights_.resize(narcs);
+    // Pass 2: scatter arcs
+    OMP_PFOR_DYN
+    for(size_t c = 0; c < nb; ++c) {
+        size_t lbad = 0;
+        detail::for_each_dimacs_line(s, bounds[c], bounds[c + 1],
+            [&](uint64_t u, uint64_t v, double w) {
+                const auto pos = cursors[u - 1].fetch_add(1, std::memory_order_relaxed);
+                ret.targets_[pos] = v - 1;
+                ret.weights_[pos] = w;
+            }, [](auto...) {}, lbad);
+    }
+    cursors.reset();
+    OMP_PFOR_DYN
+    for(size_t u = 0; u < nv; ++u) {
+        const auto start = ret.offsets_[u], stop = ret.offsets_[u + 1];
+        auto tp = ret.targets_.data() + start;
+        if(std::is_sorted(tp, tp + (stop - start))) continue;
+        std::vector<std::pair<IT, WT>> tmp(stop - start);
+        for(size_t j = 0; j < tmp.size(); ++j) tmp[j] = {tp[j], ret.weights_[start + j]};
+        shared::sort(tmp.begin(), tmp.end(), [](const auto &x, const auto &y) {return x.first < y.first;});
+        for(size_t j = 0; j < tmp.size(); ++j) {
+            tp[j] = tmp[j].first;
+            ret.weights_[start + j] = tmp[j].second;
+        }
+    }
+    if(const size_t nc = ncoords.load()) {
+        if(nc != nv) std::fprintf(stderr, "Warning: coordinates found for %zu of %zu vertices\n", nc, nv);
+        ret.coords_ = std::move(coords);
+    }
+    return ret;
+}
+
+template<typename WT=float, typename IT=uint32_t>
+CSRGraph<WT, IT> dimacs2csr(const std::string &path) {
+    MINOCORE_PHASE("dimacs2csr");
+    return textparse::with_file_contents(path, [](const char *s, size_t n) {
+        return parse_dimacs_csr<WT, IT>(s, n);
+    });
+}
+
+inline std::string csr_graph_cache_path(const std::string &path) {
+    return path + ".mcg";
+}
+
+/*
+ * Parses path once, writing a binary CSR graph next to it;
+ * later calls map the cache read-only instead of parsing.
+ */
+template<typename WT=float, typename IT=uint32_t>
+MappedCSRGraph<WT, IT> dimacs2csr_cached(const std::string &path) {
+    const std::string cpath = csr_graph_cache_path(path);
+    struct stat in, out;
+    if(::stat(path.data(), &in)) throw std::runtime_error(std::string("Failed to stat ") + path);
+    if(::stat(cpath.data(), &out) || out.st_mtime < in.st_mtime)
+        dimacs2csr<WT, IT>(path).write(cpath);
+    return MappedCSRGraph<WT, IT>(cpath);
+}
+
+/*
+ * Builds a minocore::Graph from a CSR graph with vertices pre-sized, skipping text parsing entirely.
+ * For undirected graphs, an arc pair u -> v, v -> u becomes a single edge with the smaller of the two weights,
+ * so shortest paths match the arcs' own; arcs listed in only one direction are kept.
+ */
+template<typename DirectedS=undirectedS, typename VtxProps=boost::no_property, typename GraphProps=boost::no_property,
+         typename WT, typename IT>
+Graph<DirectedS, float, VtxProps, GraphProps> csr2graph(const CSRGraphView<WT, IT> &csr) {
+    using GraphType = Graph<DirectedS, float, VtxProps, GraphProps>;
+    using edge_property_type = typename GraphType::edge_property_type;
+    static constexpr bool undirected = std::is_same_v<DirectedS, boost::undirectedS>;
+    const size_t nv = csr.num_vertices();
+    GraphType ret(nv);
+    for(size_t u = 0; u < nv; ++u) {
+        const IT *tp = csr.targets(u);
+        const WT *wp = csr.weights(u);
+        for(size_t i = 0, d = csr.degree(u); i < d; ++i) {
+            const size_t v = tp[i];
+            WT w = wp[i];
+            if constexpr(undirected) {
+                const int64_t rev = csr.find_arc(v, u);
+                if(v < u && rev >= 0) continue;
+                if(rev >= 0) w = std::min(w, csr.weights()[rev]);
+            }
+            boost::add_edge(u, v, static_cast<edge_property_type>(w), ret);
+        }
+    }
+    return ret;
+}
+
+/*
+ * Single-source shortest paths directly over a CSR graph.
+ * dist must have room for num_vertices() entries; unreachable vertices are set to max().
+ */
+template<typename FT=double, typename WT, typename IT>
+void csr_dijkstra(const CSRGraphView<WT, IT> &csr, size_t source, FT *dist) {
+    const size_t nv = csr.num_vertices();
+    std::fill(dist, dist + nv, std::numeric_limits<FT>::max());
+    using QE = std::pair<FT, IT>;
+    std::priority_queue<QE, std::vector<QE>, std::greater<QE>> pq;
+    dist[source] = 0;
+    pq.emplace(FT(0), IT(source));
+    while(!pq.empty()) {
+        const FT d = pq.top().first;
+        const IT u = pq.top().second;
+        pq.pop();
+        if(d > dist[u]) continue; // Stale entry
+        csr.for_each_arc(u, [&](IT v, WT w) {
+            const FT nd = d + w;
+            if(nd < dist[v]) {
+                dist[v] = nd;
+                pq.emplace(nd, v);
+            }
+        });
+    }
+}
+
+} // namespace graph
+
+using graph::CSRGraph;
+using graph::CSRGraphView;
+using graph::MappedCSRGraph;
+using graph::dimacs2csr;
+using graph::dimacs2csr_cached;
+using graph::csr2graph;
+
+} // namespace minocore
+
+#endif /* FGC_GRAPH_CSR_H__ */
@@ -3,7 +3,13 @@
 #define FGC_GRAPH_DIST_H__
 #include "minocore/graph/graph.h"
 #include "diskmat/diskmat.h"
+#include "minocore/util/trace.h"
+#include "minocore/util/exception.h"
+#include <algorithm>
 #include <atomic>
+#include <cmath>
+#include <numeric>
+#include <unordered_map>
 
 namespace minocore {
 using diskmat::DiskMat;
@@ -11,6 +17,7 @@ using diskmat::DiskMat;
 namespace graph {
 template<typename Graph, typename MatType, typename VType=std::vector<typename boost::graph_traits<Graph>::vertex_descriptor>>
 void fill_graph_distmat(const Graph &x, MatType &mat, const VType *sources=nullptr, bool only_sources_as_dests=false, bool all_sources=false) {
+    MINOCORE_PHASE("fill_graph_distmat");
     const size_t nrows = all_sources || (sources == nullptr) ? boost::num_vertices(x)
                                                              : sources->size();
     if(only_sources_as_dests && sources == nullptr) throw std::invalid_argument("only_sources_as_dests requires sources be non-null");
@@ -48,7 +55,7 @@ void fill_graph_distmat(const Graph &x, MatType &mat, const VType *sources=nullp
             ++rows_complete;
             const auto val = rows_complete.load();
             if((val & (val - 1)) == 0)
-                std::fprintf(stderr, "Completed dijkstra for row %zu/%zu\n", val, nrows);
+                MINOCORE_LOG("Completed dijkstra for row %zu/%zu\n", val, nrows);
         }
     } else {
         assert(ncol == boost::num_vertices(x));
@@ -61,7 +68,7 @@ void fill_graph_distmat(const Graph &x, MatType &mat, const VType *sources=nullp
             ++rows_complete;
             const auto val = rows_complete.load();
             if((val & (val - 1)) == 0)
-                std::fprintf(stderr, "Completed dijkstra for row %zu/%zu\n", val, nrows);
+                MINOCORE_LOG("Completed dijkstra for row %zu/%zu\n", val, nrows);
         }
     }
 }
@@ -73,7 +80,7 @@ graph2diskmat(const Graph &x, std::string path, const VType *sources=nullptr, bo
     using FT = typename Graph::edge_property_type::value_type;
     size_t nv = sources && only_sources_as_dests ? sources->size(): boost::num_vertices(x);
     size_t nrows = all_sources || !sources ? boost::num_vertices(x): sources->size();
-    std::fprintf(stderr, "all sources: %d. nrows: %zu\n", all_sources, nrows);
+    MINOCORE_LOG("all sources: %d. nrows: %zu\n", all_sources, nrows);
     DiskMat<FT> ret(nrows, nv, path);
     fill_graph_distmat(x, ret, sources, only_sources_as_dests, all_sources);
     return ret;
@@ -87,14 +94,173 @@ graph2rammat(const Graph &x, std::string, const VType *sources=nullptr, bool onl
     using FT = typename Graph::edge_property_type::value_type;
     size_t nv = sources && only_sources_as_dests ? sources->size(): boost::num_vertices(x);
     size_t nrows = all_sources || !sources ? boost::num_vertices(x): sources->size();
-    std::fprintf(stderr, "all sources: %d. nrows: %zu\n", all_sources, nrows);
+    MINOCORE_LOG("all sources: %d. nrows: %zu\n", all_sources, nrows);
     blaze::DynamicMatrix<FT>  ret(nrows, nv);
     fill_graph_distmat(x, ret, sources, only_sources_as_dests, all_sources);
     return ret;
 }
 
 
+/*
+ * Single-source shortest-path rows, each computed at most once.
+ * For evaluating many overlapping source sets, e.g., nested coresets of increasing size (CoresetSampler::sample_nested).
+ */
+template<typename Graph, typename FT=float>
+class SSSPRowCache {
+    using Vertex = typename boost::graph_traits<Graph>::vertex_descriptor;
+    const Graph &g_;
+    blaze::DynamicMatrix<FT> rows_;
+    std::unordered_map<Vertex, uint32_t> slots_;
+public:
+    SSSPRowCache(const Graph &g, size_t expected_rows=0): g_(g), rows_(0, boost::num_vertices(g)) {
+        rows_.reserve(expected_rows * rows_.spacing());
+    }
+    /*
+     * Runs Dijkstra from each of sources[0..n) not already cached, in parallel.
+     * Returns the number of new rows.
+     */
+    template<typename VT>
+    size_t ensure(const VT *sources, size_t n) {
+        MINOCORE_PHASE("SSSPRowCache::ensure");
+        std::vector<Vertex> todo;
+        const size_t start = rows_.rows();
+        for(size_t i = 0; i < n; ++i)
+            if(slots_.emplace(Vertex(sources[i]), start + todo.size()).second)
+                todo.push_back(sources[i]);
+        if(todo.empty()) return 0;
+        const size_t nr = start + todo.size();
+        if(nr * rows_.spacing() > rows_.capacity())
+            rows_.reserve(std::max(2 * rows_.capacity(), nr * rows_.spacing()));
+        rows_.resize(nr, rows_.columns(), true);
+        OMP_PFOR_DYN
+        for(size_t i = 0; i < todo.size(); ++i)
+            boost::dijkstra_shortest_paths(g_, todo[i], boost::distance_map(&rows_(start + i, 0)));
+        MINOCORE_LOG("SSSPRowCache: %zu new rows, %zu total\n", todo.size(), nr);
+        return todo.size();
+    }
+    bool contains(Vertex v) const {return slots_.find(v) != slots_.end();}
+    auto row(Vertex v) const {return blaze::row(rows_, slots_.at(v));}
+    // Rows for sources[0..n), which must have been passed to ensure, as a new matrix
+    template<typename VT>
+    blaze::DynamicMatrix<FT> gather(const VT *sources, size_t n) const {
+        std::vector<uint32_t> idx(n);
+        for(size_t i = 0; i < n; ++i) idx[i] = slots_.at(Vertex(sources[i]));
+        return blaze::rows(rows_, idx.data(), idx.size());
+    }
+    size_t size() const {return rows_.rows();}
+    const blaze::DynamicMatrix<FT> &matrix() const {return rows_;}
+};
+
+/*
+ * Multi-source shortest paths: dist[v] = min over sources of d(s, v), with unreachable vertices set to max().
+ * Unlike adding a synthetic vertex joined to the sources, this leaves g untouched,
+ * so it can be called concurrently on a shared graph. heap is caller-provided scratch space.
+ */
+template<typename Graph, typename VT, typename FT>
+void multi_source_dijkstra(const Graph &g, const VT *sources, size_t n, FT *dist,
+                           std::vector<std::pair<FT, uint32_t>> &heap)
+{
+    using QE = std::pair<FT, uint32_t>;
+    const size_t nv = boost::num_vertices(g);
+    std::fill(dist, dist + nv, std::numeric_limits<FT>::max());
+    heap.clear();
+    for(size_t i = 0; i < n; ++i) {
+        const uint32_t s = sources[i];
+        if(dist[s] != FT(0)) {
+            dist[s] = 0;
+            heap.emplace_back(FT(0), s);
+        }
+    }
+    // All keys are zero, so heap is already a valid heap
+    const auto cmp = std::greater<QE>();
+    const auto wmap = boost::get(boost::edge_weight, g);
+    typename boost::graph_traits<Graph>::out_edge_iterator ei, ee;
+    size_t heapops = heap.size();
+    while(!heap.empty()) {
+        std::pop_heap(heap.begin(), heap.end(), cmp);
+        const auto [d, u] = heap.back();
+        heap.pop_back();
+        if(d > dist[u]) continue; // Stale entry
+        for(std::tie(ei, ee) = boost::out_edges(u, g); ei != ee; ++ei) {
+            const uint32_t v = boost::target(*ei, g);
+            const FT nd = d + boost::get(wmap, *ei);
+            if(nd < dist[v]) {
+                dist[v] = nd;
+                heap.emplace_back(nd, v);
+                std::push_heap(heap.begin(), heap.end(), cmp);
+                ++heapops;
+            }
+        }
+    }
+    MINOCORE_COUNT(HEAP_OPS, heapops);
+}
+
+/*
+ * Coreset distortion for many center sets at once.
+ * ret(c, j) = |sum_i w_i d(C_c, x_i)^z / sum_v d(C_c, v)^z - 1| for center set C_c and coreset j,
+ * with the full cost taken over domain (e.g., the vertices within a bounding box) if provided, and over all vertices otherwise.
+ *
+ * Center sets are processed in parallel, each thread with its own distance buffer and heap, without copying or modifying g.
+ * The coresets are merged into a single vertex-sorted list of (vertex, coreset, weight) triples up front,
+ * so that each center set is reduced against every coreset in one ascending sweep over its distance buffer.
+ * CenterSets is a random-access container of containers of vertex ids; coresets need indices_ and weights_ (as IndexCoreset).
+ */
+template<typename Graph, typename CenterSets, typename CoresetCon>
+blaze::DynamicMatrix<double>
+coreset_distortions(const Graph &g, const CenterSets &centersets, const CoresetCon &coresets, double z=1.,
+                    const std::vector<typename boost::graph_traits<Graph>::vertex_descriptor> *domain=nullptr)
+{
+    MINOCORE_PHASE("coreset_distortions");
+    const size_t nv = boost::num_vertices(g), ncs = coresets.size(), ncenters = centersets.size();
+    MINOCORE_REQUIRE(nv <= std::numeric_limits<uint32_t>::max(), "Vertex ids must fit in 32 bits");
+    struct Entry {
+        uint32_t vertex, coreset;
+        double weight;
+        bool operator<(const Entry &o) const {return std::tie(vertex, coreset) < std::tie(o.vertex, o.coreset);}
+    };
+    std::vector<Entry> entries;
+    {
+        size_t total = 0;
+        for(const auto &cs: coresets) total += cs.size();
+        entries.reserve(total);
+    }
+    for(size_t j = 0; j < ncs; ++j) {
+        const auto &cs = coresets[j];
+        for(size_t i = 0; i < cs.size(); ++i)
+            entries.push_back(Entry{uint32_t(cs.indices_[i]), uint32_t(j), double(cs.weights_[i])});
+    }
+    std::sort(entries.begin(), entries.end());
+    blaze::DynamicMatrix<double> ret(ncenters, ncs);
+    OMP_PRAGMA("omp parallel")
+    {
+        std::vector<double> dist(nv);
+        std::vector<std::pair<double, uint32_t>> heap;
+        std::vector<typename boost::graph_traits<Graph>::vertex_descriptor> centers;
+        std::vector<double> cscost(ncs);
+        OMP_PRAGMA("omp for schedule(dynamic)")
+        for(size_t c = 0; c < ncenters; ++c) {
+            const auto &cset = centersets[c];
+            centers.assign(std::begin(cset), std::end(cset));
+            multi_source_dijkstra(g, centers.data(), centers.size(), dist.data(), heap);
+            if(z != 1.)
+                for(auto &d: dist) d = std::pow(d, z);
+            double fullcost = 0.;
+            if(domain) for(const auto v: *domain) fullcost += dist[v];
+            else       fullcost = std::accumulate(dist.begin(), dist.end(), 0.);
+            std::fill(cscost.begin(), cscost.end(), 0.);
+            for(const auto &e: entries) cscost[e.coreset] += dist[e.vertex] * e.weight;
+            const double fcinv = 1. / fullcost;
+            auto r = row(ret, c);
+            for(size_t j = 0; j < ncs; ++j) r[j] = std::abs(cscost[j] * fcinv - 1.);
+        }
+    }
+    return ret;
+}
+
 } // namespace graph
+using graph::SSSPRowCache;
+using graph::multi_source_dijkstra;
+using graph::coreset_distortions;
 using graph::fill_graph_distmat;
 using graph::graph2diskmat;
 using graph::graph2rammat;
@@ -1,5 +1,6 @@
 #pragma once
 #include "graph.h"
+#include "csr.h"
 #include <fstream>
 #include <string>
 #include <climits>
@@ -51,7 +52,7 @@ Graph<DirectedS, float, VtxProps, GraphProps> parse_dimacs_unweighted(std::strin
         ++id;
     }
     std::cout << line << '\n';
-    std::fprintf(stderr, "num edges: %zu. num vertices: %zu\n", boost::num_edges(ret), boost::num_vertices(ret));
+    MINOCORE_LOG("num edges: %zu. num vertices: %zu\n", boost::num_edges(ret), boost::num_vertices(ret));
     return ret;
 }
 
@@ -100,53 +101,15 @@ Graph<DirectedS, float, VtxProps, GraphProps> parse_nber(std::string fn) {
         assert(it->second < boost::num_vertices(ret));
         assert(it->first < boost::num_vertices(ret));
     }
-    std::fprintf(stderr, "num edges: %zu. num vertices: %zu\n", boost::num_edges(ret), boost::num_vertices(ret));
+    MINOCORE_LOG("num edges: %zu. num vertices: %zu\n", boost::num_edges(ret), boost::num_vertices(ret));
     return ret;
 }
+// DIMACS shortest-path (.gr) files are parsed in parallel into CSR form, then built in bulk.
+// Arcs listed in both directions become a single undirected edge, with the smaller of the two weights.
 static minocore::Graph<undirectedS> dimacs_official_parse(std::string input) {
-    minocore::Graph<undirectedS> g;
-    std::ifstream ifs(input);
-    std::string graphtype;
-    size_t nnodes = 0, nedges = 0;
-    for(std::string line; std::getline(ifs, line);) {
-        if(line.empty()) continue;
-        switch(line.front()) {
-            case 'c': break; // nothing
-            case 'p': {
-                const char *p = line.data() + 2, *p2 = ++p;
-                while(!std::isspace(*p2)) ++p2;
-                graphtype = std::string(p, p2 - p);
-                std::fprintf(stderr, "graphtype: %s\n", graphtype.data());
-                p = p2 + 1;
-                nnodes = std::strtoull(p, nullptr, 10);
-                for(size_t i = 0; i < nnodes; ++i)
-                    boost::add_vertex(g); // Add all the vertices
-                if((p2 = std::strchr(p, ' ')) == nullptr) throw std::runtime_error(std::string("Failed to parse file at ") + input);
-                p = p2 + 1;
-                nedges = std::strtoull(p, nullptr, 10);
-                std::fprintf(stderr, "n: %zu. m: %zu\n", nnodes, nedges);
-                break;
-            }
-            case 'a': {
-                assert(nnodes);
-                char *strend;
-                const char *p = line.data() + 2;
-                size_t lhs = std::strtoull(p, &strend, 10);
-                assert(lhs >= 1 || !std::fprintf(stderr, "p: %s\n", p));
-                p = strend + 1;
-                size_t rhs = std::strtoull(p, &strend, 10);
-                assert(rhs >= 1 || !std::fprintf(stderr, "p: %s\n", p));
-                p = strend + 1;
-                double dist = std::atof(p);
-                boost::add_edge(lhs - 1, rhs - 1, dist, g);
-                assert(lhs - 1 < boost::num_vertices(g));
-                assert(rhs - 1 < boost::num_vertices(g));
-                break;
-            }
-            default: std::fprintf(stderr, "Unexpected: this line! (%s)\n", line.data()); throw std::runtime_error("");
-        }
-    }
-    return g;
+    auto csr = dimacs2csr(input);
+    MINOCORE_LOG("n: %zu. m: %zu\n", csr.num_vertices(), csr.num_arcs());
+    return csr2graph<undirectedS>(csr.view());
 }
 
 static minocore::Graph<undirectedS> dimacs_parse(std::string fn) {
@@ -172,6 +135,8 @@ static minocore::Graph<undirectedS> parse_by_fn(std::string input) {
     minocore::Graph<undirectedS> g;
     if(input.find(".csv") != std::string::npos) {
         g = csv_parse(input);
+    } else if(input.find(".mcg") != std::string::npos) {
+        g = csr2graph<undirectedS>(MappedCSRGraph<>(input).view());
     } else if(input.find(".gr") != std::string::npos && input.find(".graph") == std::string::npos) {
         g = dimacs_official_parse(input);
     } else g = dimacs_parse(input);
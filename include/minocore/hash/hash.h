@@ -3,6 +3,7 @@
 #define FGC_HASH_H__
 #include "minocore/util/blaze_adaptor.h"
 #include "minocore/util/macros.h"
+#include "minocore/util/trace.h"
 #include <random>
 #include "xxHash/xxh3.h"
 #include "xxHash/xxhash.h"
@@ -360,6 +361,11 @@ public:
             for(auto &pair: tables_[i])
                 shared::sort(pair.second.begin(), pair.second.end());
     }
+    void clear() {
+        for(unsigned i = 0; i < l(); ++i)
+            tables_[i].clear();
+        ids_used_ = 0;
+    }
     const LSHasherSettings &settings() const {return hasher_.settings();}
     auto k()   const {return settings().k_;}
     auto l()   const {return settings().l_;}
@@ -384,7 +390,7 @@ public:
     template<typename MT, bool OSO>
     void add(const blaze::Matrix<MT, OSO> &input, IT idoffset=0) {
         auto hv = blaze::evaluate(hash(input));
-        std::fprintf(stderr, "hv shape: %zu/%zu.\n", hv.rows(), hv.columns());
+        MINOCORE_LOG("hv shape: %zu/%zu.\n", hv.rows(), hv.columns());
         if(nh_ != hv.columns()) {
             std::fprintf(stderr, "[%s] nh_: %u. hv.columns: %zu\n", __PRETTY_FUNCTION__, nh_, hv.columns());
             std::exit(1);
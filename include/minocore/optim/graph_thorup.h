@@ -4,6 +4,7 @@
 #include <thread>
 #include "minocore/graph/graph.h"
 #include "minocore/util/blaze_adaptor.h"
+#include "minocore/util/trace.h"
 #include <cassert>
 
 
@@ -44,6 +45,7 @@ std::vector<typename boost::graph_traits<Graph>::vertex_descriptor>
 template<typename Graph, typename BBoxContainer=std::vector<typename boost::graph_traits<Graph>::vertex_descriptor>>
 auto
 thorup_sample(Graph &x, unsigned k, uint64_t seed, size_t max_sampled=0, BBoxContainer *bbox_vertices_ptr=nullptr) {
+    MINOCORE_PHASE("thorup_sample");
     using Vertex = typename boost::graph_traits<Graph>::vertex_descriptor;
     if(max_sampled == 0) max_sampled = boost::num_vertices(x);
     // Algorithm E, Thorup p.418
@@ -54,9 +56,9 @@ thorup_sample(Graph &x, unsigned k, uint64_t seed, size_t max_sampled=0, BBoxCon
     const double eps  = 1. / std::sqrt(logn);
     size_t samples_per_round = std::ceil(21. * k * logn / eps);
     size_t iterations_per_round = std::ceil(3 * logn);
-    std::fprintf(stderr, "max sampled: %zu\n", max_sampled);
-    std::fprintf(stderr, "samples per round: %zu\n", samples_per_round);
-    std::fprintf(stderr, "iterations per round: %zu\n", iterations_per_round);
+    MINOCORE_LOG("max sampled: %zu\n", max_sampled);
+    MINOCORE_LOG("samples per round: %zu\n", samples_per_round);
+    MINOCORE_LOG("iterations per round: %zu\n", iterations_per_round);
     flat_hash_set<Vertex> samples;
     std::vector<Vertex> current_buffer;
     std::mt19937_64 mt(seed);
@@ -65,7 +67,7 @@ thorup_sample(Graph &x, unsigned k, uint64_t seed, size_t max_sampled=0, BBoxCon
         samples.insert(current_buffer.begin(), current_buffer.end());
         current_buffer.clear();
         if(samples.size() >= max_sampled) break;
-        std::fprintf(stderr, "Samples size after iter %zu/%zu: %zu\n", i, nr, samples.size());
+        MINOCORE_LOG("Samples size after iter %zu/%zu: %zu\n", i, nr, samples.size());
     }
     current_buffer.assign(samples.begin(), samples.end());
     if(max_sampled < samples.size())
@@ -80,6 +82,7 @@ thorup_d(Graph &x, RNG &rng, size_t nperround, size_t maxnumrounds,
          const BBoxTemplate<typename boost::graph_traits<Graph>::vertex_descriptor, BBoxArgs...> *bbox_vertices_ptr=nullptr,
          const WType *weights=nullptr)
 {
+    MINOCORE_PHASE("thorup_d");
     using Vertex = typename boost::graph_traits<Graph>::vertex_descriptor;
     using edge_cost = std::decay_t<decltype(get(boost::edge_weight_t(), x, std::declval<Graph>()))>;
     assert_connected(x);
@@ -260,7 +263,7 @@ std::vector<typename boost::graph_traits<Graph>::vertex_descriptor>
     }
     VERBOSE_ONLY(std::fprintf(stderr, "num vertices: %zu\n", boost::num_vertices(x));)
     boost::clear_vertex(synthetic_vertex, x);
-    std::fprintf(stderr, "size: %zu\n", container.size());
+    MINOCORE_LOG("size: %zu\n", container.size());
     return container;
 }
 
@@ -306,7 +309,7 @@ get_costs(Graph &x, const Container &container) {
     costs.resize(nv);
     assert(costs.size() == assignments.size());
     assert(nv == costs.size());
-    std::fprintf(stderr, "Total cost of solution: %g\n", blaze::sum(costs));
+    MINOCORE_LOG("Total cost of solution: %g\n", blaze::sum(costs));
     return std::make_pair(std::move(costs), assignments);
 }
 
@@ -319,6 +322,7 @@ thorup_sample_mincost(Graph &x, unsigned k, uint64_t seed, unsigned num_iter,
 {
     // Modification of Thorup, wherein we run Thorup Algorithm E
     // with eps = 0.5 a fixed number of times and return the best result.
+    MINOCORE_PHASE("thorup_sample_mincost");
     assert_connected(x);
 
     static constexpr double eps = 0.5;
@@ -346,7 +350,7 @@ thorup_sample_mincost(Graph &x, unsigned k, uint64_t seed, unsigned num_iter,
             OMP_CRITICAL
             {
                 if(next.second < bestsol.second) {
-                    std::fprintf(stderr, "Replacing old cost of %g/%zu with %g/%zu\n", bestsol.second, bestsol.first.size(), next.second, next.first.size());
+                    MINOCORE_LOG("Replacing old cost of %g/%zu with %g/%zu\n", bestsol.second, bestsol.first.size(), next.second, next.first.size());
                     std::swap(next, bestsol);
                 }
             }
@@ -369,7 +373,7 @@ blaze::DynamicVector<IType> histogram_assignments(const Con &c, unsigned ncenter
         ++ret.at(c[vtces[i]]);
     }
 #ifndef NDEBUG
-    std::fprintf(stderr, "Sum of center counts: %u\n", blaze::sum(ret));
+    MINOCORE_LOG("Sum of center counts: %u\n", blaze::sum(ret));
 #endif
     return ret;
 }
@@ -403,7 +407,7 @@ thorup_sample_mincost_with_weights(Graph &x, unsigned k, uint64_t seed,
     auto ccounts = histogram_assignments(firstset.second, firstset.first.size(), *bbox_vertices_ptr);
     assert(firstset.first.size());
 #ifndef NDEBUG
-    std::fprintf(stderr, "sum ccounts before anything: %u/%zu\n", blaze::sum(ccounts), ccounts.size());
+    MINOCORE_LOG("sum ccounts before anything: %u/%zu\n", blaze::sum(ccounts), ccounts.size());
     auto check_sum = [&](const auto &countcontainer) {return sum(countcontainer) == (bbox_vertices_ptr ? bbox_vertices_ptr->size(): boost::num_vertices(x));};
     assert(check_sum(ccounts));
 #endif
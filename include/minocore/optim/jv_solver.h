@@ -2,6 +2,7 @@
 #define JV_SOLVER_H__
 #include "minocore/util/blaze_adaptor.h"
 #include "minocore/util/packed.h"
+#include "minocore/util/trace.h"
 #include <chrono>
 #include <atomic>
 #include <mutex>
@@ -147,7 +148,7 @@ private:
             }
             n_open_clients_ = update_facilities(next_paid_.top().second, working_open_facilities_[next_paid_.top().second], time);
             //next_paid_.pop_top();
-            std::fprintf(stderr, "n open clients: %zu. facilities size: %zu\n", n_open_clients_, next_paid_.size());
+            MINOCORE_LOG("n open clients: %zu. facilities size: %zu\n", n_open_clients_, next_paid_.size());
             if(n_open_clients_ == 0) break;
         }
         return time;
@@ -649,7 +650,7 @@ public:
             }
             size_t nf = solver.final_open_facilities_.size();
             if(nf == k) {
-                std::fprintf(stderr, "[%zu] nf == k, setting to terminate\n", my_id);
+                MINOCORE_LOG("[%zu] nf == k, setting to terminate\n", my_id);
                 terminate.store(1);
                 maxcost.store(mycost);
                 mincost.store(mycost);
@@ -659,21 +660,21 @@ public:
                 }
                 break;
             } else if(nf > k) {
-                std::fprintf(stderr, "[%zu] nf > k, setting mincost from %g to %g\n", my_id, mincost.load(), mycost);
+                MINOCORE_LOG("[%zu] nf > k, setting mincost from %g to %g\n", my_id, mincost.load(), mycost);
                 double lastmincost = mincost;
                 while(mycost > lastmincost && !std::atomic_compare_exchange_weak(
                       &mincost,
                       &lastmincost,
                       mycost))
                 {
-                     std::fprintf(stderr, "Doing compare/weak with mincost = %g and last = %g\n", mincost.load(), lastmincost);
+                     MINOCORE_LOG("Doing compare/weak with mincost = %g and last = %g\n", mincost.load(), lastmincost);
                 }
                 if(nf < maxk) {
-                    std::fprintf(stderr, "[%zu] nf > k, setting maxk from %u to %zu at %g \n", my_id, maxk, nf, mycost);
+                    MINOCORE_LOG("[%zu] nf > k, setting maxk from %u to %zu at %g \n", my_id, maxk, nf, mycost);
                     std::lock_guard<std::mutex> lock(mut);
                     maxk = nf;
                 }
-                std::fprintf(stderr, "[%zu] released lock, nf > k[%u] (csize: %zu at %g) Old min cost: %g\n", my_id, k, nf, mycost, lastmincost);
+                MINOCORE_LOG("[%zu] released lock, nf > k[%u] (csize: %zu at %g) Old min cost: %g\n", my_id, k, nf, mycost, lastmincost);
             } else {
                 double lastmaxcost = maxcost;
                 while(mycost < lastmaxcost && !std::atomic_compare_exchange_weak(
@@ -684,7 +685,7 @@ public:
                     std::lock_guard<std::mutex> lock(mut);
                     mink = nf;
                 }
-                std::fprintf(stderr, "[%zu] released lock, nf < k [%u] (csize: %zu at %g). Old max cost: %g\n", my_id, k,  nf, mycost, lastmaxcost);
+                MINOCORE_LOG("[%zu] released lock, nf < k [%u] (csize: %zu at %g). Old max cost: %g\n", my_id, k,  nf, mycost, lastmaxcost);
             }
             double cost;
             typename std::set<double>::const_iterator it;
@@ -697,13 +698,13 @@ public:
                 } else {
                     cost = (maxcost.load() - mincost.load()) * std::pow(randval, 3) + mincost.load();
                 }
-                std::fprintf(stderr, "[%zu] randomly selected cost: %g\n", my_id, cost);
+                MINOCORE_LOG("[%zu] randomly selected cost: %g\n", my_id, cost);
                 // TODO: Consider random selection in geometric mean
             }
             //while(maxcost.load() != mincost.load() &&
             //      myspacing / (maxcost.load() - mincost.load()) < spacing * .1 &&
             //      !terminate.load());
-            std::fprintf(stderr, "Selected new cost: %g\n", cost);
+            MINOCORE_LOG("Selected new cost: %g\n", cost);
             {
                 std::lock_guard<std::mutex> lock(mut);
                 current_running.erase(mycost);
@@ -711,8 +712,8 @@ public:
             }
             mycost = cost;
             if(terminate.load()) break;
-            std::fprintf(stderr, "thread %zu viewing min/max costs of %g/%g\n", my_id,
-                                mincost.load(), maxcost.load());
+            MINOCORE_LOG("thread %zu viewing min/max costs of %g/%g\n", my_id,
+                        mincost.load(), maxcost.load());
         }
     }
     std::pair<std::vector<IT>, std::vector<std::vector<IT>>>
@@ -773,7 +774,7 @@ public:
                           std::ref(terminate), seed + ind, num_threads, std::ref(rounds_completed), maxrounds, k
             );
         }
-        std::fprintf(stderr, "Threads started [%zu]\n", threads.size());
+        MINOCORE_LOG("Threads started [%zu]\n", threads.size());
         for(auto &t: threads) t.join();
         maxcost = amaxcost.load();
         mincost = amincost.load();
@@ -870,8 +871,8 @@ public:
             if(verbose) std::fprintf(stderr, "[Round %zu] Facility cost: %0.12g. Size: %zu. Time in ms: %g. \n",
                                      roundnum, medcost, final_open_facilities_.size(), (fstop - fstart).count() * 0.000001);
             if(++roundnum > maxrounds || std::abs(mincost - maxcost) < 1e-16 * medcost) {
-                std::fprintf(stderr, "Failed to find exact solution using JV in %zu rounds. Now using local search from current solution of %zu points to desired k = %u\n",
-                             roundnum, final_open_facilities_.size(), k);
+                MINOCORE_LOG("Failed to find exact solution using JV in %zu rounds. Now using local search from current solution of %zu points to desired k = %u\n",
+                     roundnum, final_open_facilities_.size(), k);
                 while(final_open_facilities_.size() < k) {
                     final_open_facilities_.push_back(local_best_to_add());
                 }
@@ -886,8 +887,8 @@ public:
         }
         auto kmed_stop = std::chrono::high_resolution_clock::now();
         FT sol_cost = calculate_cost(false);
-        std::fprintf(stderr, "Solution cost with %zu centers: %g. Time to perform clustering: %g\n", final_open_facilities_.size(), sol_cost,
-                     (kmed_stop - kmed_start).count() * 1.e-6);
+        MINOCORE_LOG("Solution cost with %zu centers: %g. Time to perform clustering: %g\n", final_open_facilities_.size(), sol_cost,
+             (kmed_stop - kmed_start).count() * 1.e-6);
         return std::make_pair(final_open_facilities_, final_open_facility_assignments_);
     }
     IT local_best_to_add() const {
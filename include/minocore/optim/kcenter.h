@@ -3,6 +3,7 @@
 #include "minocore/coreset/matrix_coreset.h"
 #include "minocore/util/div.h"
 #include "minocore/util/blaze_adaptor.h"
+#include "minocore/util/trace.h"
 #include <queue>
 
 namespace minocore {
@@ -13,6 +14,106 @@ using blz::sqrL2Norm;
 using blz::push_back;
 
 
+namespace detail {
+
+/*
+ * Factor used for triangle-inequality pruning in farthest-first traversal:
+ * for a metric, d(c_new, c_a) >= 2 d(x, c_a) implies d(x, c_new) >= d(x, c_a);
+ * for squared L2, the same holds with a factor of 4 on the squared distances.
+ * Zero means the norm is not known to support pruning.
+ */
+template<typename Norm> struct kcenter_pruning_factor: std::integral_constant<int, 0> {};
+template<> struct kcenter_pruning_factor<blz::L1Norm>: std::integral_constant<int, 2> {};
+template<> struct kcenter_pruning_factor<blz::L2Norm>: std::integral_constant<int, 2> {};
+template<> struct kcenter_pruning_factor<blz::L3Norm>: std::integral_constant<int, 2> {};
+template<> struct kcenter_pruning_factor<blz::L4Norm>: std::integral_constant<int, 2> {};
+template<> struct kcenter_pruning_factor<blz::maxNormFunctor>: std::integral_constant<int, 2> {};
+template<> struct kcenter_pruning_factor<blz::infNormFunction>: std::integral_constant<int, 2> {};
+template<> struct kcenter_pruning_factor<blz::sqrL2Norm>: std::integral_constant<int, 4> {};
+
+} // namespace detail
+
+/*
+ * Farthest-first traversal with triangle-inequality pruning.
+ * Each point keeps its distance to (and the index of) its nearest center.
+ * When a new center is added, its distances to the existing centers are computed once,
+ * and points whose assigned center is at least factor * (their current distance) away from the new center
+ * are skipped, since the new center cannot be closer.
+ * The distance updates and the argmax are performed in parallel in blocks: each block first compacts the points
+ * which survive the test, then evaluates their distances to the new center in one pass.
+ */
+template<typename Iter, typename FT=shared::ContainedTypeFromIterator<Iter>,
+         typename IT=std::uint32_t, typename RNG, typename Norm=L2Norm>
+std::vector<IT>
+kcenter_greedy_2approx_pruned(Iter first, Iter end, RNG &rng, size_t k, const Norm &norm=Norm(), size_t maxdest=0)
+{
+    static constexpr int factor = detail::kcenter_pruning_factor<Norm>::value;
+    static_assert(factor > 0, "Norm must support triangle-inequality pruning");
+    static_assert(sizeof(typename RNG::result_type) == sizeof(IT), "IT must have the same size as the result type of the RNG");
+    static_assert(std::is_arithmetic<FT>::value, "FT must be arithmetic");
+    auto dm = make_index_dm(first, norm);
+    size_t np = end - first;
+    if(maxdest == 0) maxdest = np;
+    k = std::min(k, maxdest);
+    std::vector<IT> centers;
+    centers.reserve(k);
+    std::vector<FT> distances(maxdest), ccdist;
+    std::vector<IT> asn(maxdest, 0);
+    ccdist.reserve(k);
+    static constexpr FT startval =  std::is_floating_point<FT>::value ? -std::numeric_limits<FT>::max(): std::numeric_limits<FT>::min();
+    std::pair<FT, IT> maxdist(startval, 0);
+    IT newc = rng() % maxdest;
+    centers.push_back(newc);
+#ifdef _OPENMP
+    #pragma omp declare reduction (max : std::pair<FT, IT> : std::max(omp_in, omp_out) )
+    #pragma omp parallel for reduction(max: maxdist) schedule(static, 1024)
+#endif
+    for(IT i = 0; i < maxdest; ++i) {
+        const FT v = i == newc ? FT(0): FT(dm(newc, i));
+        distances[i] = v;
+        maxdist = std::max(maxdist, std::make_pair(v, i));
+    }
+    static constexpr size_t BLOCK = 1024;
+    const size_t nblocks = (maxdest + BLOCK - 1) / BLOCK;
+    size_t nskipped = 0;
+    for(size_t ci = 1; ci < k; ++ci) {
+        centers.push_back(newc = maxdist.second);
+        distances[newc] = 0.;
+        asn[newc] = ci;
+        ccdist.resize(ci);
+        OMP_PFOR
+        for(size_t j = 0; j < ci; ++j)
+            ccdist[j] = dm(newc, centers[j]);
+        maxdist = std::pair<FT, IT>(startval, 0);
+#ifdef _OPENMP
+        #pragma omp parallel for reduction(max: maxdist) reduction(+:nskipped)
+#endif
+        for(size_t b = 0; b < nblocks; ++b) {
+            const IT lo = b * BLOCK, hi = std::min(lo + BLOCK, maxdest);
+            // Compact the points the new center could be closer to, without branching,
+            // then evaluate their distances back to back, with the new center's row in cache.
+            IT cand[BLOCK];
+            FT cdist[BLOCK];
+            unsigned nc = 0;
+            for(IT i = lo; i < hi; ++i) {
+                cand[nc] = i;
+                nc += distances[i] > 0 && ccdist[asn[i]] < factor * distances[i];
+            }
+            for(unsigned t = 0; t < nc; ++t)
+                cdist[t] = dm(newc, cand[t]);
+            for(unsigned t = 0; t < nc; ++t)
+                if(auto &ldist = distances[cand[t]]; cdist[t] < ldist)
+                    ldist = cdist[t], asn[cand[t]] = ci;
+            for(IT i = lo; i < hi; ++i)
+                maxdist = std::max(maxdist, std::make_pair(distances[i], i));
+            nskipped += (hi - lo) - nc;
+            MINOCORE_COUNT(DISTANCE_EVALS, nc);
+        }
+    }
+    MINOCORE_LOG("kcenter_greedy_2approx_pruned: pruning skipped %zu of %zu distance evaluations\n", nskipped, (k - 1) * maxdest);
+    return centers;
+} // kcenter_greedy_2approx_pruned
+
 /*
  *
  * Greedy, provable 2-approximate solution
@@ -25,6 +126,9 @@ kcenter_greedy_2approx(Iter first, Iter end, RNG &rng, size_t k, const Norm &nor
 {
     static_assert(sizeof(typename RNG::result_type) == sizeof(IT), "IT must have the same size as the result type of the RNG");
     static_assert(std::is_arithmetic<FT>::value, "FT must be arithmetic");
+    if constexpr(detail::kcenter_pruning_factor<Norm>::value > 0) {
+        return kcenter_greedy_2approx_pruned<Iter, FT, IT>(first, end, rng, k, norm, maxdest);
+    }
     auto dm = make_index_dm(first, norm);
     size_t np = end - first;
     if(maxdest == 0) maxdest = np;
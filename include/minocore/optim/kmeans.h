@@ -7,6 +7,7 @@
 #include "minocore/coreset/matrix_coreset.h"
 #include "minocore/util/oracle.h"
 #include "minocore/util/timer.h"
+#include "minocore/util/trace.h"
 #include "minocore/util/div.h"
 #include "minocore/util/blaze_adaptor.h"
 
@@ -37,6 +38,7 @@ template<typename Oracle, typename FT=std::decay_t<decltype(std::declval<Oracle>
 std::tuple<std::vector<IT>, std::vector<IT>, std::vector<FT>>
 kmeanspp(const Oracle &oracle, RNG &rng, size_t np, size_t k, const WFT *weights=nullptr) {
     //std::fprintf(stderr, "Starting kmeanspp with np = %zu and k = %zu%s.\n", np, k, weights ? " and non-null weights": "");
+    MINOCORE_PHASE("kmeanspp");
     std::vector<IT> centers;
     std::vector<FT> distances(np, 0.), cdf(np);
     {
@@ -109,7 +111,7 @@ std::pair<blaze::DynamicVector<IT>, blaze::DynamicVector<FT>> get_oracle_costs(c
 {
     blaze::DynamicVector<IT> assignments(np);
     blaze::DynamicVector<FT> costs(np, std::numeric_limits<FT>::max());
-    util::Timer t("get oracle costs");
+    MINOCORE_PHASE("get_oracle_costs");
     OMP_PFOR
     for(size_t i = 0; i < np; ++i) {
         auto it = sol.begin();
@@ -123,7 +125,7 @@ std::pair<blaze::DynamicVector<IT>, blaze::DynamicVector<FT>> get_oracle_costs(c
         costs[i] = mincost;
         assignments[i] = minind;
     }
-    std::fprintf(stderr, "Centers have total cost %g\n", blz::sum(costs));
+    MINOCORE_LOG("Centers have total cost %g\n", blz::sum(costs));
     return std::make_pair(assignments, costs);
 }
 
@@ -138,6 +140,7 @@ template<typename Oracle,
 std::vector<IT>
 kmc2(const Oracle &oracle, RNG &rng, size_t np, size_t k, size_t m = 2000)
 {
+    MINOCORE_PHASE("kmc2");
     if(m == 0) throw std::invalid_argument("m must be nonzero");
     schism::Schismatic<IT> div(np);
     shared::flat_hash_set<IT> centers{div.mod(IT(rng()))};
@@ -200,7 +203,7 @@ kmeanspp(const blaze::Matrix<MT, SO> &mat, RNG &rng, size_t k, const Norm &norm=
     std::tuple<std::vector<IT>, std::vector<IT>, std::vector<FT>> ret;
     if(rowwise) {
         auto rowit = blz::rowiterator(~mat);
-        std::fprintf(stderr, "Mat shape: %zu/%zu\n", (~mat).rows(), (~mat).columns());
+        MINOCORE_LOG("Mat shape: %zu/%zu\n", (~mat).rows(), (~mat).columns());
         ret = kmeanspp(rowit.begin(), rowit.end(), rng, k, norm, weights);
     } else { // columnwise
         auto columnit = blz::columniterator(~mat);
@@ -236,6 +239,7 @@ double lloyd_iteration(std::vector<IT> &assignments, std::vector<WFT> &counts,
                        bool use_moving_average=false)
 {
     static_assert(std::is_floating_point_v<WFT>, "WTF must be floating point for weighted kmeans");
+    MINOCORE_PHASE("lloyd_iteration");
     // make sure this is only rowwise/rowMajor
     assert(counts.size() == centers.rows() || !std::fprintf(stderr, "counts size: %zu. centers rows: %zu\n", counts.size(), centers.rows()));
     assert(centers.columns() == data.columns());
@@ -298,7 +302,7 @@ double lloyd_iteration(std::vector<IT> &assignments, std::vector<WFT> &counts,
         }
     }
 #ifndef NDEBUG
-    std::fprintf(stderr, "Assigned cluster centers\n");
+    MINOCORE_LOG("Assigned cluster centers\n");
 #endif
     for(size_t i = 0; i < centers.rows(); ++i) {
         VERBOSE_ONLY(std::fprintf(stderr, "center %zu has count %g\n", i, counts[i]);)
@@ -320,7 +324,7 @@ double lloyd_iteration(std::vector<IT> &assignments, std::vector<WFT> &counts,
             costs[item] = 0.;
             assignments[item] = i;
             //std::fprintf(stderr, "Reassigning center %zu to row %zu because it has lost all support\n", i, item);
-            std::fprintf(stderr, "Reassigning center %zu to row %zu because it has lost all support\n", i, item);
+            MINOCORE_LOG("Reassigning center %zu to row %zu because it has lost all support\n", i, item);
             row(centers, i BLAZE_CHECK_DEBUG) = row(data, item);
             centers_reassigned = true;
         }
@@ -346,7 +350,7 @@ double lloyd_iteration(std::vector<IT> &assignments, std::vector<WFT> &counts,
         assignments[i] = label;
         total_loss += getw(i) * dist;
     }
-    std::fprintf(stderr, "total loss: %g\n", total_loss);
+    MINOCORE_LOG("total loss: %g\n", total_loss);
     if(std::isnan(total_loss)) total_loss = std::numeric_limits<decltype(total_loss)>::infinity();
     return total_loss;
 }
@@ -364,17 +368,17 @@ double lloyd_loop(std::vector<IT> &assignments, std::vector<WFT> &counts,
     size_t iternum = 0;
     double oldloss = std::numeric_limits<double>::max(), newloss;
     for(;;) {
-        std::fprintf(stderr, "Starting iter %zu\n", iternum);
+        MINOCORE_LOG("Starting iter %zu\n", iternum);
         newloss = lloyd_iteration(assignments, counts, centers, data, func, weights, use_moving_average);
         double change_in_cost = std::abs(oldloss - newloss) / std::min(oldloss, newloss);
         if(iternum++ == maxiter || change_in_cost <= tolerance) {
-            std::fprintf(stderr, "Change in cost from %g to %g is %g\n", oldloss, newloss, change_in_cost);
+            MINOCORE_LOG("Change in cost from %g to %g is %g\n", oldloss, newloss, change_in_cost);
             break;
         }
-        std::fprintf(stderr, "new loss at %zu: %0.30g. old loss: %0.30g\n", iternum, newloss, oldloss);
+        MINOCORE_LOG("new loss at %zu: %0.30g. old loss: %0.30g\n", iternum, newloss, oldloss);
         oldloss = newloss;
     }
-    std::fprintf(stderr, "Completed with final loss of %0.30g after %zu rounds\n", newloss, iternum);
+    MINOCORE_LOG("Completed with final loss of %0.30g after %zu rounds\n", newloss, iternum);
     return newloss;
 }
 
@@ -386,6 +390,7 @@ void minibatch_lloyd_iteration(std::vector<IT> &assignments, std::vector<WFT> &c
                                const Functor &func=Functor(),
                                const WFT *weights=nullptr)
 {
+    MINOCORE_PHASE("minibatch_lloyd_iteration");
     if(batchsize < assignments.size()) batchsize = assignments.size();
     const size_t np = assignments.size();
     selection.clear();
@@ -446,7 +451,7 @@ double mb_lloyd_loop(std::vector<IT> &assignments, std::vector<WFT> &counts,
     wy::WyRand<IT, 4> rng(seed);
     size_t iternum = 0;
     while(iternum++ < maxiter) {
-        std::fprintf(stderr, "Starting minibatch iter %zu\n", iternum);
+        MINOCORE_LOG("Starting minibatch iter %zu\n", iternum);
         minibatch_lloyd_iteration(assignments, counts, centers, data, batch_size, rng, selection, func, weights);
     }
     double loss = 0.;
@@ -465,7 +470,7 @@ double mb_lloyd_loop(std::vector<IT> &assignments, std::vector<WFT> &counts,
         assignments[i] = label;
         loss += closs;
     }
-    std::fprintf(stderr, "Completed with final loss of %0.30g after %zu rounds\n", loss, iternum);
+    MINOCORE_LOG("Completed with final loss of %0.30g after %zu rounds\n", loss, iternum);
     return loss;
 }
 
@@ -489,7 +494,7 @@ auto kmeans_coreset(Iter start, Iter end,
     static_assert(std::is_same<decltype(ics), coresets::IndexCoreset<IT, sq_t>>::value, "must be this type");
     //coresets::IndexCoreset<IT, sq_t> ics(cs.sample(cs_size, rng()));
 #ifndef NDEBUG
-    std::fprintf(stderr, "max sampled idx: %u\n", *std::max_element(ics.indices_.begin(), ics.indices_.end()));
+    MINOCORE_LOG("max sampled idx: %u\n", *std::max_element(ics.indices_.begin(), ics.indices_.end()));
 #endif
     return ics;
 }
@@ -512,7 +517,7 @@ auto kmeans_matrix_coreset(const blaze::Matrix<MT, SO> &mat, size_t k, RNG &rng,
 #ifndef NDEBUG
     for(auto idx: ics.indices_)
         assert(idx < rowwise ? (~mat).rows(): (~mat).columns());
-    std::fprintf(stderr, "Got kmeans coreset of size %zu\n", ics.size());
+    MINOCORE_LOG("Got kmeans coreset of size %zu\n", ics.size());
 #endif
     return index2matrix(ics, ~mat);
 }
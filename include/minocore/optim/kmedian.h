@@ -15,129 +15,325 @@ namespace coresets {
 using namespace blz;
 using namespace boost::accumulators;
 
+/*
+ * Weighted geometric median by Weiszfeld iteration, argmin_y sum_i w_i ||x_i - y||, starting from the weighted mean.
+ *
+ * Each pass computes distances and accumulates the Weiszfeld numerator, denominator and objective in parallel over blocks of rows.
+ * An iterate which lands on data points (total weight eta) is handled with the Vardi-Zhang modification:
+ * it is optimal if the pull r of the remaining points is at most eta, and otherwise the step is shortened by eta / r.
+ * With accelerate, Nesterov-style momentum is applied to the Weiszfeld map T: y_{k+1} = z_{k+1} + (k - 1) / (k + 2) (z_{k+1} - z_k),
+ * where z_{k+1} = T(y_k), restarting from the last z whenever the objective increases.
+ * Stops when the objective or the iterate changes by at most eps relative to its magnitude, or after max_iter passes.
+ */
 template<typename MT, bool SO, typename VT, typename WeightType=const typename MT::ElementType *>
 auto &geomedian(const blz::DenseMatrix<MT, SO> &mat, blz::DenseVector<VT, !SO> &dv, double eps=1e-8,
-              const WeightType &weights=nullptr) {
-    // Solve geometric median for a set of points.
-    //
-    using FT = typename std::decay_t<decltype(~mat)>::ElementType;
+                const WeightType &weights=nullptr, size_t max_iter=1000, bool accelerate=true)
+{
+    MINOCORE_PHASE("geomedian");
+    using DV = blaze::DynamicVector<double, !SO>;
     const auto &_mat = ~mat;
-    ~dv = blz::mean<blz::columnwise>(_mat);
-    FT prevcost = std::numeric_limits<FT>::max();
-    blaze::DynamicVector<FT, !SO> costs(_mat.rows(), FT(0));
-    size_t iternum = 0;
-    const size_t nr = _mat.rows();
-    assert((~dv).size() == (~mat).columns());
-    for(;;) {
+    const size_t nr = _mat.rows(), nc = _mat.columns();
+    if((~dv).size() != nc) (~dv).resize(nc);
+    if(nr == 0) {
+        ~dv = 0;
+        return dv;
+    }
+    auto weight = [&weights](size_t i) -> double {return weights ? double(weights[i]): 1.;};
+    struct Pass {
+        double f = 0., s = 0., eta = 0.; // Objective, sum of w_i / d_i, weight of points at y
+    };
+    // t = sum_i w_i x_i / d_i over points not at y
+    auto weiszfeld_pass = [&](const DV &y, DV &t) {
+        Pass ret;
+        t = 0.;
+        OMP_PRAGMA("omp parallel")
+        {
+            DV lt(nc, 0.);
+            Pass lp;
+            OMP_PRAGMA("omp for schedule(static)")
+            for(size_t i = 0; i < nr; ++i) {
+                const auto r = row(_mat, i BLAZE_CHECK_DEBUG);
+                const double d = blz::l2Dist(r, y), w = weight(i);
+                if(d == 0.) {
+                    lp.eta += w;
+                    continue;
+                }
+                lp.f += w * d;
+                lp.s += w / d;
+                lt += r * (w / d);
+            }
+            OMP_CRITICAL
+            {
+                t += lt;
+                ret.f += lp.f; ret.s += lp.s; ret.eta += lp.eta;
+            }
+        }
+        MINOCORE_COUNT(DISTANCE_EVALS, nr);
+        return ret;
+    };
+    DV cur(nc, 0.), t(nc), plain(nc), prevplain(nc);
+    {
+        double wsum = 0.;
         for(size_t i = 0; i < nr; ++i) {
-            auto dist = blz::l2Dist(row(_mat, i BLAZE_CHECK_DEBUG), ~dv);
-            if(weights) dist *= weights[i];
-            costs[i] = dist;
+            const double w = weight(i);
+            cur += row(_mat, i BLAZE_CHECK_DEBUG) * w;
+            wsum += w;
+        }
+        cur *= 1. / wsum;
+    }
+    double fprev = std::numeric_limits<double>::max();
+    size_t iter = 0, k = 0; // k: steps since the last momentum restart
+    while(iter++ < max_iter) {
+        const Pass p = weiszfeld_pass(cur, t);
+        if(p.f > fprev && k) {
+            // Momentum overshot: restart from the last plain Weiszfeld point
+            cur = plain;
+            k = 0;
+            continue;
+        }
+        if(std::abs(fprev - p.f) <= eps * p.f || p.s == 0.) break;
+        swap(prevplain, plain);
+        plain = t * (1. / p.s);
+        if(p.eta > 0.) {
+            const double r = blz::l2Norm(t - p.s * cur);
+            if(r <= p.eta) break; // The data point at cur is the median
+            const double beta = p.eta / r;
+            plain = (1. - beta) * plain + beta * cur;
         }
-        ++iternum;
-        costs = 1. / costs;
-        costs *= 1. / blaze::sum(costs);
-        ~dv = costs * ~mat;
-        FT newcost = l1Dist(row(_mat, 0 BLAZE_CHECK_DEBUG), ~dv);
-        for(size_t i = 1; i < nr; newcost += l1Dist(row(_mat, i++ BLAZE_CHECK_DEBUG), ~dv));
-        if(std::abs(newcost - prevcost) <= eps) break;
-        prevcost = newcost;
+        fprev = p.f;
+        const double stepnorm = blz::l2Norm(plain - cur);
+        if(accelerate && k) cur = plain + (double(k - 1) / (k + 2)) * (plain - prevplain);
+        else                cur = plain;
+        ++k;
+        if(stepnorm <= eps * blz::l2Norm(cur)) break;
     }
+    MINOCORE_LOG("geomedian: %zu passes, objective %g\n", std::min(iter, max_iter), fprev);
+    ~dv = cur;
     return dv;
 }
 
+namespace detail {
+
+// Median of v[0..n), reordering v; for even n, the mean of the two middle values. Expected O(n).
+template<typename T>
+T select_median(T *v, size_t n) {
+    assert(n);
+    const size_t h = n / 2;
+    std::nth_element(v, v + h, v + n);
+    if(n & 1) return v[h];
+    return T(.5) * (v[h] + *std::max_element(v, v + h));
+}
+
+// As select_median, for a column of n entries of which only the nz nonzeros are in v.
+template<typename T>
+T select_median_implicit_zeros(T *v, size_t nz, size_t n) {
+    assert(nz <= n);
+    const size_t nzeros = n - nz;
+    if(nzeros == n) return T(0);
+    const size_t nneg = std::count_if(v, v + nz, [](T x) {return x < T(0);});
+    // Sorted, the column is the negatives, then the zeros, then the positives.
+    auto kth = [&](size_t k) -> T {
+        if(k >= nneg && k < nneg + nzeros) return T(0);
+        if(k >= nneg) k -= nzeros;
+        std::nth_element(v, v + k, v + nz);
+        return v[k];
+    };
+    const size_t h = n / 2;
+    return n & 1 ? kth(h): T(.5) * (kth(h - 1) + kth(h));
+}
+
+/*
+ * Weighted median of (value, weight) pairs p[0..n), reordering p, by quickselect with three-way partitioning.
+ * Returns the smallest value at which the cumulative weight reaches half of total,
+ * or the midpoint between it and the next larger value with positive weight if it reaches exactly half.
+ * Expected O(n).
+ */
+template<typename T, typename W>
+T weighted_select_median(std::pair<T, W> *p, size_t n, W total) {
+    assert(n);
+    const W half = total * W(.5);
+    W acc = 0;                  // Weight of everything below p[lo]
+    T upper = T(0);             // Smallest positive-weight value above p[hi - 1], if has_upper
+    bool has_upper = false;
+    size_t lo = 0, hi = n;
+    T pv = p[0].first;
+    auto min_positive = [](const std::pair<T, W> *b, const std::pair<T, W> *e, T &out) {
+        bool found = false;
+        for(; b != e; ++b)
+            if(b->second > W(0) && (!found || b->first < out)) out = b->first, found = true;
+        return found;
+    };
+    while(lo < hi) {
+        {
+            const T a = p[lo].first, b = p[lo + (hi - lo) / 2].first, c = p[hi - 1].first;
+            pv = std::max(std::min(a, b), std::min(std::max(a, b), c));
+        }
+        auto lt_end = std::partition(p + lo, p + hi, [pv](const auto &x) {return x.first < pv;});
+        auto eq_end = std::partition(lt_end, p + hi, [pv](const auto &x) {return !(pv < x.first);});
+        W wl = 0, we = 0;
+        for(auto it = p + lo; it != lt_end; ++it) wl += it->second;
+        for(auto it = lt_end; it != eq_end; ++it) we += it->second;
+        if(acc + wl >= half && wl > W(0)) {
+            T m = pv;
+            if(min_positive(lt_end, p + hi, m)) upper = m, has_upper = true;
+            hi = lt_end - p;
+        } else if(acc + wl + we >= half) {
+            if(acc + wl + we == half) {
+                T next = pv;
+                if(min_positive(eq_end, p + hi, next)) return T(.5) * (pv + next);
+                if(has_upper) return T(.5) * (pv + upper);
+            }
+            return pv;
+        } else {
+            acc += wl + we;
+            lo = eq_end - p;
+        }
+    }
+    return pv; // Only reached if rounding left acc just short of half
+}
+
+// Columns gathered per task: enough to read row-major rows in contiguous runs while keeping scratch near L2-sized.
+template<typename T>
+size_t median_block_size(size_t nr, bool column_major) {
+    return column_major ? size_t(1): std::max(size_t(1), std::min(size_t(16), (size_t(1) << 18) / std::max(nr * sizeof(T), size_t(1))));
+}
+
+// Column-major copy of a row-major sparse matrix, so that each column's nonzeros are contiguous
+template<typename MT, bool SO>
+decltype(auto) column_major_sparse(const blz::SparseMatrix<MT, SO> &data) {
+    if constexpr(SO == blaze::columnMajor) return ~data;
+    else return blaze::CompressedMatrix<ElementType_t<MT>, blaze::columnMajor>(~data);
+}
+
+} // namespace detail
+
+/*
+ * Column-wise (L1) medians.
+ * Columns are processed in parallel, each thread gathering blocks of columns into its own scratch space
+ * and selecting with nth_element or a weighted quickselect, rather than sorting.
+ * For sparse data, only nonzeros are gathered; the zeros are accounted for by count (or total weight).
+ */
 template<typename MT, bool SO, typename VT, bool TF>
 void l1_unweighted_median(const blz::DenseMatrix<MT, SO> &data, blz::DenseVector<VT, TF> &ret) {
+    MINOCORE_PHASE("l1_unweighted_median");
+    using FT = ElementType_t<MT>;
     assert((~ret).size() == (~data).columns());
     auto &rr(~ret);
     const auto &dr(~data);
-    const bool odd = dr.rows() % 2;
-    const size_t hlf = dr.rows() / 2;
-    if(0) {
-#if 0
-        std::fprintf(stderr, "note: Boost approximate median takes more time and is less accurate than exact calculation via sorting.\nNot recommended.\n");
-        //using acc_tag = boost::accumulators::stats<boost::accumulators::tag::median(boost::accumulators::tag::with_p_square_cumulative_distribution)>;
-        using acc_tag = boost::accumulators::stats<boost::accumulators::tag::median(with_p_square_quantile)>;
-        using FT = ElementType_t<MT>;
-        for(size_t i = 0; i < dr.columns(); ++i) {
-            boost::accumulators::accumulator_set<FT, acc_tag> acc;
-            for(auto v: column(dr, i)) acc(v);
-            (~ret)[i] = boost::accumulators::median(acc);
-        }
-#endif
-    } else {
-        for(size_t i = 0; i < dr.columns(); ++i) {
-            blaze::DynamicVector<ElementType_t<MT>, blaze::columnVector> tmpind = column(data, i); // Should do fast copying.
-            shared::sort(tmpind.begin(), tmpind.end());
-            rr[i] = odd ? tmpind[hlf]: ElementType_t<MT>(.5) * (tmpind[hlf] + tmpind[hlf + 1]);
+    const size_t nr = dr.rows(), nc = dr.columns();
+    if(nr == 0) {
+        rr = 0;
+        return;
+    }
+    const size_t bs = detail::median_block_size<FT>(nr, SO == blaze::columnMajor), nblocks = (nc + bs - 1) / bs;
+    OMP_PRAGMA("omp parallel")
+    {
+        std::vector<FT> scratch(bs * nr);
+        OMP_PRAGMA("omp for schedule(dynamic)")
+        for(size_t b = 0; b < nblocks; ++b) {
+            const size_t cb = b * bs, ce = std::min(cb + bs, nc);
+            for(size_t i = 0; i < nr; ++i)
+                for(size_t c = cb; c < ce; ++c)
+                    scratch[(c - cb) * nr + i] = dr(i, c);
+            for(size_t c = cb; c < ce; ++c)
+                rr[c] = detail::select_median(&scratch[(c - cb) * nr], nr);
         }
     }
 }
 
+template<typename MT, bool SO, typename VT, bool TF>
+void l1_unweighted_median(const blz::SparseMatrix<MT, SO> &data, blz::DenseVector<VT, TF> &ret) {
+    MINOCORE_PHASE("l1_unweighted_median");
+    using FT = ElementType_t<MT>;
+    assert((~ret).size() == (~data).columns());
+    auto &rr(~ret);
+    const size_t nr = (~data).rows();
+    const auto &csc = detail::column_major_sparse(data);
+    OMP_PRAGMA("omp parallel")
+    {
+        std::vector<FT> scratch;
+        OMP_PRAGMA("omp for schedule(dynamic)")
+        for(size_t c = 0; c < csc.columns(); ++c) {
+            scratch.clear();
+            for(auto it = csc.begin(c); it != csc.end(c); ++it)
+                if(it->value() != FT(0)) scratch.push_back(it->value());
+            rr[c] = detail::select_median_implicit_zeros(scratch.data(), scratch.size(), nr);
+        }
+    }
+}
 
-
-template<typename MT, bool SO, typename VT2, bool TF2, typename FT=CommonType_t<ElementType_t<MT>, ElementType_t<VT2>>, typename IT=uint32_t>
-static inline void weighted_median(const blz::Matrix<MT, SO> &data, blz::DenseVector<VT2, TF2> &ret, const FT *weights) {
+template<typename MT, bool SO, typename VT2, bool TF2, typename FT=CommonType_t<ElementType_t<MT>, ElementType_t<VT2>>>
+void weighted_median(const blz::DenseMatrix<MT, SO> &data, blz::DenseVector<VT2, TF2> &ret, const FT *weights) {
+    MINOCORE_PHASE("weighted_median");
     assert(weights);
-    const size_t nc = (~data).columns();
+    using ET = ElementType_t<MT>;
+    const auto &dr(~data);
+    const size_t nr = dr.rows(), nc = dr.columns();
     if((~ret).size() != nc) {
         (~ret).resize(nc);
     }
-    if(0) {
-#if 0
-        //OMP_PFOR
-        for(size_t i = 0; i < nc; ++i) {
-            auto &mat = ~data;
-            using acc_tag = boost::accumulators::stats<boost::accumulators::tag::weighted_median>;
-            boost::accumulators::accumulator_set<FT, acc_tag, FT> acc;
-            auto col = column(mat, i);
-            for(size_t j = 0; j < col.size(); ++j) {
-                acc(col[j], weight = weights[j]);
-            }
-            (~ret)[i] = boost::accumulators::median(acc);
+    auto &rr(~ret);
+    if(nr == 0) {
+        rr = 0;
+        return;
+    }
+    FT wsum = 0;
+    for(size_t i = 0; i < nr; ++i) wsum += weights[i];
+    const size_t bs = detail::median_block_size<std::pair<ET, FT>>(nr, SO == blaze::columnMajor), nblocks = (nc + bs - 1) / bs;
+    OMP_PRAGMA("omp parallel")
+    {
+        std::vector<std::pair<ET, FT>> scratch(bs * nr);
+        OMP_PRAGMA("omp for schedule(dynamic)")
+        for(size_t b = 0; b < nblocks; ++b) {
+            const size_t cb = b * bs, ce = std::min(cb + bs, nc);
+            for(size_t i = 0; i < nr; ++i)
+                for(size_t c = cb; c < ce; ++c)
+                    scratch[(c - cb) * nr + i] = {dr(i, c), weights[i]};
+            for(size_t c = cb; c < ce; ++c)
+                rr[c] = detail::weighted_select_median(&scratch[(c - cb) * nr], nr, wsum);
         }
-#endif
-    } else {
-        if(unlikely((~data).columns() > ((uint64_t(1) << (sizeof(IT) * CHAR_BIT)) - 1)))
-            throw std::runtime_error("Use a different index type, there are more features than fit in IT");
-        const size_t nr = (~data).rows();
-        auto pairs = std::make_unique<std::pair<ElementType_t<MT>, IT>[]>(nr);
-        std::unique_ptr<FT[]> cw(new FT[nr]); //
-        for(size_t i = 0; i < nc; ++i) {
-            auto col = column(~data, i);
-            for(size_t j = 0; j < nr; ++j)
-                pairs[j] = {col[j], j};
-            shared::sort(pairs.get(), pairs.get() + nr);
-            FT wsum = 0., maxw = -std::numeric_limits<FT>::max();
-            IT maxind = -0;
-            for(size_t j = 0; j < nr; ++j) {
-               auto neww = weights[pairs[j].second];
-               wsum += neww, cw[j] = wsum;
-               if(neww > maxw) maxw = neww, maxind = j;
-            }
-            if(maxw > wsum * .5) {
-                // Return the value of the tuple with maximum weight
-                (~ret)[i] = pairs[maxind].first;
-                continue;
+    }
+}
+
+template<typename MT, bool SO, typename VT2, bool TF2, typename FT=CommonType_t<ElementType_t<MT>, ElementType_t<VT2>>>
+void weighted_median(const blz::SparseMatrix<MT, SO> &data, blz::DenseVector<VT2, TF2> &ret, const FT *weights) {
+    MINOCORE_PHASE("weighted_median");
+    assert(weights);
+    using ET = ElementType_t<MT>;
+    const size_t nr = (~data).rows(), nc = (~data).columns();
+    if((~ret).size() != nc) {
+        (~ret).resize(nc);
+    }
+    auto &rr(~ret);
+    FT wsum = 0;
+    for(size_t i = 0; i < nr; ++i) wsum += weights[i];
+    const auto &csc = detail::column_major_sparse(data);
+    OMP_PRAGMA("omp parallel")
+    {
+        std::vector<std::pair<ET, FT>> scratch;
+        OMP_PRAGMA("omp for schedule(dynamic)")
+        for(size_t c = 0; c < nc; ++c) {
+            scratch.clear();
+            FT nzw = 0;
+            for(auto it = csc.begin(c); it != csc.end(c); ++it) {
+                if(it->value() == ET(0)) continue;
+                scratch.emplace_back(it->value(), weights[it->index()]);
+                nzw += weights[it->index()];
             }
-            FT mid = wsum * .5;
-            auto it = std::lower_bound(pairs.get(), pairs.get() + nr, mid,
-                 [](std::pair<ElementType_t<MT>, IT> x, FT y)
-            {
-                return x.first < y;
-            });
-            (~ret)[i] = it->first == mid ? FT(.5 * (it->first + it[1].first)): FT(it[1].first);
+            // All implicit zeros collapse into one entry carrying their total weight
+            if(scratch.size() < nr) scratch.emplace_back(ET(0), std::max(wsum - nzw, FT(0)));
+            rr[c] = scratch.empty() ? ET(0): detail::weighted_select_median(scratch.data(), scratch.size(), wsum);
         }
     }
 }
 
 
 template<typename MT, bool SO, typename VT, bool TF, typename VT3=blz::CommonType_t<ElementType_t<MT>, ElementType_t<VT>>>
-void l1_median(const blz::DenseMatrix<MT, SO> &data, blz::DenseVector<VT, TF> &ret, const VT3 *weights=static_cast<VT3 *>(nullptr)) {
+void l1_median(const blz::Matrix<MT, SO> &data, blz::DenseVector<VT, TF> &ret, const VT3 *weights=static_cast<VT3 *>(nullptr)) {
     if(weights)
-        weighted_median(data, ret, weights);
+        weighted_median(~data, ret, weights);
     else
-        l1_unweighted_median(data, ret);
+        l1_unweighted_median(~data, ret);
 }
 
 
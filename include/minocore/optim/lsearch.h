@@ -3,6 +3,7 @@
 #define FGC_LOCAL_SEARCH_H__
 #include "diskmat/diskmat.h"
 #include "minocore/util/oracle.h"
+#include "minocore/util/trace.h"
 #include "minocore/optim/kcenter.h"
 #include "pdqsort/pdqsort.h"
 #include "discreture/include/discreture.hpp"
@@ -36,14 +37,14 @@ struct ExhaustiveSearcher {
             const double cost = blaze::sum(blaze::min<blaze::columnwise>(rows(mat_, comb.data(), comb.size())));
             ++nchecked;
             if((nchecked & (nchecked - 1)) == 0)
-                std::fprintf(stderr, "iteration %zu completed\n", nchecked);
+                MINOCORE_LOG("iteration %zu completed\n", nchecked);
             if(cost < current_cost_) {
-                std::fprintf(stderr, "Swapping to new center set with new cost = %g on iteration %zu\n", cost, nchecked);
+                MINOCORE_LOG("Swapping to new center set with new cost = %g on iteration %zu\n", cost, nchecked);
                 current_cost_ = cost;
                 std::copy(comb.data(), comb.data() + comb.size(), bestsol_.data());
             }
         }
-        std::fprintf(stderr, "Best result: %g. Total number of combinations checked: %zu\n", current_cost_, nchecked);
+        MINOCORE_LOG("Best result: %g. Total number of combinations checked: %zu\n", current_cost_, nchecked);
     }
 };
 
@@ -118,12 +119,12 @@ struct LocalKMedSearcher {
             for(unsigned i = 0; i < mat_.rows(); ++i)
                 sol_.insert(i);
         } else if(do_kcenter && mat_.rows() == mat_.columns()) {
-            std::fprintf(stderr, "Using kcenter\n");
+            MINOCORE_LOG("Using kcenter\n");
             auto rowits = blz::rowiterator(mat_);
             auto approx = coresets::kcenter_greedy_2approx(rowits.begin(), rowits.end(), rng, k_, MatrixLookup(), std::min(mat_.rows(), mat_.columns()));
             for(const auto c: approx) sol_.insert(c);
 #ifndef NDEBUG
-            std::fprintf(stderr, "k_: %u. sol size: %zu. rows: %zu. columns: %zu\n", k_, sol_.size(),
+            MINOCORE_LOG("k_: %u. sol size: %zu. rows: %zu. columns: %zu\n", k_, sol_.size(),
                          mat_.rows(), mat_.columns());
 #endif
             assert(sol_.size() == k_ || sol_.size() == mat_.rows());
@@ -189,7 +190,7 @@ struct LocalKMedSearcher {
 
     void assign() {
         assert(assignments_.size() == nc_);
-        std::fprintf(stderr, "rows: %zu. cols: %zu. sol size: %zu. k: %u\n",
+        MINOCORE_LOG("rows: %zu. cols: %zu. sol size: %zu. k: %u\n",
                      mat_.rows(), mat_.columns(), sol_.size(), k_);
         assert(sol_.size() == k_ || sol_.size() == mat_.rows());
         DBG_ONLY(std::fprintf(stderr, "Initialized assignments at size %zu\n", assignments_.size());)
@@ -305,6 +306,7 @@ struct LocalKMedSearcher {
     }
 
     void run_lazy() {
+        MINOCORE_PHASE("lsearch::run_lazy");
 #if 0
         shared::flat_hash_map<IType, std::vector<IType>> current_assignments;
         for(size_t i = 0; i < assignments_.size(); ++i) {
@@ -326,6 +328,7 @@ struct LocalKMedSearcher {
                 auto potential_index = ordering_[pi];
                 if(sol_.find(potential_index) != sol_.end() || potential_index == oldcenter) continue;
                 newindices.back() = potential_index;
+                MINOCORE_COUNT(SWAPS_TRIED, 1);
                 assert(std::find(newindices.begin(), newindices.end(), oldcenter) == newindices.end());
                 double val = 0.;
                 auto newptr = row(mat_, potential_index);
@@ -353,12 +356,13 @@ struct LocalKMedSearcher {
                     assign();
                     //current_cost_ = blaze::sum(current_costs_);
                     ++total;
-                    std::fprintf(stderr, "Swap number %zu updated with delta %.12g to new cost with cost %0.12g\n", total, val, current_cost_);
+                    MINOCORE_COUNT(SWAPS_ACCEPTED, 1);
+                    MINOCORE_LOG("Swap number %zu updated with delta %.12g to new cost with cost %0.12g\n", total, val, current_cost_);
                     goto next;
                 }
             }
         }
-        std::fprintf(stderr, "Finished in %zu swaps by exhausting all potential improvements. Final cost: %f\n",
+        MINOCORE_LOG("Finished in %zu swaps by exhausting all potential improvements. Final cost: %f\n",
                      total, current_cost_);
     }
 
@@ -381,7 +385,9 @@ struct LocalKMedSearcher {
             for(auto &&swap_out_comb: discreture::combinations(csol.size(), nswap)) {
                 for(auto &&swap_in_comb: discreture::combinations(swap_in.size(), nswap)) {
                     auto v = evaluate_multiswap_rt(swap_in_comb.data(), swap_out_comb.data(), nswap);
+                    MINOCORE_COUNT(SWAPS_TRIED, 1);
                     if(v >= diffthresh_) {
+                        MINOCORE_COUNT(SWAPS_ACCEPTED, 1);
                         for(auto v: swap_out_comb) sol_.erase(v);
                         sol_.insert(swap_in_comb.begin(), swap_in_comb.end());
                         current_cost_ -= v;
@@ -392,6 +398,7 @@ struct LocalKMedSearcher {
         }
     }
     void run() {
+        MINOCORE_PHASE("lsearch::run");
         assign();
         const double diffthresh = initial_cost_ / k_ * eps_;
         diffthresh_ = diffthresh;
@@ -402,7 +409,7 @@ struct LocalKMedSearcher {
                 return;
         }
         //const double diffthresh = 0.;
-        std::fprintf(stderr, "diffthresh: %f\n", diffthresh);
+        MINOCORE_LOG("diffthresh: %f\n", diffthresh);
         size_t total = 0;
         next:
         for(const auto oldcenter: sol_) {
@@ -414,24 +421,26 @@ struct LocalKMedSearcher {
             for(size_t pi = 0; pi < nr_; ++pi) {
                 size_t potential_index = ordering_[pi];
                 if(sol_.find(potential_index) != sol_.end()) continue;
+                MINOCORE_COUNT(SWAPS_TRIED, 1);
                 if(const auto val = evaluate_swap(potential_index, oldcenter, true);
                    val > diffthresh) {
 #ifndef NDEBUG
-                    std::fprintf(stderr, "Swapping %zu for %u. Swap number %zu. Current cost: %g. Improvement: %g. Threshold: %g.\n", potential_index, oldcenter, total + 1, current_cost_, val, diffthresh);
+                    MINOCORE_LOG("Swapping %zu for %u. Swap number %zu. Current cost: %g. Improvement: %g. Threshold: %g.\n", potential_index, oldcenter, total + 1, current_cost_, val, diffthresh);
 #endif
                     sol_.erase(oldcenter);
                     sol_.insert(potential_index);
                     ++total;
                     current_cost_ -= val;
-                    std::fprintf(stderr, "Swap number %zu with cost %0.12g\n", total, current_cost_);
+                    MINOCORE_COUNT(SWAPS_ACCEPTED, 1);
+                    MINOCORE_LOG("Swap number %zu with cost %0.12g\n", total, current_cost_);
                     goto next;
                 }
             }
        }
-        std::fprintf(stderr, "Finished in %zu swaps by exhausting all potential improvements. Final cost: %f\n",
+        MINOCORE_LOG("Finished in %zu swaps by exhausting all potential improvements. Final cost: %f\n",
                      total, current_cost_);
         if(max_swap_n_ > 1) {
-            std::fprintf(stderr, "max_swap_n_ %u set. Searching multiswaps\n", max_swap_n_);
+            MINOCORE_LOG("max_swap_n_ %u set. Searching multiswaps\n", max_swap_n_);
             run_multi(max_swap_n_);
         }
     }
@@ -452,7 +461,7 @@ struct LocalKMedSearcher {
                 wsol[si] = ci;
                 const double cost = blaze::sum(blaze::min<blaze::columnwise>(rows(mat_, wsol)));
                 if(cost < ccost) {
-                    std::fprintf(stderr, "Found a better one: %g vs %g (%g)\n", cost, ccost, ccost - cost);
+                    MINOCORE_LOG("Found a better one: %g vs %g (%g)\n", cost, ccost, ccost - cost);
                     ccost = cost;
                     fsol = wsol;
                     wsol = fsol;
@@ -466,7 +475,7 @@ struct LocalKMedSearcher {
         if(improvement_made) goto start;
         current_cost_ = ccost;
 #ifndef NDEBUG
-        std::fprintf(stderr, "improved cost for %zu rounds and a total improvemnet of %g\n", extra_rounds, ocost - current_cost_);
+        MINOCORE_LOG("improved cost for %zu rounds and a total improvemnet of %g\n", extra_rounds, ocost - current_cost_);
         //assert(std::abs(ocost - current_cost_) < ((initial_cost_ / k_ * eps_) + 0.1));  // 1e-5 for numeric stability issues
 #endif
     }
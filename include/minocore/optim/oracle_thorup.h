@@ -6,6 +6,7 @@
 #include <cassert>
 #include "fastiota/fastiota_ho.h"
 #include "minocore/util/oracle.h"
+#include "minocore/util/trace.h"
 #include "boost/iterator/transform_iterator.hpp"
 
 
@@ -19,6 +20,7 @@ namespace thorup {
  *  2. Use the selected points F as the new set of points (``npoints''), with weight = |C_f| (number of cities assigned to facility f)
  *  3. Wrap the previous oracle in another oracle that maps indices within F to the original data
  *  4. Performing the next iteration
+ * Comparisons go through improves(oracle, ...), so a LandmarkOracle skips distances its lower bounds rule out.
  */
 template<typename Oracle,
          typename FT=std::decay_t<decltype(std::declval<Oracle>()(0,0))>,
@@ -28,6 +30,7 @@ template<typename Oracle,
 std::tuple<std::vector<IT>, blaze::DynamicVector<FT>, std::vector<IT>>
 oracle_thorup_d(const Oracle &oracle, size_t npoints, unsigned k, const WFT *weights=static_cast<const WFT *>(nullptr), double npermult=21, double nroundmult=3, double eps=0.5, uint64_t seed=1337)
 {
+    MINOCORE_PHASE("oracle_thorup_d");
     const FT total_weight = weights ? static_cast<FT>(blaze::sum(blaze::CustomVector<WFT, blaze::unaligned, blaze::unpadded>((WFT *)weights, npoints)))
                                     : static_cast<FT>(npoints);
     size_t nperround = npermult * k * std::log(total_weight) / eps;
@@ -68,7 +71,7 @@ oracle_thorup_d(const Oracle &oracle, size_t npoints, unsigned k, const WFT *wei
                 minindices[v] = v;
                 for(size_t j = 0; j < npoints; ++j) {
                     if(j != v && mincosts[j] != 0.) {
-                        if(auto score = oracle(v, j);score < mincosts[j]) {
+                        if(FT score; improves(oracle, v, j, mincosts[j], score)) {
                             mincosts[j] = score;
                             minindices[j] = v;
                         }
@@ -131,8 +134,7 @@ oracle_thorup_d(const Oracle &oracle, size_t npoints, unsigned k, const WFT *wei
                 for(size_t j = 0; j < npoints; ++j) {
                     if(j != actual_index) {
                         if(auto oldcost = mincosts[j]; oldcost != 0.) {
-                            auto newcost = oracle(actual_index, j);
-                            if(newcost < oldcost) {
+                            if(FT newcost; improves(oracle, actual_index, j, oldcost, newcost)) {
                                 mincosts[j] = newcost;
                                 minindices[j] = actual_index;
                             }
@@ -0,0 +1,143 @@
+#pragma once
+#ifndef FGC_UTIL_BINARY_FORMAT_H__
+#define FGC_UTIL_BINARY_FORMAT_H__
+#include "minocore/util/macros.h"
+#include "minocore/util/trace.h"
+#include "mio/single_include/mio/mio.hpp"
+#include "xxHash/xxh3.h"
+#include "xxHash/xxhash.h"
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+
+namespace minocore {
+namespace io {
+
+/*
+ * Versioned binary layout shared by CoresetSampler, IndexCoreset, and CSRGraph.
+ *
+ * [Header][section 0][pad][section 1][pad]...
+ * Every section starts at a multiple of SECTION_ALIGNMENT, so a mapped file can be used in place.
+ * The checksum (XXH3-64) covers every byte after the header.
+ *
+ * Header types other than FileHeader must be trivially copyable and provide the fields
+ * magic, version, endian, ft_size, it_size, offsets, file_size, and checksum.
+ */
+
+static constexpr uint32_t FORMAT_VERSION = 1;
+static constexpr uint32_t ENDIAN_MARKER = 0x01020304u;
+static constexpr size_t SECTION_ALIGNMENT = 64;
+static constexpr size_t MAX_SECTIONS = 6;
+
+struct FileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t endian;    // ENDIAN_MARKER as written by the producer
+    uint32_t ft_size;
+    uint32_t it_size;
+    uint64_t n;         // Number of points (sampler) or entries (coreset)
+    uint64_t k;
+    uint64_t b;
+    uint64_t seed;
+    int32_t  sens;
+    uint32_t flags;     // Bitmask of sections present
+    uint64_t offsets[MAX_SECTIONS];
+    uint64_t file_size;
+    uint64_t checksum;
+};
+static_assert(sizeof(FileHeader) == 128, "FileHeader must be exactly 128 bytes");
+
+inline uint64_t align_up(uint64_t x) {
+    return (x + SECTION_ALIGNMENT - 1) & ~uint64_t(SECTION_ALIGNMENT - 1);
+}
+
+template<typename Header=FileHeader>
+class SectionWriter {
+    static_assert(std::is_trivially_copyable_v<Header>, "Header must be trivially copyable");
+    std::FILE *fp_;
+    XXH3_state_t *state_;
+    uint64_t pos_;
+    std::string path_;
+    void raw_write(const void *ptr, size_t nb) {
+        if(nb && std::fwrite(ptr, 1, nb, fp_) != nb)
+            throw std::runtime_error(std::string("Failed to write to ") + path_);
+        XXH3_64bits_update(state_, ptr, nb);
+        pos_ += nb;
+    }
+public:
+    SectionWriter(const std::string &path): fp_(std::fopen(path.data(), "wb")), state_(XXH3_createState()), pos_(sizeof(Header)), path_(path) {
+        if(!fp_) throw std::runtime_error(std::string("Failed to open ") + path + " for writing");
+        XXH3_64bits_reset(state_);
+        static const Header placeholder{};
+        if(std::fwrite(&placeholder, sizeof(placeholder), 1, fp_) != 1)
+            throw std::runtime_error(std::string("Failed to write to ") + path_);
+    }
+    ~SectionWriter() {
+        if(fp_) std::fclose(fp_);
+        XXH3_freeState(state_);
+    }
+    // Pads to the next aligned offset, writes nb bytes, and returns the section's offset.
+    uint64_t write(const void *ptr, size_t nb) {
+        static const char zeros[SECTION_ALIGNMENT]{};
+        raw_write(zeros, align_up(pos_) - pos_);
+        const uint64_t ret = pos_;
+        raw_write(ptr, nb);
+        return ret;
+    }
+    // Fills in size and checksum, then writes the header in place.
+    void finish(Header &hdr) {
+        hdr.version = FORMAT_VERSION;
+        hdr.endian = ENDIAN_MARKER;
+        hdr.file_size = pos_;
+        hdr.checksum = XXH3_64bits_digest(state_);
+        if(std::fseek(fp_, 0, SEEK_SET) || std::fwrite(&hdr, sizeof(hdr), 1, fp_) != 1)
+            throw std::runtime_error(std::string("Failed to write header to ") + path_);
+        const int rc = std::fclose(fp_);
+        fp_ = nullptr;
+        if(rc) throw std::runtime_error(std::string("Failed to close ") + path_);
+    }
+};
+
+template<typename Header>
+inline void set_magic(Header &hdr, const char *magic) {
+    std::memcpy(hdr.magic, magic, sizeof(hdr.magic));
+}
+
+/*
+ * Checks magic, version, byte order, type sizes and (optionally) the checksum of a mapped file.
+ * Section bounds are checked by the caller via section().
+ */
+template<typename Header=FileHeader>
+inline const Header &validate(const mio::mmap_source &ms, const char *magic, size_t ft_size, size_t it_size, bool verify_checksum) {
+    if(ms.size() < sizeof(Header)) throw std::runtime_error("File too small to contain a header");
+    const Header &hdr = *reinterpret_cast<const Header *>(ms.data());
+    if(std::memcmp(hdr.magic, magic, sizeof(hdr.magic))) throw std::runtime_error("Wrong magic number: not a file of the expected type");
+    if(hdr.endian != ENDIAN_MARKER) throw std::runtime_error("Byte order mismatch: file was written on a machine with different endianness");
+    if(hdr.version != FORMAT_VERSION)
+        throw std::runtime_error(std::string("Unsupported format version ") + std::to_string(hdr.version));
+    if(hdr.ft_size != ft_size || hdr.it_size != it_size)
+        throw std::runtime_error("Type size mismatch: FT/IT differ from those used to write the file");
+    if(hdr.file_size != ms.size()) throw std::runtime_error("File size does not match header (truncated file?)");
+    if(verify_checksum) {
+        MINOCORE_COUNT(BYTES_READ, ms.size());
+        if(XXH3_64bits(ms.data() + sizeof(Header), ms.size() - sizeof(Header)) != hdr.checksum)
+            throw std::runtime_error("Checksum mismatch: file is corrupted");
+    }
+    return hdr;
+}
+
+template<typename T, typename Header>
+const T *section(const mio::mmap_source &ms, const Header &hdr, size_t index, size_t count) {
+    const uint64_t off = hdr.offsets[index];
+    if(off % SECTION_ALIGNMENT || off < sizeof(Header) || off + count * sizeof(T) > hdr.file_size)
+        throw std::runtime_error(std::string("Section ") + std::to_string(index) + " is out of bounds or misaligned");
+    return reinterpret_cast<const T *>(ms.data() + off);
+}
+
+} // namespace io
+} // namespace minocore
+
+#endif /* FGC_UTIL_BINARY_FORMAT_H__ */
@@ -2,26 +2,160 @@
 #define CSC_H__
 #include "./shared.h"
 #include "./timer.h"
+#include "./trace.h"
 #include "./blaze_adaptor.h"
 #include "mio/single_include/mio/mio.hpp"
 #include <fstream>
+#include <sys/mman.h>
 
 namespace minocore {
 
-template<typename IndPtrType=uint64_t, typename IndicesType=uint64_t, typename DataType=uint32_t>
-struct CSCMatrixView {
+/*
+ * CompressedRowView: a read-only blaze sparse row vector over externally-owned
+ * index/value arrays (e.g., a memory-mapped CSR/CSC file).
+ * Values are produced on access as (raw + prior) * scale, where prior is either
+ * a scalar or a per-feature vector; this lets DissimilarityApplicator keep the raw
+ * counts untouched and store only compact per-row state (row sums) on the side.
+ */
+template<typename FT, typename IndicesType, typename ValT>
+class CompressedRowView: public blaze::SparseVector<CompressedRowView<FT, IndicesType, ValT>, blaze::rowVector> {
+public:
+    using This          = CompressedRowView<FT, IndicesType, ValT>;
+    using BaseType      = blaze::SparseVector<This, blaze::rowVector>;
+    using ResultType    = blaze::CompressedVector<FT, blaze::rowVector>;
+    using TransposeType = blaze::CompressedVector<FT, blaze::columnVector>;
+    using ElementType   = FT;
+    using ReturnType    = const FT;
+    using CompositeType = const This &;
+    using Element       = blaze::ValueIndexPair<FT>;
+    static constexpr bool smpAssignable = false;
+
+    class ConstIterator {
+        const This *ref_;
+        size_t pos_;
+    public:
+        using IteratorCategory = std::forward_iterator_tag;
+        using ValueType        = Element;
+        using PointerType      = const ConstIterator *;
+        using ReferenceType    = Element;
+        using DifferenceType   = std::ptrdiff_t;
+        using iterator_category = IteratorCategory;
+        using value_type        = ValueType;
+        using pointer           = PointerType;
+        using reference         = ReferenceType;
+        using difference_type   = DifferenceType;
+
+        ConstIterator(): ref_(nullptr), pos_(0) {}
+        ConstIterator(const This *ref, size_t pos): ref_(ref), pos_(pos) {}
+        INLINE ConstIterator &operator++() {++pos_; return *this;}
+        INLINE ConstIterator operator++(int) {auto ret(*this); ++pos_; return ret;}
+        INLINE Element operator*() const {return Element(value(), index());}
+        INLINE const ConstIterator *operator->() const {return this;}
+        INLINE FT value() const {return ref_->value_at(pos_);}
+        INLINE size_t index() const {return ref_->idx_[pos_];}
+        INLINE bool operator==(const ConstIterator &o) const {return pos_ == o.pos_;}
+        INLINE bool operator!=(const ConstIterator &o) const {return pos_ != o.pos_;}
+        INLINE DifferenceType operator-(const ConstIterator &o) const {return DifferenceType(pos_) - DifferenceType(o.pos_);}
+    };
+    using Iterator = ConstIterator;
+
+private:
+    const IndicesType *idx_;
+    const ValT *vals_;
+    size_t nnz_, dim_;
+    FT scale_, prior_;
+    const FT *prior_vec_;
+
+public:
+    CompressedRowView(const IndicesType *idx, const ValT *vals, size_t nnz, size_t dim,
+                      FT scale=1, FT prior=0, const FT *prior_vec=nullptr):
+        idx_(idx), vals_(vals), nnz_(nnz), dim_(dim), scale_(scale), prior_(prior), prior_vec_(prior_vec)
+    {
+    }
+    INLINE FT value_at(size_t pos) const {
+        assert(pos < nnz_);
+        return (static_cast<FT>(vals_[pos]) + (prior_vec_ ? prior_vec_[idx_[pos]]: prior_)) * scale_;
+    }
+    size_t size() const {return dim_;}
+    size_t nonZeros() const {return nnz_;}
+    ConstIterator begin()  const {return ConstIterator(this, 0);}
+    ConstIterator cbegin() const {return begin();}
+    ConstIterator end()    const {return ConstIterator(this, nnz_);}
+    ConstIterator cend()   const {return end();}
+    ConstIterator lowerBound(size_t index) const {
+        return ConstIterator(this, std::lower_bound(idx_, idx_ + nnz_, index) - idx_);
+    }
+    ConstIterator upperBound(size_t index) const {
+        return ConstIterator(this, std::upper_bound(idx_, idx_ + nnz_, index) - idx_);
+    }
+    ConstIterator find(size_t index) const {
+        auto it = lowerBound(index);
+        return it != end() && it->index() == index ? it: end();
+    }
+    ReturnType operator[](size_t index) const {
+        assert(index < dim_);
+        auto it = find(index);
+        return it == end() ? FT(0): it->value();
+    }
+    ReturnType at(size_t index) const {
+        if(index >= dim_) throw std::out_of_range("Invalid vector access index");
+        return (*this)[index];
+    }
+    FT scale() const {return scale_;}
+    const IndicesType *indices() const {return idx_;}
+    const ValT *values() const {return vals_;}
+    template<typename Other> bool canAlias(const Other *) const noexcept {return false;}
+    template<typename Other> bool isAliased(const Other *) const noexcept {return false;}
+    bool canSMPAssign() const noexcept {return false;}
+};
+
+namespace detail {
+
+/*
+ * Shared storage for compressed views where each item (row) occupies a contiguous
+ * range [indptr[i], indptr[i + 1]) of the index and data arrays.
+ * This is a CSR matrix's row or a CSC matrix's column; either way, items are exposed as rows.
+ */
+template<typename IndPtrType, typename IndicesType, typename DataType, typename FT>
+struct CompressedItemView {
+    using ElementType = FT;
+    using RowType = CompressedRowView<FT, IndicesType, DataType>;
     const IndPtrType *const indptr_;
     const IndicesType *const indices_;
     const DataType *const data_;
     const uint64_t nnz_;
     const uint32_t nf_, n_;
+    CompressedItemView(const IndPtrType *indptr, const IndicesType *indices, const DataType *data,
+                       uint64_t nnz, uint32_t nfeat, uint32_t nitems):
+        indptr_(indptr), indices_(indices), data_(data), nnz_(nnz), nf_(nfeat), n_(nitems)
+    {
+    }
+    size_t rows() const {return n_;}
+    size_t columns() const {return nf_;}
+    size_t nonZeros() const {return nnz_;}
+    size_t nonZeros(size_t i) const {return indptr_[i + 1] - indptr_[i];}
+    RowType row(size_t i, FT scale=1, FT prior=0, const FT *prior_vec=nullptr) const {
+        assert(i < n_);
+        const size_t start = indptr_[i];
+        return RowType(indices_ + start, data_ + start, indptr_[i + 1] - start, nf_, scale, prior, prior_vec);
+    }
+    // Row over derived values stored in an nnz-length array parallel to data_
+    template<typename VT>
+    CompressedRowView<FT, IndicesType, VT> row(size_t i, const VT *derived, FT scale=1) const {
+        assert(i < n_);
+        const size_t start = indptr_[i];
+        return CompressedRowView<FT, IndicesType, VT>(indices_ + start, derived + start, indptr_[i + 1] - start, nf_, scale);
+    }
+};
+
+} // namespace detail
+
+template<typename IndPtrType=uint64_t, typename IndicesType=uint64_t, typename DataType=uint32_t, typename FT=float>
+struct CSCMatrixView: public detail::CompressedItemView<IndPtrType, IndicesType, DataType, FT> {
+    using super = detail::CompressedItemView<IndPtrType, IndicesType, DataType, FT>;
     CSCMatrixView(const IndPtrType *indptr, const IndicesType *indices, const DataType *data,
                   uint64_t nnz, uint32_t nfeat, uint32_t nitems):
-        indptr_(indptr),
-        indices_(indices),
-        data_(data),
-        nnz_(nnz),
-        nf_(nfeat), n_(nitems)
+        super(indptr, indices, data, nnz, nfeat, nitems)
     {
     }
     struct Column {
@@ -32,89 +166,116 @@ struct CSCMatrixView {
         size_t nnz() const {return stop_ - start_;}
     };
     auto column(size_t i) const {
-        return Column(*this, indptr_[i], indptr_[i + 1]);
+        return Column(*this, this->indptr_[i], this->indptr_[i + 1]);
+    }
+};
+
+template<typename IndPtrType=uint64_t, typename IndicesType=uint64_t, typename DataType=uint32_t, typename FT=float>
+struct CSRMatrixView: public detail::CompressedItemView<IndPtrType, IndicesType, DataType, FT> {
+    using super = detail::CompressedItemView<IndPtrType, IndicesType, DataType, FT>;
+    CSRMatrixView(const IndPtrType *indptr, const IndicesType *indices, const DataType *data,
+                  uint64_t nnz, uint32_t nrows, uint32_t ncolumns):
+        super(indptr, indices, data, nnz, ncolumns, nrows)
+    {
     }
 };
 
-template<typename FT=float, typename IndPtrType, typename IndicesType, typename DataType>
-blz::SM<FT, blaze::rowMajor> csc2sparse(const CSCMatrixView<IndPtrType, IndicesType, DataType> &mat, bool skip_empty=false) {
+template<typename T>
+struct is_compressed_view: std::false_type {};
+template<typename IP, typename ID, typename DT, typename FT>
+struct is_compressed_view<CSCMatrixView<IP, ID, DT, FT>>: std::true_type {};
+template<typename IP, typename ID, typename DT, typename FT>
+struct is_compressed_view<CSRMatrixView<IP, ID, DT, FT>>: std::true_type {};
+template<typename T>
+static constexpr bool is_compressed_view_v = is_compressed_view<std::decay_t<T>>::value;
+
+template<typename IP, typename ID, typename DT, typename FT>
+auto row(const detail::CompressedItemView<IP, ID, DT, FT> &view, size_t i, blaze::Unchecked={}) {
+    return view.row(i);
+}
+
+/*
+ * MappedCompressedMatrix owns read-only, shared memory maps of the
+ * indptr/indices/data files written under a prefix, and exposes them through a view.
+ * The pages are never modified, so multiple processes share a single copy in the page cache.
+ */
+template<typename ViewType>
+struct MappedCompressedMatrix;
+
+template<template<typename, typename, typename, typename> class View,
+         typename IndPtrType, typename IndicesType, typename DataType, typename FT>
+struct MappedCompressedMatrix<View<IndPtrType, IndicesType, DataType, FT>> {
+    using view_type = View<IndPtrType, IndicesType, DataType, FT>;
+    mio::mmap_source indptr_, indices_, data_;
+    std::unique_ptr<view_type> view_;
+
+    MappedCompressedMatrix(std::string prefix, bool prefault=false) {
+        std::string shape = prefix + "shape.file";
+        std::FILE *ifp = std::fopen(shape.data(), "rb");
+        if(!ifp) throw std::runtime_error(std::string("Failed to open ") + shape);
+        uint32_t dims[2];
+        const bool dims_read = std::fread(dims, sizeof(uint32_t), 2, ifp) == 2;
+        std::fclose(ifp);
+        if(!dims_read) throw std::runtime_error("Failed to read dims from file");
+        indptr_.map(prefix + "indptr.file");
+        indices_.map(prefix + "indices.file");
+        data_.map(prefix + "data.file");
+        const size_t nnz = indices_.size() / sizeof(IndicesType);
+        // CSC shape files store (#features, #items), CSR shape files store (#rows, #columns)
+        view_.reset(new view_type((const IndPtrType *)indptr_.data(), (const IndicesType *)indices_.data(),
+                                  (const DataType *)data_.data(), nnz, dims[0], dims[1]));
+        const size_t nitems = view_->rows();
+        if(indptr_.size() / sizeof(IndPtrType) != nitems + 1)
+            throw std::runtime_error(std::string("indptr has ") + std::to_string(indptr_.size() / sizeof(IndPtrType)) + " entries, expected " + std::to_string(nitems + 1));
+        if(data_.size() / sizeof(DataType) != nnz)
+            throw std::runtime_error("data and indices files have different numbers of entries");
+        if(size_t(view_->indptr_[nitems]) != nnz)
+            throw std::runtime_error("indptr does not match the number of nonzeros");
+        advise(prefault ? MADV_WILLNEED: MADV_NORMAL);
+    }
+    void advise(int flag) const {
+        for(const auto *mp: {&indptr_, &indices_, &data_})
+            if(mp->size()) ::madvise((void *)mp->data(), mp->size(), flag);
+    }
+    view_type &view() {return *view_;}
+    const view_type &view() const {return *view_;}
+    size_t rows() const {return view_->rows();}
+    size_t columns() const {return view_->columns();}
+    size_t nonZeros() const {return view_->nonZeros();}
+};
+
+template<typename FT=float, typename IndPtrType=uint64_t, typename IndicesType=uint64_t, typename DataType=uint32_t>
+using MappedCSCMatrix = MappedCompressedMatrix<CSCMatrixView<IndPtrType, IndicesType, DataType, FT>>;
+template<typename FT=float, typename IndPtrType=uint64_t, typename IndicesType=uint64_t, typename DataType=uint32_t>
+using MappedCSRMatrix = MappedCompressedMatrix<CSRMatrixView<IndPtrType, IndicesType, DataType, FT>>;
+
+template<typename FT=float, typename IndPtrType, typename IndicesType, typename DataType, typename VFT>
+blz::SM<FT, blaze::rowMajor> csc2sparse(const CSCMatrixView<IndPtrType, IndicesType, DataType, VFT> &mat, bool skip_empty=false) {
     blz::SM<FT, blaze::rowMajor> ret(mat.n_, mat.nf_);
     ret.reserve(mat.nnz_);
     size_t used_rows = 0, i;
     for(i = 0; i < mat.n_; ++i) {
         auto col = mat.column(i);
-        if(mat.n_ > 100000 && i % 10000 == 0) std::fprintf(stderr, "%zu/%u\r", i, mat.n_);
+        if(mat.n_ > 100000 && i % 10000 == 0) MINOCORE_LOG("%zu/%u\r", i, mat.n_);
         if(skip_empty && 0u == col.nnz()) continue;
         for(auto s = col.start_; s < col.stop_; ++s) {
             ret.append(used_rows, mat.indices_[s], mat.data_[s]);
         }
         ret.finalize(used_rows++);
     }
-    if(used_rows != i) std::fprintf(stderr, "Only used %zu/%zu rows, skipping empty rows\n", used_rows, i);
+    if(used_rows != i) MINOCORE_LOG("Only used %zu/%zu rows, skipping empty rows\n", used_rows, i);
     return ret;
 }
 
 template<typename FT=float, typename IndPtrType=uint64_t, typename IndicesType=uint64_t, typename DataType=uint32_t>
 blz::SM<FT, blaze::rowMajor> csc2sparse(std::string prefix, bool skip_empty=false) {
-    util::Timer t("csc2sparse load time");
-    std::string indptrn  = prefix + "indptr.file";
-    std::string indicesn = prefix + "indices.file";
-    std::string datan    = prefix + "data.file";
-    std::string shape    = prefix + "shape.file";
-    std::FILE *ifp = std::fopen(shape.data(), "rb");
-    uint32_t dims[2];
-    if(std::fread(dims, sizeof(uint32_t), 2, ifp) != 2) throw std::runtime_error("Failed to read dims from file");
-    uint32_t nfeat = dims[0], nsamples = dims[1];
-    std::fprintf(stderr, "nfeat: %u. nsample: %u\n", nfeat, nsamples);
-    std::fclose(ifp);
-    using mmapper = mio::mmap_source;
-    mmapper indptr(indptrn), indices(indicesn), data(datan);
-    CSCMatrixView<IndPtrType, IndicesType, DataType>
-        matview((const IndPtrType *)indptr.data(), (const IndicesType *)indices.data(),
-                (const DataType *)data.data(), indices.size() / sizeof(IndicesType),
-                 nfeat, nsamples);
-    std::fprintf(stderr, "indptr size: %zu\n", indptr.size() / sizeof(IndPtrType));
-    std::fprintf(stderr, "indices size: %zu\n", indices.size() / sizeof(IndicesType));
-    std::fprintf(stderr, "data size: %zu\n", data.size() / sizeof(DataType));
-#ifndef MADV_REMOVE
-#  define MADV_FLAGS (MADV_DONTNEED | MADV_FREE)
-#else
-#  define MADV_FLAGS (MADV_DONTNEED | MADV_REMOVE)
-#endif
-    ::madvise((void *)indptr.data(), indptr.size(), MADV_FLAGS);
-    ::madvise((void *)indices.data(), indices.size(), MADV_FLAGS);
-    ::madvise((void *)data.data(), data.size(), MADV_FLAGS);
-#undef MADV_FLAGS
-    return csc2sparse<FT>(matview, skip_empty);
-}
-
-template<typename FT=float, bool SO=blaze::rowMajor>
-blz::SM<FT, SO> mtx2sparse(std::string prefix)
-{
-    std::string line;
-    std::ifstream ifs(prefix);
-    do std::getline(ifs, line); while(line.front() == '%');
-    char *s;
-    size_t columns = std::strtoull(line.data(), &s, 10),
-             nr  = std::strtoull(s, &s, 10),
-             lines = std::strtoull(s, nullptr, 10);
-    size_t lastline = 0;
-    blz::SM<FT, SO> ret(nr, columns);
-    ret.reserve(lines);
-    while(lines--)
-    {
-        if(!std::getline(ifs, line)) throw std::runtime_error("Error in reading file: unexpected number of lines");
-        size_t row, col, cnt;
-        col = std::strtoull(line.data(), &s, 10) - 1;
-        row = std::strtoull(s, &s, 10) - 1;
-        cnt = std::strtoull(s, &s, 10);
-        if(unlikely(lastline > row)) throw std::runtime_error("Unsorted file.");
-        while(lastline < row) ret.finalize(lastline++);
-        ret.append(row, col, cnt);
-    }
-    while(lastline < ret.rows())
-        ret.finalize(lastline++);
-    if(std::getline(ifs, line)) throw std::runtime_error("Error reading file: too many lines");
+    MINOCORE_PHASE("csc2sparse");
+    MappedCSCMatrix<FT, IndPtrType, IndicesType, DataType> mapped(prefix);
+    MINOCORE_LOG("nfeat: %zu. nsample: %zu. nnz: %zu\n", mapped.columns(), mapped.rows(), mapped.nonZeros());
+    mapped.advise(MADV_SEQUENTIAL);
+    auto ret = csc2sparse<FT>(mapped.view(), skip_empty);
+    // The source pages are clean and file-backed, so the kernel can drop them without writeback.
+    mapped.advise(MADV_DONTNEED);
     return ret;
 }
 
@@ -1,10 +1,12 @@
 #ifndef FGC_GEO_H__
 #define FGC_GEO_H__
+#include <cassert>
 #include <stdexcept>
 #include <cstdio>
 #include <cstdlib>
 #include <utility>
 #include <string>
+#include "minocore/util/trace.h"
 
 namespace minocore {
 struct latlon_t: public std::pair<double, double> {
@@ -57,7 +59,7 @@ struct BoundingBoxData {
          * lon,lat,lon,lat
          * %f,%f,%f,%f[,%f][,%f]
          */
-        std::fprintf(stderr, "parsing %s\n", s);
+        MINOCORE_LOG("parsing %s\n", s);
         double llon, llat, ulon, ulat, highprob = 0.99, loprob=0.01;
         llon = std::strtod(s, const_cast<char **>(&s));
         llat = std::strtod(++s, const_cast<char **>(&s));
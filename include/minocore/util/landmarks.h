@@ -0,0 +1,160 @@
+#ifndef MINOCORE_UTIL_LANDMARKS_H__
+#define MINOCORE_UTIL_LANDMARKS_H__
+#include "minocore/util/oracle.h"
+#include "minocore/util/macros.h"
+#include "minocore/util/trace.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <random>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#ifdef _OPENMP
+#  include <omp.h>
+#endif
+
+namespace minocore {
+
+/*
+ * Landmark (pivot) bounds for an expensive metric oracle.
+ *
+ * Distances from every point to a few pivots are computed up front. By the triangle inequality,
+ *     max_p |d(x, p) - d(y, p)| <= d(x, y) <= min_p d(x, p) + d(p, y),
+ * which costs O(#pivots) table reads rather than an oracle call.
+ * Pivots are chosen by farthest-first traversal, which spreads them over the space and so tightens the lower bounds.
+ *
+ * Calls through operator() are exact. improves(lo, i, j, best, d), used by oracle_thorup_d,
+ * only calls the oracle when the lower bound does not already show d(i, j) >= best.
+ * stats() reports the exact calls made and the calls skipped.
+ */
+template<typename Oracle, typename FT=std::decay_t<decltype(std::declval<Oracle>()(0,0))>>
+class LandmarkOracle {
+    const Oracle &oracle_;
+    size_t np_;
+    std::vector<size_t> pivots_;
+    std::vector<FT> table_; // Point-major: table_[x * npivots + p] = d(x, pivots_[p])
+    struct alignas(64) Counts {
+        std::atomic<uint64_t> exact{0}, skipped{0};
+    };
+    mutable std::unique_ptr<Counts[]> counts_;
+    unsigned ncounts_ = 1;
+
+    Counts &local() const {
+        unsigned tid = 0;
+        OMP_ONLY(tid = omp_get_thread_num() % ncounts_;)
+        return counts_[tid];
+    }
+    // fill(p, out) sets out[x] = d(p, x) for every point x
+    template<typename RowFunc>
+    void select_pivots(unsigned npivots, uint64_t seed, const RowFunc &fill) {
+        MINOCORE_PHASE("LandmarkOracle::select_pivots");
+        npivots = std::min<size_t>(npivots, np_);
+        std::vector<FT> row(np_), mind(np_, std::numeric_limits<FT>::max());
+        std::vector<std::vector<FT>> rows;
+        std::mt19937_64 rng(seed);
+        size_t next = np_ ? rng() % np_: 0;
+        for(unsigned i = 0; i < npivots; ++i) {
+            pivots_.push_back(next);
+            fill(next, row.data());
+            for(size_t x = 0; x < np_; ++x) mind[x] = std::min(mind[x], row[x]);
+            rows.push_back(row);
+            next = std::max_element(mind.begin(), mind.end()) - mind.begin();
+        }
+        const size_t m = pivots_.size();
+        table_.resize(np_ * m);
+        OMP_PFOR
+        for(size_t x = 0; x < np_; ++x)
+            for(size_t p = 0; p < m; ++p)
+                table_[x * m + p] = rows[p][x];
+    }
+    void init_counts() {
+        OMP_ONLY(ncounts_ = omp_get_max_threads();)
+        counts_.reset(new Counts[ncounts_]);
+    }
+public:
+    using output_type = FT;
+    // Pivot rows from the oracle itself: npivots * np calls.
+    LandmarkOracle(const Oracle &oracle, size_t np, unsigned npivots=16, uint64_t seed=0): oracle_(oracle), np_(np) {
+        init_counts();
+        select_pivots(npivots, seed, [&](size_t p, FT *out) {
+            OMP_PFOR
+            for(size_t x = 0; x < np_; ++x) out[x] = x == p ? FT(0): FT(oracle_(p, x));
+        });
+    }
+    // Pivot rows from fill(p, out), setting out[x] = d(p, x) for all x: e.g., one single-source shortest-paths run on a graph.
+    template<typename RowFunc, typename=std::enable_if_t<!std::is_integral_v<RowFunc>>>
+    LandmarkOracle(const Oracle &oracle, size_t np, unsigned npivots, uint64_t seed, const RowFunc &fill): oracle_(oracle), np_(np) {
+        init_counts();
+        select_pivots(npivots, seed, fill);
+    }
+
+    FT operator()(size_t i, size_t j) const {
+        local().exact.fetch_add(1, std::memory_order_relaxed);
+        return oracle_(i, j);
+    }
+    FT lower_bound(size_t i, size_t j) const {
+        const size_t m = pivots_.size();
+        const FT *ti = &table_[i * m], *tj = &table_[j * m];
+        FT ret = 0;
+        for(size_t p = 0; p < m; ++p) ret = std::max(ret, std::abs(ti[p] - tj[p]));
+        return ret;
+    }
+    FT upper_bound(size_t i, size_t j) const {
+        const size_t m = pivots_.size();
+        const FT *ti = &table_[i * m], *tj = &table_[j * m];
+        FT ret = std::numeric_limits<FT>::max();
+        for(size_t p = 0; p < m; ++p) ret = std::min(ret, ti[p] + tj[p]);
+        return ret;
+    }
+    // Whether d(i, j) < best, setting d if so; calls the oracle only if the lower bound leaves it open.
+    bool improves(size_t i, size_t j, FT best, FT &d) const {
+        if(lower_bound(i, j) >= best) {
+            local().skipped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        d = (*this)(i, j);
+        return d < best;
+    }
+
+    const Oracle &oracle() const {return oracle_;}
+    const std::vector<size_t> &pivots() const {return pivots_;}
+    size_t size() const {return np_;}
+
+    struct Stats {
+        uint64_t exact = 0, skipped = 0;
+        double skip_rate() const {return exact + skipped ? double(skipped) / (exact + skipped): 0.;}
+    };
+    Stats stats() const {
+        Stats ret;
+        for(unsigned i = 0; i < ncounts_; ++i) {
+            ret.exact += counts_[i].exact.load(std::memory_order_relaxed);
+            ret.skipped += counts_[i].skipped.load(std::memory_order_relaxed);
+        }
+        return ret;
+    }
+    void reset_stats() {
+        for(unsigned i = 0; i < ncounts_; ++i)
+            counts_[i].exact.store(0, std::memory_order_relaxed), counts_[i].skipped.store(0, std::memory_order_relaxed);
+    }
+};
+
+template<typename Oracle, typename FT, typename BFT>
+INLINE bool improves(const LandmarkOracle<Oracle, FT> &x, size_t i, size_t j, BFT best, BFT &d) {
+    FT tmp;
+    if(!x.improves(i, j, FT(best), tmp)) return false;
+    d = tmp;
+    return true;
+}
+
+template<typename Oracle>
+auto make_landmark_oracle(const Oracle &oracle, size_t np, unsigned npivots=16, uint64_t seed=0) {
+    return LandmarkOracle<Oracle>(oracle, np, npivots, seed);
+}
+
+} // namespace minocore
+
+#endif /* MINOCORE_UTIL_LANDMARKS_H__ */
@@ -0,0 +1,275 @@
+#ifndef MINOCORE_UTIL_MTX_H__
+#define MINOCORE_UTIL_MTX_H__
+#include "./csc.h"
+#include "./exception.h"
+#include "./textparse.h"
+#include <atomic>
+#include <cstring>
+#include <type_traits>
+#include <sys/stat.h>
+#ifdef _OPENMP
+#  include <omp.h>
+#endif
+
+namespace minocore {
+
+namespace mtx {
+
+/*
+ * Parallel MatrixMarket (coordinate) loader.
+ *
+ * The file is mmap'd (or slurped, for pipes), split into newline-aligned chunks,
+ * and parsed twice in parallel: once to count entries per output row, and once to
+ * scatter entries into CSR order via atomic cursors (a counting sort).
+ * Input files therefore need not be sorted; rows are sorted by column index afterwards.
+ *
+ * As with mtx2sparse, by default the file is transposed, so that the columns of a
+ * features x items file (e.g., genes x cells) become the rows of the result.
+ */
+
+struct MTXHeader {
+    size_t nrows = 0, ncols = 0, nnz = 0;
+    size_t data_offset = 0; // Byte offset of the first entry line
+    bool pattern = false, symmetric = false;
+};
+
+namespace detail {
+
+using namespace textparse;
+
+// Calls func(first_index, second_index, value) for each entry in [begin, end), with 1-based indices as in the file.
+template<typename Func>
+void for_each_entry(const char *s, size_t begin, size_t end, bool pattern, const Func &func) {
+    const char *p = s + begin, *const e = s + end;
+    while(p < e) {
+        const char *nl = next_line(p, e);
+        const char *q = skip_ws(p, nl);
+        if(q < nl && *q != '%' && *q != '\n') {
+            const uint64_t x = parse_uint(q, nl);
+            const uint64_t y = parse_uint(q, nl);
+            const double v = pattern ? 1.: parse_float<double>(q, nl);
+            func(x, y, v);
+        }
+        p = nl;
+    }
+}
+
+} // namespace detail
+
+inline MTXHeader parse_header(const char *s, size_t n) {
+    MTXHeader ret;
+    const char *p = s, *const e = s + n;
+    if(n >= 14 && std::memcmp(s, "%%MatrixMarket", 14) == 0) {
+        std::string banner(p, detail::next_line(p, e));
+        std::transform(banner.begin(), banner.end(), banner.begin(), [](auto c) {return std::tolower(c);});
+        if(banner.find("array") != std::string::npos)
+            throw NotImplementedError("Only coordinate MatrixMarket files are supported");
+        if(banner.find("complex") != std::string::npos
+           || banner.find("hermitian") != std::string::npos || banner.find("skew") != std::string::npos)
+            throw NotImplementedError("Complex, Hermitian, and skew-symmetric MatrixMarket files are not supported");
+        ret.pattern = banner.find("pattern") != std::string::npos;
+        ret.symmetric = banner.find("symmetric") != std::string::npos;
+    }
+    while(p < e && (*p == '%' || *p == '\n' || *p == '\r')) p = detail::next_line(p, e);
+    if(p == e) throw std::runtime_error("Missing size line in MatrixMarket file");
+    const char *nl = detail::next_line(p, e);
+    ret.nrows = detail::parse_uint(p, nl);
+    ret.ncols = detail::parse_uint(p, nl);
+    ret.nnz   = detail::parse_uint(p, nl);
+    ret.data_offset = nl - s;
+    if(ret.symmetric && ret.nrows != ret.ncols) throw std::runtime_error("Symmetric MatrixMarket file must be square");
+    return ret;
+}
+
+template<typename FT=float, typename IndPtrType=uint64_t, typename IndicesType=uint32_t>
+struct CSRData {
+    std::vector<IndPtrType> indptr_;
+    std::vector<IndicesType> indices_;
+    std::vector<FT> data_;
+    size_t nr_ = 0, nc_ = 0;
+
+    size_t rows() const {return nr_;}
+    size_t columns() const {return nc_;}
+    size_t nonZeros() const {return data_.size();}
+    auto view() const {
+        return CSRMatrixView<IndPtrType, IndicesType, FT, FT>(indptr_.data(), indices_.data(), data_.data(), data_.size(), nr_, nc_);
+    }
+    template<bool SO=blaze::rowMajor>
+    blz::SM<FT, SO> to_sparse() const {
+        blz::SM<FT, blaze::rowMajor> ret(nr_, nc_);
+        ret.reserve(data_.size());
+        for(size_t i = 0; i < nr_; ++i) {
+            for(auto j = indptr_[i]; j < indptr_[i + 1]; ++j)
+                ret.append(i, indices_[j], data_[j]);
+            ret.finalize(i);
+        }
+        if constexpr(SO == blaze::rowMajor) return ret;
+        else return blz::SM<FT, SO>(ret);
+    }
+    // Writes the prefix{indptr,indices,data,shape}.file layout read by MappedCSRMatrix.
+    // shape.file is written last, so its presence marks a complete cache.
+    void write(std::string prefix) const {
+        auto dump = [&](const std::string &path, const void *ptr, size_t nb) {
+            std::FILE *ofp = std::fopen(path.data(), "wb");
+            if(!ofp) throw std::runtime_error(std::string("Failed to open ") + path + " for writing");
+            const bool ok = std::fwrite(ptr, 1, nb, ofp) == nb;
+            if(std::fclose(ofp) || !ok) throw std::runtime_error(std::string("Failed to write ") + path);
+        };
+        if(nr_ > std::numeric_limits<uint32_t>::max() || nc_ > std::numeric_limits<uint32_t>::max())
+            throw std::runtime_error("Dimensions too large for shape.file");
+        std::remove((prefix + "shape.file").data());
+        dump(prefix + "indptr.file", indptr_.data(), indptr_.size() * sizeof(IndPtrType));
+        dump(prefix + "indices.file", indices_.data(), indices_.size() * sizeof(IndicesType));
+        dump(prefix + "data.file", data_.data(), data_.size() * sizeof(FT));
+        const uint32_t dims[2] {uint32_t(nr_), uint32_t(nc_)};
+        dump(prefix + "shape.file", dims, sizeof(dims));
+    }
+};
+
+template<typename FT=float, typename IndPtrType=uint64_t, typename IndicesType=uint32_t>
+CSRData<FT, IndPtrType, IndicesType> parse_mtx(const char *s, size_t n, bool transpose=true, size_t nchunks=0) {
+    const MTXHeader hdr = parse_header(s, n);
+    CSRData<FT, IndPtrType, IndicesType> ret;
+    const size_t nitems = transpose ? hdr.ncols: hdr.nrows, nfeat = transpose ? hdr.nrows: hdr.ncols;
+    ret.nr_ = nitems; ret.nc_ = nfeat;
+    if(nfeat > size_t(std::numeric_limits<IndicesType>::max()) + 1)
+        throw std::runtime_error("IndicesType is too small for the number of columns");
+    if(!nchunks) {
+        nchunks = 1;
+        OMP_ONLY(nchunks = omp_get_max_threads() * 8;)
+    }
+    const auto bounds = detail::make_chunks(s, hdr.data_offset, n, nchunks);
+    const size_t nb = bounds.size() - 1;
+    std::unique_ptr<std::atomic<uint64_t>[]> cursors(new std::atomic<uint64_t>[nitems]());
+    std::atomic<uint64_t> nbad(0);
+    auto unpack = [&](uint64_t x, uint64_t y, uint64_t &item, uint64_t &feat) {
+        if(transpose) std::swap(x, y);
+        item = x - 1; feat = y - 1;
+        return x - 1 < nitems && y - 1 < nfeat; // Also rejects 0, which wraps around
+    };
+    // Pass 1: count entries per row
+    OMP_PFOR_DYN
+    for(size_t c = 0; c < nb; ++c) {
+        detail::for_each_entry(s, bounds[c], bounds[c + 1], hdr.pattern, [&](uint64_t x, uint64_t y, double) {
+            uint64_t item, feat;
+            if(unlikely(!unpack(x, y, item, feat))) {
+                nbad.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            cursors[item].fetch_add(1, std::memory_order_relaxed);
+            if(hdr.symmetric && item != feat) cursors[feat].fetch_add(1, std::memory_order_relaxed);
+        });
+    }
+    if(nbad.load()) throw std::runtime_error(std::to_string(nbad.load()) + " MatrixMarket entries had out-of-range indices");
+    ret.indptr_.resize(nitems + 1);
+    ret.indptr_[0] = 0;
+    for(size_t i = 0; i < nitems; ++i) {
+        const uint64_t cnt = cursors[i].load(std::memory_order_relaxed);
+        cursors[i].store(ret.indptr_[i], std::memory_order_relaxed);
+        ret.indptr_[i + 1] = ret.indptr_[i] + cnt;
+    }
+    const size_t nnz = ret.indptr_[nitems];
+    if(!hdr.symmetric && nnz != hdr.nnz)
+        std::fprintf(stderr, "Warning: header lists %zu entries, but %zu were found\n", hdr.nnz, nnz);
+    ret.indices_.resize(nnz);
+    ret.data_.resize(nnz);
+    // Pass 2: scatter entries to their rows
+    OMP_PFOR_DYN
+    for(size_t c = 0; c < nb; ++c) {
+        detail::for_each_entry(s, bounds[c], bounds[c + 1], hdr.pattern, [&](uint64_t x, uint64_t y, double v) {
+            uint64_t item, feat;
+            unpack(x, y, item, feat);
+            auto pos = cursors[item].fetch_add(1, std::memory_order_relaxed);
+            ret.indices_[pos] = feat;
+            ret.data_[pos] = v;
+            if(hdr.symmetric && item != feat) {
+                pos = cursors[feat].fetch_add(1, std::memory_order_relaxed);
+                ret.indices_[pos] = item;
+                ret.data_[pos] = v;
+            }
+        });
+    }
+    cursors.reset();
+    // Entries of a row may come from several chunks, so restore column order within each row.
+    OMP_PFOR_DYN
+    for(size_t i = 0; i < nitems; ++i) {
+        const auto start = ret.indptr_[i], stop = ret.indptr_[i + 1];
+        auto ip = ret.indices_.data() + start;
+        if(std::is_sorted(ip, ip + (stop - start))) continue;
+        std::vector<std::pair<IndicesType, FT>> tmp(stop - start);
+        for(size_t j = 0; j < tmp.size(); ++j) tmp[j] = {ip[j], ret.data_[start + j]};
+        shared::sort(tmp.begin(), tmp.end(), [](const auto &x, const auto &y) {return x.first < y.first;});
+        for(size_t j = 0; j < tmp.size(); ++j) {
+            ip[j] = tmp[j].first;
+            ret.data_[start + j] = tmp[j].second;
+        }
+    }
+    return ret;
+}
+
+template<typename FT=float, typename IndPtrType=uint64_t, typename IndicesType=uint32_t>
+CSRData<FT, IndPtrType, IndicesType> mtx2csr(std::string path, bool transpose=true) {
+    MINOCORE_PHASE("mtx2csr");
+    return textparse::with_file_contents(path, [transpose](const char *s, size_t n) {
+        return parse_mtx<FT, IndPtrType, IndicesType>(s, n, transpose);
+    });
+}
+
+namespace detail {
+// e.g., "f4" for float, "u8" for uint64_t
+template<typename T>
+std::string type_tag() {
+    return (std::is_floating_point_v<T> ? 'f': std::is_signed_v<T> ? 'i': 'u') + std::to_string(sizeof(T));
+}
+} // namespace detail
+
+// The element types are part of the prefix, so caches written for different types never alias one another.
+template<typename FT=float, typename IndPtrType=uint64_t, typename IndicesType=uint32_t>
+std::string csr_cache_prefix(const std::string &path, bool transpose=true) {
+    return path + (transpose ? ".csr.": ".csr.rows.")
+         + detail::type_tag<FT>() + '.' + detail::type_tag<IndPtrType>() + '.' + detail::type_tag<IndicesType>() + '.';
+}
+
+// True if a complete cache exists and is at least as new as the input
+inline bool csr_cache_is_fresh(const std::string &path, const std::string &prefix) {
+    struct stat in, out;
+    if(::stat(path.data(), &in) || ::stat((prefix + "shape.file").data(), &out)) return false;
+    for(const char *suf: {"indptr.file", "indices.file", "data.file"})
+        if(struct stat tmp; ::stat((prefix + suf).data(), &tmp)) return false;
+    return out.st_mtime >= in.st_mtime;
+}
+
+/*
+ * Parses path once, writing a binary CSR cache next to it;
+ * later calls map the cache read-only instead of parsing.
+ * A cache which fails to map (e.g., truncated) is reparsed and rewritten.
+ */
+template<typename FT=float, typename IndPtrType=uint64_t, typename IndicesType=uint32_t>
+MappedCSRMatrix<FT, IndPtrType, IndicesType, FT> mtx2csr_cached(std::string path, bool transpose=true) {
+    using MappedType = MappedCSRMatrix<FT, IndPtrType, IndicesType, FT>;
+    const std::string prefix = csr_cache_prefix<FT, IndPtrType, IndicesType>(path, transpose);
+    if(csr_cache_is_fresh(path, prefix)) {
+        try {
+            return MappedType(prefix);
+        } catch(const std::runtime_error &ex) {
+            MINOCORE_LOG("Reparsing %s: unusable cache at %s (%s)\n", path.data(), prefix.data(), ex.what());
+        }
+    }
+    mtx2csr<FT, IndPtrType, IndicesType>(path, transpose).write(prefix);
+    return MappedType(prefix);
+}
+
+} // namespace mtx
+
+template<typename FT=float, bool SO=blaze::rowMajor>
+blz::SM<FT, SO> mtx2sparse(std::string prefix)
+{
+    return mtx::mtx2csr<FT>(prefix).template to_sparse<SO>();
+}
+
+using mtx::mtx2csr;
+using mtx::mtx2csr_cached;
+
+} // namespace minocore
+
+#endif /* MINOCORE_UTIL_MTX_H__ */
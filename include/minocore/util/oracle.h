@@ -1,10 +1,20 @@
 #ifndef FGC_ORACLE_H__
 #define FGC_ORACLE_H__
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <memory>
 #include <vector>
 #include <mutex>
 #include <shared_mutex>
+#include <thread>
 #include <unordered_map>
 #include "./macros.h"
+#include "./exception.h"
+#include "./blaze_adaptor.h"
+#ifdef _OPENMP
+#  include <omp.h>
+#endif
 
 namespace minocore {
 
@@ -127,6 +137,217 @@ auto make_caching_oracle_wrapper(const Oracle &oracle) {
     return CachingOracleWrapper<Oracle, Map, symmetric, threadsafe, IT>(oracle);
 }
 
+/*
+ * Pair cache for an expensive oracle, bounded by a memory budget and safe for concurrent use.
+ *
+ * Keys hash to one of a power-of-two number of shards, each an open-addressing table probed linearly over at most PROBE slots.
+ * Reads take no lock: each shard has a seqlock, and a read retries if a writer was active in its shard during the probe.
+ * Inserts lock only their shard, and misses are computed outside any lock (so two threads may both compute a new pair).
+ * When a key's probe window is full, CLOCK (second-chance) eviction picks the victim:
+ * hits set a slot's reference bit, and the sweep clears bits until it reaches a slot which has not been hit since.
+ *
+ * Usable anywhere an oracle is (oracle_thorup_d, kmeanspp, kmc2, the metric selectors); it must not outlive the wrapped oracle.
+ * Requires an arithmetic result and indices of at most 32 bits.
+ */
+template<typename Oracle, bool symmetric=true, typename IT=std::uint32_t>
+class ShardedCachingOracle {
+public:
+    using output_type = std::decay_t<decltype(std::declval<Oracle>()(0,0))>;
+    static_assert(std::is_arithmetic_v<output_type>, "ShardedCachingOracle requires an arithmetic result");
+    static_assert(sizeof(IT) <= 4, "ShardedCachingOracle requires indices of at most 32 bits");
+    static constexpr unsigned PROBE = 8;
+
+    struct Stats {
+        uint64_t hits = 0, misses = 0, evictions = 0, size = 0, capacity = 0, bytes = 0;
+        double hit_rate() const {return hits + misses ? double(hits) / (hits + misses): 0.;}
+    };
+private:
+    static constexpr uint64_t EMPTY = uint64_t(-1);
+    struct Slot {
+        std::atomic<uint64_t> key{EMPTY};
+        std::atomic<output_type> value{output_type(0)};
+        std::atomic<uint8_t> ref{0};
+    };
+    struct alignas(64) Shard {
+        std::atomic<uint32_t> seq{0}; // Odd while a writer holds the shard
+        uint32_t hand = 0;            // CLOCK hand, advanced by writers only
+        // Counters live on their own cache line so that counting hits does not slow readers of seq
+        alignas(64) std::atomic<uint64_t> hits{0}, misses{0}, evictions{0}, size{0};
+    };
+    const Oracle &oracle_;
+    std::unique_ptr<Shard[]> shards_;
+    std::unique_ptr<Slot[]> slots_;
+    unsigned shard_bits_;
+    size_t shard_cap_; // Slots per shard, a power of two
+
+    static uint64_t mix(uint64_t x) {
+        x ^= x >> 33; x *= 0xff51afd7ed558ccdULL;
+        x ^= x >> 33; x *= 0xc4ceb9fe1a85ec53ULL;
+        return x ^ (x >> 33);
+    }
+    size_t shard_of(uint64_t h) const {return shard_bits_ ? h >> (64 - shard_bits_): 0;}
+    Slot &slot(size_t shard, size_t pos) const {return slots_[shard * shard_cap_ + (pos & (shard_cap_ - 1))];}
+
+    bool lookup(uint64_t key, size_t shard, size_t home, output_type &out) const {
+        const Shard &sh = shards_[shard];
+        for(;;) {
+            const uint32_t s0 = sh.seq.load(std::memory_order_acquire);
+            if(s0 & 1) {
+                std::this_thread::yield();
+                continue;
+            }
+            Slot *found = nullptr;
+            output_type v = 0;
+            for(unsigned p = 0; p < PROBE; ++p) {
+                Slot &s = slot(shard, home + p);
+                const uint64_t k = s.key.load(std::memory_order_relaxed);
+                if(k == key) {
+                    v = s.value.load(std::memory_order_relaxed);
+                    found = &s;
+                    break;
+                }
+                if(k == EMPTY) break; // Eviction replaces entries in place, so no key lies past an empty slot
+            }
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if(sh.seq.load(std::memory_order_relaxed) != s0) continue;
+            if(found) {
+                if(!found->ref.load(std::memory_order_relaxed)) found->ref.store(1, std::memory_order_relaxed);
+                out = v;
+            }
+            return found != nullptr;
+        }
+    }
+    uint32_t lock(size_t shard) const {
+        auto &seq = shards_[shard].seq;
+        uint32_t s = seq.load(std::memory_order_relaxed);
+        for(;;) {
+            if(!(s & 1) && seq.compare_exchange_weak(s, s + 1, std::memory_order_acquire, std::memory_order_relaxed)) break;
+            std::this_thread::yield();
+            s = seq.load(std::memory_order_relaxed);
+        }
+        std::atomic_thread_fence(std::memory_order_release);
+        return s;
+    }
+    void unlock(size_t shard, uint32_t s) const {shards_[shard].seq.store(s + 2, std::memory_order_release);}
+
+    void insert(uint64_t key, size_t shard, size_t home, output_type value) const {
+        Shard &sh = shards_[shard];
+        const uint32_t s = lock(shard);
+        Slot *dest = nullptr;
+        for(unsigned p = 0; p < PROBE; ++p) {
+            Slot &sl = slot(shard, home + p);
+            const uint64_t k = sl.key.load(std::memory_order_relaxed);
+            if(k == key) { // Inserted by another thread while this one computed it
+                unlock(shard, s);
+                return;
+            }
+            if(k == EMPTY) {
+                dest = &sl;
+                sh.size.fetch_add(1, std::memory_order_relaxed);
+                break;
+            }
+        }
+        if(!dest) {
+            // Second chance: at most two passes over the window, since the first clears every reference bit
+            for(unsigned p = sh.hand++ % PROBE;; p = (p + 1) % PROBE) {
+                Slot &sl = slot(shard, home + p);
+                if(!sl.ref.load(std::memory_order_relaxed)) {
+                    dest = &sl;
+                    break;
+                }
+                sl.ref.store(0, std::memory_order_relaxed);
+            }
+            sh.evictions.fetch_add(1, std::memory_order_relaxed);
+        }
+        dest->key.store(key, std::memory_order_relaxed);
+        dest->value.store(value, std::memory_order_relaxed);
+        dest->ref.store(0, std::memory_order_relaxed);
+        unlock(shard, s);
+    }
+public:
+    /*
+     * max_bytes bounds bytes(), shard headers included (rounded down to a power of two number of slots per shard).
+     * nshards defaults to a power of two at least 4x the thread count, reduced if the headers would crowd out the slots.
+     */
+    ShardedCachingOracle(const Oracle &oracle, size_t max_bytes=size_t(64) << 20, unsigned nshards=0): oracle_(oracle) {
+        if(!nshards) {
+            nshards = 4;
+            OMP_ONLY(nshards *= omp_get_max_threads();)
+        }
+        // Smallest useful shard: its header and two probe windows
+        static constexpr size_t MIN_SHARD_BYTES = sizeof(Shard) + 2 * PROBE * sizeof(Slot);
+        MINOCORE_REQUIRE(max_bytes >= MIN_SHARD_BYTES, "Cache budget is too small");
+        shard_bits_ = 0;
+        while((size_t(1) << shard_bits_) < nshards && (size_t(2) << shard_bits_) * MIN_SHARD_BYTES <= max_bytes) ++shard_bits_;
+        const size_t ns = size_t(1) << shard_bits_;
+        const size_t nslots = (max_bytes - ns * sizeof(Shard)) / sizeof(Slot);
+        shard_cap_ = size_t(1) << (63 - __builtin_clzll(nslots / ns));
+        shards_.reset(new Shard[ns]);
+        slots_.reset(new Slot[ns * shard_cap_]);
+    }
+    output_type operator()(IT lh, IT rh) const {
+        if constexpr(symmetric) if(lh > rh) std::swap(lh, rh);
+        const uint64_t key = (uint64_t(lh) << 32) | uint32_t(rh);
+        assert(key != EMPTY);
+        const uint64_t h = mix(key);
+        const size_t shard = shard_of(h);
+        output_type ret;
+        if(lookup(key, shard, h, ret)) {
+            shards_[shard].hits.fetch_add(1, std::memory_order_relaxed);
+            return ret;
+        }
+        shards_[shard].misses.fetch_add(1, std::memory_order_relaxed);
+        ret = oracle_(lh, rh);
+        insert(key, shard, h, ret);
+        return ret;
+    }
+    bool contains(IT lh, IT rh) const {
+        if constexpr(symmetric) if(lh > rh) std::swap(lh, rh);
+        const uint64_t key = (uint64_t(lh) << 32) | uint32_t(rh), h = mix(key);
+        output_type tmp;
+        return lookup(key, shard_of(h), h, tmp);
+    }
+    size_t nshards() const {return size_t(1) << shard_bits_;}
+    size_t capacity() const {return nshards() * shard_cap_;}
+    size_t bytes() const {return capacity() * sizeof(Slot) + nshards() * sizeof(Shard);}
+    Stats stats() const {
+        Stats ret;
+        for(size_t i = 0; i < nshards(); ++i) {
+            const Shard &sh = shards_[i];
+            ret.hits += sh.hits.load(std::memory_order_relaxed);
+            ret.misses += sh.misses.load(std::memory_order_relaxed);
+            ret.evictions += sh.evictions.load(std::memory_order_relaxed);
+            ret.size += sh.size.load(std::memory_order_relaxed);
+        }
+        ret.capacity = capacity();
+        ret.bytes = bytes();
+        return ret;
+    }
+    void reset_stats() {
+        for(size_t i = 0; i < nshards(); ++i)
+            for(auto p: {&shards_[i].hits, &shards_[i].misses, &shards_[i].evictions})
+                p->store(0, std::memory_order_relaxed);
+    }
+    // Empties the cache; concurrent calls see each shard either before or after it is cleared.
+    void clear() {
+        for(size_t i = 0; i < nshards(); ++i) {
+            const uint32_t s = lock(i);
+            for(size_t j = 0; j < shard_cap_; ++j) {
+                Slot &sl = slots_[i * shard_cap_ + j];
+                sl.key.store(EMPTY, std::memory_order_relaxed);
+                sl.ref.store(0, std::memory_order_relaxed);
+            }
+            shards_[i].size.store(0, std::memory_order_relaxed);
+            unlock(i, s);
+        }
+    }
+};
+
+template<bool symmetric=true, typename IT=std::uint32_t, typename Oracle>
+auto make_sharded_caching_oracle(const Oracle &oracle, size_t max_bytes=size_t(64) << 20, unsigned nshards=0) {
+    return ShardedCachingOracle<Oracle, symmetric, IT>(oracle, max_bytes, nshards);
+}
+
 struct MatrixLookup {};
 
 template<typename Mat>
@@ -293,6 +514,20 @@ void prep_range(It start, It2 end, const RowCachingOracleWrapper<Oracle, Map, sy
     x.cache_range(start, end);
 }
 
+/*
+ * improves(oracle, i, j, best, d): whether oracle(i, j) < best, setting d to it if so.
+ * Oracles with cheap lower bounds (e.g., LandmarkOracle) overload this to skip the exact call when the bound decides.
+ */
+template<typename T, typename FT>
+INLINE bool improves(const T &oracle, size_t i, size_t j, FT best, FT &d) {
+    d = oracle(i, j);
+    return d < best;
+}
+template<typename Oracle, typename IT, typename FT>
+INLINE bool improves(const OracleWrapper<Oracle, IT> &x, size_t i, size_t j, FT best, FT &d) {
+    return improves(x.oracle_, x.lookup(i), x.lookup(j), best, d);
+}
+
 template<template<typename...> class Map=std::unordered_map, bool symmetric=true, bool threadsafe=false, typename IT=std::uint32_t, typename FT=float, typename Oracle>
 auto make_row_caching_oracle_wrapper(const Oracle &oracle, size_t np, size_t rsvsz=0) {
     return RowCachingOracleWrapper<Oracle, Map, symmetric, threadsafe, IT, FT>(oracle, np, rsvsz);
@@ -0,0 +1,227 @@
+#ifndef FGC_REGION_H__
+#define FGC_REGION_H__
+#include "minocore/util/geo.h"
+#include "minocore/util/macros.h"
+#include "minocore/util/shared.h"
+#include "minocore/util/exception.h"
+#include "minocore/util/trace.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <numeric>
+#include <random>
+#include <vector>
+
+namespace minocore {
+
+namespace geo {
+
+/*
+ * Uniform grid over (lat, lon) points for bounding-box queries.
+ * Points are bucketed by a counting sort into cells of a grid spanning their extent, with coordinates copied in cell order.
+ * A query visits only the cells overlapping the box, and only tests containment in the cells on its border:
+ * points in interior cells are inside by construction.
+ * Points with NaN coordinates (e.g., vertices missing from an osm2dimacs coordinate list) are never returned.
+ */
+class GridIndex {
+    double latlo_ = 0., lonlo_ = 0., latscale_ = 0., lonscale_ = 0.;
+    uint32_t nlat_ = 1, nlon_ = 1;
+    size_t n_ = 0;
+    std::vector<uint64_t> offsets_; // Cell c holds ids_[offsets_[c]..offsets_[c + 1])
+    std::vector<uint32_t> ids_;
+    std::vector<latlon_t> pts_;     // Parallel to ids_
+
+    INLINE uint32_t latcell(double lat) const {
+        const double v = (lat - latlo_) * latscale_;
+        return v <= 0. ? 0u: std::min(uint32_t(v), nlat_ - 1);
+    }
+    INLINE uint32_t loncell(double lon) const {
+        const double v = (lon - lonlo_) * lonscale_;
+        return v <= 0. ? 0u: std::min(uint32_t(v), nlon_ - 1);
+    }
+    template<typename Getter>
+    void build(size_t n, const Getter &get, double points_per_cell) {
+        MINOCORE_PHASE("GridIndex::build");
+        MINOCORE_REQUIRE(n <= std::numeric_limits<uint32_t>::max(), "GridIndex ids must fit in 32 bits");
+        MINOCORE_REQUIRE(points_per_cell > 0., "points_per_cell must be positive");
+        n_ = n;
+        double latlo = std::numeric_limits<double>::max(), lathi = std::numeric_limits<double>::lowest();
+        double lonlo = latlo, lonhi = lathi;
+        size_t nvalid = 0;
+        OMP_PRAGMA("omp parallel for reduction(min:latlo,lonlo) reduction(max:lathi,lonhi) reduction(+:nvalid)")
+        for(size_t i = 0; i < n; ++i) {
+            const latlon_t p = get(i);
+            if(std::isnan(p.lat()) || std::isnan(p.lon())) continue;
+            latlo = std::min(latlo, p.lat()); lathi = std::max(lathi, p.lat());
+            lonlo = std::min(lonlo, p.lon()); lonhi = std::max(lonhi, p.lon());
+            ++nvalid;
+        }
+        if(nvalid) {
+            // Roughly square cells, points_per_cell points per cell on average
+            const double latspan = std::max(lathi - latlo, 1e-12), lonspan = std::max(lonhi - lonlo, 1e-12);
+            const double ncells = std::max(1., nvalid / points_per_cell);
+            const double side = std::sqrt(latspan * lonspan / ncells);
+            nlat_ = std::max(1., std::min(std::ceil(latspan / side), 65536.));
+            nlon_ = std::max(1., std::min(std::ceil(lonspan / side), 65536.));
+            latlo_ = latlo; lonlo_ = lonlo;
+            latscale_ = nlat_ / latspan; lonscale_ = nlon_ / lonspan;
+        }
+        const size_t nc = size_t(nlat_) * nlon_;
+        std::vector<uint32_t> cells(n);
+        OMP_PFOR
+        for(size_t i = 0; i < n; ++i) {
+            const latlon_t p = get(i);
+            cells[i] = std::isnan(p.lat()) || std::isnan(p.lon()) ? uint32_t(-1)
+                                                                  : latcell(p.lat()) * nlon_ + loncell(p.lon());
+        }
+        offsets_.assign(nc + 1, 0);
+        for(const auto c: cells) if(c != uint32_t(-1)) ++offsets_[c + 1];
+        std::partial_sum(offsets_.begin(), offsets_.end(), offsets_.begin());
+        ids_.resize(nvalid);
+        pts_.resize(nvalid, latlon_t(0., 0.));
+        std::vector<uint64_t> pos(offsets_.begin(), offsets_.end() - 1);
+        for(size_t i = 0; i < n; ++i) {
+            if(cells[i] == uint32_t(-1)) continue;
+            const auto dest = pos[cells[i]]++;
+            ids_[dest] = i;
+            pts_[dest] = get(i);
+        }
+    }
+public:
+    GridIndex() {}
+    GridIndex(const latlon_t *pts, size_t n, double points_per_cell=16.) {
+        build(n, [pts](size_t i) {return pts[i];}, points_per_cell);
+    }
+    GridIndex(const std::vector<latlon_t> &pts, double points_per_cell=16.): GridIndex(pts.data(), pts.size(), points_per_cell) {}
+    // Interleaved (lat, lon) pairs, as stored by CSRGraph
+    GridIndex(const double *coords, size_t n, double points_per_cell=16.) {
+        build(n, [coords](size_t i) {return latlon_t(coords[2 * i], coords[2 * i + 1]);}, points_per_cell);
+    }
+
+    size_t size() const {return n_;}
+    size_t ncells() const {return offsets_.size() - 1;}
+
+    // Calls func(id) for every point inside bb, in cell order
+    template<typename Func>
+    void for_each_in(const BoundingBoxData &bb, const Func &func) const {
+        if(ids_.empty() || bb.lathi < bb.latlo || bb.lonhi < bb.lonlo) return;
+        const uint32_t clo = latcell(bb.latlo), chi = latcell(bb.lathi);
+        const uint32_t dlo = loncell(bb.lonlo), dhi = loncell(bb.lonhi);
+        for(uint32_t c = clo; c <= chi; ++c) {
+            for(uint32_t d = dlo; d <= dhi; ++d) {
+                const size_t cell = size_t(c) * nlon_ + d;
+                const uint64_t b = offsets_[cell], e = offsets_[cell + 1];
+                if(c > clo && c < chi && d > dlo && d < dhi) {
+                    for(uint64_t i = b; i < e; ++i) func(ids_[i]);
+                } else {
+                    for(uint64_t i = b; i < e; ++i)
+                        if(bb.contains(pts_[i])) func(ids_[i]);
+                }
+            }
+        }
+    }
+    // Ids of points inside bb, ascending
+    template<typename IT=uint32_t>
+    std::vector<IT> query(const BoundingBoxData &bb) const {
+        MINOCORE_PHASE("GridIndex::query");
+        std::vector<IT> ret;
+        for_each_in(bb, [&ret](uint32_t id) {ret.push_back(id);});
+        shared::sort(ret.begin(), ret.end());
+        return ret;
+    }
+    size_t count(const BoundingBoxData &bb) const {
+        size_t ret = 0;
+        for_each_in(bb, [&ret](uint32_t) {++ret;});
+        return ret;
+    }
+};
+
+/*
+ * A subset X of points 0..n) selected by region, for clustering on X alone.
+ * members lists X in ascending order, and inside/outside partition it by region membership.
+ * Per-point inputs are gathered into contiguous arrays over X once, so that samplers and cost evaluators run on X directly,
+ * and results (e.g., coreset indices) are mapped back to global ids once, instead of indirecting in every inner loop.
+ */
+template<typename IT=uint32_t>
+struct RegionSubset {
+    std::vector<IT> members, inside, outside;
+    size_t n = 0; // Size of the full set
+
+    size_t size() const {return members.size();}
+    bool empty() const {return members.empty();}
+    const std::vector<IT> *members_ptr() const {return &members;}
+
+    // out[i] = values[members[i]]
+    template<typename T, typename OT>
+    void gather(const T *values, OT *out) const {
+        OMP_PFOR
+        for(size_t i = 0; i < members.size(); ++i) out[i] = values[members[i]];
+    }
+    template<typename T>
+    std::vector<T> gather(const T *values) const {
+        std::vector<T> ret(members.size());
+        gather(values, ret.data());
+        return ret;
+    }
+    // Replaces subset-local ids with global ids in place
+    template<typename OIT>
+    void to_global(OIT *ids, size_t nids) const {
+        for(size_t i = 0; i < nids; ++i) ids[i] = members[ids[i]];
+    }
+    template<typename Container>
+    void to_global(Container &ids) const {to_global(ids.data(), ids.size());}
+};
+
+namespace detail {
+// Bernoulli(p) selection over [0, n), visiting only the selected positions by drawing geometric gaps
+template<typename RNG, typename Func>
+void bernoulli_positions(size_t n, double p, RNG &rng, const Func &func) {
+    if(p <= 0. || n == 0) return;
+    if(p >= 1.) {
+        for(size_t i = 0; i < n; ++i) func(i);
+        return;
+    }
+    std::geometric_distribution<uint64_t> gap(p);
+    for(uint64_t i = gap(rng); i < n; i += gap(rng) + 1) func(i);
+}
+} // namespace detail
+
+/*
+ * Samples the subset used for region-restricted clustering: each point inside bb is kept with probability bb.p_box,
+ * and each point outside with probability bb.p_nobox.
+ * Region membership comes from the index, and both draws skip directly between kept points,
+ * so the cost is proportional to the points inside plus the points kept rather than to n.
+ * Points without coordinates count as outside.
+ * With p_box = 1 and p_nobox = 0, this is the region itself.
+ */
+template<typename IT=uint32_t>
+RegionSubset<IT> sample_region(const GridIndex &index, const BoundingBoxData &bb, uint64_t seed=0) {
+    MINOCORE_PHASE("sample_region");
+    MINOCORE_REQUIRE(bb.valid(), "Invalid bounding box");
+    RegionSubset<IT> ret;
+    ret.n = index.size();
+    const std::vector<IT> in = index.query<IT>(bb);
+    std::mt19937_64 rng(seed);
+    detail::bernoulli_positions(in.size(), bb.p_box, rng, [&](size_t i) {ret.inside.push_back(in[i]);});
+    // Position j of the complement is the j-th id not in `in`; both sequences ascend, so one merge pass suffices.
+    size_t skip = 0;
+    detail::bernoulli_positions(ret.n - in.size(), bb.p_nobox, rng, [&](size_t j) {
+        while(skip < in.size() && size_t(in[skip]) <= j + skip) ++skip;
+        ret.outside.push_back(j + skip);
+    });
+    ret.members.resize(ret.inside.size() + ret.outside.size());
+    std::merge(ret.inside.begin(), ret.inside.end(), ret.outside.begin(), ret.outside.end(), ret.members.begin());
+    MINOCORE_LOG("sample_region: kept %zu/%zu inside, %zu outside\n", ret.inside.size(), in.size(), ret.outside.size());
+    return ret;
+}
+
+} // namespace geo
+
+using geo::GridIndex;
+using geo::RegionSubset;
+using geo::sample_region;
+
+} // namespace minocore
+
+#endif /* FGC_REGION_H__ */
@@ -0,0 +1,123 @@
+#ifndef MINOCORE_UTIL_TEXTPARSE_H__
+#define MINOCORE_UTIL_TEXTPARSE_H__
+#include "minocore/util/macros.h"
+#include "minocore/util/trace.h"
+#include "mio/single_include/mio/mio.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace minocore {
+
+namespace textparse {
+
+/*
+ * Locale-free scanning primitives for the parallel text loaders (MatrixMarket, DIMACS).
+ * Each takes a cursor and the end of the current line, and advances the cursor past what it consumed.
+ */
+
+static constexpr double exact_powers_of_ten[] {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+INLINE double exact_pow10(int x) {
+    return x <= 22 ? exact_powers_of_ten[x]: std::pow(10., x);
+}
+
+INLINE const char *skip_ws(const char *p, const char *e) {
+    while(p < e && (*p == ' ' || *p == '\t' || *p == '\r')) ++p;
+    return p;
+}
+
+// No locale, no errno: digits are consumed until the first non-digit.
+INLINE uint64_t parse_uint(const char *&p, const char *e) {
+    p = skip_ws(p, e);
+    uint64_t ret = 0;
+    for(unsigned d; p < e && (d = unsigned(*p - '0')) < 10u; ++p)
+        ret = ret * 10 + d;
+    return ret;
+}
+
+// Accepts [+-]digits[.digits][(e|E)[+-]digits].
+// The mantissa is accumulated as an integer (up to 19 significant digits) and scaled once.
+template<typename FT=double>
+INLINE FT parse_float(const char *&p, const char *e) {
+    p = skip_ws(p, e);
+    bool neg = false;
+    if(p < e && (*p == '-' || *p == '+')) neg = *p++ == '-';
+    uint64_t mant = 0;
+    int exp10 = 0, ndig = 0;
+    for(unsigned d; p < e && (d = unsigned(*p - '0')) < 10u; ++p) {
+        if(ndig < 19) {mant = mant * 10 + d; ndig += mant != 0;}
+        else ++exp10;
+    }
+    if(p < e && *p == '.') {
+        for(unsigned d; ++p < e && (d = unsigned(*p - '0')) < 10u;) {
+            if(ndig < 19) {mant = mant * 10 + d; ndig += mant != 0; --exp10;}
+        }
+    }
+    if(p < e && (*p | 0x20) == 'e') {
+        bool eneg = false;
+        if(++p < e && (*p == '-' || *p == '+')) eneg = *p++ == '-';
+        int ev = 0;
+        for(unsigned d; p < e && (d = unsigned(*p - '0')) < 10u; ++p)
+            if(ev < 10000) ev = ev * 10 + d;
+        exp10 += eneg ? -ev: ev;
+    }
+    double ret = mant;
+    if(exp10 > 0)      ret *= exact_pow10(exp10);
+    else if(exp10 < 0) ret /= exact_pow10(-exp10);
+    return neg ? -ret: ret;
+}
+
+INLINE const char *next_line(const char *p, const char *e) {
+    const char *eol = static_cast<const char *>(std::memchr(p, '\n', e - p));
+    return eol ? eol + 1: e;
+}
+
+// Boundaries of nchunks newline-aligned chunks covering [begin, end)
+inline std::vector<size_t> make_chunks(const char *s, size_t begin, size_t end, size_t nchunks) {
+    std::vector<size_t> ret{begin};
+    const size_t chunksize = std::max(size_t(1) << 16, (end - begin + nchunks - 1) / std::max(nchunks, size_t(1)));
+    while(ret.back() < end) {
+        size_t next = ret.back() + chunksize;
+        if(next >= end) next = end;
+        else next = next_line(s + next, s + end) - s;
+        ret.push_back(next);
+    }
+    return ret;
+}
+
+/*
+ * Calls func(const char *data, size_t size) on the contents of path.
+ * Regular files are mmap'd; pipes and other streams, which cannot be mapped, are read into memory.
+ */
+template<typename Func>
+auto with_file_contents(const std::string &path, const Func &func) {
+    struct stat st;
+    if(::stat(path.data(), &st)) throw std::runtime_error(std::string("Failed to stat ") + path);
+    if(S_ISREG(st.st_mode) && st.st_size > 0) {
+        mio::mmap_source ms(path);
+        ::madvise((void *)ms.data(), ms.size(), MADV_WILLNEED);
+        MINOCORE_COUNT(BYTES_READ, ms.size());
+        return func(ms.data(), ms.size());
+    }
+    std::ifstream ifs(path);
+    std::string buf((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+    MINOCORE_COUNT(BYTES_READ, buf.size());
+    return func(static_cast<const char *>(buf.data()), buf.size());
+}
+
+} // namespace textparse
+
+} // namespace minocore
+
+#endif /* MINOCORE_UTIL_TEXTPARSE_H__ */
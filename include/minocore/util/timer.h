@@ -1,5 +1,6 @@
 #ifndef TIMER_H__
 #define TIMER_H__
+#include "minocore/util/trace.h"
 #include <chrono>
 #include <cstdint>
 #include <iostream>
@@ -16,22 +17,28 @@ static inline double timediff2ms(std::chrono::time_point<Clock> start, std::chro
     return std::chrono::duration<double, std::milli>(stop - start).count();
 }
 
+/*
+ * Scoped timer. Each timed interval is also recorded as a trace phase named msg_ when tracing is enabled (see trace.h).
+ * Timers constructed with display=false only feed the trace, which is what library code should use.
+ */
 struct Timer {
 
     std::string msg_;
     std::chrono::time_point<hrc> start_, stop_;
+    bool display_ = true, traced_ = false;
 
     static auto now() {return hrc::now();}
 
-    Timer(std::string msg=std::string()): msg_(msg), start_(now()) {}
+    Timer(std::string msg=std::string(), bool display=true): msg_(msg), start_(now()), display_(display) {}
 
     void report() {
         stop_ = now();
+        record_trace();
         display();
     }
     void restart(std::string msg) {if(!msg.empty()) msg_ = msg; reset(); start();}
     void display() const {
-        if(start_.time_since_epoch().count())
+        if(display_ && start_.time_since_epoch().count())
             std::cerr << "[---Timer---] " << msg_ << " " << timediff2ms(start_, stop_) << "ms\n";
     }
     void reset() {
@@ -40,9 +47,11 @@ struct Timer {
     void start() {
         if(start_.time_since_epoch().count()) {
             stop_ = now();
+            record_trace();
             display();
         }
         start_ = now();
+        traced_ = false;
     }
 
     uint64_t diff() const {return timediff2ms(start_, stop_);}
@@ -53,8 +62,21 @@ struct Timer {
 
     ~Timer() {
         stop();
+        record_trace();
         display();
     }
+private:
+    // Records the interval [start_, stop_] once per start()
+    void record_trace() {
+        if(traced_ || !start_.time_since_epoch().count()) return;
+        traced_ = true;
+#if MINOCORE_TRACE
+        if(!trace::enabled()) return;
+        auto &reg = trace::Registry::get();
+        const uint64_t stop_ns = reg.now_ns(), dur_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(stop_ - start_).count();
+        trace::record(reg.intern(msg_), stop_ns > dur_ns ? stop_ns - dur_ns: 0, stop_ns);
+#endif
+    }
 };
 
 } // util
@@ -0,0 +1,275 @@
+#ifndef MINOCORE_UTIL_TRACE_H__
+#define MINOCORE_UTIL_TRACE_H__
+#include "minocore/util/macros.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cinttypes>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+ * Phase-level instrumentation.
+ *
+ * MINOCORE_PHASE("name") times the enclosing scope,
+ * and MINOCORE_COUNT(DISTANCE_EVALS, n) bumps a per-thread counter.
+ * Both compile to nothing unless MINOCORE_TRACE is defined to a nonzero value,
+ * and when compiled in, record only while trace::enabled() (initially, when $MINOCORE_TRACE is set and nonzero).
+ * If $MINOCORE_TRACE_FILE is set, a chrome://tracing (or Perfetto) trace is written there at exit.
+ *
+ * MINOCORE_LOG(...) replaces progress messages in library code:
+ * it prints to stderr only when trace::verbose() (initially, when $MINOCORE_VERBOSE is set and nonzero).
+ */
+
+#ifndef MINOCORE_TRACE
+#  define MINOCORE_TRACE 0
+#endif
+
+namespace minocore {
+
+namespace trace {
+
+enum Counter: unsigned {
+    DISTANCE_EVALS,
+    SWAPS_TRIED,
+    SWAPS_ACCEPTED,
+    HEAP_OPS,
+    BYTES_READ,
+    NUM_COUNTERS
+};
+
+static constexpr const char *counter_names[NUM_COUNTERS] {
+    "distance_evals", "swaps_tried", "swaps_accepted", "heap_ops", "bytes_read"
+};
+
+namespace detail {
+inline bool env_flag(const char *name) {
+    const char *s = std::getenv(name);
+    return s && *s && std::strcmp(s, "0") != 0;
+}
+inline std::atomic<bool> &verbose_flag() {
+    static std::atomic<bool> ret(env_flag("MINOCORE_VERBOSE"));
+    return ret;
+}
+} // namespace detail
+
+inline bool verbose() {return detail::verbose_flag().load(std::memory_order_relaxed);}
+inline void set_verbose(bool v) {detail::verbose_flag().store(v, std::memory_order_relaxed);}
+
+#if defined(__GNUC__) || defined(__clang__)
+__attribute__((format(printf, 1, 2)))
+#endif
+inline void log(const char *fmt, ...) {
+    std::va_list ap;
+    va_start(ap, fmt);
+    std::vfprintf(stderr, fmt, ap);
+    va_end(ap);
+}
+
+#if MINOCORE_TRACE
+
+struct Event {
+    const char *name;
+    uint64_t start_ns, dur_ns;
+};
+
+struct alignas(64) ThreadState {
+    uint64_t counters[NUM_COUNTERS]{};
+    std::vector<Event> events;
+    uint32_t tid;
+    ThreadState(uint32_t id): tid(id) {}
+};
+
+class Registry {
+    std::mutex mut_;
+    // Thread states outlive their threads so that dumps after a parallel region see everything.
+    std::vector<std::unique_ptr<ThreadState>> states_;
+    std::set<std::string> names_;
+    const std::chrono::steady_clock::time_point epoch_ = std::chrono::steady_clock::now();
+public:
+    std::atomic<bool> enabled_{detail::env_flag("MINOCORE_TRACE") || std::getenv("MINOCORE_TRACE_FILE")};
+
+    static Registry &get() {
+        static Registry ret;
+        return ret;
+    }
+    ThreadState *add_thread() {
+        std::lock_guard<std::mutex> lock(mut_);
+        states_.emplace_back(new ThreadState(states_.size()));
+        return states_.back().get();
+    }
+    // Stable storage for names which are not string literals (e.g., util::Timer messages)
+    const char *intern(const std::string &s) {
+        std::lock_guard<std::mutex> lock(mut_);
+        return names_.insert(s).first->data();
+    }
+    uint64_t now_ns() const {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch_).count();
+    }
+    template<typename Func>
+    void for_each_thread(const Func &func) {
+        std::lock_guard<std::mutex> lock(mut_);
+        for(const auto &s: states_) func(*s);
+    }
+    void reset() {
+        for_each_thread([](ThreadState &s) {
+            s.events.clear();
+            std::fill(std::begin(s.counters), std::end(s.counters), uint64_t(0));
+        });
+    }
+    void write_chrome_trace(std::FILE *fp);
+    ~Registry() {
+        if(const char *path = std::getenv("MINOCORE_TRACE_FILE")) {
+            if(std::FILE *fp = std::fopen(path, "w")) {
+                write_chrome_trace(fp);
+                std::fclose(fp);
+            }
+        }
+    }
+};
+
+inline ThreadState &thread_state() {
+    static thread_local ThreadState *ret = Registry::get().add_thread();
+    return *ret;
+}
+
+inline bool enabled() {return Registry::get().enabled_.load(std::memory_order_relaxed);}
+inline void set_enabled(bool v) {Registry::get().enabled_.store(v, std::memory_order_relaxed);}
+inline void reset() {Registry::get().reset();}
+
+INLINE void count(Counter c, uint64_t n=1) {
+    if(enabled()) thread_state().counters[c] += n;
+}
+
+// Records a completed phase; used by Phase and util::Timer
+inline void record(const char *name, uint64_t start_ns, uint64_t stop_ns) {
+    thread_state().events.push_back(Event{name, start_ns, stop_ns - start_ns});
+}
+
+class Phase {
+    const char *name_;
+    uint64_t start_;
+public:
+    Phase(const char *name): name_(enabled() ? name: nullptr), start_(name_ ? Registry::get().now_ns(): 0) {}
+    ~Phase() {
+        if(name_) record(name_, start_, Registry::get().now_ns());
+    }
+    Phase(const Phase &) = delete;
+};
+
+// Counter totals over all threads
+inline std::vector<uint64_t> counter_totals() {
+    std::vector<uint64_t> ret(NUM_COUNTERS);
+    Registry::get().for_each_thread([&](const ThreadState &s) {
+        for(unsigned i = 0; i < NUM_COUNTERS; ++i) ret[i] += s.counters[i];
+    });
+    return ret;
+}
+
+struct PhaseSummary {
+    size_t calls = 0;
+    double total_ms = 0., max_ms = 0.;
+};
+
+// Per-phase call counts and times, summed over threads
+inline std::map<std::string, PhaseSummary> phase_summary() {
+    std::map<std::string, PhaseSummary> ret;
+    Registry::get().for_each_thread([&](const ThreadState &s) {
+        for(const auto &e: s.events) {
+            auto &ps = ret[e.name];
+            const double ms = e.dur_ns * 1e-6;
+            ++ps.calls;
+            ps.total_ms += ms;
+            ps.max_ms = std::max(ps.max_ms, ms);
+        }
+    });
+    return ret;
+}
+
+/*
+ * Writes the Chrome trace event format: one complete ("X") event per phase and
+ * one counter ("C") event per thread with its final counter values.
+ * Aggregated phases and counter totals are included under "summary".
+ */
+inline void Registry::write_chrome_trace(std::FILE *fp) {
+    const auto summary = phase_summary();
+    const auto totals = counter_totals();
+    std::lock_guard<std::mutex> lock(mut_);
+    std::fprintf(fp, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [");
+    bool first = true;
+    for(const auto &s: states_) {
+        for(const auto &e: s->events) {
+            std::fprintf(fp, "%s\n{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 0, \"tid\": %u, \"ts\": %.3f, \"dur\": %.3f}",
+                         first ? "": ",", e.name, s->tid, e.start_ns * 1e-3, e.dur_ns * 1e-3);
+            first = false;
+        }
+        std::fprintf(fp, "%s\n{\"name\": \"counters\", \"ph\": \"C\", \"pid\": 0, \"tid\": %u, \"ts\": %.3f, \"args\": {",
+                     first ? "": ",", s->tid, now_ns() * 1e-3);
+        for(unsigned i = 0; i < NUM_COUNTERS; ++i)
+            std::fprintf(fp, "%s\"%s\": %" PRIu64, i ? ", ": "", counter_names[i], s->counters[i]);
+        std::fprintf(fp, "}}");
+        first = false;
+    }
+    std::fprintf(fp, "\n], \"summary\": {\"phases\": {");
+    first = true;
+    for(const auto &[name, ps]: summary) {
+        std::fprintf(fp, "%s\n\"%s\": {\"calls\": %zu, \"total_ms\": %.6g, \"max_ms\": %.6g}",
+                     first ? "": ",", name.data(), ps.calls, ps.total_ms, ps.max_ms);
+        first = false;
+    }
+    std::fprintf(fp, "}, \"counters\": {");
+    for(unsigned i = 0; i < NUM_COUNTERS; ++i)
+        std::fprintf(fp, "%s\"%s\": %" PRIu64, i ? ", ": "", counter_names[i], totals[i]);
+    std::fprintf(fp, "}}}\n");
+}
+
+inline void dump_chrome_trace(std::FILE *fp) {Registry::get().write_chrome_trace(fp);}
+
+#  define MINOCORE_TRACE_CAT_(x, y) x##y
+#  define MINOCORE_TRACE_CAT(x, y) MINOCORE_TRACE_CAT_(x, y)
+#  define MINOCORE_PHASE(name) ::minocore::trace::Phase MINOCORE_TRACE_CAT(minocore_phase_, __LINE__)(name)
+#  define MINOCORE_COUNT(counter, n) ::minocore::trace::count(::minocore::trace::counter, (n))
+
+#else
+
+// Tracing compiled out: the same interface, doing nothing.
+inline constexpr bool enabled() {return false;}
+inline void set_enabled(bool) {}
+inline void reset() {}
+inline void count(Counter, uint64_t=1) {}
+inline void record(const char *, uint64_t, uint64_t) {}
+inline std::vector<uint64_t> counter_totals() {return std::vector<uint64_t>(NUM_COUNTERS);}
+inline void dump_chrome_trace(std::FILE *fp) {
+    std::fprintf(fp, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": []}\n");
+}
+
+#  define MINOCORE_PHASE(name) (void)0
+#  define MINOCORE_COUNT(counter, n) (void)0
+
+#endif /* MINOCORE_TRACE */
+
+inline void dump_chrome_trace(const std::string &path) {
+    std::FILE *fp = std::fopen(path.data(), "w");
+    if(!fp) throw std::runtime_error(std::string("Failed to open ") + path);
+    dump_chrome_trace(fp);
+    std::fclose(fp);
+}
+
+} // namespace trace
+
+} // namespace minocore
+
+#define MINOCORE_LOG(...) do {if(::minocore::trace::verbose()) ::minocore::trace::log(__VA_ARGS__);} while(0)
+
+#endif /* MINOCORE_UTIL_TRACE_H__ */
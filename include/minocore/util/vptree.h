@@ -0,0 +1,247 @@
+#ifndef MINOCORE_UTIL_VPTREE_H__
+#define MINOCORE_UTIL_VPTREE_H__
+#include "minocore/util/macros.h"
+#include "minocore/util/exception.h"
+#include "minocore/util/packed.h"
+#include "minocore/util/trace.h"
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <numeric>
+#include <random>
+#include <vector>
+
+namespace minocore {
+
+namespace vp {
+
+/*
+ * Vantage-point tree over items of a metric space, given only the metric.
+ *
+ * dist(a, b) is the distance between items a and b, used to build the tree and to insert into it.
+ * Queries instead take dq(id), the distance from the query to item id, so a query need not be an item
+ * (e.g., index the centers, and query with each point).
+ * Each internal node holds a vantage point and two subtrees, along with the range of distances from the vantage point
+ * to the items of each, and a search skips a subtree when the triangle inequality rules it out.
+ * Inserting widens these ranges along its path and splits the leaf it lands in once the leaf holds 2 * leaf_size items,
+ * so the tree can grow (e.g., with the centers of greedy k-center) without being rebuilt.
+ *
+ * Pruning is exact only for metrics. For squared metrics (SQRL2, JSD), index their square roots.
+ * Queries may run concurrently with each other, but not with insert.
+ */
+template<typename Dist, typename FT=float, typename IT=uint32_t>
+class VPTree {
+    static constexpr uint32_t NONE = uint32_t(-1);
+    struct Node {
+        IT vp = 0;
+        bool leaf = true;
+        FT mu = 0;                     // Items with d(vp, x) <= mu are in child[0], and the rest in child[1]
+        FT lo[2]{0, 0}, hi[2]{0, 0};   // Range of d(vp, x) over each subtree
+        uint32_t child[2]{NONE, NONE};
+        std::vector<IT> items;         // Leaves only
+    };
+    Dist dist_;
+    std::vector<Node> nodes_;
+    uint32_t root_ = NONE;
+    size_t n_ = 0, leaf_size_;
+    std::mt19937_64 rng_;
+
+    uint32_t new_node() {
+        nodes_.emplace_back();
+        return nodes_.size() - 1;
+    }
+    // Builds the subtree over ids[0..n) at node `at` (or a new node), returning its index
+    uint32_t build(IT *ids, size_t n, uint32_t at=NONE) {
+        const uint32_t ret = at == NONE ? new_node(): at;
+        nodes_[ret] = Node();
+        if(n <= leaf_size_) {
+            nodes_[ret].items.assign(ids, ids + n);
+            return ret;
+        }
+        std::swap(ids[0], ids[rng_() % n]);
+        const IT vp = ids[0];
+        std::vector<std::pair<FT, IT>> dists(n - 1);
+        OMP_PRAGMA("omp parallel for if(n > 4096)")
+        for(size_t i = 1; i < n; ++i)
+            dists[i - 1] = {FT(dist_(vp, ids[i])), ids[i]};
+        const size_t half = (n - 1) / 2;
+        std::nth_element(dists.begin(), dists.begin() + half, dists.end());
+        FT lo0 = dists[half].first, lo1 = std::numeric_limits<FT>::max(), hi1 = 0;
+        for(size_t i = 0; i < half; ++i) lo0 = std::min(lo0, dists[i].first);
+        for(size_t i = half + 1; i < n - 1; ++i) lo1 = std::min(lo1, dists[i].first), hi1 = std::max(hi1, dists[i].first);
+        for(size_t i = 0; i < n - 1; ++i) ids[i + 1] = dists[i].second;
+        const FT mu = dists[half].first;
+        dists = std::vector<std::pair<FT, IT>>();
+        const uint32_t inside = build(ids + 1, half + 1);
+        const uint32_t outside = half + 2 < n ? build(ids + half + 2, n - half - 2): NONE;
+        Node &node = nodes_[ret];
+        node.leaf = false;
+        node.vp = vp;
+        node.mu = mu;
+        node.lo[0] = lo0; node.hi[0] = mu;
+        node.lo[1] = lo1; node.hi[1] = hi1;
+        node.child[0] = inside;
+        node.child[1] = outside;
+        return ret;
+    }
+    // Visits the items of subtree ni which may lie within tau of the query, where visit(d, id, tau) may shrink tau
+    template<typename DQ, typename Visit>
+    void search(uint32_t ni, const DQ &dq, FT &tau, const Visit &visit) const {
+        const Node &node = nodes_[ni];
+        if(node.leaf) {
+            for(const IT id: node.items) visit(FT(dq(id)), id, tau);
+            return;
+        }
+        const FT d = dq(node.vp);
+        visit(d, node.vp, tau);
+        const int first = d > node.mu;
+        for(const int s: {first, 1 - first}) {
+            const uint32_t c = node.child[s];
+            if(c != NONE && d + tau >= node.lo[s] && d - tau <= node.hi[s])
+                search(c, dq, tau, visit);
+        }
+    }
+public:
+    using pair_type = packed::pair<FT, IT>;
+
+    // An empty tree, to be filled by rebuild or insert
+    explicit VPTree(Dist dist, size_t leaf_size=16, uint64_t seed=0): dist_(std::move(dist)), leaf_size_(std::max(leaf_size, size_t(1))), rng_(seed) {}
+    template<typename It, typename=std::enable_if_t<!std::is_integral_v<It>>>
+    VPTree(Dist dist, It begin, It end, size_t leaf_size=16, uint64_t seed=0): VPTree(std::move(dist), leaf_size, seed) {
+        std::vector<IT> ids(begin, end);
+        rebuild(ids.data(), ids.size());
+    }
+    // Replaces the contents with ids[0..n), reordering ids
+    void rebuild(IT *ids, size_t n) {
+        MINOCORE_PHASE("VPTree::build");
+        nodes_.clear();
+        n_ = n;
+        root_ = n ? build(ids, n): NONE;
+    }
+    // Replaces the contents with items [0, n)
+    void rebuild(size_t n) {
+        std::vector<IT> ids(n);
+        std::iota(ids.begin(), ids.end(), IT(0));
+        rebuild(ids.data(), n);
+    }
+    void insert(IT id) {
+        ++n_;
+        if(root_ == NONE) {
+            root_ = new_node();
+            nodes_[root_].items.push_back(id);
+            return;
+        }
+        uint32_t cur = root_;
+        while(!nodes_[cur].leaf) {
+            const FT d = dist_(nodes_[cur].vp, id);
+            const int s = d > nodes_[cur].mu;
+            if(nodes_[cur].child[s] == NONE) {
+                const uint32_t c = new_node();
+                Node &node = nodes_[cur];
+                node.child[s] = c;
+                node.lo[s] = node.hi[s] = d;
+            } else {
+                Node &node = nodes_[cur];
+                node.lo[s] = std::min(node.lo[s], d);
+                node.hi[s] = std::max(node.hi[s], d);
+            }
+            cur = nodes_[cur].child[s];
+        }
+        auto &items = nodes_[cur].items;
+        items.push_back(id);
+        if(items.size() >= 2 * leaf_size_) {
+            std::vector<IT> tmp(std::move(items));
+            build(tmp.data(), tmp.size(), cur);
+        }
+    }
+    size_t size() const {return n_;}
+    bool empty() const {return n_ == 0;}
+    size_t num_nodes() const {return nodes_.size();}
+
+    // The (up to) k items nearest the query, as (distance, id) ascending
+    template<typename DQ>
+    std::vector<pair_type> knn(const DQ &dq, unsigned k) const {
+        std::vector<pair_type> heap;
+        if(root_ == NONE || !k) return heap;
+        heap.reserve(k);
+        FT tau = std::numeric_limits<FT>::max();
+        search(root_, dq, tau, [&](FT d, IT id, FT &t) {
+            if(heap.size() < k) {
+                heap.emplace_back(d, id);
+                std::push_heap(heap.begin(), heap.end());
+                if(heap.size() == k) t = heap.front().first;
+            } else if(pair_type(d, id) < heap.front()) {
+                std::pop_heap(heap.begin(), heap.end());
+                heap.back() = pair_type(d, id);
+                std::push_heap(heap.begin(), heap.end());
+                t = heap.front().first;
+            }
+        });
+        std::sort_heap(heap.begin(), heap.end());
+        return heap;
+    }
+    // The nearest item, or (max, IT(-1)) if empty
+    template<typename DQ>
+    pair_type nearest(const DQ &dq) const {
+        pair_type ret(std::numeric_limits<FT>::max(), IT(-1));
+        if(root_ == NONE) return ret;
+        FT tau = ret.first;
+        search(root_, dq, tau, [&](FT d, IT id, FT &t) {
+            if(pair_type(d, id) < ret) ret = pair_type(d, id), t = d;
+        });
+        return ret;
+    }
+    // Ids of the items within distance r of the query, ascending
+    template<typename DQ>
+    std::vector<IT> range(const DQ &dq, FT r) const {
+        std::vector<IT> ret;
+        if(root_ == NONE) return ret;
+        FT tau = r;
+        search(root_, dq, tau, [&](FT d, IT id, FT &) {if(d <= r) ret.push_back(id);});
+        std::sort(ret.begin(), ret.end());
+        return ret;
+    }
+
+    /*
+     * Batch queries, in parallel: make_dq(q) returns the query functor for query q in [0, nq).
+     * knn_batch returns nq rows of k entries, each ascending, padded with (max, IT(-1)) if the tree holds fewer than k items.
+     */
+    template<typename MakeDQ>
+    std::vector<pair_type> knn_batch(size_t nq, const MakeDQ &make_dq, unsigned k) const {
+        MINOCORE_PHASE("VPTree::knn_batch");
+        std::vector<pair_type> ret(nq * k, pair_type(std::numeric_limits<FT>::max(), IT(-1)));
+        OMP_PFOR_DYN
+        for(size_t q = 0; q < nq; ++q) {
+            const auto nn = knn(make_dq(q), k);
+            std::copy(nn.begin(), nn.end(), ret.begin() + q * k);
+        }
+        return ret;
+    }
+    // Sets asn[q] and costs[q] to the nearest item to query q and its distance
+    template<typename MakeDQ, typename AIT, typename CFT>
+    void nearest_batch(size_t nq, const MakeDQ &make_dq, AIT *asn, CFT *costs) const {
+        MINOCORE_PHASE("VPTree::nearest_batch");
+        OMP_PFOR_DYN
+        for(size_t q = 0; q < nq; ++q) {
+            const auto p = nearest(make_dq(q));
+            asn[q] = p.second;
+            costs[q] = p.first;
+        }
+    }
+};
+
+template<typename FT=float, typename IT=uint32_t, typename Dist>
+auto make_vptree(Dist dist, size_t n, size_t leaf_size=16, uint64_t seed=0) {
+    VPTree<Dist, FT, IT> ret(std::move(dist), leaf_size, seed);
+    ret.rebuild(n);
+    return ret;
+}
+
+} // namespace vp
+
+using vp::VPTree;
+using vp::make_vptree;
+
+} // namespace minocore
+
+#endif /* MINOCORE_UTIL_VPTREE_H__ */
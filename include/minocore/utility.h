@@ -8,13 +8,17 @@
 #include "minocore/util/Inf2Zero.h"
 
 #include "minocore/util/csc.h"
+#include "minocore/util/mtx.h"
 
 #include "minocore/util/div.h"
 #include "minocore/util/packed.h"
 
 #include "minocore/util/oracle.h"
+#include "minocore/util/vptree.h"
+#include "minocore/util/landmarks.h"
 
 #include "minocore/util/geo.h"
+#include "minocore/util/region.h"
 
 #include "minocore/util/timer.h"
 
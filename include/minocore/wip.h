@@ -3,6 +3,7 @@
 
 #include "./wip/caratheodory.h"
 #include "./wip/streaming.h"
+#include "./wip/sharded_streaming.h"
 #include "./wip/gen_kmedian.h"
 
 #endif
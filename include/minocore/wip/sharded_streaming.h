@@ -0,0 +1,197 @@
+#pragma once
+#ifndef FGC_SHARDED_STREAMING_H__
+#define FGC_SHARDED_STREAMING_H__
+#include "minocore/wip/streaming.h"
+#include "minocore/optim/kmeans.h"
+#include "minocore/optim/lsearch.h"
+#include <numeric>
+
+namespace minocore {
+namespace streaming {
+
+/*
+ * ShardedKServiceClusterer
+ * Runs nshards independent DenseKServiceClusterer instances on a partition of the stream:
+ * the i-th row of the stream is sent to shard i % nshards. Each batch is split across shards,
+ * which then process their rows in parallel.
+ *
+ * Every merge_interval rows (checked at batch boundaries), the weighted facilities of all shards
+ * and the current global summary are merged into a new global summary of at most summary_size facilities
+ * by solving weighted k-median over them, each facility moving its weight to the nearest one selected.
+ * Weighted D-sampling picks CANDIDATE_FACTOR * summary_size candidate facilities, and single-swap local search
+ * (LocalKMedSearcher, with costs scaled by weight) runs over the candidates, seeded with the first summary_size picks.
+ * The seed costs O(log summary_size) times the optimum in expectation, and local search only lowers it,
+ * stopping within a factor 5 + eps of the best summary drawn from the candidates;
+ * this constant-factor offline step is what the BMORST analysis requires of each merge.
+ * This takes O(total * summary_size) distance evaluations and memory, rather than a total x total cost matrix.
+ * Weight is conserved by the merge, so the summary continues to represent every point seen.
+ *
+ * Shard seeds are derived from the seed and the shard index, and partitioning does not depend on thread scheduling,
+ * so results are deterministic given the seed, the number of shards, and the batch sizes used.
+ */
+template<typename FT=float, typename Norm=blz::L1Norm>
+class ShardedKServiceClusterer {
+    using shard_type = DenseKServiceClusterer<FT, Norm>;
+    static constexpr size_t CANDIDATE_FACTOR = 4;
+    Norm func_;
+    std::vector<shard_type> shards_;
+    unsigned k_;
+    size_t d_, summary_size_, merge_interval_, nseen_ = 0, since_merge_ = 0, nmerges_ = 0;
+    uint64_t seed_;
+    blaze::DynamicMatrix<FT> summary_;
+    blaze::DynamicVector<FT> summary_weights_;
+    // Per-shard batch buffers, reused across batches
+    std::vector<blaze::DynamicMatrix<FT>> shard_rows_;
+    std::vector<blaze::DynamicVector<FT>> shard_weights_;
+public:
+    ShardedKServiceClusterer(unsigned k, size_t n, size_t d, double alpha, unsigned nshards,
+                             size_t merge_interval=size_t(1) << 20, uint64_t seed=0, size_t summary_size=0):
+        k_(k), d_(d), merge_interval_(merge_interval), seed_(seed),
+        shard_rows_(nshards), shard_weights_(nshards)
+    {
+        MINOCORE_VALIDATE(nshards > 0);
+        // Default summary size matches the O(k log n) facilities an OFL phase keeps.
+        summary_size_ = summary_size ? summary_size: size_t(std::ceil(k * (1. + std::log(std::max(n, size_t(2))))));
+        shards_.reserve(nshards);
+        wy::WyHash<uint64_t, 2> seedgen(seed);
+        for(unsigned i = 0; i < nshards; ++i)
+            shards_.emplace_back(k, (n + nshards - 1) / nshards, d, alpha, seedgen());
+    }
+    size_t num_shards() const {return shards_.size();}
+    size_t num_processed() const {return nseen_;}
+    size_t num_merges() const {return nmerges_;}
+    const auto &shard(size_t i) const {return shards_[i];}
+
+    template<typename MT>
+    void add_batch(const blaze::DenseMatrix<MT, blaze::rowMajor> &batch, const FT *weights=nullptr) {
+        const auto &b = ~batch;
+        MINOCORE_VALIDATE(b.columns() == d_);
+        const size_t nb = b.rows(), ns = shards_.size();
+        OMP_PFOR
+        for(size_t s = 0; s < ns; ++s) {
+            // Rows with global index congruent to s mod ns
+            const size_t first = (s + ns - nseen_ % ns) % ns;
+            const size_t nr = first < nb ? (nb - first + ns - 1) / ns: size_t(0);
+            if(!nr) continue;
+            auto &rows = shard_rows_[s];
+            auto &w = shard_weights_[s];
+            if(rows.rows() < nr) rows.resize(nr, d_, false), w.resize(nr, false);
+            for(size_t i = first, j = 0; i < nb; i += ns, ++j) {
+                row(rows, j, blaze::unchecked) = row(b, i, blaze::unchecked);
+                w[j] = weights ? weights[i]: FT(1);
+            }
+            shards_[s].add_batch(submatrix(rows, 0, 0, nr, d_), w.data());
+        }
+        nseen_ += nb;
+        if((since_merge_ += nb) >= merge_interval_) {
+            merge();
+            since_merge_ = 0;
+        }
+    }
+
+    template<typename RowReader, typename WeightGen=UniformW<FT>>
+    void process(RowReader &rows, WeightGen &&wgen=WeightGen(), size_t batch_size=1024 * 16) {
+        blaze::DynamicMatrix<FT> buf(batch_size, d_);
+        blaze::DynamicVector<FT> wbuf(batch_size);
+        const size_t stride = buf.spacing();
+        for(;;) {
+            size_t nr = 0;
+            for(; nr < batch_size; ++nr) {
+                const size_t nread = rows.read(buf.data() + nr * stride, d_);
+                if(nread != d_) {
+                    if(nread) throw std::runtime_error("Partial row read from stream");
+                    break;
+                }
+            }
+            if(!nr) break;
+            if(wgen.read(wbuf.data(), nr) != nr)
+                throw std::runtime_error("Failed to read weights for batch");
+            add_batch(submatrix(buf, 0, 0, nr, d_), wbuf.data());
+            if(nr < batch_size) break;
+        }
+    }
+
+    /*
+     * Merges all shard facilities and the current summary into a new summary.
+     * Shards keep their phase, facility cost and running cost but drop their facilities.
+     */
+    void merge() {
+        size_t total = summary_.rows();
+        for(const auto &s: shards_) total += s.size();
+        if(!total) return;
+        blaze::DynamicMatrix<FT> pts(total, d_);
+        blaze::DynamicVector<FT> ptw(total);
+        size_t offset = summary_.rows();
+        if(offset) {
+            submatrix(pts, 0, 0, offset, d_) = summary_;
+            subvector(ptw, 0, offset) = summary_weights_;
+        }
+        for(auto &s: shards_) {
+            const size_t nf = s.size();
+            if(!nf) continue;
+            submatrix(pts, offset, 0, nf, d_) = s.facilities();
+            subvector(ptw, offset, nf) = s.weights();
+            offset += nf;
+            s.clear_facilities();
+        }
+        ++nmerges_;
+        if(total <= summary_size_) {
+            summary_ = std::move(pts);
+            summary_weights_ = std::move(ptw);
+            return;
+        }
+        // Candidates: weighted D-sampling (k-means++ with the norm itself, as suits k-median) over the facilities.
+        // Its first summary_size picks are the seed for local search.
+        auto oracle = [&](size_t i, size_t j) {return FT(func_(row(pts, i, blaze::unchecked), row(pts, j, blaze::unchecked)));};
+        wy::WyRand<uint64_t, 2> rng(seed_ + nmerges_);
+        const size_t ncand = std::min(total, CANDIDATE_FACTOR * summary_size_);
+        auto cand = std::get<0>(coresets::kmeanspp(oracle, rng, total, ncand, ptw.data()));
+        // Weighted k-median over the facilities, opening candidates: cost(c, j) = w_j * d(f_c, f_j)
+        blaze::DynamicMatrix<FT> costs(cand.size(), total);
+        OMP_PFOR
+        for(size_t i = 0; i < cand.size(); ++i) {
+            auto pr = row(pts, cand[i], blaze::unchecked);
+            auto cr = row(costs, i, blaze::unchecked);
+            for(size_t j = 0; j < total; ++j)
+                cr[j] = ptw[j] * func_(pr, row(pts, j, blaze::unchecked));
+        }
+        auto lsearcher = make_kmed_lsearcher(costs, std::min(summary_size_, cand.size()), 1e-5, seed_ + nmerges_);
+        std::vector<uint32_t> seed(summary_size_);
+        std::iota(seed.begin(), seed.end(), 0u);
+        lsearcher.assign_centers(seed.begin(), seed.begin() + std::min(summary_size_, cand.size()));
+        lsearcher.run();
+        std::vector<uint32_t> sol(lsearcher.sol_.begin(), lsearcher.sol_.end());
+        shared::sort(sol.begin(), sol.end());
+        blaze::DynamicVector<FT> newweights(sol.size(), FT(0));
+        std::vector<uint32_t> selected(sol.size());
+        for(size_t i = 0; i < sol.size(); ++i) selected[i] = cand[sol[i]];
+        for(size_t j = 0; j < total; ++j) {
+            auto col = column(costs, j);
+            size_t best = 0;
+            for(size_t i = 1; i < sol.size(); ++i)
+                if(col[sol[i]] < col[sol[best]]) best = i;
+            newweights[best] += ptw[j];
+        }
+        summary_ = rows(pts, selected.data(), selected.size());
+        summary_weights_ = std::move(newweights);
+    }
+
+    // Merges outstanding shard facilities and returns the global weighted summary,
+    // which should then be clustered by an offline method.
+    std::pair<const blaze::DynamicMatrix<FT> &, const blaze::DynamicVector<FT> &> summary() {
+        merge();
+        return {summary_, summary_weights_};
+    }
+};
+
+template<typename FT=float, typename Norm=blz::L1Norm>
+auto make_sharded_kservice_clusterer(unsigned k, size_t n, size_t d, double alpha, unsigned nshards,
+                                     size_t merge_interval=size_t(1) << 20, uint64_t seed=0, size_t summary_size=0)
+{
+    return ShardedKServiceClusterer<FT, Norm>(k, n, d, alpha, nshards, merge_interval, seed, summary_size);
+}
+
+} // namespace streaming
+} // namespace minocore
+
+#endif /* FGC_SHARDED_STREAMING_H__ */
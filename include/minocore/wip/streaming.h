@@ -2,18 +2,22 @@
 #ifndef FGC_STREAMING_H__
 #define FGC_STREAMING_H__
 #include <cstdio>
+#include <cstring>
 #include <cmath>
+#include <algorithm>
+#include <vector>
 
 #include <iostream>
 #include <type_traits>
 #include <stdexcept>
 #include <random>
-#include <stack>
 
 
 #include <zlib.h>
 
 #include "minocore/dist/distance.h"
+#include "minocore/hash/hash.h"
+#include "minocore/util/trace.h"
 
 
 namespace minocore {
@@ -41,15 +45,30 @@ struct IterW {
     decltype(auto) operator()() {
         return *data_++;
     }
+    // Bulk read for mini-batch processing; returns the number of items read.
+    template<typename FT>
+    size_t read(FT *dest, size_t n) {
+        for(size_t i = 0; i < n; ++i) dest[i] = *data_++;
+        return n;
+    }
 };
 
 template<typename FT=double>
 struct PointerW: public IterW<const FT *> {
     PointerW(const FT *ptr): IterW<const FT *>(ptr) {}
+    size_t read(FT *dest, size_t n) {
+        std::memcpy(dest, this->data_, n * sizeof(FT));
+        this->data_ += n;
+        return n;
+    }
 };
 template<typename FT=double>
 struct UniformW: public IterW<UniformWeightIterator<FT>> {
     UniformW(): IterW<UniformWeightIterator<FT>>(UniformWeightIterator<FT>()) {}
+    size_t read(FT *dest, size_t n) {
+        std::fill(dest, dest + n, static_cast<FT>(1));
+        return n;
+    }
 };
 
 template<typename FT=double>
@@ -63,6 +82,11 @@ struct ZlibW {
         }
         return ret;
     };
+    size_t read(FT *dest, size_t n) {
+        const int rc = gzread(fp_, dest, n * sizeof(FT));
+        if(rc < 0) throw std::runtime_error("Failed to read from file\n");
+        return rc / sizeof(FT);
+    }
 };
 
 template<typename FT=double>
@@ -71,9 +95,14 @@ struct istreamW {
     istreamW(std::istream &s): s_(s) {}
     FT operator()() {
         FT ret;
-        s_.read(&ret, sizeof(ret));
+        if(!s_.read(reinterpret_cast<char *>(&ret), sizeof(ret)))
+            throw std::runtime_error("Failed to read from stream\n");
         return ret;
     };
+    size_t read(FT *dest, size_t n) {
+        s_.read(reinterpret_cast<char *>(dest), n * sizeof(FT));
+        return s_.gcount() / sizeof(FT);
+    }
 };
 template<typename CT>
 struct is_uniform_weighting: public std::false_type {};
@@ -101,28 +130,27 @@ struct is_uniform_weighting<UniformW<FT>>: public std::true_type {};
     WeightGen defaults to UniformW, which returns 1. each time. ZlibW, istreamW, and PointerW load
     successive values from a stream as described by their names.
 
-    When the stream has been completely processed, the set of points on the sack (mstack_)
+    When the stream has been completely processed, the set of facilities (items_ and weights_)
     must be clustered by another method.
+    For dense vectors, DenseKServiceClusterer (below) consumes mini-batches of rows instead.
     For general metric spaces, we recommend Jain-Vazirani or local search.
     For k-means, k-medians, and Bregman Divergences, we recommend Lloyd's algorithm/EM.
  */
 
-template<typename Item, typename Func, typename WT=double, typename RNG=std::mt19937_64>
+template<typename Item, typename Func, typename WT=double, typename RNG=wy::WyRand<uint64_t, 2>>
 class KServiceClusterer {
     Func func_;
-    WT l_i_, f_, cost_, alpha_, beta_;
+    WT l_i_, f_, cost_ = 0, alpha_, beta_, gamma_, logn_, max_facilities_;
     unsigned k_;
     size_t n_ = 0, i_ = 0;
+    bool reinserting_ = false;
 public:
-    struct mutable_stack: public std::stack<std::pair<Item, WT>> {
-        mutable_stack() {}
-        auto &getc() {return this->c;}
-        const auto &getc() const {return this->c;}
-        auto  operator[](size_t index) const {return this->c[index];}
-        auto &operator[](size_t index)       {return this->c[index];}
-    };
-    mutable_stack mstack_;
-    typename mutable_stack::container_type readingstack_;
+    // Facilities and their weights are stored contiguously (SoA)
+    std::vector<Item> items_;
+    std::vector<WT> weights_;
+    // Facilities from previous phases, awaiting re-insertion
+    std::vector<Item> pending_items_;
+    std::vector<WT> pending_weights_;
     std::uniform_real_distribution<WT> urd_;
     RNG rng_;
 
@@ -136,61 +164,377 @@ public:
         return std::max(beta_ * get_kofl() + 1.,
                         4. * alpha_ * alpha_ * alpha_ * get_cofl() * get_cofl() + 2 * alpha_ * alpha_ * get_cofl());
     }
+    size_t size() const {return items_.size();}
+    size_t phase() const {return i_;}
+    WT cost() const {return cost_;}
 
     template<typename AItem>
     std::pair<unsigned, WT> assign(const AItem &item) const {
-        if(mstack_.empty()) return {-1, std::numeric_limits<WT>::max()};
+        if(items_.empty()) return {-1, std::numeric_limits<WT>::max()};
         unsigned i = 0;
-        WT mindist = func_(mstack_[0], item), dist;
-        for(unsigned j = 1; j < mstack_.size(); ++j)
-            if((dist = func_(mstack_[j])) < mindist) mindist = dist, i = j;
+        WT mindist = func_(items_[0], item), dist;
+        for(unsigned j = 1; j < items_.size(); ++j)
+            if((dist = func_(items_[j], item)) < mindist) mindist = dist, i = j;
         return {i, mindist};
     }
     template<typename AItem>
     void add(const AItem &item, WT weight=1.) {
-        auto [asn, mincost] = assign(item);
-        auto cost = weight * mincost;
-        auto gam = get_gamma();
-        if(cost / f_ > urd_(rng_)) {
-            mstack_.push(std::pair<Item, WT>{item, weight});
-        } else {
-            cost_ += cost;
-            mstack_[asn].second += weight;
-        }
-        if(cost_ > gam * l_i_ || mstack_.size() > (gam - 1) * (1 + std::log(n_)) * k_) {
-            readingstack_ = std::move(mstack_.getc());
-            ++i_;
-            l_i_ *= beta_;
-            f_ = l_i_ / (k_ * (1 + std::log(n_)));
-        }
+        consider(item, weight);
+        reinsert();
     }
     template<typename Generator, typename WeightGen=UniformW<WT>>
-    void process_step(Generator &gen, WeightGen &wgen=WeightGen()) {
-        if(readingstack_.size()) {
-            add(readingstack_.top().first, readingstack_.top().second);
-            readingstack_.pop();
-        }
-        ++n_;
+    void process_step(Generator &gen, WeightGen &wgen) {
         add(gen(), wgen());
     }
     template<typename Generator, typename WeightGen=UniformW<WT>>
     void process(Generator &gen, WeightGen &&wgen=WeightGen()) {
         WeightGen weight_gen(std::move(wgen));
         while(gen.size() /* maybe rename for easier interface? */ ) {
-            process_step(gen, wgen);
+            process_step(gen, weight_gen);
         }
     }
     KServiceClusterer(Func func, unsigned k, size_t n, double alpha, uint64_t seed=std::rand()):
         func_(func), l_i_(1),
-        alpha_(alpha), beta_(2. * alpha_ * alpha_  * get_cofl() + 2. * alpha_), k_(k), n_(n), i_(1)
+        alpha_(alpha), beta_(2. * alpha_ * alpha_  * get_cofl() + 2. * alpha_), k_(k), n_(n), i_(1), rng_(seed)
     {
-        rng_.seed(seed);
+        gamma_ = get_gamma();
+        logn_ = std::log(std::max(n_, size_t(2)));
+        max_facilities_ = (gamma_ - 1) * (1 + logn_) * k_;
+        f_ = l_i_ / (k_ * (1 + logn_));
+    }
+private:
+    template<typename AItem>
+    void consider(const AItem &item, WT weight) {
+        auto [asn, mincost] = assign(item);
+        auto cost = weight * mincost;
+        if(items_.empty() || cost / f_ > urd_(rng_)) {
+            items_.emplace_back(item);
+            weights_.push_back(weight);
+        } else {
+            cost_ += cost;
+            weights_[asn] += weight;
+        }
+        if(cost_ > gamma_ * l_i_ || items_.size() > max_facilities_)
+            next_phase();
+    }
+    void next_phase() {
+        // Facilities from the previous phase become weighted points in the next.
+        pending_items_.insert(pending_items_.end(), std::make_move_iterator(items_.begin()), std::make_move_iterator(items_.end()));
+        pending_weights_.insert(pending_weights_.end(), weights_.begin(), weights_.end());
+        items_.clear();
+        weights_.clear();
+        cost_ = 0;
+        ++i_;
+        l_i_ *= beta_;
+        f_ = l_i_ / (k_ * (1 + logn_));
+    }
+    void reinsert() {
+        if(reinserting_) return;
+        reinserting_ = true;
+        std::vector<Item> items;
+        std::vector<WT> weights;
+        while(pending_items_.size()) {
+            std::swap(items, pending_items_);
+            std::swap(weights, pending_weights_);
+            for(size_t i = 0; i < items.size(); ++i)
+                consider(items[i], weights[i]);
+            items.clear();
+            weights.clear();
+        }
+        reinserting_ = false;
+    }
+};
+
+/*
+ * DenseKServiceClusterer
+ * The same BMORST/OFL procedure as KServiceClusterer, specialized for dense row vectors.
+ * Facilities are stored in a row-major matrix with their weights (and squared norms) in contiguous vectors.
+ * Points are processed in mini-batches: distances from the batch to the facilities present at the start
+ * of the batch are computed at once (by a matrix product for L2/squared L2, otherwise row-wise with SIMD kernels),
+ * and facilities opened during the batch are checked individually. A phase change re-inserts the old facilities
+ * as a single weighted batch before the next point, and the rest of the batch is then matched against the new set.
+ * If Hasher is not void, an LSHTable over the facilities restricts the search to colliding facilities once
+ * the number of facilities reaches lsh_threshold. (This is approximate.)
+ * All buffers are reused, so steady-state processing does not allocate.
+ */
+
+struct NoLSH {};
+
+template<typename FT=float, typename Norm=blz::sqrL2Norm, typename Hasher=void, typename RNG=wy::WyRand<uint64_t, 2>>
+class DenseKServiceClusterer {
+    static_assert(std::is_floating_point_v<FT>, "FT must be floating-point");
+    static constexpr bool use_gemm = std::is_same_v<Norm, blz::sqrL2Norm> || std::is_same_v<Norm, blz::L2Norm>;
+    static constexpr bool take_sqrt = std::is_same_v<Norm, blz::L2Norm>;
+    using table_type = std::conditional_t<std::is_void_v<Hasher>, NoLSH, hash::LSHTable<Hasher, uint32_t>>;
+    static constexpr size_t npos = size_t(-1);
+
+    Norm func_;
+    FT l_i_, f_, cost_ = 0, alpha_, beta_, gamma_, logn_, max_facilities_;
+    unsigned k_;
+    size_t n_, d_, i_ = 1, nf_ = 0, npending_ = 0, nseen_ = 0;
+    bool reinserting_ = false;
+
+    // Facilities: only the first nf_ rows are in use.
+    blaze::DynamicMatrix<FT> facilities_;
+    blaze::DynamicVector<FT> fweights_, fnorms_;
+    // Facilities from previous phases, awaiting re-insertion
+    blaze::DynamicMatrix<FT> pending_, reinsert_buf_;
+    blaze::DynamicVector<FT> pending_weights_, reinsert_weights_;
+    // Batch buffers
+    blaze::DynamicMatrix<FT> dists_, batch_;
+    blaze::DynamicVector<FT> batch_weights_;
+    std::vector<size_t> bestind_;
+    std::vector<FT> bestdist_;
+
+    std::unique_ptr<table_type> table_;
+    size_t lsh_threshold_ = npos;
+    std::uniform_real_distribution<FT> urd_;
+    RNG rng_;
+public:
+    DenseKServiceClusterer(unsigned k, size_t n, size_t d, double alpha, uint64_t seed=std::rand(), Norm func=Norm()):
+        func_(func), l_i_(1), alpha_(alpha), beta_(2. * alpha * alpha * get_cofl() + 2. * alpha),
+        k_(k), n_(n), d_(d), rng_(seed)
+    {
+        gamma_ = get_gamma();
+        logn_ = std::log(std::max(n_, size_t(2)));
+        max_facilities_ = (gamma_ - 1) * (1 + logn_) * k_;
+        f_ = l_i_ / (k_ * (1 + logn_));
+        const size_t initcap = std::max(size_t(16), size_t(k_) * 4);
+        facilities_.resize(initcap, d_);
+        fweights_.resize(initcap);
+        fnorms_.resize(initcap);
+    }
+    double get_cofl() const {return 3 * alpha_ + 1;}
+    double get_kofl() const {return (6 * alpha_  + 1) * k_;}
+    double get_gamma() const {
+        return std::max(beta_ * get_kofl() + 1.,
+                        4. * alpha_ * alpha_ * alpha_ * get_cofl() * get_cofl() + 2 * alpha_ * alpha_ * get_cofl());
+    }
+    size_t size() const {return nf_;}
+    size_t phase() const {return i_;}
+    size_t num_processed() const {return nseen_;}
+    FT cost() const {return cost_;}
+    auto facilities() const {return submatrix(facilities_, 0, 0, nf_, d_);}
+    auto weights() const {return subvector(fweights_, 0, nf_);}
+    // Drops the current facilities (e.g., after they have been merged elsewhere),
+    // keeping the phase, the facility cost and the phase's running cost, so the phase still ends at its cost bound.
+    void clear_facilities() {
+        nf_ = 0;
+        if constexpr(!std::is_void_v<Hasher>) {
+            if(table_) table_->clear();
+        }
+    }
+
+    // Enables LSH-restricted search once there are at least `threshold` facilities.
+    template<typename...HArgs>
+    void enable_lsh(size_t threshold, HArgs &&...args) {
+        static_assert(!std::is_void_v<Hasher>, "Hasher must be provided to use LSH");
+        table_.reset(new table_type(std::forward<HArgs>(args)...));
+        lsh_threshold_ = threshold;
+        for(size_t i = 0; i < nf_; ++i)
+            table_->add(row(facilities_, i, blaze::unchecked), i);
+    }
+
+    template<typename VT>
+    void add(const blaze::DenseVector<VT, blaze::rowVector> &item, FT weight=1.) {
+        if(batch_.rows() != 1 || batch_.columns() != d_) batch_.resize(1, d_);
+        row(batch_, 0, blaze::unchecked) = ~item;
+        add_batch(batch_, &weight);
+    }
+
+    template<typename MT>
+    void add_batch(const blaze::DenseMatrix<MT, blaze::rowMajor> &batch, const FT *weights=nullptr) {
+        const auto &b = ~batch;
+        MINOCORE_VALIDATE(b.columns() == d_);
+        const size_t nb = b.rows();
+        for(size_t i = 0; i < nb;) {
+            // Facilities [0, base) are covered by distances precomputed for rows [start, nb).
+            const size_t start = i;
+            size_t base = nf_;
+            if(use_lsh(nf_)) base = 0;
+            else             batch_nearest(submatrix(b, start, 0, nb - start, d_), base);
+            while(i < nb) {
+                auto r = row(b, i, blaze::unchecked);
+                size_t asn = npos;
+                FT mincost = std::numeric_limits<FT>::max();
+                if(use_lsh(nf_)) {
+                    std::tie(asn, mincost) = lsh_nearest(r);
+                } else {
+                    if(base) asn = bestind_[i - start], mincost = bestdist_[i - start];
+                    for(size_t j = base; j < nf_; ++j) {
+                        if(FT d = distance(r, j); d < mincost) mincost = d, asn = j;
+                    }
+                }
+                const size_t phase_before = i_;
+                consider(r, weights ? weights[i]: FT(1), asn, mincost);
+                ++i;
+                if(i_ != phase_before) {
+                    // Put the previous phase's facilities back before the next point, which would otherwise
+                    // be served by an empty facility set; then recompute distances for the rest of the batch.
+                    // (During re-insertion itself, they are picked up by the enclosing reinsert loop.)
+                    reinsert();
+                    break;
+                }
+            }
+        }
+        nseen_ += nb;
+        reinsert();
+    }
+
+    /*
+     * process
+     * Consumes rows (d_ values each) from a bulk reader (ZlibW, istreamW, PointerW)
+     * in mini-batches of batch_size rows until the reader is exhausted.
+     * Weights are read from wgen, which defaults to uniform weights.
+     */
+    template<typename RowReader, typename WeightGen=UniformW<FT>>
+    void process(RowReader &rows, WeightGen &&wgen=WeightGen(), size_t batch_size=1024) {
+        blaze::DynamicMatrix<FT> buf(batch_size, d_);
+        if(batch_weights_.size() < batch_size) batch_weights_.resize(batch_size);
+        const size_t stride = buf.spacing();
+        for(;;) {
+            size_t nr = 0;
+            for(; nr < batch_size; ++nr) {
+                const size_t nread = rows.read(buf.data() + nr * stride, d_);
+                if(nread != d_) {
+                    if(nread) throw std::runtime_error("Partial row read from stream");
+                    break;
+                }
+            }
+            if(!nr) break;
+            if(wgen.read(batch_weights_.data(), nr) != nr)
+                throw std::runtime_error("Failed to read weights for batch");
+            add_batch(submatrix(buf, 0, 0, nr, d_), batch_weights_.data());
+            if(nr < batch_size) break;
+        }
+    }
+
+private:
+    template<typename VT>
+    FT distance(const VT &r, size_t j) const {
+        return func_(r, row(facilities_, j, blaze::unchecked));
+    }
+    bool use_lsh(size_t nf) const {
+        if constexpr(std::is_void_v<Hasher>) return false;
+        else return table_ && nf >= lsh_threshold_;
+    }
+    template<typename VT>
+    std::pair<size_t, FT> lsh_nearest(const VT &r) const {
+        if constexpr(std::is_void_v<Hasher>) {
+            throw std::runtime_error("Unreachable");
+        } else {
+            std::pair<size_t, FT> ret{npos, std::numeric_limits<FT>::max()};
+            const auto candidates = table_->query(r);
+            if(candidates.empty()) {
+                for(size_t j = 0; j < nf_; ++j)
+                    if(FT d = distance(r, j); d < ret.second) ret = {j, d};
+            } else {
+                for(const auto &pair: candidates)
+                    if(FT d = distance(r, pair.first); d < ret.second) ret = {pair.first, d};
+            }
+            return ret;
+        }
+    }
+    // Fills bestind_/bestdist_ with the nearest facility in [0, nf) for each row of the batch
+    template<typename MT>
+    void batch_nearest(const MT &b, size_t nf) {
+        const size_t nb = b.rows();
+        bestind_.resize(nb);
+        bestdist_.resize(nb);
+        if(!nf) return;
+        if constexpr(use_gemm) {
+            dists_ = b * trans(submatrix(facilities_, 0, 0, nf, d_));
+            for(size_t i = 0; i < nb; ++i) {
+                const FT bn = blaze::sqrNorm(row(b, i, blaze::unchecked));
+                auto dr = row(dists_, i, blaze::unchecked);
+                size_t bi = 0;
+                FT bd = bn + fnorms_[0] - FT(2) * dr[0];
+                for(size_t j = 1; j < nf; ++j) {
+                    const FT d = bn + fnorms_[j] - FT(2) * dr[j];
+                    if(d < bd) bd = d, bi = j;
+                }
+                bd = std::max(bd, FT(0));
+                if constexpr(take_sqrt) bd = std::sqrt(bd);
+                bestind_[i] = bi;
+                bestdist_[i] = bd;
+            }
+        } else {
+            for(size_t i = 0; i < nb; ++i) {
+                auto r = row(b, i, blaze::unchecked);
+                size_t bi = 0;
+                FT bd = distance(r, 0);
+                for(size_t j = 1; j < nf; ++j)
+                    if(FT d = distance(r, j); d < bd) bd = d, bi = j;
+                bestind_[i] = bi;
+                bestdist_[i] = bd;
+            }
+        }
+    }
+    template<typename VT>
+    void open_facility(const VT &r, FT weight) {
+        if(nf_ == facilities_.rows()) {
+            const size_t newcap = nf_ << 1;
+            facilities_.resize(newcap, d_, true);
+            fweights_.resize(newcap, true);
+            fnorms_.resize(newcap, true);
+        }
+        row(facilities_, nf_, blaze::unchecked) = r;
+        fweights_[nf_] = weight;
+        if constexpr(use_gemm) fnorms_[nf_] = blaze::sqrNorm(r);
+        if constexpr(!std::is_void_v<Hasher>) {
+            if(table_) table_->add(row(facilities_, nf_, blaze::unchecked), nf_);
+        }
+        ++nf_;
+    }
+    template<typename VT>
+    void consider(const VT &r, FT weight, size_t asn, FT mincost) {
+        const FT cost = weight * mincost;
+        if(asn == npos || cost / f_ > urd_(rng_)) {
+            open_facility(r, weight);
+        } else {
+            cost_ += cost;
+            fweights_[asn] += weight;
+        }
+        if(cost_ > gamma_ * l_i_ || nf_ > max_facilities_)
+            next_phase();
+    }
+    void next_phase() {
+        // Facilities from the previous phase become weighted points in the next.
+        if(npending_ + nf_ > pending_.rows()) {
+            const size_t newcap = std::max(npending_ + nf_, pending_.rows() << 1);
+            pending_.resize(newcap, d_, true);
+            pending_weights_.resize(newcap, true);
+        }
+        submatrix(pending_, npending_, 0, nf_, d_) = submatrix(facilities_, 0, 0, nf_, d_);
+        subvector(pending_weights_, npending_, nf_) = subvector(fweights_, 0, nf_);
+        npending_ += nf_;
+        nf_ = 0;
+        cost_ = 0;
+        ++i_;
+        l_i_ *= beta_;
+        f_ = l_i_ / (k_ * (1 + logn_));
+        if constexpr(!std::is_void_v<Hasher>) {
+            if(table_) table_->clear();
+        }
+    }
+    void reinsert() {
+        if(reinserting_) return;
+        reinserting_ = true;
+        while(npending_) {
+            std::swap(pending_, reinsert_buf_);
+            std::swap(pending_weights_, reinsert_weights_);
+            const size_t nr = npending_;
+            npending_ = 0;
+            add_batch(submatrix(reinsert_buf_, 0, 0, nr, d_), reinsert_weights_.data());
+            nseen_ -= nr; // Re-inserted facilities are not new items.
+        }
+        reinserting_ = false;
     }
 };
 
 template<typename Item, typename Func, template<typename> class WeightGen=UniformW, typename FT=double>
 auto make_kservice_clusterer(Func func, unsigned k, size_t n, double alpha, bool uniform_weighting=is_uniform_weighting<WeightGen<FT>>::value) {
-    if(uniform_weighting) std::fprintf(stderr, "Uniform weighting\n");
+    if(uniform_weighting) MINOCORE_LOG("Uniform weighting\n");
     return KServiceClusterer<Item, Func, FT>(func, k, n, alpha);
 }
 
@@ -210,6 +554,23 @@ auto make_online_l2_clusterer(unsigned k, size_t n, bool uniform_weighting=is_un
     return make_kservice_clusterer<Item, blz::L2Norm, FT>(blz::L2Norm(), k, n, 1., uniform_weighting);
 }
 
+template<typename FT=float, typename Norm=blz::L1Norm>
+auto make_dense_kservice_clusterer(unsigned k, size_t n, size_t d, double alpha, uint64_t seed=std::rand()) {
+    return DenseKServiceClusterer<FT, Norm>(k, n, d, alpha, seed);
+}
+template<typename FT=float>
+auto make_dense_online_kmedian_clusterer(unsigned k, size_t n, size_t d, uint64_t seed=std::rand()) {
+    return make_dense_kservice_clusterer<FT, blz::L1Norm>(k, n, d, 1., seed);
+}
+template<typename FT=float>
+auto make_dense_online_kmeans_clusterer(unsigned k, size_t n, size_t d, uint64_t seed=std::rand()) {
+    return make_dense_kservice_clusterer<FT, blz::sqrL2Norm>(k, n, d, 2., seed);
+}
+template<typename FT=float>
+auto make_dense_online_l2_clusterer(unsigned k, size_t n, size_t d, uint64_t seed=std::rand()) {
+    return make_dense_kservice_clusterer<FT, blz::L2Norm>(k, n, d, 1., seed);
+}
+
 } // namespace streaming
 } // namespace minocore
 
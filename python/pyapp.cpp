@@ -0,0 +1,119 @@
+#include "pyapp.h"
+
+template<typename MatrixType, typename...Args>
+PyApplicator bind_applicator(std::vector<py::object> owners, dist::DissimilarityMeasure measure, jsd::Prior prior,
+                             const PriorVector *pc, Args &&...args)
+{
+    auto ret = std::make_shared<BoundApplicator<MatrixType>>();
+    ret->owners_ = std::move(owners);
+    ret->mat_.reset(new MatrixType(std::forward<Args>(args)...));
+    {
+        py::gil_scoped_release nogil;
+        ret->app_.reset(new jsd::DissimilarityApplicator<MatrixType>(*ret->mat_, measure, prior, pc));
+    }
+    return PyApplicator{std::move(ret)};
+}
+
+static py::array contiguous_member(py::object obj, const char *name) {
+    py::array ret = obj.attr(name);
+    if(ret.ndim() != 1 || !(ret.flags() & py::array::c_style))
+        throw std::invalid_argument(std::string("CSR ") + name + " must be a contiguous 1-d array");
+    return ret;
+}
+
+template<typename IndPtrType, typename DataType>
+PyApplicator bind_csr(py::object csr, py::array indptr, py::array indices, py::array data, size_t nr, size_t nc,
+                      dist::DissimilarityMeasure measure, jsd::Prior prior, const PriorVector *pc)
+{
+    return bind_applicator<CSRView<IndPtrType, DataType>>(
+        {csr, indptr, indices, data}, measure, prior, pc,
+        static_cast<const IndPtrType *>(indptr.data()), static_cast<const IndPtrType *>(indices.data()),
+        static_cast<const DataType *>(data.data()), uint64_t(data.shape(0)), uint32_t(nr), uint32_t(nc));
+}
+
+static PyApplicator make_applicator(py::object data, dist::DissimilarityMeasure measure, jsd::Prior prior, py::object prior_data) {
+    std::unique_ptr<PriorVector> pc;
+    if(!prior_data.is_none()) {
+        auto arr = py::cast<FNA>(prior_data);
+        pc.reset(new PriorVector(arr.size()));
+        std::copy(arr.data(), arr.data() + arr.size(), pc->data());
+    }
+    if(py::hasattr(data, "indptr")) {
+        if(py::str(data.attr("format")).cast<std::string>() != "csr")
+            throw std::invalid_argument("Sparse input must be in CSR format (call .tocsr())");
+        auto shape = data.attr("shape").cast<std::pair<size_t, size_t>>();
+        if(std::max(shape.first, shape.second) > std::numeric_limits<uint32_t>::max())
+            throw std::invalid_argument("Sparse input has too many rows or columns");
+        // Rows are binary-searched, so indices must be sorted and unique. Canonicalize a copy rather than the caller's matrix.
+        if(!data.attr("has_canonical_format").cast<bool>()) {
+            data = data.attr("copy")();
+            data.attr("sum_duplicates")();
+        }
+        py::array indptr = contiguous_member(data, "indptr"), indices = contiguous_member(data, "indices"),
+                  values = contiguous_member(data, "data");
+        if(!indptr.dtype().is(indices.dtype()))
+            throw std::invalid_argument("CSR indptr and indices must have the same dtype");
+        const bool wide = indptr.dtype().is(py::dtype::of<int64_t>());
+        if(!wide && !indptr.dtype().is(py::dtype::of<int32_t>()))
+            throw std::invalid_argument("CSR indices must be int32 or int64");
+        const bool dbl = values.dtype().is(py::dtype::of<double>());
+        if(!dbl && !values.dtype().is(py::dtype::of<float>()))
+            throw std::invalid_argument("CSR data must be float32 or float64");
+        auto f = wide ? (dbl ? &bind_csr<int64_t, double>: &bind_csr<int64_t, float>)
+                      : (dbl ? &bind_csr<int32_t, double>: &bind_csr<int32_t, float>);
+        return f(data, indptr, indices, values, shape.first, shape.second, measure, prior, pc.get());
+    }
+    py::array arr = py::cast<py::array>(data);
+    if(!arr.dtype().is(py::dtype::of<float>()) || arr.ndim() != 2 || !(arr.flags() & py::array::c_style) || !arr.writeable())
+        throw std::invalid_argument("Dense input must be a writeable, C-contiguous 2-d float32 array; use np.ascontiguousarray(x, dtype=np.float32)");
+    return bind_applicator<DenseMatrix>({arr}, measure, prior, pc.get(),
+                                        static_cast<float *>(arr.mutable_data()), size_t(arr.shape(0)), size_t(arr.shape(1)));
+}
+
+void init_applicator(py::module &m) {
+    py::enum_<dist::DissimilarityMeasure>(m, "Measure")
+        .value("L1", dist::L1).value("L2", dist::L2).value("SQRL2", dist::SQRL2)
+        .value("JSM", dist::JSM).value("JSD", dist::JSD).value("MKL", dist::MKL).value("POISSON", dist::POISSON)
+        .value("HELLINGER", dist::HELLINGER).value("BHATTACHARYYA_METRIC", dist::BHATTACHARYYA_METRIC)
+        .value("BHATTACHARYYA_DISTANCE", dist::BHATTACHARYYA_DISTANCE)
+        .value("TOTAL_VARIATION_DISTANCE", dist::TOTAL_VARIATION_DISTANCE).value("LLR", dist::LLR)
+        .value("REVERSE_MKL", dist::REVERSE_MKL).value("REVERSE_POISSON", dist::REVERSE_POISSON)
+        .value("UWLLR", dist::UWLLR).value("ITAKURA_SAITO", dist::ITAKURA_SAITO)
+        .value("REVERSE_ITAKURA_SAITO", dist::REVERSE_ITAKURA_SAITO)
+        .value("COSINE_DISTANCE", dist::COSINE_DISTANCE).value("PROBABILITY_COSINE_DISTANCE", dist::PROBABILITY_COSINE_DISTANCE);
+    py::enum_<jsd::Prior>(m, "Prior")
+        .value("NONE", jsd::NONE).value("DIRICHLET", jsd::DIRICHLET)
+        .value("GAMMA_BETA", jsd::GAMMA_BETA).value("FEATURE_SPECIFIC_PRIOR", jsd::FEATURE_SPECIFIC_PRIOR);
+
+    py::class_<PyApplicator>(m, "Applicator")
+    .def(py::init(&make_applicator),
+         "Wraps a 2-d float32 NumPy array or a SciPy CSR matrix without copying. "
+         "Dense rows are normalized in place. The applicator keeps a reference to its input, which must not be resized.",
+         py::arg("data"), py::arg("measure") = dist::JSD, py::arg("prior") = jsd::NONE, py::arg("prior_data") = py::none())
+    .def("__len__", &PyApplicator::size)
+    .def_property_readonly("measure", &PyApplicator::measure)
+    .def("__call__", [](const PyApplicator &a, size_t i, size_t j) {
+        if(std::max(i, j) >= a.size()) throw std::out_of_range("Point index out of range");
+        return a.visit([i, j](const auto &app) {return double(app(i, j));});
+    }, "Dissimilarity between points i and j", py::arg("i"), py::arg("j"), py::call_guard<py::gil_scoped_release>());
+
+    m.def("make_knns", [](const PyApplicator &a, unsigned k) {
+        std::vector<packed::pair<float, uint32_t>> knns;
+        {
+            py::gil_scoped_release nogil;
+            knns = a.visit([k](const auto &app) {return make_knns<uint32_t>(app, k);});
+        }
+        const size_t np = a.size(), kk = np ? knns.size() / np: 0;
+        py::array_t<float> dists({np, kk});
+        py::array_t<uint32_t> ids({np, kk});
+        float *dp = dists.mutable_data();
+        uint32_t *ip = ids.mutable_data();
+        {
+            py::gil_scoped_release nogil;
+            OMP_PFOR
+            for(size_t i = 0; i < knns.size(); ++i)
+                dp[i] = knns[i].first, ip[i] = knns[i].second;
+        }
+        return py::make_tuple(dists, ids);
+    }, "Returns (distances, indices), each of shape (n, k), of each point's k nearest neighbors", py::arg("app"), py::arg("k"));
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include "pyfgc.h"
+#include <variant>
+
+/*
+ * DissimilarityApplicator over Python-owned buffers.
+ *
+ * Dense inputs are wrapped in a blaze::CustomMatrix over the NumPy array (rows are normalized in place, as in C++);
+ * SciPy CSR inputs are wrapped in a read-only CSRMatrixView over indptr/indices/data.
+ * Either way, the applicator refers to the Python buffers directly and holds references to keep them alive.
+ *
+ * Bindings take it by const reference and release the GIL. That is safe across Python threads
+ * because only const methods are exposed, and the applicator locks its lazily built log/sqrt caches itself.
+ * A binding which mutates the applicator must keep the GIL held instead.
+ */
+
+using DenseMatrix = blaze::CustomMatrix<float, blaze::unaligned, blaze::unpadded, blaze::rowMajor>;
+template<typename IndPtrType, typename DataType>
+using CSRView = CSRMatrixView<IndPtrType, IndPtrType, DataType, float>;
+using PriorVector = blaze::DynamicVector<float, blaze::rowVector>;
+
+template<typename MatrixType>
+struct BoundApplicator {
+    std::vector<py::object> owners_;
+    std::unique_ptr<MatrixType> mat_;
+    std::unique_ptr<jsd::DissimilarityApplicator<MatrixType>> app_;
+    ~BoundApplicator() {
+        app_.reset();
+        mat_.reset(); // Before the buffers are released
+    }
+};
+
+struct PyApplicator {
+    std::variant<std::shared_ptr<BoundApplicator<DenseMatrix>>,
+                 std::shared_ptr<BoundApplicator<CSRView<int32_t, float>>>,
+                 std::shared_ptr<BoundApplicator<CSRView<int32_t, double>>>,
+                 std::shared_ptr<BoundApplicator<CSRView<int64_t, float>>>,
+                 std::shared_ptr<BoundApplicator<CSRView<int64_t, double>>>> ptr_;
+
+    // Calls func(app) with the concrete applicator. func must return the same type for every alternative.
+    template<typename Func>
+    decltype(auto) visit(const Func &func) const {
+        return std::visit([&](const auto &p) -> decltype(auto) {return func(*p->app_);}, ptr_);
+    }
+    size_t size() const {return visit([](const auto &app) {return app.size();});}
+    dist::DissimilarityMeasure measure() const {return visit([](const auto &app) {return app.get_measure();});}
+};
@@ -0,0 +1,108 @@
+#include "pyapp.h"
+
+using CentersVec = std::vector<blaze::DynamicVector<float, blaze::rowVector>>;
+
+// Moves c if it already holds T, and converts otherwise.
+template<typename T, typename Container>
+std::vector<T> as_vector(Container &&c) {
+    if constexpr(std::is_same_v<std::decay_t<Container>, std::vector<T>>) return std::move(c);
+    else return std::vector<T>(c.begin(), c.end());
+}
+
+// Copies k centers of dimension d into a (k, d) array; k is small, so this copy is negligible.
+static py::array centers2numpy(const CentersVec &centers) {
+    const size_t k = centers.size(), d = k ? centers.front().size(): 0;
+    py::array_t<float> ret({k, d});
+    float *p = ret.mutable_data();
+    for(size_t i = 0; i < k; ++i)
+        std::copy(centers[i].begin(), centers[i].end(), p + i * d);
+    return ret;
+}
+
+struct HardResult {
+    blz::DV<uint32_t> assignments;
+    blz::DV<float> costs;
+};
+
+void init_clustering(py::module &m) {
+    m.def("kmeanspp", [](const PyApplicator &a, unsigned k, uint64_t seed, py::object weights) {
+        const auto w = weights_arg(weights, a.size());
+        const float *wp = w.second;
+        std::vector<uint32_t> centers, asn;
+        std::vector<float> costs;
+        {
+            py::gil_scoped_release nogil;
+            std::tie(centers, asn, costs) = a.visit([&](const auto &app) {
+                auto [c, s, d] = jsd::make_kmeanspp(app, k, seed, wp);
+                return std::make_tuple(as_vector<uint32_t>(std::move(c)), as_vector<uint32_t>(std::move(s)), as_vector<float>(std::move(d)));
+            });
+        }
+        return py::make_tuple(to_numpy(std::move(centers)), to_numpy(std::move(asn)), to_numpy(std::move(costs)));
+    }, "k-means++ (D2) seeding. Returns (center indices, assignments, costs)",
+    py::arg("app"), py::arg("k"), py::arg("seed") = 13, py::arg("weights") = py::none());
+
+    m.def("perform_clustering", [](const PyApplicator &a, unsigned k, py::object weights, bool extrinsic, uint64_t seed, size_t max_iter, double eps) {
+        using namespace clustering;
+        const auto w = weights_arg(weights, a.size());
+        const float *wp = w.second;
+        HardResult res;
+        if(extrinsic) {
+            CentersVec centers;
+            {
+                py::gil_scoped_release nogil;
+                std::tie(centers, res.assignments, res.costs) = a.visit([&](const auto &app) {
+                    return perform_clustering<HARD, EXTRINSIC>(app, k, wp, DEFAULT_SAMPLING, DEFAULT_OPT, DEFAULT_APPROX, seed, max_iter, eps);
+                });
+            }
+            return py::make_tuple(centers2numpy(centers), to_numpy(std::move(res.assignments)), to_numpy(std::move(res.costs)));
+        }
+        blz::DV<uint32_t> centers;
+        {
+            py::gil_scoped_release nogil;
+            std::tie(centers, res.assignments, res.costs) = a.visit([&](const auto &app) {
+                return perform_clustering<HARD, INTRINSIC>(app, k, wp, DEFAULT_SAMPLING, DEFAULT_OPT, DEFAULT_APPROX, seed, max_iter, eps);
+            });
+        }
+        return py::make_tuple(to_numpy(std::move(centers)), to_numpy(std::move(res.assignments)), to_numpy(std::move(res.costs)));
+    }, "Hard clustering. Returns (centers, assignments, costs), where centers are point indices (intrinsic) or a (k, d) array (extrinsic)",
+    py::arg("app"), py::arg("k"), py::arg("weights") = py::none(), py::arg("extrinsic") = false, py::arg("seed") = 0,
+    py::arg("max_iter") = 100, py::arg("eps") = 1e-4);
+
+    m.def("perform_lloyd_loop", [](const PyApplicator &a, py::array centers, py::object weights, uint64_t seed, size_t max_iter, double eps) {
+        using namespace clustering;
+        const auto w = weights_arg(weights, a.size());
+        const float *wp = w.second;
+        CentersVec ctrs;
+        std::vector<uint32_t> ids;
+        if(centers.ndim() == 1) {
+            auto idarr = py::cast<INA>(centers);
+            ids.assign(idarr.data(), idarr.data() + idarr.size());
+            for(const auto id: ids) if(id >= a.size()) throw std::out_of_range("Center index out of range");
+        } else if(centers.ndim() == 2) {
+            auto carr = py::cast<FNA>(centers);
+            ctrs.resize(carr.shape(0));
+            for(size_t i = 0; i < ctrs.size(); ++i) {
+                ctrs[i].resize(carr.shape(1));
+                std::copy(carr.data(i, 0), carr.data(i, 0) + carr.shape(1), ctrs[i].begin());
+            }
+        } else throw std::invalid_argument("centers must be a 1-d array of point indices or a (k, d) array");
+        HardResult res;
+        LloydLoopResult rc;
+        {
+            py::gil_scoped_release nogil;
+            rc = a.visit([&](const auto &app) {
+                if(!ids.empty()) {
+                    ctrs.resize(ids.size());
+                    for(size_t i = 0; i < ids.size(); ++i) ctrs[i] = app.row(ids[i]);
+                }
+                MINOCORE_REQUIRE(ctrs.empty() || ctrs.front().size() == app.data().columns(), "Center dimension must match the data");
+                res.assignments.resize(app.size());
+                return perform_lloyd_loop<HARD>(ctrs, res.assignments, app, ctrs.size(), res.costs, seed, wp, max_iter, eps);
+            });
+        }
+        return py::make_tuple(centers2numpy(ctrs), to_numpy(std::move(res.assignments)), to_numpy(std::move(res.costs)), rc == FINISHED);
+    }, "Lloyd's algorithm from initial centers (point indices or a (k, d) array in the applicator's normalized space). "
+       "Returns (centers, assignments, costs, converged)",
+    py::arg("app"), py::arg("centers"), py::arg("weights") = py::none(), py::arg("seed") = 0,
+    py::arg("max_iter") = 100, py::arg("eps") = 1e-4);
+}
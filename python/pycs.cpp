@@ -1,31 +1,63 @@
 #include "pyfgc.h"
 #include "minocore/coreset/matrix_coreset.h"
 #include "pybind11/numpy.h"
+#include <mutex>
 
 using CSType = coresets::CoresetSampler<float, uint32_t>;
-using FNA =  py::array_t<float, py::array::c_style | py::array::forcecast>;
-using DNA =  py::array_t<double, py::array::c_style | py::array::forcecast>;
-using INA =  py::array_t<uint32_t, py::array::c_style | py::array::forcecast>;
+
+/*
+ * Methods release the GIL, so Python threads sharing a sampler are serialized here instead:
+ * make_sampler rebuilds the sampler, and sample advances its RNG.
+ * The lock is taken after releasing the GIL (and dropped before reacquiring it), so the two never deadlock.
+ */
+struct PyCoresetSampler {
+    CSType cs_;
+    std::mutex lock_;
+};
 
 void init_coreset(py::module &m) {
-    py::class_<CSType>(m, "CoresetSampler")
+    py::enum_<coresets::SensitivityMethod>(m, "SensitivityMethod")
+        .value("BFL", coresets::BFL).value("FL", coresets::FL).value("LFKF", coresets::LFKF)
+        .value("VX", coresets::VX).value("LBK", coresets::LBK);
+
+    py::class_<PyCoresetSampler>(m, "CoresetSampler")
     .def(py::init<>())
     .def("make_sampler", [](
-        CSType &cs, size_t ncenters, py::array costs, INA assignments, py::object weights, uint64_t seed, minocore::coresets::SensitivityMethod sens)
+        PyCoresetSampler &s, size_t ncenters, py::array costs, INA assignments, py::object weights, uint64_t seed, minocore::coresets::SensitivityMethod sens)
     {
-        py::buffer_info buf1 = costs.request(), asb = assignments.request();
-        if(buf1.ndim != 1) throw std::runtime_error("buffer must have one dimension (reshape if necessary)");
-        float *wp = nullptr;
-        if(auto p(pybind11::cast<FNA>(weights)); p)
-            wp = static_cast<float *>(p.request().ptr);
+        if(costs.ndim() != 1) throw std::runtime_error("buffer must have one dimension (reshape if necessary)");
+        if(assignments.ndim() != 1 || assignments.shape(0) != costs.shape(0))
+            throw std::invalid_argument("assignments must have one entry per point");
+        const auto w = weights_arg(weights, costs.shape(0));
+        const float *wp = w.second;
+        const size_t np = costs.shape(0);
+        const uint32_t *asn = assignments.data();
         if(py::isinstance<py::array_t<float>>(costs)) {
-            cs.make_sampler(ncenters, costs.shape(0), (float *)buf1.ptr, (uint32_t *)asb.ptr, wp, seed, sens);
+            auto fcosts = py::cast<FNA>(costs);
+            py::gil_scoped_release nogil;
+            std::lock_guard<std::mutex> guard(s.lock_);
+            s.cs_.make_sampler(np, ncenters, fcosts.data(), asn, wp, seed, sens);
         } else {
-            cs.make_sampler(ncenters, costs.shape(0), (double *)buf1.ptr, (uint32_t *)asb.ptr, wp, seed, sens);
+            auto dcosts = py::cast<DNA>(costs);
+            py::gil_scoped_release nogil;
+            std::lock_guard<std::mutex> guard(s.lock_);
+            s.cs_.make_sampler(np, ncenters, dcosts.data(), asn, wp, seed, sens);
         }
     },
     "Generates a coreset sampler given a set of costs, assignments, and, optionally, weights. This can be used to generate an index coreset",
     py::arg("ncenters"), py::arg("costs"), py::arg("assignments"),
-    py::arg("weights") =  py::cast<py::none>(Py_None), py::arg("seed") = 13, py::arg("sens")=minocore::coresets::BFL);
-
+    py::arg("weights") =  py::cast<py::none>(Py_None), py::arg("seed") = 13, py::arg("sens")=minocore::coresets::BFL)
+    .def("sample", [](PyCoresetSampler &s, size_t n, uint64_t seed) {
+        coresets::IndexCoreset<uint32_t, float> ics(0);
+        {
+            py::gil_scoped_release nogil;
+            std::lock_guard<std::mutex> guard(s.lock_);
+            ics = s.cs_.sample(n, seed);
+        }
+        return py::make_tuple(to_numpy(std::move(ics.indices_)), to_numpy(std::move(ics.weights_)));
+    }, "Samples a coreset of size n. Returns (indices, weights)", py::arg("n"), py::arg("seed") = 0)
+    .def("__len__", [](PyCoresetSampler &s) {
+        std::lock_guard<std::mutex> guard(s.lock_);
+        return s.cs_.size();
+    }, py::call_guard<py::gil_scoped_release>());
 }
@@ -5,5 +5,34 @@
 #include "minocore/minocore.h"
 using namespace minocore;
 namespace py = pybind11;
-void init_ex1(py::module &);
+void init_applicator(py::module &);
+void init_clustering(py::module &);
 void init_coreset(py::module &);
+
+using FNA =  py::array_t<float, py::array::c_style | py::array::forcecast>;
+using DNA =  py::array_t<double, py::array::c_style | py::array::forcecast>;
+using INA =  py::array_t<uint32_t, py::array::c_style | py::array::forcecast>;
+
+/*
+ * Hands a contiguous container (std::vector, blaze::DynamicVector) to NumPy without copying.
+ * The container is moved to the heap, and the returned array owns it through a capsule.
+ */
+template<typename Container>
+py::array to_numpy(Container &&c) {
+    using CT = std::decay_t<Container>;
+    using T = std::decay_t<decltype(*c.data())>;
+    auto p = new CT(std::move(c));
+    py::capsule owner(p, [](void *x) {delete static_cast<CT *>(x);});
+    return py::array_t<T>(py::ssize_t(p->size()), p->data(), owner);
+}
+
+// Optional float32 weights of length n; None yields a null pointer.
+// The array is returned alongside the pointer so that a converted copy outlives its use.
+inline std::pair<FNA, const float *> weights_arg(py::object weights, size_t n) {
+    if(weights.is_none()) return {FNA(), nullptr};
+    auto arr = py::cast<FNA>(weights);
+    if(arr.ndim() != 1 || size_t(arr.shape(0)) != n)
+        throw std::invalid_argument("weights must be a 1-d array with one entry per point");
+    const float *ptr = arr.data();
+    return {std::move(arr), ptr};
+}
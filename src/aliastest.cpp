@@ -0,0 +1,70 @@
+#include "minocore/coreset.h"
+#include <cstdio>
+#include <random>
+
+using namespace minocore;
+
+// Rebuilds each bucket's implied probability, prob[i] / n plus (1 - prob[j]) / n over the j aliased to i,
+// and compares it to the normalized input weights.
+template<typename FT>
+int check_table(const char *name, const std::vector<FT> &w) {
+    const size_t n = w.size();
+    coresets::VoseAliasTable<FT, uint32_t> table(w.data(), w.data() + n);
+    const FT *prob = table.probabilities();
+    const uint32_t *alias = table.aliases();
+    std::vector<double> mass(n);
+    size_t nbad = 0;
+    for(size_t i = 0; i < n; ++i) {
+        nbad += !(prob[i] >= 0 && prob[i] <= 1) || alias[i] >= n;
+        mass[i] += double(prob[i]) / n;
+        mass[alias[i]] += (1. - double(prob[i])) / n;
+    }
+    const double total = std::accumulate(w.begin(), w.end(), 0.);
+    double maxerr = 0.;
+    for(size_t i = 0; i < n; ++i) maxerr = std::max(maxerr, std::abs(mass[i] - w[i] / total));
+    std::fprintf(stderr, "%s: n = %zu, max error %g, %zu invalid buckets\n", name, n, maxerr, nbad);
+    return maxerr > 1e-9 || nbad;
+}
+
+int main(int argc, char **argv) {
+    // Several construction chunks, with a ragged last one
+    const size_t n = argc > 1 ? std::atoi(argv[1]): 100003;
+    std::mt19937_64 rng(11);
+    std::exponential_distribution<float> ed;
+    int rc = 0;
+    std::vector<float> w(n);
+    for(auto &x: w) x = ed(rng) * (rng() % 128 == 0 ? 1000.f: 1.f);
+    rc |= check_table("skewed", w);
+    std::fill(w.begin(), w.end(), 3.f);
+    rc |= check_table("equal", w);
+    for(auto &x: w) x = rng() % 3 ? 0.f: ed(rng);
+    rc |= check_table("zeros", w);
+    std::fill(w.begin(), w.end(), 0.f);
+    w[n / 2] = 1.f;
+    rc |= check_table("one nonzero", w);
+    std::vector<double> dw(n);
+    for(size_t i = 0; i < n; ++i) dw[i] = i % 2 ? 1e-3: double(i);
+    rc |= check_table("double", dw);
+
+    // Per-center sums agree with a serial reference for any number of histograms
+    const size_t ncenters = 37;
+    std::vector<uint32_t> asn(n);
+    std::vector<float> costs(n), weights(n);
+    for(size_t i = 0; i < n; ++i) asn[i] = rng() % 4 ? 0: rng() % ncenters, costs[i] = ed(rng), weights[i] = 1 + rng() % 5;
+    coresets::CoresetSampler<float, uint32_t> sampler;
+    sampler.make_sampler(n, ncenters, costs.data(), asn.data(), weights.data(), 13, coresets::BFL);
+    std::vector<uint64_t> counts(ncenters);
+    std::vector<double> wsums(ncenters), csums(ncenters);
+    for(size_t i = 0; i < n; ++i)
+        ++counts[asn[i]], wsums[asn[i]] += weights[i], csums[asn[i]] += double(weights[i]) * costs[i];
+    for(const size_t nt: {1, 2, 3, 5, 8, 13}) {
+        const auto sums = sampler.cluster_sums(ncenters, costs.data(), asn.data(), nt);
+        size_t nerr = 0;
+        for(size_t c = 0; c < ncenters; ++c)
+            nerr += sums.counts[c] != counts[c] || std::abs(sums.weights[c] - wsums[c]) > 1e-9 * wsums[c]
+                 || std::abs(sums.costs[c] - csums[c]) > 1e-9 * csums[c];
+        std::fprintf(stderr, "cluster_sums with %zu histograms: %zu mismatches\n", nt, nerr);
+        rc |= nerr != 0;
+    }
+    return rc;
+}
@@ -1,9 +1,23 @@
 #include "minocore/util/csc.h"
+#include "minocore/dist/applicator.h"
 
+// Returns the number of distances on which the mapped view and the loaded copy disagree
 template<typename IndPtrT, typename IndicesT, typename VT>
-void dothing(std::string path) {
+size_t dothing(std::string path) {
     auto read = minocore::csc2sparse<float, IndPtrT, IndicesT, VT>(path);
     std::fprintf(stderr, "nr: %zu. nc: %zu. nnz: %zu\n", read.rows(), read.columns(), read.nonZeros());
+    minocore::MappedCSCMatrix<float, IndPtrT, IndicesT, VT> mapped(path);
+    auto &view = mapped.view();
+    if(view.rows() != read.rows() || view.nonZeros() != read.nonZeros()) throw std::runtime_error("view/copy mismatch");
+    auto viewapp = minocore::make_probdiv_applicator(view, minocore::jsd::JSD, minocore::jsd::DIRICHLET);
+    auto copyapp = minocore::make_probdiv_applicator(read, minocore::jsd::JSD, minocore::jsd::DIRICHLET);
+    size_t nmismatch = 0;
+    for(size_t i = 1; i < std::min(view.rows(), size_t(100)); ++i) {
+        auto vd = viewapp(i - 1, i), cd = copyapp(i - 1, i);
+        if(std::abs(vd - cd) > 1e-4 * std::max(std::abs(cd), 1.f))
+            std::fprintf(stderr, "Mismatch at %zu: view %g, copy %g\n", i, vd, cd), ++nmismatch;
+    }
+    return nmismatch;
 }
 
 enum VT {
@@ -38,33 +52,38 @@ int main(int argc, char *argv[]) {
     // Use as ./csctest -pu32 -iu32 -df32 cao_atlas_
     if(optind != argc) inpath = argv[optind];
     if(dt != U32 && dt != F32) throw std::runtime_error("Not supported: datatype other than f32 or u32");
+    size_t nmismatch = 0;
     if(ip == U64) {
         if(id == U64) {
             if(dt == U32) {
-                dothing<uint64_t, uint64_t, uint32_t>(inpath);
+                nmismatch = dothing<uint64_t, uint64_t, uint32_t>(inpath);
             } else if(dt == F32) {
-                dothing<uint64_t, uint64_t, float>(inpath);
+                nmismatch = dothing<uint64_t, uint64_t, float>(inpath);
             }
         } else {
             if(dt == U32) {
-                dothing<uint64_t, uint32_t, uint32_t>(inpath);
+                nmismatch = dothing<uint64_t, uint32_t, uint32_t>(inpath);
             } else if(dt == F32) {
-                dothing<uint64_t, uint32_t, float>(inpath);
+                nmismatch = dothing<uint64_t, uint32_t, float>(inpath);
             }
         }
     } else {
         if(id == U64) {
             if(dt == U32) {
-                dothing<uint32_t, uint64_t, uint32_t>(inpath);
+                nmismatch = dothing<uint32_t, uint64_t, uint32_t>(inpath);
             } else if(dt == F32) {
-                dothing<uint32_t, uint64_t, float>(inpath);
+                nmismatch = dothing<uint32_t, uint64_t, float>(inpath);
             }
         } else {
             if(dt == U32) {
-                dothing<uint32_t, uint32_t, uint32_t>(inpath);
+                nmismatch = dothing<uint32_t, uint32_t, uint32_t>(inpath);
             } else if(dt == F32) {
-                dothing<uint32_t, uint32_t, float>(inpath);
+                nmismatch = dothing<uint32_t, uint32_t, float>(inpath);
             }
         }
     }
+    if(nmismatch) {
+        std::fprintf(stderr, "%zu mismatches between the mapped view and the loaded copy\n", nmismatch);
+        return 1;
+    }
 }
@@ -0,0 +1,76 @@
+#include "minocore/graph/csr.h"
+#include <cstdio>
+#include <random>
+#include <set>
+#include <string>
+
+using namespace minocore;
+
+// Parses a small DIMACS graph (with free-text comments containing "->"), round-trips it through the binary format,
+// and checks Dijkstra on csr2graph (antiparallel arcs with different weights) against csr_dijkstra on min-weight arcs.
+int main(int argc, char **argv) {
+    size_t nerr = 0;
+    const std::string small =
+        "c Following this line are node reassignments -> parsed ids\n"
+        "c -> not a record either\n"
+        "c 12->3 missing its tab\n"
+        "p sp 3 4\n"
+        "c -7->1\t1.5\t2.5\n"
+        "c 8->2\t-3\t4\n"
+        "a 1 2 5\n"
+        "a 2 1 3\n"
+        "a 2 3 1\n"
+        "a 3 2 1\n";
+    auto g = graph::parse_dimacs_csr<float>(small.data(), small.size());
+    const auto v = g.view();
+    nerr += v.num_vertices() != 3 || v.num_arcs() != 4;
+    nerr += v.find_arc(0, 1) < 0 || v.weights()[v.find_arc(0, 1)] != 5.f;
+    nerr += v.find_arc(1, 0) < 0 || v.weights()[v.find_arc(1, 0)] != 3.f;
+    nerr += !v.has_coordinates() || v.coordinate(0).lat() != 1.5 || v.coordinate(1).lon() != 4. || !std::isnan(v.coordinate(2).lat());
+    const std::string path = "csrtest.tmp.mcg";
+    g.write(path);
+    {
+        MappedCSRGraph<float> mapped(path, true);
+        const auto &m = mapped.view();
+        nerr += m.num_vertices() != v.num_vertices() || m.num_arcs() != v.num_arcs()
+             || !std::equal(v.offsets(), v.offsets() + v.num_vertices() + 1, m.offsets())
+             || !std::equal(v.targets(), v.targets() + v.num_arcs(), m.targets())
+             || !std::equal(v.weights(), v.weights() + v.num_arcs(), m.weights())
+             || !std::equal(v.coordinates(), v.coordinates() + 4, m.coordinates());
+    }
+    std::remove(path.data());
+    auto bg = csr2graph<boost::undirectedS>(v);
+    nerr += boost::num_edges(bg) != 2;
+    for(auto [ei, ee] = boost::edges(bg); ei != ee; ++ei)
+        nerr += boost::get(boost::edge_weight_t(), bg, *ei) != (boost::source(*ei, bg) + boost::target(*ei, bg) == 1 ? 3.f: 1.f);
+    if(nerr) std::fprintf(stderr, "%zu errors on the small graph\n", nerr);
+
+    // Random graph: every edge listed in both directions, with different weights in asym and the smaller one in both of sym
+    const size_t nv = argc > 1 ? std::atoi(argv[1]): 2000, ne = nv * 4;
+    std::mt19937_64 rng(13);
+    std::uniform_real_distribution<float> wdist(1.f, 10.f);
+    std::string asym = "p sp " + std::to_string(nv) + ' ' + std::to_string(2 * ne) + '\n', sym = asym;
+    std::set<std::pair<size_t, size_t>> seen; // Each pair once, so that every edge has exactly one arc per direction
+    while(seen.size() < ne) {
+        const size_t a = rng() % nv + 1, b = rng() % nv + 1;
+        if(a == b || !seen.emplace(std::min(a, b), std::max(a, b)).second) continue;
+        const float w1 = std::round(wdist(rng)), w2 = std::round(wdist(rng)), w = std::min(w1, w2);
+        asym += "a " + std::to_string(a) + ' ' + std::to_string(b) + ' ' + std::to_string(w1) + '\n';
+        asym += "a " + std::to_string(b) + ' ' + std::to_string(a) + ' ' + std::to_string(w2) + '\n';
+        sym += "a " + std::to_string(a) + ' ' + std::to_string(b) + ' ' + std::to_string(w) + '\n';
+        sym += "a " + std::to_string(b) + ' ' + std::to_string(a) + ' ' + std::to_string(w) + '\n';
+    }
+    auto ga = graph::parse_dimacs_csr<float>(asym.data(), asym.size(), 7);
+    auto gs = graph::parse_dimacs_csr<float>(sym.data(), sym.size(), 7);
+    auto boostg = csr2graph<boost::undirectedS>(ga.view());
+    std::vector<double> bdist(nv), cdist(nv);
+    size_t nmismatch = 0;
+    for(size_t src = 0; src < nv; src += nv / 10 + 1) {
+        boost::dijkstra_shortest_paths(boostg, src, boost::distance_map(&bdist[0]));
+        graph::csr_dijkstra(gs.view(), src, cdist.data());
+        for(size_t i = 0; i < nv; ++i)
+            nmismatch += bdist[i] != cdist[i];
+    }
+    if(nmismatch) std::fprintf(stderr, "%zu shortest-path distances differ between Boost and CSR Dijkstra\n", nmismatch);
+    return nerr || nmismatch;
+}
@@ -0,0 +1,37 @@
+#include "minocore/graph/csr.h"
+#include <getopt.h>
+
+void usage(const char *s) {
+    std::fprintf(stderr, "Usage: %s <flags> <input.gr> <output=input.gr.mcg>\n"
+                         "-d\tEmit double-precision weights [float]\n"
+                         "-v\tRe-map the output and verify its checksum\n", s);
+    std::exit(1);
+}
+
+template<typename WT>
+void emit(std::string in, std::string out, bool verify) {
+    auto csr = minocore::dimacs2csr<WT>(in);
+    std::fprintf(stderr, "Parsed graph with %zu vertices and %zu arcs%s\n", csr.num_vertices(), csr.num_arcs(),
+                 csr.coords_.empty() ? "": " (with coordinates)");
+    csr.write(out);
+    if(verify) {
+        minocore::MappedCSRGraph<WT> mapped(out, true);
+        if(mapped.view().num_arcs() != csr.num_arcs()) throw std::runtime_error("Mapped graph does not match");
+    }
+}
+
+int main(int argc, char *argv[]) {
+    bool use_float = true, verify = false;
+    for(int c;(c = getopt(argc, argv, "dvh")) >= 0;) {
+        switch(c) {
+            case 'd': use_float = false; break;
+            case 'v': verify = true; break;
+            case 'h': default: usage(argv[0]);
+        }
+    }
+    if(optind == argc) usage(argv[0]);
+    std::string in(argv[optind]), out(optind + 1 < argc ? argv[optind + 1]: minocore::graph::csr_graph_cache_path(in));
+    if(use_float) emit<float>(in, out, verify);
+    else          emit<double>(in, out, verify);
+    return 0;
+}
@@ -80,4 +80,50 @@ int main(int c, char **a) {
             assert(l1dist(m, tmpv) >= cwmed || !std::fprintf(stderr, "newv: %g vs oldv %g, pert = %g", l1dist(m, tmpv), cwmed, pert));
         }
     }
+    // Sparse inputs account for implicit zeros without expanding them, and should match the dense result.
+    blaze::DynamicMatrix<float> sparsified = m;
+    for(size_t i = 0; i < sparsified.rows(); ++i)
+        for(size_t j = 0; j < sparsified.columns(); ++j)
+            if((i * 31 + j * 17) % 5) sparsified(i, j) = 0.f;
+    blaze::CompressedMatrix<float> sm = sparsified;
+    blaze::DynamicVector<float> w = blaze::generate(m.rows(), [](size_t i) {return float(i % 7 + 1);});
+    blaze::DynamicVector<float, blaze::rowVector> dmed(dim), smed(dim), dwmed(dim), swmed(dim);
+    minocore::coresets::l1_median(sparsified, dmed);
+    minocore::coresets::l1_median(sm, smed);
+    minocore::coresets::l1_median(sparsified, dwmed, w.data());
+    minocore::coresets::l1_median(sm, swmed, w.data());
+    if(dmed != smed || dwmed != swmed) {
+        std::fprintf(stderr, "Sparse and dense medians differ\n");
+        return EXIT_FAILURE;
+    }
+    // Integral weights should match repeating rows, with and without acceleration.
+    {
+        blaze::DynamicMatrix<double> pts(50, 8), repeated(0, 8);
+        randomize(pts);
+        std::vector<double> pw(pts.rows());
+        for(size_t i = 0; i < pts.rows(); ++i) {
+            pw[i] = i % 3 + 1;
+            for(unsigned j = 0; j < pw[i]; ++j) {
+                repeated.resize(repeated.rows() + 1, repeated.columns());
+                row(repeated, repeated.rows() - 1) = row(pts, i);
+            }
+        }
+        blaze::DynamicVector<double, blaze::rowVector> wgm, rgm, pgm;
+        minocore::coresets::geomedian(pts, wgm, 1e-12, pw.data());
+        minocore::coresets::geomedian(repeated, rgm, 1e-12);
+        minocore::coresets::geomedian(pts, pgm, 1e-12, pw.data(), 1000, false);
+        if(blaze::max(blaze::abs(wgm - rgm)) > 1e-6 || blaze::max(blaze::abs(wgm - pgm)) > 1e-6) {
+            std::fprintf(stderr, "Weighted geometric medians differ\n");
+            return EXIT_FAILURE;
+        }
+        // A point carrying more than half the weight is the median.
+        pts(0, 0) += 1.;
+        std::vector<double> heavy(pts.rows(), 1.);
+        heavy[0] = pts.rows();
+        minocore::coresets::geomedian(pts, wgm, 1e-12, heavy.data());
+        if(blaze::max(blaze::abs(wgm - row(pts, 0))) > 1e-6) {
+            std::fprintf(stderr, "Geometric median missed the majority point\n");
+            return EXIT_FAILURE;
+        }
+    }
 }
@@ -1,5 +1,5 @@
 #include "minocore/dist/applicator.h"
-#include "minocore/util/csc.h"
+#include "minocore/util/mtx.h"
 #include "minocore/util/timer.h"
 #include <getopt.h>
 #include "blaze/util/Serialization.h"
@@ -1,6 +1,23 @@
 #include "include/minocore/dist/knngraph.h"
 
+// Every point labeled, and labels in [0, nclusters)
+template<typename Res>
+int check_labels(const Res &res, size_t np) {
+    if(res.labels_.size() != np || res.nclusters_ < 1 || res.nclusters_ > np) {
+        std::fprintf(stderr, "rcc: %zu labels for %zu points, %zu clusters\n", res.labels_.size(), np, res.nclusters_);
+        return 1;
+    }
+    for(const auto l: res.labels_) {
+        if(l >= res.nclusters_) {
+            std::fprintf(stderr, "rcc: label %zu out of range for %zu clusters\n", size_t(l), res.nclusters_);
+            return 1;
+        }
+    }
+    return 0;
+}
+
 int main() {
+    int rc = 0;
     blaze::DynamicMatrix<float> mat = blaze::generate(1000, 50, [](auto x, auto y) {
         return float(std::rand()) / RAND_MAX + (x * y) / 1000. / 50.;
     });
@@ -9,4 +26,29 @@ int main() {
     auto graph = minocore::knns2graph(knns, app.size(), true);
     auto mst = minocore::knng2mst(graph);
     std::fprintf(stderr, "mst size: %zu edges vs %zu nodes\n", mst.size(), app.size());
+    auto edges = minocore::make_rcc_edges(app.data(), knns);
+    auto rccres = minocore::perform_rcc(app.data(), edges, 20);
+    std::fprintf(stderr, "rcc: %zu edges, %zu clusters, final objective %g\n", edges.num_edges(), rccres.nclusters_, rccres.objective_.back());
+    rc |= check_labels(rccres, app.size());
+
+    // Three well-separated blobs: no cluster may span two of them, so there are at least three clusters.
+    static constexpr size_t NB = 3, PER = 100, D = 5;
+    blaze::DynamicMatrix<float> blobs = blaze::generate(NB * PER, D, [](auto x, auto y) {
+        return float(std::rand()) / RAND_MAX + 100.f * (x / PER) * (y == x / PER % D);
+    });
+    auto bapp = minocore::jsd::make_probdiv_applicator(blobs, blz::distance::L2);
+    auto bres = minocore::perform_rcc(bapp, 10);
+    rc |= check_labels(bres, NB * PER);
+    std::vector<size_t> blob_of(bres.nclusters_, size_t(-1));
+    for(size_t i = 0; i < NB * PER; ++i) {
+        auto &b = blob_of[bres.labels_[i]];
+        if(b == size_t(-1)) b = i / PER;
+        else if(b != i / PER) {
+            std::fprintf(stderr, "rcc: cluster %zu spans blobs %zu and %zu\n", size_t(bres.labels_[i]), b, i / PER);
+            rc = 1;
+            break;
+        }
+    }
+    std::fprintf(stderr, "rcc on blobs: %zu clusters\n", bres.nclusters_);
+    return rc;
 }
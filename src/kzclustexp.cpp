@@ -26,9 +26,11 @@ static size_t str2nbytes(const char *s) {
     return ret;
 }
 
+// k distinct centers drawn from X, as vertex ids: ids are drawn in X's local id space and mapped back once.
+template<typename Vertex=size_t>
 std::vector<uint32_t>
 generate_random_centers(uint64_t seed, unsigned k, unsigned x_size,
-                 const std::vector<size_t> *bbox_vertices_ptr=nullptr) {
+                 const RegionSubset<Vertex> *region=nullptr) {
     std::vector<uint32_t> random_centers;
     wy::WyRand<uint32_t, 2> rng(seed);
     while(random_centers.size() < k) {
@@ -36,10 +38,9 @@ generate_random_centers(uint64_t seed, unsigned k, unsigned x_size,
         if(std::find(random_centers.begin(), random_centers.end(), v) == random_centers.end())
             random_centers.push_back(v);
     }
-    if(bbox_vertices_ptr) {
-        assert(x_size == bbox_vertices_ptr->size());
-        for(auto &rc: random_centers)
-            rc = bbox_vertices_ptr->operator[](rc);
+    if(region) {
+        assert(x_size == region->size());
+        region->to_global(random_centers);
     }
     return random_centers;
 }
@@ -47,8 +48,12 @@ generate_random_centers(uint64_t seed, unsigned k, unsigned x_size,
 #ifndef CORESET_COMPACT
 #define CORESET_COMPACT 1
 #endif
-template<typename Samp, typename Graph, typename RNG, typename VType=std::vector<size_t>>
-void emit_coreset_optimization_runtime(Samp &sampler, unsigned k, double z, Graph &g, const VType *bbox_vertices_ptr, std::vector<unsigned> &coreset_sizes, std::string outpath, RNG &rng,
+/*
+ * Coreset indices, local searches and cost evaluation all work in X's local id space (the region, if any).
+ * Results are mapped to vertex ids once per coreset or solution, and costs are gathered onto X once per solution.
+ */
+template<typename Samp, typename Graph, typename RNG, typename Vertex=size_t>
+void emit_coreset_optimization_runtime(Samp &sampler, unsigned k, double z, Graph &g, const RegionSubset<Vertex> *region, std::vector<unsigned> &coreset_sizes, std::string outpath, RNG &rng,
                                        bool skip_vxs=false)
 {
     using CoresetType = typename Samp::CoresetType;
@@ -61,11 +66,18 @@ void emit_coreset_optimization_runtime(Samp &sampler, unsigned k, double z, Grap
     ofs << "Dijkstra time\t";
     if(!skip_vxs) ofs << "VxS time\tVxS cost\t";
     ofs << "SxS time\tSxS cost\n";
-    for(auto csz: coreset_sizes) {
-        if(csz > (boost::num_vertices(g) * 2)) continue;
+    // One nested draw serves every size, and each point's Dijkstra row is computed once across sizes,
+    // so "Dijkstra time" is the time for the rows this size adds.
+    std::vector<size_t> sizes;
+    for(auto csz: coreset_sizes)
+        if(csz <= (boost::num_vertices(g) * 2)) sizes.push_back(csz);
+    std::vector<CoresetType> nested = sampler.sample_nested(sizes);
+    SSSPRowCache<Graph, float> sssp(g, sizes.empty() ? size_t(0): std::min(*std::max_element(sizes.begin(), sizes.end()), boost::num_vertices(g)));
+    for(size_t si = 0; si < sizes.size(); ++si) {
+        size_t csz = sizes[si];
         ofs << csz;
         if(csz < k) ofs << '*';
-        CoresetType cs = sampler.sample(csz);
+        CoresetType &cs = nested[si];
 #if CORESET_COMPACT
         cs.compact();
         csz = cs.size();
@@ -74,25 +86,20 @@ void emit_coreset_optimization_runtime(Samp &sampler, unsigned k, double z, Grap
         ofs<< '\t';
         // Not needed for theoeretical guarantees, but compacting may be of practical importance
         // , especially for the case of larger coresets.
-        blz::DM<float> distances(csz, boost::num_vertices(g)), sqdistances(csz, csz);
+        std::vector<size_t> sources(cs.indices_.begin(), cs.indices_.begin() + csz);
+        if(region) region->to_global(sources);
+        blz::DM<float> sqdistances(csz, csz);
         util::Timer t;
         t.start();
-        OMP_PFOR
-        for(unsigned csidx = 0; csidx < csz; ++csidx) {
-            auto idx = bbox_vertices_ptr ? bbox_vertices_ptr->operator[](cs.indices_[csidx])
-                                         : cs.indices_[csidx];
-            boost::dijkstra_shortest_paths(g, idx, boost::distance_map(&distances(csidx, 0)));
-            assert(boost::num_vertices(g) == row(distances, csidx).size());
-        }
+        sssp.ensure(sources.data(), csz);
+        blz::DM<float> distances = sssp.gather(sources.data(), csz);
 #if !NDEBUG
         for(size_t i = 0; i < csz; ++i) {
             auto lhr = row(distances, i);
-            auto lhid = bbox_vertices_ptr ? bbox_vertices_ptr->operator[](cs.indices_[i])
-                                          : cs.indices_[i];
+            auto lhid = sources[i];
             for(size_t j = i + 1; j < csz; ++j) {
                 auto rhr = row(distances, j);
-                auto rhid = bbox_vertices_ptr ? bbox_vertices_ptr->operator[](cs.indices_[j])
-                                              : cs.indices_[j];
+                auto rhid = sources[j];
                 auto l2r = lhr[rhid], r2l = rhr[lhid];
                 assert(std::abs(l2r - r2l) < 1e-2 || !std::fprintf(stderr, "rhs: %0.12g. lhs: %0.12g\n", r2l, l2r));
             }
@@ -100,9 +107,9 @@ void emit_coreset_optimization_runtime(Samp &sampler, unsigned k, double z, Grap
 #endif
         if(z != 1.)
             distances = blaze::pow(distances, z);
-        if(bbox_vertices_ptr) {
-            std::fprintf(stderr, "Filtering to x of size %zu\n", bbox_vertices_ptr->size());
-            distances = columns(distances, bbox_vertices_ptr->data(), bbox_vertices_ptr->size());
+        if(region) {
+            std::fprintf(stderr, "Filtering to x of size %zu\n", region->size());
+            distances = columns(distances, region->members.data(), region->size());
         }
         for(unsigned i = 0; i < csz; ++i) {
             row(distances, i BLAZE_CHECK_DEBUG) *= cs.weights_[i];
@@ -113,21 +120,15 @@ void emit_coreset_optimization_runtime(Samp &sampler, unsigned k, double z, Grap
         t.stop();
         ofs << t.diff() << '\t';
         t.reset();
-        blz::DV<float> costs;
+        blz::DV<float> costs, xcosts(region ? region->size(): size_t(0));
         std::vector<uint32_t> _;
         auto get_cost_of_solution = [&]() {
+            if(region) region->gather(costs.data(), xcosts.data());
+            const auto &c = region ? xcosts: costs;
             double cost = 0.;
-            if(bbox_vertices_ptr) {
-                OMP_PRAGMA("omp parallel for reduction(+:cost)")
-                for(size_t i = 0; i < bbox_vertices_ptr->size(); ++i) {
-                    cost += costs[bbox_vertices_ptr->operator[](i)];
-                }
-            } else {
-                OMP_PRAGMA("omp parallel for reduction(+:cost)")
-                for(size_t i = 0; i < boost::num_vertices(g); ++i) {
-                    cost += costs[i];
-                }
-            }
+            OMP_PRAGMA("omp parallel for reduction(+:cost)")
+            for(size_t i = 0; i < c.size(); ++i)
+                cost += c[i];
             return cost;
         };
         t.start();
@@ -136,12 +137,7 @@ void emit_coreset_optimization_runtime(Samp &sampler, unsigned k, double z, Grap
             vxs_lsearcher.run();
             std::fprintf(stderr, "optimizing over vxs: %zu/%zu. cs weight size: %zu\n", distances.rows(), distances.columns(), cs.weights_.size());
             std::vector<size_t> solution(vxs_lsearcher.sol_.begin(), vxs_lsearcher.sol_.end());
-            if(bbox_vertices_ptr) {
-                for(auto &i: solution) {
-                    assert(i < bbox_vertices_ptr->size());
-                    i = bbox_vertices_ptr->operator[](i);
-                }
-            }
+            if(region) region->to_global(solution);
             t.stop();
             ofs << t.diff() << '\t';
             std::tie(costs, _) = get_costs(g, solution);
@@ -153,14 +149,9 @@ void emit_coreset_optimization_runtime(Samp &sampler, unsigned k, double z, Grap
         //sqdistances = blaze::rows(distances, cs.indices_.data(), cs.indices_.size());
         auto sxs_lsearcher = make_kmed_lsearcher(sqdistances, k, 1e-2, rng(), static_cast<std::vector<unsigned> *>(nullptr), blaze::sum(cs.weights_));
         sxs_lsearcher.run();
-        std::vector<size_t> solution(sxs_lsearcher.sol_.begin(), sxs_lsearcher.sol_.end());
-        for(auto &i: solution) {
-            i = cs.indices_[i];
-            if(bbox_vertices_ptr) {
-                assert(i < bbox_vertices_ptr->size());
-                i = bbox_vertices_ptr->operator[](i);
-            }
-        }
+        std::vector<size_t> solution(sxs_lsearcher.sol_.size());
+        std::transform(sxs_lsearcher.sol_.begin(), sxs_lsearcher.sol_.end(), solution.begin(), [&cs](auto i) {return cs.indices_[i];});
+        if(region) region->to_global(solution);
         t.stop();
         ofs << t.diff() << '\t';
         t.reset();
@@ -172,53 +163,34 @@ void emit_coreset_optimization_runtime(Samp &sampler, unsigned k, double z, Grap
 }
 
 
-template<typename Graph, typename ICon, typename FCon, typename IT, typename RetCon, typename CSWT>
-void calculate_distortion_centerset(Graph &x, const ICon &indices, FCon &costbuffer,
-                             const std::vector<coresets::IndexCoreset<IT, CSWT>> &coresets,
-                             RetCon &ret, double z,
-                             const std::vector<typename boost::graph_traits<Graph>::vertex_descriptor> *
-                             bbox_vertices_ptr = nullptr)
-{
-    assert(ret.size() == coresets.size());
-    const size_t nv = boost::num_vertices(x);
-    const size_t ncs = coresets.size();
-    {
-        util::ScopedSyntheticVertex<Graph> vx(x);
-        auto synthetic_vertex = vx.get();
-        for(auto idx: indices) {
-            boost::add_edge(synthetic_vertex, idx, 0., x);
-        }
-        boost::dijkstra_shortest_paths(x, synthetic_vertex, distance_map(&costbuffer[0]));
-    }
-    if(z != 1.) costbuffer = pow(costbuffer, z);
-    double fullcost = 0.;
-    if(bbox_vertices_ptr) {
-        const size_t nbox_vertices = bbox_vertices_ptr->size();
-        OMP_PRAGMA("omp parallel for reduction(+:fullcost)")
-        for(unsigned i = 0; i < nbox_vertices; ++i) {
-            fullcost += costbuffer[bbox_vertices_ptr->operator[](i)];
-        }
-    } else {
-        OMP_PRAGMA("omp parallel for reduction(+:fullcost)")
-        for(unsigned i = 0; i < nv; ++i) {
-            fullcost += costbuffer[i];
-        }
-    }
-    const double fcinv = 1. / fullcost;
+template<typename Vertex=size_t>
+std::vector<std::vector<uint32_t>>
+random_centersets(size_t n, uint64_t seed, unsigned k, unsigned x_size, const RegionSubset<Vertex> *region=nullptr) {
+    std::vector<std::vector<uint32_t>> ret(n);
     OMP_PFOR
-    for(size_t j = 0; j < ncs; ++j) {
-        // In theory, this could be
-        auto &cs = coresets[j];
-        const auto indices = cs.indices_.data();
-        const auto weights = cs.weights_.data();
-        const size_t cssz = cs.size();
-        double coreset_cost = 0.;
-        SK_UNROLL_8
-        for(unsigned i = 0; i < cssz; ++i) {
-            coreset_cost += costbuffer[indices[i]] * weights[i];
+    for(size_t i = 0; i < n; ++i) {
+        ret[i] = generate_random_centers(i + seed, k, x_size, region);
+#ifndef NDEBUG
+        if(region) {
+            for(const auto rc: ret[i]) {
+                assert(std::binary_search(region->members.begin(), region->members.end(), rc));
+            }
         }
-        ret[j] = std::abs(coreset_cost * fcinv - 1.);
+#endif
     }
+    return ret;
+}
+
+// Column-wise maximum and mean of a (center sets x coresets) distortion matrix
+template<typename MT, typename VT>
+void summarize_distortions(const MT &distortions, VT &maxdistortion, VT &meandistortion) {
+    assert(distortions.columns() == maxdistortion.size());
+    for(size_t i = 0; i < distortions.rows(); ++i) {
+        auto r = trans(row(distortions, i));
+        maxdistortion = blaze::serial(max(maxdistortion, r));
+        meandistortion += r;
+    }
+    meandistortion /= distortions.rows();
 }
 template<typename CS, typename CoorCon, typename BBox>
 void show_fraction_in_out(const CS &coreset, const CoorCon &coordinates, const BBox bbox) {
@@ -466,8 +438,10 @@ int main(int argc, char **argv) {
     timer.stop();
     timer.display();
     using Vertex = typename boost::graph_traits<decltype(g)>::vertex_descriptor;
-    std::vector<Vertex> in_vertices, out_vertices;
-    std::vector<Vertex> bbox_vertices;
+    // X: all vertices if no bounding box is set, and otherwise the vertices sampled by region.
+    RegionSubset<Vertex> region;
+    std::vector<Vertex> &in_vertices = region.inside, &out_vertices = region.outside;
+    std::vector<Vertex> &bbox_vertices = region.members;
     size_t nsampled_in = 0, nsampled_out = 0;
     if(bbox.set()) {
         assert(bbox.valid());
@@ -487,24 +461,10 @@ int main(int argc, char **argv) {
     timer.report();
     if(bbox.set()) {
         timer.restart("bbox sampling:");
-        wy::WyRand<uint32_t, 2> bbox_rng(coordinates.size() + seed);
-        std::uniform_real_distribution<float> urd;
-        for(const auto vtx: g.vertices()) {
-            assert(vtx < g.num_vertices());
-            if(bbox.contains(coordinates.at(vtx))) {
-                if(urd(bbox_rng) < bbox.p_box) {
-                    in_vertices.push_back(vtx);
-                    bbox_vertices.push_back(vtx);
-                    ++nsampled_in;
-                }
-            } else {
-                if(urd(bbox_rng) < bbox.p_nobox) {
-                    out_vertices.push_back(vtx);
-                    bbox_vertices.push_back(vtx);
-                    ++nsampled_out;
-                }
-            }
-        }
+        const GridIndex coordinate_index(coordinates);
+        region = sample_region<Vertex>(coordinate_index, bbox, coordinates.size() + seed);
+        nsampled_in = in_vertices.size();
+        nsampled_out = out_vertices.size();
         timer.report();
         std::fprintf(stderr, "sampled in: %zu. sampled out: %zu. sample probs: %g, %g\n", nsampled_in, nsampled_out, bbox.p_box, bbox.p_nobox);
         auto coord_fn = output_prefix + ".coords.txt";
@@ -525,9 +485,11 @@ int main(int argc, char **argv) {
     // nullptr here for the case of using all vertices
     // but nonzero if a bounding box has been used to select $X \subseteq V$.
     const std::vector<Vertex> *bbox_vertices_ptr = nullptr;
+    const RegionSubset<Vertex> *region_ptr = nullptr;
     const size_t x_size = bbox_vertices.empty() ? boost::num_vertices(g): bbox_vertices.size();
     if(bbox_vertices.size()) {
         bbox_vertices_ptr = &bbox_vertices;
+        region_ptr = &region;
 #ifndef NDEBUG
         for(auto vtx: bbox_vertices)
             assert(vtx < boost::num_vertices(g));
@@ -554,18 +516,12 @@ int main(int argc, char **argv) {
     timer.report();
     timer.restart("center counts:");
     std::vector<uint32_t> center_counts(sampled.size());
-    if(bbox.set()) {
-        OMP_PFOR
-        for(size_t i = 0; i < bbox_vertices.size(); ++i) {
-            assert(bbox_vertices[i] < thorup_assignments.size());
-            OMP_ATOMIC
-            ++center_counts[thorup_assignments[bbox_vertices[i]]];
-        }
-    } else {
+    {
+        const std::vector<uint32_t> xassignments = bbox.set() ? region.gather(thorup_assignments.data()): thorup_assignments;
         OMP_PFOR
-        for(size_t i = 0; i < thorup_assignments.size(); ++i) {
+        for(size_t i = 0; i < xassignments.size(); ++i) {
             OMP_ATOMIC
-            ++center_counts[thorup_assignments[i]];
+            ++center_counts[xassignments[i]];
         }
     }
     timer.report();
@@ -668,22 +624,19 @@ int main(int argc, char **argv) {
     coresets::CoresetSampler<float, uint32_t> sampler, bflsampler;
     {
         timer.restart("make coreset samplers:");
-        std::unique_ptr<float[]> bbox_costs;
-        std::unique_ptr<uint32_t[]> bbox_assignments;
+        std::vector<float> bbox_costs;
+        std::vector<uint32_t> bbox_assignments;
         const float *cost_data = costs.data();
         const uint32_t *assignments_data = assignments.data();
         if(bbox.set()) {
+            // Contiguous costs and assignments over X, so that the samplers never see global vertex ids
             std::fprintf(stderr, "fetching bbox costs/assignments\n");
-            bbox_costs.reset(new float[x_size]);
-            bbox_assignments.reset(new uint32_t[x_size]);
-            OMP_PFOR
-            for(size_t i = 0; i < bbox_vertices.size(); ++i) {
-                const uint32_t bvi = bbox_vertices[i];
-                bbox_costs[i] = costs[bvi];
-                bbox_assignments[i] = assignments[bvi];
-            }
-            cost_data = bbox_costs.get();
-            assignments_data = bbox_assignments.get();
+            bbox_costs.resize(x_size);
+            bbox_assignments.resize(x_size);
+            region.gather(costs.data(), bbox_costs.data());
+            region.gather(assignments.data(), bbox_assignments.data());
+            cost_data = bbox_costs.data();
+            assignments_data = bbox_assignments.data();
         }
         std::fprintf(stderr, "Building coreset samplers with %p/%p pointers and set cardinality %zu\n",
                      static_cast<const void *>(cost_data), static_cast<const void *>(assignments_data),
@@ -720,8 +673,7 @@ int main(int argc, char **argv) {
     const size_t distvecsz = ncs * 3;
     blaze::DynamicVector<double> meanmaxdistortion(distvecsz, 0.),
                                  meanmeandistortion(distvecsz, 0.),
-                                 sumfdistortion(distvecsz, 0.), tmpfdistortion(distvecsz); // distortions on F
-    blaze::DynamicVector<double> fdistbuffer(boost::num_vertices(g)); // For F, for comparisons
+                                 sumfdistortion(distvecsz, 0.); // distortions on F
     timer.restart("evaluate random centers " + std::to_string(coreset_testing_num_iters) + " times: ");
     assert(uniform_sampler.size() == sampler.size());
     assert(uniform_sampler.size() == bflsampler.size());
@@ -733,63 +685,32 @@ int main(int argc, char **argv) {
         std::fprintf(stderr, "Making VX coresets. sampler size: %zu\n", sampler.size());
         for(auto coreset_size: coreset_sizes) {
             coresets.emplace_back(sampler.sample(coreset_size));
-            if(bbox.set()) {
-                for(auto &idx: coresets.back().indices_) idx = bbox_vertices.at(idx);
-            }
+            if(bbox.set()) region.to_global(coresets.back().indices_);
             //show_fraction_in_out(coresets.back(), coordinates, bbox);
         }
         std::fprintf(stderr, "Making BFL coresets.size: %zu\n", bflsampler.size());
         for(auto coreset_size: coreset_sizes) {
             coresets.emplace_back(bflsampler.sample(coreset_size));
-            if(bbox.set()) {
-                for(auto &idx: coresets.back().indices_) idx = bbox_vertices.at(idx);
-            }
+            if(bbox.set()) region.to_global(coresets.back().indices_);
         }
         std::fprintf(stderr, "Making Uniform coresets\n");
         for(auto coreset_size: coreset_sizes) {
             coresets.emplace_back(uniform_sampler.sample(coreset_size));
-            if(bbox.set()) {
-                for(auto &idx: coresets.back().indices_) idx = bbox_vertices.at(idx);
-            }
+            if(bbox.set()) region.to_global(coresets.back().indices_);
             //show_fraction_in_out(coresets.back(), coordinates, bbox);
         }
         assert(coresets.size() == distvecsz);
         std::fprintf(stderr, "[Phase 5] Generated coresets for iter %zu/%u\n", i + 1, coreset_testing_num_iters);
         blaze::DynamicVector<double> maxdistortion(distvecsz, std::numeric_limits<double>::min()),
                                      meandistortion(distvecsz, 0.);
-        OMP_PFOR
-        for(size_t i = 0; i < testing_num_centersets; ++i) {
-            //if(i % 10 == 0)
-            //    std::fprintf(stderr, "Calculating distortion %zu/%zu\n", i, random_centers.rows());
-            auto random_centers = generate_random_centers(i + seed + coreset_testing_num_iters, k, x_size, bbox_vertices_ptr);
-#ifndef NDEBUG
-            if(bbox_vertices_ptr) {
-                for(const auto rc: random_centers) {
-                    assert(std::find(bbox_vertices_ptr->begin(), bbox_vertices_ptr->end(), rc) != bbox_vertices_ptr->end());
-                }
-            }
-#endif
-            blaze::DynamicVector<double> distbuffer(boost::num_vertices(g));
-            blaze::DynamicVector<double> currentdistortion(coresets.size());
-#ifdef _OPENMP
-            decltype(g) gcopy(g);
-#else
-            auto &gcopy(g);
-#endif
-            calculate_distortion_centerset(gcopy, random_centers, distbuffer, coresets, currentdistortion, z, bbox_vertices_ptr);
-            OMP_CRITICAL
-            {
-                maxdistortion = blaze::serial(max(maxdistortion, currentdistortion));
-            }
-            OMP_CRITICAL
-            {
-                meandistortion = blaze::serial(meandistortion + currentdistortion);
-            }
+        {
+            const auto distortions = coreset_distortions(g, random_centersets(testing_num_centersets, seed + coreset_testing_num_iters, k, x_size, region_ptr),
+                                                         coresets, z, bbox_vertices_ptr);
+            summarize_distortions(distortions, maxdistortion, meandistortion);
         }
-        calculate_distortion_centerset(g, approx_v, fdistbuffer, coresets, tmpfdistortion, z, bbox_vertices_ptr);
-        sumfdistortion += tmpfdistortion;
+        const auto fdistortion = coreset_distortions(g, std::vector<decltype(approx_v)>{approx_v}, coresets, z, bbox_vertices_ptr);
+        sumfdistortion += trans(row(fdistortion, 0));
         meanmaxdistortion += maxdistortion;
-        meandistortion /= testing_num_centersets;
         meanmeandistortion += meandistortion;
     }
     timer.report();
@@ -811,8 +732,7 @@ int main(int argc, char **argv) {
     for(auto ek: extra_ks) {
         blaze::DynamicVector<double> meanmaxdistortion(distvecsz, 0.),
                                      meanmeandistortion(distvecsz, 0.),
-                                     sumfdistortion(distvecsz, 0.), tmpfdistortion(distvecsz); // distortions on F
-        blaze::DynamicVector<double> fdistbuffer(boost::num_vertices(g)); // For F, for comparisons
+                                     sumfdistortion(distvecsz, 0.); // distortions on F
         std::string ofname_ok = output_prefix + ".table_out.ok." + std::to_string(ek) + ".tsv";
         std::ofstream ofs(ofname_ok);
         for(unsigned i = 0; i < coreset_testing_num_iters; ++i) {
@@ -822,44 +742,26 @@ int main(int argc, char **argv) {
             coresets.reserve(ncs * 3);
             for(auto coreset_size: coreset_sizes) {
                 coresets.emplace_back(sampler.sample(coreset_size));
-                if(bbox.set()) {
-                    for(auto &idx: coresets.back().indices_) idx = bbox_vertices.at(idx);
-                }
+                if(bbox.set()) region.to_global(coresets.back().indices_);
             }
             for(auto coreset_size: coreset_sizes) {
                 coresets.emplace_back(bflsampler.sample(coreset_size));
-                if(bbox.set()) {
-                    for(auto &idx: coresets.back().indices_) idx = bbox_vertices.at(idx);
-                }
+                if(bbox.set()) region.to_global(coresets.back().indices_);
             }
             for(auto coreset_size: coreset_sizes) {
                 coresets.emplace_back(uniform_sampler.sample(coreset_size));
-                if(bbox.set()) {
-                    for(auto &idx: coresets.back().indices_) idx = bbox_vertices.at(idx);
-                }
+                if(bbox.set()) region.to_global(coresets.back().indices_);
             }
             assert(coresets.size() == distvecsz);
-            OMP_PFOR
-            for(size_t i = 0; i < testing_num_centersets; ++i) {
-                auto random_centers = generate_random_centers(i + seed + coreset_testing_num_iters, k, x_size, bbox_vertices_ptr);
-                blaze::DynamicVector<double> distbuffer(boost::num_vertices(g));
-                blaze::DynamicVector<double> currentdistortion(coresets.size());
-                OMP_ELSE(decltype(g), auto &) gcopy(g);
-                calculate_distortion_centerset(gcopy, random_centers, distbuffer, coresets, currentdistortion, z, bbox_vertices_ptr);
-                OMP_CRITICAL
-                {
-                    maxdistortion = blaze::serial(max(maxdistortion, currentdistortion));
-                }
-                OMP_CRITICAL
-                {
-                    meandistortion = blaze::serial(meandistortion + currentdistortion);
-                }
+            {
+                const auto distortions = coreset_distortions(g, random_centersets(testing_num_centersets, seed + coreset_testing_num_iters, k, x_size, region_ptr),
+                                                             coresets, z, bbox_vertices_ptr);
+                summarize_distortions(distortions, maxdistortion, meandistortion);
             }
-            meandistortion /= testing_num_centersets;
             meanmaxdistortion += maxdistortion;
             meanmeandistortion += meandistortion;
             if(i == 0 && optimize_coresets)
-                emit_coreset_optimization_runtime(sampler, k, z, g, bbox_vertices_ptr, coreset_sizes, output_prefix + "coreset.runtime", rng, skip_vxs);
+                emit_coreset_optimization_runtime(sampler, k, z, g, region_ptr, coreset_sizes, output_prefix + "coreset.runtime", rng, skip_vxs);
         }
         meanmaxdistortion /= coreset_testing_num_iters;
         meanmeandistortion /= coreset_testing_num_iters;
@@ -0,0 +1,33 @@
+#include "minocore/util/landmarks.h"
+#include <cstdio>
+#include <random>
+
+using namespace minocore;
+
+// Checks that landmark bounds hold, that improves() agrees with exact comparisons, and that it skips calls.
+int main(int argc, char **argv) {
+    const size_t n = argc > 1 ? std::atoi(argv[1]): 2000, d = 3, npivots = 16;
+    std::mt19937_64 rng(7);
+    std::normal_distribution<double> nd;
+    std::vector<double> pts(n * d);
+    for(auto &x: pts) x = nd(rng);
+    auto dist = [&](size_t a, size_t b) {
+        double s = 0.;
+        for(size_t i = 0; i < d; ++i) s += (pts[a * d + i] - pts[b * d + i]) * (pts[a * d + i] - pts[b * d + i]);
+        return std::sqrt(s);
+    };
+    auto lo = make_landmark_oracle(dist, n, npivots, 1);
+    if(lo.stats().exact) return 1; // Pivot rows are not counted
+    size_t nerr = 0;
+    for(size_t q = 0; q < 100000; ++q) {
+        const size_t i = rng() % n, j = rng() % n;
+        const double exact = dist(i, j), best = std::abs(nd(rng));
+        nerr += lo.lower_bound(i, j) > exact + 1e-12 || lo.upper_bound(i, j) < exact - 1e-12;
+        double v = -1.;
+        const bool imp = improves(lo, i, j, best, v);
+        nerr += imp != (exact < best) || (imp && v != exact);
+    }
+    const auto st = lo.stats();
+    std::fprintf(stderr, "%zu errors, %zu exact calls, %zu skipped (%g)\n", nerr, size_t(st.exact), size_t(st.skipped), st.skip_rate());
+    return nerr || !st.skipped;
+}
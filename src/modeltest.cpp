@@ -0,0 +1,37 @@
+#include "minocore/clustering/model.h"
+#include "minocore/utility.h"
+using namespace minocore;
+
+// Fits centers by k-means++ on random counts, then checks that the model labels the
+// training rows as k-means++ did, and that a written model labels them identically.
+int main(int argc, char *argv[]) {
+    const size_t n = argc > 1 ? std::atoi(argv[1]): 5000, d = argc > 2 ? std::atoi(argv[2]): 50;
+    const unsigned k = argc > 3 ? std::atoi(argv[3]): 10;
+    wy::WyRand<uint64_t> rng(13);
+    blaze::DynamicMatrix<float> data(n, d);
+    for(size_t i = 0; i < n; ++i)
+        for(size_t j = 0; j < d; ++j)
+            data(i, j) = rng() % 16;
+    int rc = 0;
+    for(const auto measure: {dist::SQRL2, dist::L1, dist::MKL, dist::JSM, dist::JSD}) {
+        blaze::DynamicMatrix<float> train(data), batch(data);
+        const auto prior = measure == dist::MKL || measure == dist::JSD ? jsd::DIRICHLET: jsd::NONE;
+        auto app = make_probdiv_applicator(train, measure, prior);
+        auto [centers, asn, costs] = make_kmeanspp(app, k);
+        auto model = ClusteringModel<float>::from_indices(app, centers.data(), centers.size(), prior);
+        auto [labels, lcosts] = model.assign(batch);
+        size_t nmismatch = 0;
+        for(size_t i = 0; i < n; ++i)
+            nmismatch += labels[i] != asn[i] && std::abs(lcosts[i] - costs[i]) > 1e-4 * std::max(costs[i], 1.f);
+        model.write("modeltest.bin");
+        auto loaded = ClusteringModel<float>::read("modeltest.bin");
+        blaze::DynamicMatrix<float> batch2(data);
+        auto [labels2, lcosts2] = loaded.assign(batch2);
+        const bool same = labels2 == labels;
+        std::fprintf(stderr, "%s: %zu/%zu labels differ from k-means++; reload %s\n",
+                     dist::detail::prob2str(measure), nmismatch, n, same ? "matches": "DIFFERS");
+        rc |= nmismatch > n / 100 || !same;
+    }
+    std::remove("modeltest.bin");
+    return rc;
+}
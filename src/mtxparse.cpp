@@ -1,20 +1,105 @@
-#include "minocore/util/csc.h"
+#include "minocore/util/mtx.h"
 #include <iostream>
 #include "blaze/util/Serialization.h"
 #include <getopt.h>
+#include <tuple>
+#include <unistd.h>
+
+void usage(const char *s) {
+    std::fprintf(stderr, "Usage: %s <flags> <input.mtx> <output=/dev/stdout>\n"
+                         "-d\tEmit double-precision values [float]\n"
+                         "-r\tKeep the file's orientation instead of transposing\n"
+                         "-c\tWrite a binary CSR cache next to the input instead of a blaze archive\n"
+                         "-t\tRun the parser self-tests and exit\n", s);
+    std::exit(1);
+}
+
+template<typename FT>
+void emit(std::string in, std::string out, bool transpose, bool cache) {
+    auto csr = minocore::mtx2csr<FT>(in, transpose);
+    std::fprintf(stderr, "Parsed %zu x %zu matrix with %zu nonzeros\n", csr.rows(), csr.columns(), csr.nonZeros());
+    if(cache) {
+        csr.write(minocore::mtx::csr_cache_prefix<FT>(in, transpose));
+    } else {
+        blaze::Archive<std::ofstream> ret(out);
+        ret << csr.to_sparse();
+    }
+}
+
+// Compares a parsed matrix against (row, column, value) triples, which must be in row-major order.
+template<typename CSR>
+size_t check(const char *name, const CSR &csr, size_t nr, size_t nc, std::vector<std::tuple<size_t, size_t, double>> expected) {
+    size_t nerr = csr.rows() != nr || csr.columns() != nc || csr.nonZeros() != expected.size();
+    for(size_t i = 0, k = 0; !nerr && i < nr; ++i)
+        for(auto j = csr.indptr_[i]; j < csr.indptr_[i + 1]; ++j, ++k)
+            nerr += std::get<0>(expected[k]) != i || std::get<1>(expected[k]) != csr.indices_[j] || std::get<2>(expected[k]) != csr.data_[j];
+    if(nerr) std::fprintf(stderr, "%s: parsed matrix does not match\n", name);
+    return nerr;
+}
+
+// Unsorted entries, symmetric and pattern headers, and typed binary caches
+int selftest() {
+    using minocore::mtx::parse_mtx;
+    size_t nerr = 0;
+    const std::string unsorted =
+        "%%MatrixMarket matrix coordinate real general\n"
+        "% Entries in no particular order\n"
+        "3 4 6\n"
+        "3 4 6.5\n1 2 1.5\n2 1 -2\n1 4 3\n3 1 5e-1\n1 1 1\n";
+    // Several chunks, so that rows gather entries from more than one of them
+    nerr += check("unsorted", parse_mtx<double>(unsorted.data(), unsorted.size(), false, 5), 3, 4,
+                  {{0, 0, 1}, {0, 1, 1.5}, {0, 3, 3}, {1, 0, -2}, {2, 0, .5}, {2, 3, 6.5}});
+    nerr += check("unsorted, transposed", parse_mtx<double>(unsorted.data(), unsorted.size(), true, 5), 4, 3,
+                  {{0, 0, 1}, {0, 1, -2}, {0, 2, .5}, {1, 0, 1.5}, {3, 0, 3}, {3, 2, 6.5}});
+    const std::string symmetric =
+        "%%MatrixMarket matrix coordinate real symmetric\n"
+        "3 3 4\n"
+        "3 1 2\n2 2 4\n1 1 1\n3 2 -1\n";
+    // Off-diagonal entries are mirrored; the diagonal appears once
+    const std::vector<std::tuple<size_t, size_t, double>> symexp
+        {{0, 0, 1}, {0, 2, 2}, {1, 1, 4}, {1, 2, -1}, {2, 0, 2}, {2, 1, -1}};
+    nerr += check("symmetric", parse_mtx<double>(symmetric.data(), symmetric.size(), false, 3), 3, 3, symexp);
+    nerr += check("symmetric, transposed", parse_mtx<double>(symmetric.data(), symmetric.size(), true, 3), 3, 3, symexp);
+    const std::string pattern =
+        "%%MatrixMarket matrix coordinate pattern symmetric\n"
+        "2 2 2\n"
+        "2 1\n1 1\n";
+    nerr += check("symmetric pattern", parse_mtx<float>(pattern.data(), pattern.size()), 2, 2, {{0, 0, 1}, {0, 1, 1}, {1, 0, 1}});
+    // Caches for different element types live side by side, and each maps back to the parsed values
+    char tmpl[] = "/tmp/mtxparseXXXXXX";
+    const int fd = ::mkstemp(tmpl);
+    if(fd < 0 || ::write(fd, unsorted.data(), unsorted.size()) != ssize_t(unsorted.size()) || ::close(fd))
+        throw std::runtime_error("Failed to write temporary MatrixMarket file");
+    const std::string path(tmpl);
+    auto fcache = minocore::mtx2csr_cached<float>(path, false);
+    auto dcache = minocore::mtx2csr_cached<double>(path, false);
+    auto dcache2 = minocore::mtx2csr_cached<double>(path, false); // Maps the existing cache
+    nerr += fcache.nonZeros() != 6 || dcache.nonZeros() != 6 || dcache2.nonZeros() != 6
+         || fcache.view().data_[2] != 3.f || dcache.view().data_[1] != 1.5 || dcache2.view().data_[5] != 6.5;
+    if(nerr) std::fprintf(stderr, "%zu self-test failures\n", nerr);
+    for(const auto &prefix: {minocore::mtx::csr_cache_prefix<float>(path, false), minocore::mtx::csr_cache_prefix<double>(path, false)})
+        for(const char *suf: {"indptr.file", "indices.file", "data.file", "shape.file"})
+            std::remove((prefix + suf).data());
+    std::remove(tmpl);
+    return nerr != 0;
+}
 
 int main(int argc, char *argv[]) {
-    bool use_float = true;
-    for(int c;(c = getopt(argc, argv, "d:")) >= 0;)
-        if(c == 'd') use_float = false;
-    std::string out("/dev/stdout");
+    bool use_float = true, transpose = true, cache = false;
+    for(int c;(c = getopt(argc, argv, "drcth")) >= 0;) {
+        switch(c) {
+            case 'd': use_float = false; break;
+            case 'r': transpose = false; break;
+            case 'c': cache = true; break;
+            case 't': return selftest();
+            case 'h': default: usage(argv[0]);
+        }
+    }
+    std::string in(optind < argc ? argv[optind]: "/dev/stdin"), out("/dev/stdout");
     if(optind + 2 <= argc)
         out = argv[optind + 1];
-    blaze::Archive<std::ofstream> ret(out);
-    if(use_float) {
-        ret << minocore::mtx2sparse<float>(argc == 1 ? "/dev/stdin": (char *)argv[optind]);
-    } else {
-        ret << minocore::mtx2sparse<double>(argc == 1 ? "/dev/stdin": (char *)argv[optind]);
-    }
+    if(cache && in == "/dev/stdin") usage(argv[0]);
+    if(use_float) emit<float>(in, out, transpose, cache);
+    else          emit<double>(in, out, transpose, cache);
     return 0;
 }
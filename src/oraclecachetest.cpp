@@ -0,0 +1,49 @@
+#include "minocore/util/oracle.h"
+#include <cstdio>
+#include <random>
+
+using namespace minocore;
+
+// An oracle which counts its calls, so that hits can be checked against the calls saved.
+struct CountingOracle {
+    mutable std::atomic<uint64_t> ncalls{0};
+    double operator()(uint32_t i, uint32_t j) const {
+        ncalls.fetch_add(1, std::memory_order_relaxed);
+        return i < j ? i * 1e-3 + j: j * 1e-3 + i;
+    }
+};
+
+// Checks values, statistics and the memory bound under concurrent queries, for budgets with and without eviction.
+int check(size_t budget, size_t np, size_t nqueries) {
+    CountingOracle oracle;
+    auto cache = make_sharded_caching_oracle(oracle, budget);
+    size_t nwrong = 0;
+    OMP_PRAGMA("omp parallel for reduction(+:nwrong)")
+    for(size_t q = 0; q < nqueries; ++q) {
+        std::mt19937_64 rng(q * 0x9E3779B97F4A7C15ull);
+        // Skewed toward low ids, so that some pairs recur
+        const uint32_t i = rng() % (1 + rng() % np), j = rng() % (1 + rng() % np);
+        nwrong += cache(i, j) != oracle(i, j);
+    }
+    const auto st = cache.stats();
+    int rc = 0;
+    if(nwrong) std::fprintf(stderr, "%zu wrong values\n", nwrong), rc = 1;
+    // The check above calls the oracle once per query
+    if(st.hits + st.misses != nqueries || oracle.ncalls.load() - nqueries != st.misses)
+        std::fprintf(stderr, "Inconsistent counts: %zu hits, %zu misses, %zu calls\n", size_t(st.hits), size_t(st.misses), size_t(oracle.ncalls.load())), rc = 1;
+    if(st.size > st.capacity || cache.bytes() > budget)
+        std::fprintf(stderr, "Exceeded bounds: size %zu, capacity %zu, %zu bytes, budget %zu\n", size_t(st.size), size_t(st.capacity), cache.bytes(), budget), rc = 1;
+    cache.clear();
+    if(cache.stats().size || cache.contains(0, 0))
+        std::fprintf(stderr, "clear left entries\n"), rc = 1;
+    std::fprintf(stderr, "budget %zu: %zu shards, capacity %zu, hit rate %g, %zu evictions\n",
+                 budget, cache.nshards(), size_t(st.capacity), st.hit_rate(), size_t(st.evictions));
+    return rc;
+}
+
+int main() {
+    int rc = check(size_t(1) << 12, 5000, 200000);
+    rc |= check(10000, 2000, 200000);
+    rc |= check(size_t(64) << 20, 500, 200000);
+    return rc;
+}
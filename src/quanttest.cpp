@@ -0,0 +1,75 @@
+#include "minocore/dist/quantized.h"
+#include "minocore/dist/knngraph.h"
+#include "minocore/utility.h"
+using namespace minocore;
+
+// Checks that quantized distances stay within their error bounds, and that reranked kNN graphs
+// and assignments agree with the exact ones, for each precision and supported measure.
+template<quant::Precision P, typename App>
+int check(const App &app, unsigned k) {
+    auto qapp = make_quantized_applicator<P>(app);
+    const size_t n = app.size();
+    size_t nviolations = 0;
+    double maxerr = 0.;
+    for(size_t i = 0; i < n; ++i) {
+        for(size_t j = i % 7; j < n; j += 7) {
+            if(i == j) continue;
+            const double exact = app(i, j), approx = qapp(i, j), err = std::abs(exact - approx);
+            // Allow for rounding in the exact applicator itself
+            nviolations += err > qapp.error_bound(i, j, approx) + 1e-5 * std::max(std::abs(exact), 1.);
+            maxerr = std::max(maxerr, err);
+        }
+    }
+    auto knns = make_knns(app, k);
+    auto qknns = make_knns(qapp, k);
+    size_t nknndiff = 0;
+    for(size_t i = 0; i < knns.size(); ++i)
+        nknndiff += std::abs(knns[i].first - qknns[i].first) > 1e-5 * std::max(float(knns[i].first), 1.f);
+    std::vector<uint32_t> ctrs(k), asn(n);
+    std::vector<float> costs(n);
+    for(unsigned i = 0; i < k; ++i) ctrs[i] = i * (n / k);
+    const size_t nexact = qapp.assign(ctrs.data(), k, asn.data(), costs.data());
+    size_t nasndiff = 0;
+    for(size_t i = 0; i < n; ++i) {
+        float best = std::numeric_limits<float>::max();
+        for(unsigned c = 0; c < k; ++c) best = std::min(best, float(app(i, ctrs[c])));
+        nasndiff += std::abs(best - costs[i]) > 1e-5 * std::max(best, 1.f);
+    }
+    std::fprintf(stderr, "%s/%s: %zu bytes vs %zu, max error %g, %zu bound violations, %zu knn and %zu assignment mismatches, %zu/%zu exact evaluations for assignment\n",
+                 quant::precision2str(P), dist::detail::prob2str(app.get_measure()), qapp.bytes(), n * app.data().columns() * sizeof(float),
+                 maxerr, nviolations, nknndiff, nasndiff, nexact, n * k);
+    return nviolations || nknndiff || nasndiff;
+}
+
+int main(int argc, char *argv[]) {
+    const size_t n = argc > 1 ? std::atoi(argv[1]): 1000, d = argc > 2 ? std::atoi(argv[2]): 100;
+    const unsigned k = argc > 3 ? std::atoi(argv[3]): 10;
+    wy::WyRand<uint64_t> rng(13);
+    blaze::DynamicMatrix<float> data(n, d);
+    for(size_t i = 0; i < n; ++i)
+        for(size_t j = 0; j < d; ++j)
+            data(i, j) = rng() % 32;
+    int rc = 0;
+    for(const auto measure: {dist::L1, dist::L2, dist::SQRL2, dist::TVD, dist::HELLINGER,
+                             dist::BHATTACHARYYA_METRIC, dist::BHATTACHARYYA_DISTANCE, dist::JSD, dist::JSM}) {
+        blaze::DynamicMatrix<float> copy(data);
+        auto app = make_probdiv_applicator(copy, measure, jsd::DIRICHLET);
+        rc |= check<quant::FP16>(app, k);
+        rc |= check<quant::BF16>(app, k);
+        if(measure != dist::JSD && measure != dist::JSM) rc |= check<quant::INT8>(app, k);
+        // Exact distances do not depend on the derived caches
+        const double before = app(0, 1);
+        app.release_derived_caches();
+        rc |= std::abs(before - app(0, 1)) > 1e-5 * std::max(std::abs(before), 1.);
+    }
+    {
+        // k = 0, and a single point, for which k is clamped to 0, give empty graphs
+        auto app = make_probdiv_applicator(data, dist::L1);
+        auto qapp = make_quantized_applicator<quant::FP16>(app);
+        rc |= !make_knns(qapp, 0).empty() || !make_knns(app, 0).empty();
+        blaze::DynamicMatrix<float> one = submatrix(data, 0, 0, 1, d);
+        auto app1 = make_probdiv_applicator(one, dist::L1);
+        rc |= !make_knns(make_quantized_applicator<quant::FP16>(app1), k).empty();
+    }
+    return rc;
+}
@@ -0,0 +1,51 @@
+#include "minocore/util/region.h"
+#include <cstdio>
+#include <random>
+
+using namespace minocore;
+
+// Checks GridIndex queries and sample_region against brute-force containment tests over random boxes.
+int main(int argc, char **argv) {
+    const size_t n = argc > 1 ? std::atoi(argv[1]): 20000, nboxes = 200;
+    std::mt19937_64 rng(5);
+    std::uniform_real_distribution<double> lat(-10., 10.), lon(30., 50.);
+    std::vector<latlon_t> pts(n);
+    for(auto &p: pts) p = latlon_t(lat(rng), lon(rng));
+    // Exact duplicates and points without coordinates
+    pts[1] = pts[0];
+    pts[2] = latlon_t(std::numeric_limits<double>::quiet_NaN(), 40.);
+    const GridIndex index(pts);
+    size_t nerr = 0;
+    for(size_t b = 0; b < nboxes; ++b) {
+        double la = lat(rng), lb = lat(rng), oa = lon(rng), ob = lon(rng);
+        BoundingBoxData bb{std::min(la, lb), std::max(la, lb), std::min(oa, ob), std::max(oa, ob), 1., 0.};
+        if(b == 0) bb = BoundingBoxData{-20., 20., 20., 60., 1., 0.}; // Everything
+        if(b == 1) bb = BoundingBoxData{pts[0].lat(), pts[0].lat(), pts[0].lon(), pts[0].lon(), 1., 0.}; // A single location
+        std::vector<uint32_t> expected, outside;
+        for(uint32_t i = 0; i < n; ++i) (bb.contains(pts[i]) ? expected: outside).push_back(i);
+        nerr += index.query(bb) != expected || index.count(bb) != expected.size();
+        // p_box = 1, p_nobox = 0 selects the region itself; p_nobox = 1 adds everything else
+        const auto region = sample_region(index, bb, b);
+        nerr += region.members != expected || region.inside != expected || !region.outside.empty();
+        bb.p_nobox = 1.;
+        const auto all = sample_region(index, bb, b);
+        nerr += all.inside != expected || all.outside != outside || all.size() != n;
+        // Partial sampling keeps subsets of each side, and members is their ordered union
+        bb.p_box = .5; bb.p_nobox = .1;
+        const auto part = sample_region(index, bb, b);
+        nerr += !std::includes(expected.begin(), expected.end(), part.inside.begin(), part.inside.end())
+             || !std::includes(outside.begin(), outside.end(), part.outside.begin(), part.outside.end())
+             || part.size() != part.inside.size() + part.outside.size()
+             || !std::is_sorted(part.members.begin(), part.members.end());
+        // Gathering onto the subset and mapping back round-trips
+        std::vector<uint32_t> ids(n);
+        std::iota(ids.begin(), ids.end(), 0u);
+        auto local = part.gather(ids.data());
+        std::vector<uint32_t> pos(part.size());
+        std::iota(pos.begin(), pos.end(), 0u);
+        part.to_global(pos);
+        nerr += local != part.members || pos != part.members;
+    }
+    std::fprintf(stderr, "%zu cells, %zu errors\n", index.ncells(), nerr);
+    return nerr != 0;
+}
@@ -13,5 +13,16 @@ int main() {
     CoresetSampler<FT> cs2("test_io.cs");
     assert(cs == cs2);
     std::system("rm test_io.cs");
+    std::vector<unsigned> centers{0, 1, 2, 3, 4};
+    cs.make_sampler(100, 5, costs.data(), asn.data(), nullptr, 13, FL, 5, centers.data());
+    cs.write_binary("test_io.bin");
+    auto cs3 = CoresetSampler<FT>::map("test_io.bin");
+    assert(cs == cs3);
+    auto lhs = cs.sample(50, 7), rhs = cs3.sample(50, 7);
+    assert(lhs.indices_ == rhs.indices_);
+    lhs.write_binary("test_io.bin");
+    auto lhs2 = IndexCoreset<unsigned, FT>::read_binary("test_io.bin");
+    assert(lhs.indices_ == lhs2.indices_ && lhs.weights_ == lhs2.weights_);
+    std::system("rm test_io.bin");
 }
 
@@ -11,47 +11,6 @@ using namespace minocore;
 using namespace boost;
 
 
-template<typename Graph, typename ICon, typename FCon, typename IT, typename RetCon, typename CSWT>
-void calculate_distortion_centerset(Graph &x, const ICon &indices, FCon &costbuffer,
-                             const std::vector<coresets::IndexCoreset<IT, CSWT>> &coresets,
-                             RetCon &ret, double z)
-{
-    assert(ret.size() == coresets.size());
-    const size_t nv = boost::num_vertices(x);
-    const size_t ncs = coresets.size();
-    util::ScopedSyntheticVertex<Graph> vx(x);
-    {
-        auto synthetic_vertex = vx.get();
-        for(auto idx: indices)
-            boost::add_edge(synthetic_vertex, idx, 0., x);
-        boost::dijkstra_shortest_paths(x, synthetic_vertex, distance_map(&costbuffer[0]));
-    }
-    if(z != 1.) {
-        costbuffer = pow(costbuffer, z);
-    }
-    double fullcost = 0.;
-    OMP_PRAGMA("omp parallel for reduction(+:fullcost)")
-    for(unsigned i = 0; i < nv; ++i) {
-        fullcost += costbuffer[i];
-    }
-    OMP_PFOR
-    for(size_t j = 0; j < ncs; ++j) {
-        const auto indices = coresets[j].indices_.data();
-        const auto weights = coresets[j].weights_.data();
-        const size_t cssz = coresets[j].size();
-        double coreset_cost = 0.;
-        for(unsigned i = 0; i < cssz; ++i) {
-            coreset_cost += costbuffer[indices[i]] * weights[i];
-        }
-        ret[j] = coreset_cost;
-    }
-    for(size_t j = 0; j < ncs; ++j) {
-        double distortion = std::abs(ret[j] / fullcost - 1.);
-        //std::fprintf(stderr, "distortion for coreset %zu of size %zu is %g\n", j, coresets[j].size(), distortion);
-        ret[j] = distortion;
-    }
-}
-
 template<typename GraphT>
 GraphT &
 max_component(GraphT &g) {
@@ -213,6 +172,9 @@ int main(int argc, char **argv) {
             r[j] = *it;
         shared::sort(r.begin(), r.end());
     }
+    std::vector<std::vector<uint32_t>> centersets(random_centers.rows());
+    for(size_t i = 0; i < random_centers.rows(); ++i)
+        centersets[i].assign(row(random_centers, i).begin(), row(random_centers, i).end());
     coresets::UniformSampler<float, uint32_t> uniform_sampler(boost::num_vertices(g));
     // We run the inner loop `coreset_testing_num_iters` times
     // and average the maximum distortion.
@@ -239,24 +201,11 @@ int main(int argc, char **argv) {
         std::fprintf(stderr, "[Phase 5] Generated coresets\n");
         blaze::DynamicVector<double> maxdistortion(distvecsz, std::numeric_limits<double>::min()),
                                      meandistortion(distvecsz, 0.);
-        OMP_PFOR
-        for(size_t i = 0; i < random_centers.rows(); ++i) {
-            //if(i % 10 == 0)
-            //    std::fprintf(stderr, "Calculating distortion %zu/%zu\n", i, random_centers.rows());
-            auto rc = row(random_centers, i);
-            assert(rc.size() == k);
-            blaze::DynamicVector<double> distbuffer(boost::num_vertices(g));
-            blaze::DynamicVector<double> currentdistortion(coresets.size());
-            decltype(g) gcopy(g);
-            calculate_distortion_centerset(gcopy, rc, distbuffer, coresets, currentdistortion, z);
-            OMP_CRITICAL
-            {
-                maxdistortion = blaze::serial(max(maxdistortion, currentdistortion));
-            }
-            OMP_CRITICAL
-            {
-                meandistortion = blaze::serial(meandistortion + currentdistortion);
-            }
+        const auto distortions = coreset_distortions(g, centersets, coresets, z);
+        for(size_t i = 0; i < distortions.rows(); ++i) {
+            auto r = trans(row(distortions, i));
+            maxdistortion = max(maxdistortion, r);
+            meandistortion += r;
         }
         meanmaxdistortion += maxdistortion;
         meandistortion /= random_centers.rows();
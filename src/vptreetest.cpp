@@ -0,0 +1,53 @@
+#include "minocore/util/vptree.h"
+#include <cmath>
+#include <cstdio>
+#include <random>
+
+using namespace minocore;
+
+// Checks kNN, nearest and range queries against brute force, for a tree built at once and one built by insertion.
+int main(int argc, char **argv) {
+    const size_t n = argc > 1 ? std::atoi(argv[1]): 5000, d = 3, nq = 500;
+    const unsigned k = 7;
+    std::mt19937_64 rng(13);
+    std::normal_distribution<double> nd;
+    std::vector<double> pts(n * d), qs(nq * d);
+    for(auto &x: pts) x = nd(rng);
+    for(auto &x: qs) x = nd(rng);
+    auto l2 = [d](const double *a, const double *b) {
+        double s = 0.;
+        for(size_t i = 0; i < d; ++i) s += (a[i] - b[i]) * (a[i] - b[i]);
+        return std::sqrt(s);
+    };
+    auto dist = [&](uint32_t a, uint32_t b) {return l2(&pts[a * d], &pts[b * d]);};
+    auto make_dq = [&](size_t q) {return [&,q](uint32_t id) {return l2(&qs[q * d], &pts[id * d]);};};
+
+    auto built = make_vptree<double>(dist, n, 8, 1);
+    VPTree<decltype(dist), double> grown(dist, 8, 2);
+    for(uint32_t i = 0; i < n; ++i) grown.insert(i);
+    int rc = 0;
+    for(const auto *tree: {&built, &grown}) {
+        const auto knns = tree->knn_batch(nq, make_dq, k);
+        std::vector<uint32_t> asn(nq);
+        std::vector<double> costs(nq);
+        tree->nearest_batch(nq, make_dq, asn.data(), costs.data());
+        size_t nerr = 0;
+        for(size_t q = 0; q < nq; ++q) {
+            const auto dq = make_dq(q);
+            std::vector<std::pair<double, uint32_t>> all(n);
+            for(uint32_t i = 0; i < n; ++i) all[i] = {dq(i), i};
+            std::sort(all.begin(), all.end());
+            for(unsigned j = 0; j < k; ++j)
+                nerr += knns[q * k + j].second != all[j].second;
+            nerr += asn[q] != all[0].second || costs[q] != all[0].first;
+            const double r = all[k * 3].first;
+            std::vector<uint32_t> expected;
+            for(const auto &p: all) if(p.first <= r) expected.push_back(p.second);
+            std::sort(expected.begin(), expected.end());
+            nerr += tree->range(dq, r) != expected;
+        }
+        std::fprintf(stderr, "%s tree: %zu nodes, %zu errors\n", tree == &built ? "Built": "Grown", tree->num_nodes(), nerr);
+        rc |= nerr != 0;
+    }
+    return rc;
+}